@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui sql xml network svg printsupport
+QT       += core gui sql xml network svg printsupport concurrent
 
 # axcontainer axserver concurrent core dbus declarative designer gui help multimedia
 # multimediawidgets network opengl printsupport qml qmltest x11extras quick script scripttools
@@ -131,10 +131,15 @@ SOURCES += src/main.cpp\
     src/route/parkingdialog.cpp \
     src/route/routecommand.cpp \
     src/route/routefinder.cpp \
+    src/route/routeheap.cpp \
+    src/route/routefinderbatch.cpp \
+    src/route/routelandmarks.cpp \
     src/mapgui/mapwidget.cpp \
     src/route/routenetworkradio.cpp \
     src/route/routenetworkairway.cpp \
     src/route/routenetwork.cpp \
+    src/route/routenetworkgraph.cpp \
+    src/route/routenetworkbenchmark.cpp \
     src/common/weatherreporter.cpp \
     src/connect/connectdialog.cpp \
     src/connect/connectclient.cpp \
@@ -179,7 +184,17 @@ SOURCES += src/main.cpp\
     src/common/mapflags.cpp \
     src/common/elevationprovider.cpp \
     src/mapgui/mappaintership.cpp \
-    src/mapgui/mappaintervehicle.cpp
+    src/mapgui/mappaintervehicle.cpp \
+    src/mapgui/mapqueryprefetch.cpp \
+    src/mapgui/maplayercompositor.cpp \
+    src/mapgui/mapdeclutter.cpp \
+    src/common/labelgrid.cpp \
+    src/common/textspritecache.cpp \
+    src/common/symbolatlas.cpp \
+    src/mapgui/mappaintprofiler.cpp \
+    src/common/aircrafttrackpyramid.cpp \
+    src/common/trackarchive.cpp \
+    src/connect/trackreplay.cpp
 
 HEADERS  += src/gui/mainwindow.h \
     src/search/columnlist.h \
@@ -214,10 +229,15 @@ HEADERS  += src/gui/mainwindow.h \
     src/route/parkingdialog.h \
     src/route/routecommand.h \
     src/route/routefinder.h \
+    src/route/routeheap.h \
+    src/route/routefinderbatch.h \
+    src/route/routelandmarks.h \
     src/mapgui/mapwidget.h \
     src/route/routenetworkradio.h \
     src/route/routenetworkairway.h \
     src/route/routenetwork.h \
+    src/route/routenetworkgraph.h \
+    src/route/routenetworkbenchmark.h \
     src/common/weatherreporter.h \
     src/connect/connectdialog.h \
     src/connect/connectclient.h \
@@ -262,7 +282,17 @@ HEADERS  += src/gui/mainwindow.h \
     src/common/mapflags.h \
     src/common/elevationprovider.h \
     src/mapgui/mappaintership.h \
-    src/mapgui/mappaintervehicle.h
+    src/mapgui/mappaintervehicle.h \
+    src/mapgui/mapqueryprefetch.h \
+    src/mapgui/maplayercompositor.h \
+    src/mapgui/mapdeclutter.h \
+    src/common/labelgrid.h \
+    src/common/textspritecache.h \
+    src/common/symbolatlas.h \
+    src/mapgui/mappaintprofiler.h \
+    src/common/aircrafttrackpyramid.h \
+    src/common/trackarchive.h \
+    src/connect/trackreplay.h
 
 FORMS    += src/gui/mainwindow.ui \
     src/db/databasedialog.ui \
@@ -285,6 +315,15 @@ DISTFILES += \
 RESOURCES += \
     littlenavmap.qrc
 
+# Headless map rendering benchmark binary littlenavmap_renderbench
+# Build with "qmake CONFIG+=renderbench" and run with QT_QPA_PLATFORM=offscreen
+renderbench {
+  TARGET = littlenavmap_renderbench
+  DEFINES += LNM_RENDERBENCH
+  SOURCES += src/mapgui/maprenderbenchmark.cpp
+  HEADERS += src/mapgui/maprenderbenchmark.h
+}
+
 ICON=resources/icons/littlenavmap.icns
 
 # =====================================================================
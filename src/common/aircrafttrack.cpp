@@ -22,16 +22,19 @@
 
 #include <QDataStream>
 #include <QDateTime>
-#include <QFile>
+#include <QSaveFile>
+
+#include <cstring>
+#include <limits>
 
 AircraftTrack::AircraftTrack()
 {
-
+  static_assert(sizeof(FileHeader) <= HEADER_SIZE, "Track file header too large");
 }
 
 AircraftTrack::~AircraftTrack()
 {
-
+  closeFile();
 }
 
 namespace at {
@@ -50,55 +53,387 @@ QDataStream& operator<<(QDataStream& dataStream, const at::AircraftTrackPos& tra
 
 }
 
-void AircraftTrack::saveState()
+void AircraftTrack::restoreState()
 {
-  QFile trackFile(atools::settings::Settings::getConfigFilename(".track"));
+  closeFile();
+
+  trackFile.setFileName(atools::settings::Settings::getConfigFilename(".track"));
+  pyramidFilename = atools::settings::Settings::getConfigFilename(".trackindex");
 
-  if(trackFile.open(QIODevice::WriteOnly))
+  QList<at::AircraftTrackPos> oldTrack;
+  bool converted = readOldTrack(oldTrack);
+
+  bool opened = openFile();
+  if(!opened)
+    qWarning() << "Cannot map track" << trackFile.fileName() << ". Using memory only.";
+
+  if(converted)
   {
-    QDataStream out(&trackFile);
-    out.setVersion(QDataStream::Qt_5_5);
-    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    qInfo() << "Converting track" << trackFile.fileName() << "with" << oldTrack.size() << "positions";
+    for(const at::AircraftTrackPos& trackPos : oldTrack)
+      append(trackPos);
 
-    out << FILE_MAGIC_NUMBER << FILE_VERSION << *this;
-    trackFile.close();
+    // Keep the old file if the converted track is in memory only
+    if(opened && mapped)
+      QFile::remove(trackFile.fileName() + ".old");
   }
-  else
-    qWarning() << "Cannot write track" << trackFile.fileName() << ":" << trackFile.errorString();
 }
 
-void AircraftTrack::restoreState()
+/* Read a track file written by previous versions. Renames the file to suffix ".old" so it is not overwritten
+ * by the new format. Returns true if the positions were read. */
+bool AircraftTrack::readOldTrack(QList<at::AircraftTrackPos>& oldTrack)
 {
-  clear();
+  if(!trackFile.exists() || !trackFile.open(QIODevice::ReadOnly))
+    return false;
+
+  bool read = false;
+  QDataStream in(&trackFile);
+  in.setVersion(QDataStream::Qt_5_5);
+  in.setFloatingPointPrecision(QDataStream::SinglePrecision);
 
-  QFile trackFile(atools::settings::Settings::getConfigFilename(".track"));
-  if(trackFile.exists())
+  quint32 magic = 0;
+  quint16 version = 0;
+  in >> magic;
+  if(magic == OLD_FILE_MAGIC_NUMBER)
   {
-    if(trackFile.open(QIODevice::ReadOnly))
+    in >> version;
+    if(version == OLD_FILE_VERSION)
     {
-      quint32 magic;
-      quint16 version;
-      QDataStream in(&trackFile);
-      in.setVersion(QDataStream::Qt_5_5);
-      in.setFloatingPointPrecision(QDataStream::SinglePrecision);
-      in >> magic;
-
-      if(magic == FILE_MAGIC_NUMBER)
+      in >> oldTrack;
+      read = in.status() == QDataStream::Ok;
+      if(!read)
       {
-        in >> version;
-        if(version == FILE_VERSION)
-          in >> *this;
-        else
-          qWarning() << "Cannot read track" << trackFile.fileName() << ". Invalid version number:" << version;
+        qWarning() << "Cannot read track" << trackFile.fileName() << ". File is truncated or corrupt.";
+        oldTrack.clear();
       }
-      else
-        qWarning() << "Cannot read track" << trackFile.fileName() << ". Invalid magic number:" << magic;
+    }
+    else
+      qWarning() << "Cannot read track" << trackFile.fileName() << ". Invalid version number:" << version;
+  }
+  trackFile.close();
+
+  if(magic == OLD_FILE_MAGIC_NUMBER)
+  {
+    // Move the old file out of the way of the new format - removed after successful conversion
+    QString oldFilename = trackFile.fileName() + ".old";
+    QFile::remove(oldFilename);
+    if(!trackFile.rename(oldFilename))
+      qWarning() << "Cannot rename track" << trackFile.fileName() << ":" << trackFile.errorString();
+
+    // Rename changes the file name
+    trackFile.setFileName(atools::settings::Settings::getConfigFilename(".track"));
+  }
+
+  return read;
+}
+
+bool AircraftTrack::openFile()
+{
+  if(!trackFile.open(QIODevice::ReadWrite))
+  {
+    qWarning() << "Cannot open track" << trackFile.fileName() << ":" << trackFile.errorString();
+    return false;
+  }
+
+  bool newFile = trackFile.size() < HEADER_SIZE;
+  if(newFile && !trackFile.resize(HEADER_SIZE))
+  {
+    qWarning() << "Cannot resize track" << trackFile.fileName() << ":" << trackFile.errorString();
+    trackFile.close();
+    return false;
+  }
+
+  header = reinterpret_cast<FileHeader *>(trackFile.map(0, HEADER_SIZE));
+  if(header == nullptr)
+  {
+    qWarning() << "Cannot map track" << trackFile.fileName() << ":" << trackFile.errorString();
+    trackFile.close();
+    return false;
+  }
+
+  if(!newFile && (header->magic != FILE_MAGIC_NUMBER || header->version != FILE_VERSION ||
+                  header->blockSize != BLOCK_SIZE))
+  {
+    qWarning() << "Cannot read track" << trackFile.fileName() << ". Invalid magic number or version:"
+               << header->magic << header->version << ". Starting new track.";
+    newFile = true;
+  }
 
-      trackFile.close();
+  if(newFile)
+  {
+    std::memset(header, 0, HEADER_SIZE);
+    header->magic = FILE_MAGIC_NUMBER;
+    header->version = FILE_VERSION;
+    header->blockSize = BLOCK_SIZE;
+    header->size = 0;
+    trackFile.resize(HEADER_SIZE);
+  }
+
+  mapped = true;
+
+  // Ignore positions in blocks missing due to a truncated file
+  qint64 fileBlocks = (trackFile.size() - HEADER_SIZE) / BLOCK_BYTES;
+  qint64 size = std::min(static_cast<qint64>(header->size), fileBlocks * BLOCK_SIZE);
+  size = std::min(size, static_cast<qint64>(std::numeric_limits<int>::max()));
+
+  // Map only the blocks containing positions - pages are loaded by the operating system on access
+  int numBlocks = static_cast<int>((size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+  for(int i = 0; i < numBlocks; i++)
+  {
+    uchar *block = trackFile.map(HEADER_SIZE + static_cast<qint64>(i) * BLOCK_BYTES, BLOCK_BYTES);
+    if(block == nullptr)
+    {
+      qWarning() << "Cannot map track block" << i << trackFile.fileName() << ":" << trackFile.errorString();
+      size = static_cast<qint64>(i) * BLOCK_SIZE;
+      break;
     }
+    blocks.append(block);
+  }
+
+  numEntries = static_cast<int>(size);
+  header->size = static_cast<quint64>(numEntries);
+  replayTrack = (header->flags & FILE_FLAG_REPLAY) != 0;
+
+  if(numEntries > 0 && !readPyramid())
+    rebuildPyramid();
+
+  qDebug() << Q_FUNC_INFO << trackFile.fileName() << "positions" << numEntries << "blocks" << blocks.size();
+  return true;
+}
+
+void AircraftTrack::closeFile()
+{
+  if(mapped)
+  {
+    writePyramid();
+
+    // Closing the file unmaps all blocks
+    trackFile.close();
+    mapped = false;
+  }
+  else
+  {
+    for(uchar *block : blocks)
+      delete[] block;
+  }
+
+  header = nullptr;
+  blocks.clear();
+  numEntries = 0;
+  replayTrack = false;
+  pyramid.clear();
+}
+
+void AircraftTrack::addBlock()
+{
+  if(mapped)
+  {
+    qint64 offset = HEADER_SIZE + static_cast<qint64>(blocks.size()) * BLOCK_BYTES;
+    if(trackFile.resize(offset + BLOCK_BYTES))
+    {
+      uchar *block = trackFile.map(offset, BLOCK_BYTES);
+      if(block != nullptr)
+      {
+        blocks.append(block);
+        return;
+      }
+    }
+
+    qWarning() << "Cannot extend track" << trackFile.fileName() << ":" << trackFile.errorString()
+               << ". Using memory only.";
+    detachFromFile();
+  }
+
+  blocks.append(new uchar[BLOCK_BYTES]);
+}
+
+void AircraftTrack::detachFromFile()
+{
+  QVector<uchar *> memoryBlocks;
+  for(uchar *block : blocks)
+  {
+    uchar *memoryBlock = new uchar[BLOCK_BYTES];
+    std::memcpy(memoryBlock, block, BLOCK_BYTES);
+    memoryBlocks.append(memoryBlock);
+  }
+
+  trackFile.close();
+  mapped = false;
+  header = nullptr;
+  blocks = memoryBlocks;
+}
+
+void AircraftTrack::clearTrack()
+{
+  if(!replayTrack && numEntries >= TrackArchive::MIN_ARCHIVE_POSITIONS)
+  {
+    // Copy positions since the archive is written in background
+    QVector<at::AircraftTrackPos> positions;
+    positions.reserve(numEntries);
+    for(int i = 0; i < numEntries; i++)
+      positions.append(at(i));
+    archive.archiveTrack(positions);
+  }
+
+  truncate(0);
+  setReplayTrack(false);
+}
+
+void AircraftTrack::setReplayTrack(bool value)
+{
+  replayTrack = value;
+
+  if(mapped)
+  {
+    if(replayTrack)
+      header->flags |= FILE_FLAG_REPLAY;
     else
-      qWarning() << "Cannot read track" << trackFile.fileName() << ":" << trackFile.errorString();
+      header->flags &= static_cast<quint16>(~FILE_FLAG_REPLAY);
+  }
+}
+
+void AircraftTrack::truncate(int newSize)
+{
+  if(newSize >= numEntries)
+    return;
+
+  newSize = std::max(newSize, 0);
+  int numBlocks = (newSize + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+  while(blocks.size() > numBlocks)
+  {
+    if(mapped)
+      trackFile.unmap(blocks.last());
+    else
+      delete[] blocks.last();
+    blocks.removeLast();
+  }
+
+  numEntries = newSize;
+
+  if(mapped)
+  {
+    header->size = static_cast<quint64>(numEntries);
+    header->generation++;
+    trackFile.resize(HEADER_SIZE + static_cast<qint64>(numBlocks) * BLOCK_BYTES);
+  }
+
+  // Drops only the tail of the simplified levels
+  pyramid.truncate(numEntries, [this](int index) -> atools::geo::Pos
+                   {
+                     return at(index).pos;
+                   });
+}
+
+void AircraftTrack::rebuildPyramid()
+{
+  qInfo() << Q_FUNC_INFO << "Rebuilding track pyramid for" << numEntries << "positions";
+
+  pyramid.clear();
+  for(int i = 0; i < numEntries; i++)
+    pyramid.append(i, at(i).pos);
+}
+
+/* Read the pyramid file and add positions which were appended after it was written.
+ * The pyramid has to cover a prefix of the track which is checked by the generation and timestamps. */
+bool AircraftTrack::readPyramid()
+{
+  QFile file(pyramidFilename);
+  if(!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QDataStream in(&file);
+  in.setVersion(QDataStream::Qt_5_5);
+  in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+  quint32 magic = 0, generation = 0, size = 0, firstTimestamp = 0, lastTimestamp = 0;
+  quint16 version = 0;
+  in >> magic >> version >> generation >> size >> firstTimestamp >> lastTimestamp;
+  if(in.status() != QDataStream::Ok || magic != PYRAMID_MAGIC_NUMBER || version != PYRAMID_VERSION)
+  {
+    qWarning() << "Cannot read track pyramid" << file.fileName() << ". Invalid magic number or version:"
+               << magic << version;
+    return false;
+  }
+
+  if(generation != header->generation || size == 0 || size > static_cast<quint32>(numEntries) ||
+     firstTimestamp != first().timestamp || lastTimestamp != at(static_cast<int>(size) - 1).timestamp)
+  {
+    qInfo() << "Track pyramid" << file.fileName() << "does not match track";
+    return false;
+  }
+
+  if(!pyramid.read(in) || pyramid.getIndexes(0).size() != static_cast<int>(size))
+  {
+    qWarning() << "Cannot read track pyramid" << file.fileName() << ". File is truncated or corrupt.";
+    pyramid.clear();
+    return false;
   }
+
+  // Add positions appended after the pyramid was written, e.g. after a crash
+  for(int i = static_cast<int>(size); i < numEntries; i++)
+    pyramid.append(i, at(i).pos);
+
+  qDebug() << Q_FUNC_INFO << file.fileName() << "positions" << size << "added" << numEntries - static_cast<int>(size);
+  return true;
+}
+
+void AircraftTrack::writePyramid() const
+{
+  if(numEntries == 0)
+  {
+    QFile::remove(pyramidFilename);
+    return;
+  }
+
+  QSaveFile file(pyramidFilename);
+  if(!file.open(QIODevice::WriteOnly))
+  {
+    qWarning() << "Cannot write track pyramid" << file.fileName() << ":" << file.errorString();
+    return;
+  }
+
+  QDataStream out(&file);
+  out.setVersion(QDataStream::Qt_5_5);
+  out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+  out << PYRAMID_MAGIC_NUMBER << PYRAMID_VERSION << header->generation << static_cast<quint32>(numEntries)
+      << first().timestamp << last().timestamp;
+  pyramid.write(out);
+
+  if(!file.commit())
+    qWarning() << "Cannot write track pyramid" << file.fileName() << ":" << file.errorString();
+}
+
+at::AircraftTrackPos AircraftTrack::at(int index) const
+{
+  return {
+           atools::geo::Pos(*column<float>(index, LONX_OFFSET), *column<float>(index, LATY_OFFSET),
+                            *column<float>(index, ALTITUDE_OFFSET)),
+           *column<quint32>(index, TIMESTAMP_OFFSET),
+           (*column<quint8>(index, FLAGS_OFFSET) & FLAG_ON_GROUND) != 0
+  };
+}
+
+void AircraftTrack::append(const at::AircraftTrackPos& trackPos, bool trackBreak)
+{
+  if(numEntries == blocks.size() * BLOCK_SIZE)
+    addBlock();
+
+  int index = numEntries;
+  *column<quint32>(index, TIMESTAMP_OFFSET) = trackPos.timestamp;
+  *column<float>(index, LONX_OFFSET) = trackPos.pos.getLonX();
+  *column<float>(index, LATY_OFFSET) = trackPos.pos.getLatY();
+  *column<float>(index, ALTITUDE_OFFSET) = trackPos.pos.getAltitude();
+  *column<quint8>(index, FLAGS_OFFSET) = static_cast<quint8>((trackPos.onGround ? FLAG_ON_GROUND : 0) |
+                                                             (trackBreak ? FLAG_TRACK_BREAK : 0));
+
+  numEntries++;
+
+  // Update size after the data is written
+  if(mapped)
+    header->size = static_cast<quint64>(numEntries);
+
+  pyramid.append(numEntries - 1, trackPos.pos);
 }
 
 bool AircraftTrack::appendTrackPos(const atools::geo::Pos& pos, const QDateTime& timestamp, bool onGround)
@@ -112,26 +447,25 @@ bool AircraftTrack::appendTrackPos(const atools::geo::Pos& pos, const QDateTime&
     append({pos, timestamp.toTime_t(), onGround});
   else
   {
+    at::AircraftTrackPos lastPos = last();
     long time = timestamp.toMSecsSinceEpoch();
-    long lastTime = last().timestamp * 1000L;
+    long lastTime = lastPos.timestamp * 1000L;
 
-    if(!pos.almostEqual(last().pos, epsilon) && !atools::almostEqual(lastTime, time, timeDiff))
+    if(!pos.almostEqual(lastPos.pos, epsilon) && !atools::almostEqual(lastTime, time, timeDiff))
     {
-      if(pos.distanceMeterTo(last().pos) > MAX_POINT_DISTANCE_METER)
-      {
-        clear();
-        pruned = true;
-      }
-      else
+      bool trackBreak = false;
+      if(pos.distanceMeterTo(lastPos.pos) > MAX_POINT_DISTANCE_METER)
       {
-        if(size() > MAX_TRACK_ENTRIES)
+        if(replayTrack)
+          // Replay jumped over a gap in the recorded flight - keep track but do not connect positions
+          trackBreak = true;
+        else
         {
-          for(int i = 0; i < PRUNE_TRACK_ENTRIES; i++)
-            removeFirst();
+          clearTrack();
           pruned = true;
         }
       }
-      append({pos, timestamp.toTime_t(), onGround});
+      append({pos, timestamp.toTime_t(), onGround}, trackBreak);
     }
   }
   return pruned;
@@ -139,8 +473,5 @@ bool AircraftTrack::appendTrackPos(const atools::geo::Pos& pos, const QDateTime&
 
 float AircraftTrack::getMaxAltitude() const
 {
-  float maxAlt = 0.f;
-  for(const at::AircraftTrackPos& trackPos : *this)
-    maxAlt = std::max(maxAlt, trackPos.pos.getAltitude());
-  return maxAlt;
+  return pyramid.getMaxAltitude();
 }
@@ -19,6 +19,11 @@
 #define LITTLENAVMAP_AIRCRAFTTRACK_H
 
 #include "geo/pos.h"
+#include "common/aircrafttrackpyramid.h"
+#include "common/trackarchive.h"
+
+#include <QFile>
+#include <QVector>
 
 namespace at {
 /* Track position. Can be converted to QVariant and thus be saved to settings */
@@ -38,47 +43,195 @@ Q_DECLARE_TYPEINFO(at::AircraftTrackPos, Q_PRIMITIVE_TYPE);
 Q_DECLARE_METATYPE(at::AircraftTrackPos);
 
 /*
- * Stores the track of the flight simulator aircraft
+ * Stores the track of the flight simulator aircraft without size limit.
+ *
+ * Positions are kept in a columnar, append only file (little_navmap.track) which is memory mapped.
+ * The file consists of a header and blocks of BLOCK_SIZE positions. Each block stores the columns
+ * timestamp, longitude, latitude, altitude and flags one after the other in native byte order.
+ * Blocks are mapped separately, so appending never remaps existing data and the operating system loads
+ * only the pages which are accessed.
+ *
+ * The pyramid of simplified levels is saved to a separate file (little_navmap.trackindex) when closing.
+ * It is used on startup if it matches the track and only positions added later are read from the track file.
+ *
+ * Each append writes directly into the mapped file. There is no separate save step.
+ * Falls back to memory if the file cannot be created or mapped.
+ *
+ * The track is added to the archive of past flights when it is cleared unless it was created by a replay.
  */
-class AircraftTrack :
-  private QList<at::AircraftTrackPos>
+class AircraftTrack
 {
 public:
+  /* Forward iterator returning positions by value */
+  class const_iterator
+  {
+public:
+    const_iterator(const AircraftTrack *aircraftTrack, int trackIndex)
+      : track(aircraftTrack), index(trackIndex)
+    {
+    }
+
+    at::AircraftTrackPos operator*() const
+    {
+      return track->at(index);
+    }
+
+    const_iterator& operator++()
+    {
+      index++;
+      return *this;
+    }
+
+    bool operator==(const const_iterator& other) const
+    {
+      return index == other.index && track == other.track;
+    }
+
+    bool operator!=(const const_iterator& other) const
+    {
+      return !(*this == other);
+    }
+
+private:
+    const AircraftTrack *track;
+    int index;
+  };
+
   AircraftTrack();
   ~AircraftTrack();
 
-  /* Saves and restores track into a separate file (little_navmap.track) */
-  void saveState();
+  /* Opens and maps the track file (little_navmap.track). Converts the track file of older versions.
+   * The track file of older versions is kept with suffix ".old" if conversion fails. */
   void restoreState();
 
-  void clearTrack()
-  {
-    clear();
-  }
+  /* Archive the track if not replayed and remove all positions */
+  void clearTrack();
+
+  /* Remove all positions from newSize on */
+  void truncate(int newSize);
 
   /*
    * Add a track position. Accurracy depends on the ground flag which will cause more
    * or less points skipped.
+   * A jump of more than MAX_POINT_DISTANCE_METER clears the track. A replayed track is kept instead and
+   * the position is marked as track break.
    * @return true if the track was pruned
    */
   bool appendTrackPos(const atools::geo::Pos& pos, const QDateTime& timestamp, bool onGround);
 
   float getMaxAltitude() const;
 
-  /* Pull only needed methods into public space */
-  using QList::isEmpty;
-  using QList::first;
-  using QList::last;
-  using QList::size;
-  using QList::at;
-  using QList::begin;
-  using QList::end;
+  /* Marks the track as filled by a replay of an archived flight. Replayed tracks are not archived again.
+   * Reset by clearTrack. */
+  void setReplayTrack(bool value);
+
+  bool isReplayTrack() const
+  {
+    return replayTrack;
+  }
+
+  const TrackArchive& getArchive() const
+  {
+    return archive;
+  }
+
+  /* Simplified levels and bounding rectangles of the track for painting */
+  const AircraftTrackPyramid& getPyramid() const
+  {
+    return pyramid;
+  }
+
+  bool isEmpty() const
+  {
+    return numEntries == 0;
+  }
+
+  int size() const
+  {
+    return numEntries;
+  }
+
+  at::AircraftTrackPos at(int index) const;
+
+  /* true if the position at index is not connected to the previous one. Always kept in all
+   * pyramid levels since the jump is larger than the largest tolerance. */
+  bool isTrackBreak(int index) const
+  {
+    return (*column<quint8>(index, FLAGS_OFFSET) & FLAG_TRACK_BREAK) != 0;
+  }
+
+  at::AircraftTrackPos first() const
+  {
+    return at(0);
+  }
+
+  at::AircraftTrackPos last() const
+  {
+    return at(numEntries - 1);
+  }
+
+  const_iterator begin() const
+  {
+    return const_iterator(this, 0);
+  }
+
+  const_iterator end() const
+  {
+    return const_iterator(this, numEntries);
+  }
 
 private:
-  /* Maximum number of track points. If exceeded entries will be removed from beginning of the list */
-  static Q_DECL_CONSTEXPR int MAX_TRACK_ENTRIES = 20000;
-  /* Number of entries to remove at once */
-  static Q_DECL_CONSTEXPR int PRUNE_TRACK_ENTRIES = 200;
+  Q_DISABLE_COPY(AircraftTrack)
+
+  /* Header at the start of the file. Padded to HEADER_SIZE. */
+  struct FileHeader
+  {
+    quint32 magic;
+    quint16 version;
+    quint16 flags;
+    quint32 blockSize;
+    quint32 generation; /* Incremented on each truncation to detect an outdated pyramid file */
+    quint64 size; /* Number of positions */
+  };
+
+  void append(const at::AircraftTrackPos& trackPos, bool trackBreak = false);
+
+  template<typename TYPE>
+  TYPE *column(int index, int offset) const
+  {
+    return reinterpret_cast<TYPE *>(blocks.at(index / BLOCK_SIZE) + offset) + index % BLOCK_SIZE;
+  }
+
+  bool openFile();
+  void closeFile();
+  void addBlock();
+
+  /* Copy all mapped blocks into memory and close the file */
+  void detachFromFile();
+  void rebuildPyramid();
+  bool readPyramid();
+  void writePyramid() const;
+  bool readOldTrack(QList<at::AircraftTrackPos>& oldTrack);
+
+  /* Number of positions in one block */
+  static Q_DECL_CONSTEXPR int BLOCK_SIZE = 4096;
+
+  /* Column offsets in a block */
+  static Q_DECL_CONSTEXPR int TIMESTAMP_OFFSET = 0;
+  static Q_DECL_CONSTEXPR int LONX_OFFSET = BLOCK_SIZE * 4;
+  static Q_DECL_CONSTEXPR int LATY_OFFSET = BLOCK_SIZE * 8;
+  static Q_DECL_CONSTEXPR int ALTITUDE_OFFSET = BLOCK_SIZE * 12;
+  static Q_DECL_CONSTEXPR int FLAGS_OFFSET = BLOCK_SIZE * 16;
+  static Q_DECL_CONSTEXPR int BLOCK_BYTES = BLOCK_SIZE * 17;
+
+  static Q_DECL_CONSTEXPR int HEADER_SIZE = 64;
+
+  /* Bits in the flags column */
+  static Q_DECL_CONSTEXPR quint8 FLAG_ON_GROUND = 1;
+  static Q_DECL_CONSTEXPR quint8 FLAG_TRACK_BREAK = 2;
+
+  /* Bits in the header flags */
+  static Q_DECL_CONSTEXPR quint16 FILE_FLAG_REPLAY = 1;
 
   /* Minimum time difference between recordings */
   static Q_DECL_CONSTEXPR int MIN_POSITION_TIME_DIFF_MS = 1000;
@@ -87,10 +240,38 @@ private:
   /* Clear track if aircraft jumps too far */
   static Q_DECL_CONSTEXPR int MAX_POINT_DISTANCE_METER = 100000;
 
-  static Q_DECL_CONSTEXPR quint32 FILE_MAGIC_NUMBER = 0x5B6C1A2B;
+  /* Magic number and version of the QDataStream based track file before version 3 */
+  static Q_DECL_CONSTEXPR quint32 OLD_FILE_MAGIC_NUMBER = 0x5B6C1A2B;
+  static Q_DECL_CONSTEXPR quint16 OLD_FILE_VERSION = 2;
+
+  static Q_DECL_CONSTEXPR quint32 FILE_MAGIC_NUMBER = 0x5B6C1A2C;
+
+  /* Version 3 uses a columnar memory mapped file */
+  static Q_DECL_CONSTEXPR quint16 FILE_VERSION = 3;
+
+  static Q_DECL_CONSTEXPR quint32 PYRAMID_MAGIC_NUMBER = 0x5B6C1A2D;
+  static Q_DECL_CONSTEXPR quint16 PYRAMID_VERSION = 1;
+
+  QFile trackFile;
+  QString pyramidFilename;
+
+  /* Mapped header or null if not mapped */
+  FileHeader *header = nullptr;
+
+  /* Mapped blocks or blocks allocated in memory if mapped is false */
+  QVector<uchar *> blocks;
+  bool mapped = false;
+
+  int numEntries = 0;
+
+  /* Copy of the replay header flag which is also valid if not mapped */
+  bool replayTrack = false;
+
+  TrackArchive archive;
 
-  /* Version 2 to adds timstamp and single floating point precision */
-  static Q_DECL_CONSTEXPR quint16 FILE_VERSION = 2;
+  /* Updated on each append and truncated incrementally. Saved when closing the file and rebuilt only if the
+   * pyramid file is missing or corrupt. Also provides the maximum altitude. */
+  AircraftTrackPyramid pyramid;
 };
 
 #endif // LITTLENAVMAP_AIRCRAFTTRACK_H
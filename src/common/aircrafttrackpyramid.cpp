@@ -0,0 +1,165 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "common/aircrafttrackpyramid.h"
+
+#include <QDataStream>
+
+#include <algorithm>
+
+// Definition needed since the array is indexed
+Q_DECL_CONSTEXPR float AircraftTrackPyramid::TOLERANCE_METER[];
+
+AircraftTrackPyramid::AircraftTrackPyramid()
+{
+  levels.resize(NUM_LEVELS);
+}
+
+AircraftTrackPyramid::~AircraftTrackPyramid()
+{
+
+}
+
+void AircraftTrackPyramid::append(int index, const atools::geo::Pos& pos)
+{
+  maxAltitude = std::max(maxAltitude, pos.getAltitude());
+
+  for(int i = 0; i < NUM_LEVELS; i++)
+  {
+    Level& level = levels[i];
+
+    if(i > 0 && !level.indexes.isEmpty() && pos.distanceMeterTo(level.lastPos) < TOLERANCE_METER[i])
+      // Too close to the last kept position of this level
+      continue;
+
+    if(level.indexes.size() % CHUNK_SIZE == 0)
+    {
+      // Start a new chunk - previous chunk includes this position to cover the connecting segment
+      if(!level.chunks.isEmpty())
+        extendChunk(level.chunks.last(), pos);
+      level.chunks.append({atools::geo::Rect(pos), level.indexes.size(), pos.getAltitude()});
+    }
+    else
+      extendChunk(level.chunks.last(), pos);
+
+    level.indexes.append(index);
+    level.lastPos = pos;
+  }
+}
+
+void AircraftTrackPyramid::truncate(int size, const PosFunctionType& posAt)
+{
+  if(size <= 0)
+  {
+    clear();
+    return;
+  }
+
+  for(Level& level : levels)
+  {
+    // Indexes are ascending - find the first one to remove
+    int num = static_cast<int>(std::lower_bound(level.indexes.begin(), level.indexes.end(), size) -
+                               level.indexes.begin());
+    if(num == level.indexes.size())
+      continue;
+
+    // The first position is kept in all levels so num is never null
+    level.indexes.resize(num);
+    level.chunks.resize((num + CHUNK_SIZE - 1) / CHUNK_SIZE);
+
+    // Last chunk might have covered removed positions
+    Chunk& chunk = level.chunks.last();
+    atools::geo::Pos pos = posAt(level.indexes.at(chunk.first));
+    chunk.bounding = atools::geo::Rect(pos);
+    chunk.maxAltitude = pos.getAltitude();
+    for(int i = chunk.first + 1; i < num; i++)
+      extendChunk(chunk, posAt(level.indexes.at(i)));
+
+    level.lastPos = posAt(level.indexes.last());
+  }
+
+  // Level 0 chunks cover all positions
+  maxAltitude = 0.f;
+  for(const Chunk& chunk : levels.first().chunks)
+    maxAltitude = std::max(maxAltitude, chunk.maxAltitude);
+}
+
+void AircraftTrackPyramid::extendChunk(Chunk& chunk, const atools::geo::Pos& pos)
+{
+  chunk.bounding.extend(pos);
+  chunk.maxAltitude = std::max(chunk.maxAltitude, pos.getAltitude());
+}
+
+void AircraftTrackPyramid::clear()
+{
+  maxAltitude = 0.f;
+
+  for(Level& level : levels)
+  {
+    level.indexes.clear();
+    level.chunks.clear();
+    level.lastPos = atools::geo::Pos();
+  }
+}
+
+void AircraftTrackPyramid::write(QDataStream& out) const
+{
+  out << maxAltitude;
+  for(const Level& level : levels)
+  {
+    out << level.indexes << level.lastPos << static_cast<quint32>(level.chunks.size());
+    for(const Chunk& chunk : level.chunks)
+      out << static_cast<qint32>(chunk.first) << chunk.maxAltitude
+          << chunk.bounding.getWest() << chunk.bounding.getNorth()
+          << chunk.bounding.getEast() << chunk.bounding.getSouth();
+  }
+}
+
+bool AircraftTrackPyramid::read(QDataStream& in)
+{
+  clear();
+
+  bool ok = true;
+  in >> maxAltitude;
+  for(Level& level : levels)
+  {
+    quint32 numChunks = 0;
+    in >> level.indexes >> level.lastPos >> numChunks;
+
+    // Each chunk covers CHUNK_SIZE kept positions
+    ok = in.status() == QDataStream::Ok &&
+         numChunks == static_cast<quint32>((level.indexes.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    if(!ok)
+      break;
+
+    level.chunks.reserve(static_cast<int>(numChunks));
+    for(quint32 i = 0; i < numChunks; i++)
+    {
+      qint32 first;
+      float maxAlt, west, north, east, south;
+      in >> first >> maxAlt >> west >> north >> east >> south;
+      level.chunks.append({atools::geo::Rect(west, north, east, south), first, maxAlt});
+    }
+  }
+
+  if(!ok || in.status() != QDataStream::Ok)
+  {
+    clear();
+    return false;
+  }
+  return true;
+}
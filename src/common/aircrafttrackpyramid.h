@@ -0,0 +1,125 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_AIRCRAFTTRACKPYRAMID_H
+#define LITTLENAVMAP_AIRCRAFTTRACKPYRAMID_H
+
+#include "geo/pos.h"
+#include "geo/rect.h"
+
+#include <QVector>
+
+#include <functional>
+
+class QDataStream;
+
+/*
+ * Multi resolution index for the aircraft track used for painting.
+ *
+ * Each level contains the indexes of track positions kept after simplification with the level's tolerance.
+ * Level 0 contains all positions. A position is kept if it is at least the tolerance away from the last
+ * kept position, so the simplified line never deviates more than the tolerance from the track. This allows
+ * updating all levels incrementally with constant cost per appended position.
+ *
+ * The kept positions of each level are grouped into chunks of CHUNK_SIZE segments with a bounding rectangle
+ * to find the visible parts of the track without projecting all positions.
+ *
+ * Since the kept positions depend only on preceding positions, the levels of a truncated track are a prefix
+ * of the levels of the full track. Truncation therefore drops only tail indexes and chunks.
+ */
+class AircraftTrackPyramid
+{
+public:
+  /* Chunk covering the kept positions [first, first + CHUNK_SIZE] of a level. The last position is the first
+   * position of the next chunk so segments between chunks are included in the bounding rectangle. */
+  struct Chunk
+  {
+    atools::geo::Rect bounding;
+    int first;
+    float maxAltitude;
+  };
+
+  /* Returns the position of the track at index */
+  typedef std::function<atools::geo::Pos(int index)> PosFunctionType;
+
+  AircraftTrackPyramid();
+  ~AircraftTrackPyramid();
+
+  /* Add a track position with index to all levels */
+  void append(int index, const atools::geo::Pos& pos);
+
+  /* Remove all positions from index size on. Drops the tail of each level and recalculates only the
+   * last remaining chunk which needs up to CHUNK_SIZE positions per level from posAt. */
+  void truncate(int size, const PosFunctionType& posAt);
+
+  void clear();
+
+  /* Write all levels to stream */
+  void write(QDataStream& out) const;
+
+  /* Read levels written by write(). Clears the pyramid and returns false on error. */
+  bool read(QDataStream& in);
+
+  /* Maximum altitude of all positions */
+  float getMaxAltitude() const
+  {
+    return maxAltitude;
+  }
+
+  int getNumLevels() const
+  {
+    return NUM_LEVELS;
+  }
+
+  /* Maximum deviation in meter from the track for a level */
+  float getToleranceMeter(int level) const
+  {
+    return TOLERANCE_METER[level];
+  }
+
+  /* Indexes into the track of all kept positions for a level */
+  const QVector<int>& getIndexes(int level) const
+  {
+    return levels.at(level).indexes;
+  }
+
+  const QVector<Chunk>& getChunks(int level) const
+  {
+    return levels.at(level).chunks;
+  }
+
+  /* Number of segments in a chunk */
+  static Q_DECL_CONSTEXPR int CHUNK_SIZE = 64;
+
+private:
+  struct Level
+  {
+    QVector<int> indexes;
+    QVector<Chunk> chunks;
+    atools::geo::Pos lastPos;
+  };
+
+  static void extendChunk(Chunk& chunk, const atools::geo::Pos& pos);
+
+  static Q_DECL_CONSTEXPR int NUM_LEVELS = 7;
+  static Q_DECL_CONSTEXPR float TOLERANCE_METER[NUM_LEVELS] = {0.f, 20.f, 80.f, 320.f, 1280.f, 5120.f, 20480.f};
+
+  QVector<Level> levels;
+  float maxAltitude = 0.f;
+};
+
+#endif // LITTLENAVMAP_AIRCRAFTTRACKPYRAMID_H
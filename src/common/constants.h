@@ -30,6 +30,9 @@
 
 // #define DEBUG_CREATE_WINDOW_STATE
 
+/* Compare lazy and preloaded route network for a fixed set of city pairs after loading a database */
+// #define DEBUG_ROUTE_NETWORK_BENCHMARK
+
 #include "geo/pos.h"
 
 const atools::geo::Pos MAG_NORTH_POLE_2007 = atools::geo::Pos(-120.72f, 83.95f, 0.f);
@@ -94,6 +97,7 @@ const QString MAP_MARKLATY = "Map/MarkLatY";
 const QString MAP_MARKLONX = "Map/MarkLonX";
 const QString MAP_RANGEMARKERS = "Map/RangeMarkers";
 const QString MAP_OVERLAY_VISIBLE = "Map/OverlayVisible";
+const QString MAP_TRACK_REPLAY_SPEED = "Map/TrackReplaySpeed";
 const QString NAVCONNECT_REMOTEHOSTS = "NavConnect/RemoteHosts";
 const QString NAVCONNECT_REMOTE = "NavConnect/Remote";
 const QString ROUTE_FILENAME = "Route/Filename";
@@ -114,7 +118,10 @@ const QString SEARCHTAB_NAV_VIEW_DIST_WIDGET = "SearchPaneNav/WidgetDistView";
 /* General settings in the configuration file not covered by any GUI elements */
 const QString SETTINGS_INFOQUERY = "Settings/InfoQuery";
 const QString SETTINGS_MAPQUERY = "Settings/MapQuery";
+const QString SETTINGS_MAPPAINT = "Settings/MapPaint";
 const QString SETTINGS_DATABASE = "Settings/Database";
+const QString SETTINGS_ROUTENETWORK = "Settings/RouteNetwork";
+const QString SETTINGS_ELEVATION = "Settings/Elevation";
 
 const QString APPROACHTREE_WIDGET = "ApproachTree/Widget";
 const QString APPROACHTREE_SELECTED_WIDGET = "ApproachTree/WidgetSelected";
@@ -175,6 +182,9 @@ const QString DATABASE_PREFIX = "little_navmap_";
 const QString DATABASE_SUFFIX = ".sqlite";
 const QString DATABASE_BACKUP_SUFFIX = "-backup";
 
+/* Directory for archived aircraft tracks below the configuration directory */
+const QString TRACK_ARCHIVE_DIR = "little_navmap_tracks";
+
 /* This is the default configuration file for reading the scenery library.
  * It can be overridden by placing a  file with the same name into
  * the configuration directory. */
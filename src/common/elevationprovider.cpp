@@ -18,6 +18,8 @@
 #include "common/elevationprovider.h"
 
 #include "navapp.h"
+#include "common/constants.h"
+#include "settings/settings.h"
 #include "dtm/globereader.h"
 #include "options/optiondata.h"
 #include "geo/line.h"
@@ -30,10 +32,14 @@
 
 #include <QMessageBox>
 
+#include <cmath>
+
 /* Limt altitude to this value */
 static Q_DECL_CONSTEXPR float ALTITUDE_LIMIT_METER = 8800.f;
 /* Point removal equality tolerance in meter */
-static Q_DECL_CONSTEXPR float SAME_ONLINE_ELEVATION_EPSILON = 1.f;
+static Q_DECL_CONSTEXPR float SAME_ELEVATION_EPSILON = 1.f;
+/* Distance between points for offline elevation data */
+static Q_DECL_CONSTEXPR float SAMPLE_DISTANCE_METER = 500.f;
 
 using atools::geo::Pos;
 using atools::geo::Line;
@@ -42,9 +48,46 @@ using atools::dtm::GlobeReader;
 
 using namespace Marble;
 
+/* Add point to elevations unless it has the same altitude as the last one. Keeps the last point of a
+ * stretch with same altitude. */
+static void addElevation(LineString& elevations, const Pos& pos, Pos& lastDropped)
+{
+  if(!elevations.isEmpty())
+  {
+    if(atools::almostEqual(elevations.last().getAltitude(), pos.getAltitude(), SAME_ELEVATION_EPSILON))
+    {
+      // Drop points with similar altitude
+      lastDropped = pos;
+      return;
+    }
+    else if(lastDropped.isValid())
+    {
+      // Add last point of a stretch with similar altitude
+      elevations.append(lastDropped);
+      lastDropped = Pos();
+    }
+  }
+  elevations.append(pos);
+}
+
+ElevationProvider::ElevationTile::ElevationTile(int tileIndex)
+  : lastUsed(0), index(tileIndex)
+{
+  for(QAtomicInteger<qint16>& cell : cells)
+    cell.store(CELL_EMPTY);
+}
+
 ElevationProvider::ElevationProvider(QObject *parent, const Marble::ElevationModel *model)
   : QObject(parent), marbleModel(model)
 {
+  tiles = new QAtomicPointer<ElevationTile>[NUM_TILES];
+
+  qint64 cacheSizeMb = atools::settings::Settings::instance().getAndStoreValue(
+    lnm::SETTINGS_ELEVATION + "CacheSizeMb", DEFAULT_CACHE_SIZE_MB).toInt();
+  maxCachedTiles = std::max(static_cast<int>(cacheSizeMb * 1024 * 1024 / static_cast<qint64>(sizeof(ElevationTile))),
+                            MIN_CACHED_TILES);
+  qDebug() << Q_FUNC_INFO << "Elevation cache" << cacheSizeMb << "MB" << maxCachedTiles << "tiles";
+
   // Marble will let us know when updates are available
   connect(marbleModel, &ElevationModel::updateAvailable, this, &ElevationProvider::marbleUpdateAvailable);
   updateReader();
@@ -52,7 +95,11 @@ ElevationProvider::ElevationProvider(QObject *parent, const Marble::ElevationMod
 
 ElevationProvider::~ElevationProvider()
 {
-  delete globeReader;
+  clearCache(0);
+  delete[] tiles;
+  setGlobeReader(nullptr);
+  qDeleteAll(retiredTiles);
+  qDeleteAll(retiredReaders);
 }
 
 void ElevationProvider::marbleUpdateAvailable()
@@ -62,19 +109,134 @@ void ElevationProvider::marbleUpdateAvailable()
 }
 
 float ElevationProvider::getElevation(const atools::geo::Pos& pos)
+{
+  if(isGlobeOfflineProvider() && pos.isValid())
+  {
+    activeReaders.ref();
+    float elevation = cachedElevation(pos);
+    activeReaders.deref();
+    return elevation;
+  }
+  else
+    return 0.f;
+}
+
+float ElevationProvider::cachedElevation(const atools::geo::Pos& pos)
+{
+  int column = static_cast<int>(std::floor((pos.getLonX() + 180.f) * CELLS_PER_DEGREE));
+  int row = static_cast<int>(std::floor((pos.getLatY() + 90.f) * CELLS_PER_DEGREE));
+  column = std::max(0, std::min(column, 360 * CELLS_PER_DEGREE - 1));
+  row = std::max(0, std::min(row, 180 * CELLS_PER_DEGREE - 1));
+
+  int tileIndex = row / CELLS_PER_DEGREE * 360 + column / CELLS_PER_DEGREE;
+  int cellIndex = row % CELLS_PER_DEGREE * CELLS_PER_DEGREE + column % CELLS_PER_DEGREE;
+
+  ElevationTile *tile = tiles[tileIndex].loadAcquire();
+  if(tile != nullptr)
+  {
+    qint16 value = tile->cells[cellIndex].loadAcquire();
+    if(value != CELL_EMPTY)
+    {
+      // Write only if the tile was not used since the clock was advanced
+      quint32 now = useCounter.load();
+      if(tile->lastUsed.load() != now)
+        tile->lastUsed.store(now);
+      return value;
+    }
+  }
+
+  // Not cached yet
+  return loadCell(tileIndex, cellIndex, row, column);
+}
+
+float ElevationProvider::loadCell(int tileIndex, int cellIndex, int row, int column)
 {
   QMutexLocker locker(&mutex);
 
-  if(isGlobeOfflineProvider())
+  GlobeReader *reader = globeReader.loadAcquire();
+  if(reader == nullptr)
+    return 0.f;
+
+  ElevationTile *tile = tiles[tileIndex].loadAcquire();
+  if(tile == nullptr)
+  {
+    if(cachedTiles.size() >= maxCachedTiles)
+      evictTile();
+
+    tile = new ElevationTile(tileIndex);
+    cachedTiles.append(tile);
+    tiles[tileIndex].storeRelease(tile);
+  }
+
+  qint16 value = tile->cells[cellIndex].loadAcquire();
+  if(value == CELL_EMPTY)
   {
-    float elevation = globeReader->getElevation(pos);
+    // Read at the center of the GLOBE cell
+    Pos center((column + 0.5f) / CELLS_PER_DEGREE - 180.f, (row + 0.5f) / CELLS_PER_DEGREE - 90.f);
+    float elevation = reader->getElevation(center);
     if(!(elevation > atools::dtm::OCEAN && elevation < atools::dtm::INVALID))
-      return 0.f;
-    else
-      return elevation;
+      // Reset all invalid and ocean indicators to 0
+      elevation = 0.f;
+
+    value = static_cast<qint16>(std::max(-32767.f, std::min(std::round(elevation), 32767.f)));
+    tile->cells[cellIndex].storeRelease(value);
+  }
+
+  // Advance clock - tiles used after this get a newer stamp
+  tile->lastUsed.store(useCounter.fetchAndAddRelaxed(1) + 1);
+  return value;
+}
+
+void ElevationProvider::evictTile()
+{
+  // Find least recently used tile
+  int lruIndex = 0;
+  quint32 now = useCounter.load();
+  for(int i = 1; i < cachedTiles.size(); i++)
+  {
+    if(now - cachedTiles.at(i)->lastUsed.load() > now - cachedTiles.at(lruIndex)->lastUsed.load())
+      lruIndex = i;
+  }
+
+  ElevationTile *tile = cachedTiles.takeAt(lruIndex);
+  tiles[tile->index].fetchAndStoreOrdered(nullptr);
+  retiredTiles.append(tile);
+
+  // Caller of loadCell is a reader too
+  deleteRetired(1);
+}
+
+void ElevationProvider::clearCache(int ownReaders)
+{
+  for(ElevationTile *tile : cachedTiles)
+    tiles[tile->index].fetchAndStoreOrdered(nullptr);
+  retiredTiles.append(cachedTiles);
+  cachedTiles.clear();
+  deleteRetired(ownReaders);
+}
+
+void ElevationProvider::setGlobeReader(atools::dtm::GlobeReader *reader)
+{
+  GlobeReader *oldReader = globeReader.fetchAndStoreOrdered(reader);
+  if(oldReader != nullptr)
+  {
+    // Threads which checked isGlobeOfflineProvider might still be in getElevation
+    retiredReaders.append(oldReader);
+    deleteRetired(0);
+  }
+}
+
+void ElevationProvider::deleteRetired(int ownReaders)
+{
+  // Readers starting after tiles were unlinked above cannot see them anymore.
+  // Use an ordered operation to read the counter after unlinking.
+  if(activeReaders.fetchAndAddOrdered(0) == ownReaders)
+  {
+    qDeleteAll(retiredTiles);
+    retiredTiles.clear();
+    qDeleteAll(retiredReaders);
+    retiredReaders.clear();
   }
-  else
-    return 0.f;
 }
 
 void ElevationProvider::getElevations(atools::geo::LineString& elevations, const atools::geo::Line& line)
@@ -82,21 +244,33 @@ void ElevationProvider::getElevations(atools::geo::LineString& elevations, const
   if(!line.isValid())
     return;
 
-  QMutexLocker locker(&mutex);
-
   if(isGlobeOfflineProvider())
   {
-    globeReader->getElevations(elevations, LineString(line.getPos1(), line.getPos2()));
-    for(Pos& pos : elevations)
+    // Sample along the great circle line using the tile cache
+    const Pos& pos1 = line.getPos1();
+    const Pos& pos2 = line.getPos2();
+    float distanceMeter = pos1.distanceMeterTo(pos2);
+    int numSegments = std::max(1, static_cast<int>(std::ceil(distanceMeter / SAMPLE_DISTANCE_METER)));
+
+    activeReaders.ref();
+    Pos lastDropped;
+    for(int i = 0; i <= numSegments; i++)
     {
-      float alt = pos.getAltitude();
-      if(!(alt > atools::dtm::OCEAN && alt < atools::dtm::INVALID))
-        // Reset all invalid and ocean indicators to 0
-        pos.setAltitude(0.f);
+      Pos pos = i == 0 ? pos1 : (i == numSegments ? pos2 :
+                                 pos1.interpolate(pos2, distanceMeter, static_cast<float>(i) / numSegments));
+      pos.setAltitude(cachedElevation(pos));
+      addElevation(elevations, pos, lastDropped);
     }
+    activeReaders.deref();
+
+    if(lastDropped.isValid())
+      // Keep end of line
+      elevations.append(lastDropped);
   }
   else
   {
+    QMutexLocker locker(&mutex);
+
     // Get altitude points for the line segment
     // The might not be complete and will be more complete on further iterations when we get a signal
     // from the elevation model
@@ -108,23 +282,7 @@ void ElevationProvider::getElevations(atools::geo::LineString& elevations, const
     {
       Pos pos(c.longitude(), c.latitude(), c.altitude());
       pos.toDeg();
-
-      if(!elevations.isEmpty())
-      {
-        if(atools::almostEqual(elevations.last().getAltitude(), pos.getAltitude(), SAME_ONLINE_ELEVATION_EPSILON))
-        {
-          // Drop points with similar altitude
-          lastDropped = pos;
-          continue;
-        }
-        else if(lastDropped.isValid())
-        {
-          // Add last point of a stretch with similar altitude
-          elevations.append(lastDropped);
-          lastDropped = Pos();
-        }
-      }
-      elevations.append(pos);
+      addElevation(elevations, pos, lastDropped);
     }
 
     if(elevations.isEmpty())
@@ -150,6 +308,9 @@ void ElevationProvider::optionsChanged()
 {
   // Make sure to wait for other methods to finish before changing the reader
   QMutexLocker locker(&mutex);
+
+  // Elevations might come from another directory
+  clearCache(0);
   updateReader();
 }
 
@@ -163,23 +324,22 @@ void ElevationProvider::updateReader()
                            tr("GLOBE elevation data directory is not valid:<br/><i>%1</i>").arg(path));
     else
     {
-      delete globeReader;
-      globeReader = new GlobeReader(path);
+      GlobeReader *reader = new GlobeReader(path);
       {
         qDebug() << Q_FUNC_INFO << "Opening GLOBE files";
 
-        if(!globeReader->openFiles())
+        if(!reader->openFiles())
           QMessageBox::warning(NavApp::getQMainWidget(), NavApp::applicationName(),
                                tr("Cannot open GLOBE data in directory<br/><i>%1</i>").arg(path));
         qDebug() << Q_FUNC_INFO << "Opening GLOBE done";
       }
+
+      // Publish reader after it is opened
+      setGlobeReader(reader);
     }
   }
   else
-  {
-    delete globeReader;
-    globeReader = nullptr;
-  }
+    setGlobeReader(nullptr);
 
   emit updateAvailable();
 }
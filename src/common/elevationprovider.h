@@ -18,8 +18,13 @@
 #ifndef LITTLENAVMAP_ELEVATIONPROVIDER_H
 #define LITTLENAVMAP_ELEVATIONPROVIDER_H
 
+#include <QAtomicInteger>
+#include <QAtomicPointer>
 #include <QMutex>
 #include <QObject>
+#include <QVector>
+
+#include <limits>
 
 namespace Marble {
 class ElevationModel;
@@ -40,6 +45,15 @@ class Line;
  * Wraps the slow Marble online elevation provider and the fast offline GLOBE data provider.
  * Use GLOBE data if all paramters are set properly in settings.
  *
+ * GLOBE elevations are cached in tiles of one by one degree which hold the 30 arc second grid cells as
+ * int16 values in meter. Cells are read from GlobeReader on first access. Reading cached cells needs no lock,
+ * so the profile thread and the map do not block each other. The least recently used tiles are dropped if
+ * the cache exceeds the size given by "Settings/ElevationCacheSizeMb" (default DEFAULT_CACHE_SIZE_MB).
+ * Dropped tiles and replaced GLOBE readers are deleted only when no other thread is reading.
+ *
+ * The clock for least recently used is advanced only when loading cells. Cache hits update the stamp of
+ * a tile only if it is older than the clock, so reading cached cells does not write to shared memory.
+ *
  * Class is thread safe.
  */
 class ElevationProvider :
@@ -61,7 +75,7 @@ public:
   /* true if the data is provided from the fast offline source */
   bool isGlobeOfflineProvider() const
   {
-    return globeReader != nullptr;
+    return globeReader.loadAcquire() != nullptr;
   }
 
   /* True if directory is valid and contains at least one valid GLOBE file */
@@ -75,15 +89,70 @@ signals:
   void updateAvailable();
 
 private:
+  /* Number of GLOBE cells per degree and per tile side */
+  static Q_DECL_CONSTEXPR int CELLS_PER_DEGREE = 120;
+  static Q_DECL_CONSTEXPR int NUM_TILES = 360 * 180;
+
+  /* Tiles are about 28 kB - about 3600 tiles by default */
+  static Q_DECL_CONSTEXPR int DEFAULT_CACHE_SIZE_MB = 100;
+  static Q_DECL_CONSTEXPR int MIN_CACHED_TILES = 16;
+
+  /* Cell value for not yet loaded elevations */
+  static Q_DECL_CONSTEXPR qint16 CELL_EMPTY = std::numeric_limits<qint16>::min();
+
+  /* One degree tile of GLOBE cells. Cells are filled on demand. */
+  struct ElevationTile
+  {
+    ElevationTile(int tileIndex);
+
+    QAtomicInteger<qint16> cells[CELLS_PER_DEGREE * CELLS_PER_DEGREE];
+    QAtomicInteger<quint32> lastUsed;
+    int index;
+  };
+
   void marbleUpdateAvailable();
   void updateReader();
 
+  /* Get elevation from cache or GlobeReader. Caller has to be registered in activeReaders. */
+  float cachedElevation(const atools::geo::Pos& pos);
+
+  /* Read a cell from GlobeReader into the cache */
+  float loadCell(int tileIndex, int cellIndex, int row, int column);
+
+  /* Remove the least recently used tile from the cache */
+  void evictTile();
+
+  /* Remove all tiles from the cache */
+  void clearCache(int ownReaders);
+
+  /* Replace the GLOBE reader and retire the old one */
+  void setGlobeReader(atools::dtm::GlobeReader *reader);
+
+  /* Delete removed tiles and readers if no other reader might still access them */
+  void deleteRetired(int ownReaders);
+
   const Marble::ElevationModel *marbleModel = nullptr;
-  atools::dtm::GlobeReader *globeReader = nullptr;
+  /* Read without lock to check for offline data. Only used for loading under mutex. */
+  QAtomicPointer<atools::dtm::GlobeReader> globeReader;
 
-  /* Need to synchronize here since it is called from profile widget thread */
+  /* Need to synchronize loading and the reader here since it is called from profile widget thread */
   mutable QMutex mutex;
 
+  /* Tile cache indexed by latitude and longitude in degree. Read without lock. */
+  QAtomicPointer<ElevationTile> *tiles = nullptr;
+
+  /* Guarded by mutex */
+  QVector<ElevationTile *> cachedTiles, retiredTiles;
+  QVector<atools::dtm::GlobeReader *> retiredReaders;
+
+  /* Number of threads currently reading tiles */
+  QAtomicInt activeReaders;
+
+  /* Clock for least recently used. Advanced by loadCell only. */
+  QAtomicInteger<quint32> useCounter;
+
+  /* Maximum number of tiles calculated from the configured cache size */
+  int maxCachedTiles = MIN_CACHED_TILES;
 };
 
 #endif // LITTLENAVMAP_ELEVATIONPROVIDER_H
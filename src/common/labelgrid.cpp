@@ -0,0 +1,110 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "common/labelgrid.h"
+
+#include <QTransform>
+
+#include <cmath>
+
+/* Key for a grid cell */
+static inline quint64 cellKey(qint32 x, qint32 y)
+{
+  return (static_cast<quint64>(static_cast<quint32>(y)) << 32) | static_cast<quint32>(x);
+}
+
+LabelGrid::LabelGrid(float cellSizeParam)
+  : cellSize(cellSizeParam)
+{
+}
+
+LabelGrid::~LabelGrid()
+{
+}
+
+void LabelGrid::clear()
+{
+  rects.clear();
+  cells.clear();
+  numRejected = 0;
+}
+
+bool LabelGrid::isFree(const QRectF& rect) const
+{
+  if(rects.isEmpty())
+    return true;
+
+  qint32 x1, y1, x2, y2;
+  cellRange(rect, x1, y1, x2, y2);
+
+  for(qint32 y = y1; y <= y2; y++)
+  {
+    for(qint32 x = x1; x <= x2; x++)
+    {
+      auto it = cells.constFind(cellKey(x, y));
+      if(it != cells.constEnd())
+      {
+        for(int index : it.value())
+        {
+          if(rects.at(index).intersects(rect))
+            return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void LabelGrid::insert(const QRectF& rect)
+{
+  int index = rects.size();
+  rects.append(rect);
+
+  qint32 x1, y1, x2, y2;
+  cellRange(rect, x1, y1, x2, y2);
+
+  for(qint32 y = y1; y <= y2; y++)
+  {
+    for(qint32 x = x1; x <= x2; x++)
+      cells[cellKey(x, y)].append(index);
+  }
+}
+
+bool LabelGrid::tryInsert(const QRectF& rect)
+{
+  if(isFree(rect))
+  {
+    insert(rect);
+    return true;
+  }
+
+  numRejected++;
+  return false;
+}
+
+bool LabelGrid::tryInsert(const QRectF& rect, const QTransform& transform)
+{
+  return tryInsert(transform.mapRect(rect));
+}
+
+void LabelGrid::cellRange(const QRectF& rect, qint32& x1, qint32& y1, qint32& x2, qint32& y2) const
+{
+  x1 = static_cast<qint32>(std::floor(rect.left() / cellSize));
+  y1 = static_cast<qint32>(std::floor(rect.top() / cellSize));
+  x2 = static_cast<qint32>(std::floor(rect.right() / cellSize));
+  y2 = static_cast<qint32>(std::floor(rect.bottom() / cellSize));
+}
@@ -0,0 +1,74 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_LABELGRID_H
+#define LITTLENAVMAP_LABELGRID_H
+
+#include <QHash>
+#include <QRectF>
+#include <QVector>
+
+class QTransform;
+
+/*
+ * Screen space occupied by map labels. Used to detect overlapping texts before drawing them.
+ *
+ * Rectangles are bucketed into a grid of square cells so that a collision check only has to look at
+ * labels in the cells covered by the new label. Not thread safe.
+ */
+class LabelGrid
+{
+public:
+  LabelGrid(float cellSizeParam = 64.f);
+  ~LabelGrid();
+
+  /* Remove all labels. Call before painting a new frame. */
+  void clear();
+
+  /* true if the rectangle does not overlap any label */
+  bool isFree(const QRectF& rect) const;
+
+  /* Mark the rectangle as occupied regardless of overlaps */
+  void insert(const QRectF& rect);
+
+  /* Mark the rectangle as occupied and return true if it does not overlap any label.
+   * Nothing is changed and false is returned otherwise. */
+  bool tryInsert(const QRectF& rect);
+
+  /* As above for a rectangle in local coordinates which is transformed to screen coordinates.
+   * The bounding rectangle is used for rotated labels. */
+  bool tryInsert(const QRectF& rect, const QTransform& transform);
+
+  /* Number of labels rejected by tryInsert since last clear */
+  int getNumRejected() const
+  {
+    return numRejected;
+  }
+
+private:
+  /* Get the range of grid cells covered by the rectangle */
+  void cellRange(const QRectF& rect, qint32& x1, qint32& y1, qint32& x2, qint32& y2) const;
+
+  float cellSize;
+  QVector<QRectF> rects;
+
+  /* Grid cell to indexes in rects */
+  QHash<quint64, QVector<int> > cells;
+  int numRejected = 0;
+};
+
+#endif // LITTLENAVMAP_LABELGRID_H
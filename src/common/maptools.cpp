@@ -16,3 +16,89 @@
 *****************************************************************************/
 
 #include "common/maptools.h"
+
+#include <QPair>
+#include <QVector>
+
+#include <cmath>
+
+namespace maptools {
+
+/* Squared distance of p to the segment from p1 to p2 in scaled degree */
+static float segmentDistanceSquared(const atools::geo::Pos& p, const atools::geo::Pos& p1,
+                                    const atools::geo::Pos& p2, float lonScale)
+{
+  float x = p.getLonX() * lonScale, y = p.getLatY();
+  float x1 = p1.getLonX() * lonScale, y1 = p1.getLatY();
+  float x2 = p2.getLonX() * lonScale, y2 = p2.getLatY();
+
+  float dx = x2 - x1, dy = y2 - y1;
+  float lenSquared = dx * dx + dy * dy;
+
+  float t = 0.f;
+  if(lenSquared > 0.f)
+    t = std::max(0.f, std::min(1.f, ((x - x1) * dx + (y - y1) * dy) / lenSquared));
+
+  float px = x1 + t * dx - x, py = y1 + t * dy - y;
+  return px * px + py * py;
+}
+
+void simplifyLine(const atools::geo::LineString& line, float toleranceDeg, atools::geo::LineString& result)
+{
+  result.clear();
+  int size = line.size();
+  if(size < 3 || !(toleranceDeg > 0.f))
+  {
+    result = line;
+    return;
+  }
+
+  // Use a single scale for the whole line which is sufficient for airspace sized objects
+  float minLat = line.at(0).getLatY(), maxLat = minLat;
+  for(const atools::geo::Pos& pos : line)
+  {
+    minLat = std::min(minLat, pos.getLatY());
+    maxLat = std::max(maxLat, pos.getLatY());
+  }
+  float lonScale = static_cast<float>(std::cos(atools::geo::toRadians((minLat + maxLat) / 2.f)));
+  float toleranceSquared = toleranceDeg * toleranceDeg;
+
+  QVector<bool> keep(size, false);
+  keep[0] = true;
+  keep[size - 1] = true;
+
+  // Iterative to avoid deep recursion for large boundaries
+  QVector<QPair<int, int> > stack;
+  stack.append(qMakePair(0, size - 1));
+  while(!stack.isEmpty())
+  {
+    QPair<int, int> segment = stack.takeLast();
+
+    float maxDistance = 0.f;
+    int maxIndex = -1;
+    for(int i = segment.first + 1; i < segment.second; i++)
+    {
+      float dist = segmentDistanceSquared(line.at(i), line.at(segment.first), line.at(segment.second), lonScale);
+      if(dist > maxDistance)
+      {
+        maxDistance = dist;
+        maxIndex = i;
+      }
+    }
+
+    if(maxIndex != -1 && maxDistance > toleranceSquared)
+    {
+      keep[maxIndex] = true;
+      stack.append(qMakePair(segment.first, maxIndex));
+      stack.append(qMakePair(maxIndex, segment.second));
+    }
+  }
+
+  for(int i = 0; i < size; i++)
+  {
+    if(keep.at(i))
+      result.append(line.at(i));
+  }
+}
+
+} // namespace maptools
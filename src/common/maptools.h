@@ -22,6 +22,7 @@
 #include "geo/calculations.h"
 #include "common/mapflags.h"
 #include "geo/pos.h"
+#include "geo/linestring.h"
 
 #include <QList>
 #include <QSet>
@@ -172,6 +173,13 @@ void insertSortedByTowerDistance(const CoordinateConverter& conv, QList<TYPE>& l
   list.insert(it, type);
 }
 
+/*
+ * Simplify a line or polygon using the Douglas-Peucker algorithm. Distances are calculated in degree with the
+ * longitude scaled by the cosine of the latitude. First and last point are always kept.
+ * @param toleranceDeg maximum distance of removed points to the simplified line
+ */
+void simplifyLine(const atools::geo::LineString& line, float toleranceDeg, atools::geo::LineString& result);
+
 } // namespace maptools
 
 #endif // LITTLENAVMAP_MAPTOOLS_H
@@ -0,0 +1,101 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "common/symbolatlas.h"
+
+#include <QPainter>
+#include <QHash>
+
+QAtomicInt SymbolAtlas::globalGeneration;
+
+bool SymbolAtlasKey::operator==(const SymbolAtlasKey& other) const
+{
+  return type == other.type && flags == other.flags && options == other.options && size == other.size &&
+         rotation == other.rotation && color == other.color && ratio == other.ratio &&
+         antialias == other.antialias;
+}
+
+uint qHash(const SymbolAtlasKey& key)
+{
+  return static_cast<uint>(key.type) ^ (key.flags << 4) ^ (key.options << 24) ^ (static_cast<uint>(key.size) << 8) ^
+         (static_cast<uint>(key.rotation) << 16) ^ key.color ^ qHash(static_cast<int>(key.ratio * 100.)) ^
+         static_cast<uint>(key.antialias);
+}
+
+SymbolAtlas::SymbolAtlas()
+{
+  images.setMaxCost(MAX_CACHE_KB);
+  generation = globalGeneration.load();
+}
+
+SymbolAtlas::~SymbolAtlas()
+{
+}
+
+bool SymbolAtlas::isUsable(const QPainter *painter) const
+{
+  return painter->transform().type() <= QTransform::TxTranslate;
+}
+
+void SymbolAtlas::draw(QPainter *painter, float x, float y, SymbolAtlasKey key, int extent,
+                       const PaintFunc& paintFunc)
+{
+  int currentGeneration = globalGeneration.load();
+  if(generation != currentGeneration)
+  {
+    // Colors were changed
+    images.clear();
+    generation = currentGeneration;
+  }
+
+  key.ratio = painter->device()->devicePixelRatioF();
+  key.antialias = painter->testRenderHint(QPainter::Antialiasing);
+
+  // Use an even size to get an integer center
+  extent += extent % 2;
+  QPointF topLeft(x - extent / 2, y - extent / 2);
+
+  QImage *image = images.object(key);
+  if(image != nullptr)
+    painter->drawImage(topLeft, *image);
+  else
+  {
+    image = new QImage(QSize(extent, extent) * key.ratio, QImage::Format_ARGB32_Premultiplied);
+    image->setDevicePixelRatio(key.ratio);
+    image->fill(Qt::transparent);
+
+    QPainter imagePainter(image);
+    imagePainter.setRenderHint(QPainter::Antialiasing, key.antialias);
+    paintFunc(&imagePainter, extent / 2, extent / 2);
+    imagePainter.end();
+
+    painter->drawImage(topLeft, *image);
+
+    // Takes ownership and deletes image if it is too large for the cache
+    images.insert(key, image, image->byteCount() / 1024 + 1);
+  }
+}
+
+void SymbolAtlas::clear()
+{
+  images.clear();
+}
+
+void SymbolAtlas::invalidateAll()
+{
+  globalGeneration.fetchAndAddOrdered(1);
+}
@@ -0,0 +1,90 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_SYMBOLATLAS_H
+#define LITTLENAVMAP_SYMBOLATLAS_H
+
+#include <QAtomicInt>
+#include <QCache>
+#include <QColor>
+#include <QImage>
+
+#include <functional>
+
+class QPainter;
+
+/* Key for a pre-rendered map symbol. All values that change the appearance of a symbol have to be part
+ * of the key. Device pixel ratio and antialiasing are filled in by the atlas. */
+struct SymbolAtlasKey
+{
+  int type; /* Symbol type as defined by the caller */
+  quint32 flags; /* Object flags like airport or VOR type */
+  quint32 options; /* Drawing options like route fill or fast */
+  int size;
+  int rotation; /* Degree */
+  QRgb color;
+  qreal ratio;
+  bool antialias;
+
+  bool operator==(const SymbolAtlasKey& other) const;
+};
+
+uint qHash(const SymbolAtlasKey& key);
+
+/*
+ * Cache of pre-rendered map symbols. Symbols are painted once into an image and are drawn as images
+ * afterwards. Images are used instead of pixmaps since symbols are also drawn in render threads.
+ *
+ * Colors are not completely covered by the key. Therefore all atlases are cleared on the next use
+ * after invalidateAll is called. Not thread safe except for invalidateAll.
+ */
+class SymbolAtlas
+{
+public:
+  /* Function painting a symbol centered at x and y */
+  typedef std::function<void (QPainter *painter, int x, int y)> PaintFunc;
+
+  SymbolAtlas();
+  ~SymbolAtlas();
+
+  /* true if the painter can use the atlas. Symbols would be blurry for scaled painters. */
+  bool isUsable(const QPainter *painter) const;
+
+  /*
+   * Draw symbol centered at x and y. Calls paintFunc to create the image if it is not cached.
+   * @param extent Width and height of the image in logical pixels. Must cover the symbol including pen widths.
+   */
+  void draw(QPainter *painter, float x, float y, SymbolAtlasKey key, int extent, const PaintFunc& paintFunc);
+
+  void clear();
+
+  /* Clear all atlases, e.g. if colors were changed in options */
+  static void invalidateAll();
+
+private:
+  /* Cache cost is image size in kB */
+  QCache<SymbolAtlasKey, QImage> images;
+
+  /* Cleared if different from globalGeneration */
+  int generation = 0;
+  static QAtomicInt globalGeneration;
+
+  /* Maximum size of all images in kB */
+  static Q_DECL_CONSTEXPR int MAX_CACHE_KB = 4096;
+};
+
+#endif // LITTLENAVMAP_SYMBOLATLAS_H
@@ -22,6 +22,9 @@
 #include "common/mapcolors.h"
 #include "options/optiondata.h"
 #include "common/unit.h"
+#include "common/labelgrid.h"
+#include "common/textspritecache.h"
+#include "common/symbolatlas.h"
 #include "geo/calculations.h"
 #include "util/paintercontextsaver.h"
 
@@ -130,6 +133,30 @@ QIcon SymbolPainter::createAirspaceIcon(const map::MapAirspace& airspace, int si
 
 void SymbolPainter::drawAirportSymbol(QPainter *painter, const map::MapAirport& airport,
                                       float x, float y, int size, bool isAirportDiagram, bool fast)
+{
+  if(symbolAtlas != nullptr && symbolAtlas->isUsable(painter))
+  {
+    SymbolAtlasKey key = {};
+    key.type = SYMBOL_AIRPORT;
+    key.flags = static_cast<quint32>(airport.flags);
+    key.options = isAirportDiagram | fast << 1 | (airport.longestRunwayLength == 0) << 2;
+    key.size = size;
+    key.rotation = airport.flags.testFlag(map::AP_HARD) ? airport.longestRunwayHeading : 0;
+    key.color = mapcolors::colorForAirport(airport).rgba();
+
+    // Covers fuel spikes
+    symbolAtlas->draw(painter, x, y, key, size * 2 + 8, [this, &airport, size, isAirportDiagram, fast]
+                        (QPainter *imagePainter, int xc, int yc) -> void
+                      {
+                        paintAirportSymbol(imagePainter, airport, xc, yc, size, isAirportDiagram, fast);
+                      });
+  }
+  else
+    paintAirportSymbol(painter, airport, x, y, size, isAirportDiagram, fast);
+}
+
+void SymbolPainter::paintAirportSymbol(QPainter *painter, const map::MapAirport& airport,
+                                       float x, float y, int size, bool isAirportDiagram, bool fast)
 {
   if(airport.longestRunwayLength == 0)
     size = size * 4 / 5;
@@ -222,6 +249,27 @@ void SymbolPainter::drawAirportSymbol(QPainter *painter, const map::MapAirport&
 
 void SymbolPainter::drawWaypointSymbol(QPainter *painter, const QColor& col, int x, int y, int size,
                                        bool fill, bool fast)
+{
+  if(symbolAtlas != nullptr && symbolAtlas->isUsable(painter))
+  {
+    SymbolAtlasKey key = {};
+    key.type = SYMBOL_WAYPOINT;
+    key.options = fill | fast << 1;
+    key.size = size;
+    key.color = col.isValid() ? col.rgba() : 0;
+
+    symbolAtlas->draw(painter, x, y, key, size + 10, [this, &col, size, fill, fast]
+                        (QPainter *imagePainter, int xc, int yc) -> void
+                      {
+                        paintWaypointSymbol(imagePainter, col, xc, yc, size, fill, fast);
+                      });
+  }
+  else
+    paintWaypointSymbol(painter, col, x, y, size, fill, fast);
+}
+
+void SymbolPainter::paintWaypointSymbol(QPainter *painter, const QColor& col, int x, int y, int size,
+                                        bool fill, bool fast)
 {
   atools::util::PainterContextSaver saver(painter);
   painter->setBackgroundMode(Qt::TransparentMode);
@@ -355,6 +403,28 @@ void SymbolPainter::drawAircraftSymbol(QPainter *painter, int x, int y, int size
 
 void SymbolPainter::drawVorSymbol(QPainter *painter, const map::MapVor& vor, int x, int y, int size,
                                   bool routeFill, bool fast, int largeSize)
+{
+  // Compass rose is rotated by magnetic variation and is not cached
+  if(symbolAtlas != nullptr && symbolAtlas->isUsable(painter) && largeSize == 0)
+  {
+    SymbolAtlasKey key = {};
+    key.type = SYMBOL_VOR;
+    key.flags = vor.tacan | vor.vortac << 1 | vor.hasDme << 2 | vor.dmeOnly << 3;
+    key.options = routeFill | fast << 1;
+    key.size = size;
+
+    symbolAtlas->draw(painter, x, y, key, size + 12, [this, &vor, size, routeFill, fast]
+                        (QPainter *imagePainter, int xc, int yc) -> void
+                      {
+                        paintVorSymbol(imagePainter, vor, xc, yc, size, routeFill, fast, 0);
+                      });
+  }
+  else
+    paintVorSymbol(painter, vor, x, y, size, routeFill, fast, largeSize);
+}
+
+void SymbolPainter::paintVorSymbol(QPainter *painter, const map::MapVor& vor, int x, int y, int size,
+                                   bool routeFill, bool fast, int largeSize)
 {
   atools::util::PainterContextSaver saver(painter);
   Q_UNUSED(saver);
@@ -494,6 +564,25 @@ void SymbolPainter::drawVorSymbol(QPainter *painter, const map::MapVor& vor, int
 }
 
 void SymbolPainter::drawNdbSymbol(QPainter *painter, int x, int y, int size, bool routeFill, bool fast)
+{
+  if(symbolAtlas != nullptr && symbolAtlas->isUsable(painter))
+  {
+    SymbolAtlasKey key = {};
+    key.type = SYMBOL_NDB;
+    key.options = routeFill | fast << 1;
+    key.size = size;
+
+    symbolAtlas->draw(painter, x, y, key, size + 10, [this, size, routeFill, fast]
+                        (QPainter *imagePainter, int xc, int yc) -> void
+                      {
+                        paintNdbSymbol(imagePainter, xc, yc, size, routeFill, fast);
+                      });
+  }
+  else
+    paintNdbSymbol(painter, x, y, size, routeFill, fast);
+}
+
+void SymbolPainter::paintNdbSymbol(QPainter *painter, int x, int y, int size, bool routeFill, bool fast)
 {
   atools::util::PainterContextSaver saver(painter);
   float sizeF = static_cast<float>(size);
@@ -553,7 +642,7 @@ void SymbolPainter::drawMarkerSymbol(QPainter *painter, const map::MapMarker& ma
 
 void SymbolPainter::drawNdbText(QPainter *painter, const map::MapNdb& ndb, int x, int y,
                                 textflags::TextFlags flags, int size, bool fill,
-                                const QStringList *addtionalText)
+                                const QStringList *addtionalText, LabelGrid *labelGrid)
 {
   QStringList texts;
 
@@ -569,22 +658,32 @@ void SymbolPainter::drawNdbText(QPainter *painter, const map::MapNdb& ndb, int x
   if(flags & textflags::ROUTE_TEXT)
     textAttrs |= textatt::ROUTE_BG_COLOR;
 
+  float xt = x, yt = y;
+  QVector<TextBoxPos> alternatives;
   if(!flags.testFlag(textflags::ABS_POS))
   {
-    y += size / 2 + painter->fontMetrics().ascent();
+    int offset = size / 2 + painter->fontMetrics().ascent();
+    yt += offset;
     textAttrs |= textatt::CENTER;
+
+    // Above the symbol
+    alternatives.append({xt, static_cast<float>(y - offset), textatt::CENTER});
   }
 
   if(addtionalText != nullptr)
     texts.append(*addtionalText);
 
+  if(!placeTextBox(painter, labelGrid, texts, textAttrs, xt, yt, alternatives,
+                  flags.testFlag(textflags::ROUTE_TEXT)))
+    return;
+
   int transparency = fill ? 255 : 0;
-  textBox(painter, texts, mapcolors::ndbSymbolColor, x, y, textAttrs, transparency);
+  textBoxF(painter, texts, mapcolors::ndbSymbolColor, xt, yt, textAttrs, transparency);
 }
 
 void SymbolPainter::drawVorText(QPainter *painter, const map::MapVor& vor, int x, int y,
                                 textflags::TextFlags flags, int size, bool fill,
-                                const QStringList *addtionalText)
+                                const QStringList *addtionalText, LabelGrid *labelGrid)
 {
   QStringList texts;
 
@@ -605,22 +704,31 @@ void SymbolPainter::drawVorText(QPainter *painter, const map::MapVor& vor, int x
   if(flags & textflags::ROUTE_TEXT)
     textAttrs |= textatt::ROUTE_BG_COLOR;
 
+  float xt = x, yt = y;
+  QVector<TextBoxPos> alternatives;
   if(!flags.testFlag(textflags::ABS_POS))
   {
-    x -= size / 2 + 2;
+    xt -= size / 2 + 2;
     textAttrs |= textatt::RIGHT;
+
+    // Right of the symbol
+    alternatives.append({static_cast<float>(x + size / 2 + 2), yt, textatt::LEFT});
   }
 
   if(addtionalText != nullptr)
     texts.append(*addtionalText);
 
+  if(!placeTextBox(painter, labelGrid, texts, textAttrs, xt, yt, alternatives,
+                  flags.testFlag(textflags::ROUTE_TEXT)))
+    return;
+
   int transparency = fill ? 255 : 0;
-  textBox(painter, texts, mapcolors::vorSymbolColor, x, y, textAttrs, transparency);
+  textBoxF(painter, texts, mapcolors::vorSymbolColor, xt, yt, textAttrs, transparency);
 }
 
 void SymbolPainter::drawWaypointText(QPainter *painter, const map::MapWaypoint& wp, int x, int y,
                                      textflags::TextFlags flags, int size, bool fill,
-                                     const QStringList *addtionalText)
+                                     const QStringList *addtionalText, LabelGrid *labelGrid)
 {
   QStringList texts;
 
@@ -631,22 +739,31 @@ void SymbolPainter::drawWaypointText(QPainter *painter, const map::MapWaypoint&
   if(flags & textflags::ROUTE_TEXT)
     textAttrs |= textatt::ROUTE_BG_COLOR;
 
+  float xt = x, yt = y;
+  QVector<TextBoxPos> alternatives;
   if(!flags.testFlag(textflags::ABS_POS))
   {
-    x += size / 2 + 2;
+    xt += size / 2 + 2;
     textAttrs |= textatt::LEFT;
+
+    // Left of the symbol
+    alternatives.append({static_cast<float>(x - size / 2 - 2), yt, textatt::RIGHT});
   }
 
   if(addtionalText != nullptr)
     texts.append(*addtionalText);
 
+  if(!placeTextBox(painter, labelGrid, texts, textAttrs, xt, yt, alternatives,
+                  flags.testFlag(textflags::ROUTE_TEXT)))
+    return;
+
   int transparency = fill ? 255 : 0;
-  textBox(painter, texts, mapcolors::waypointSymbolColor, x, y, textAttrs, transparency);
+  textBoxF(painter, texts, mapcolors::waypointSymbolColor, xt, yt, textAttrs, transparency);
 }
 
 void SymbolPainter::drawAirportText(QPainter *painter, const map::MapAirport& airport, float x, float y,
                                     opts::DisplayOptions dispOpts, textflags::TextFlags flags, int size,
-                                    bool diagram)
+                                    bool diagram, LabelGrid *labelGrid)
 {
   QStringList texts = airportTexts(dispOpts, flags, airport);
   if(!texts.isEmpty())
@@ -662,10 +779,21 @@ void SymbolPainter::drawAirportText(QPainter *painter, const map::MapAirport& ai
     if(airport.empty() && OptionData::instance().getFlags() & opts::MAP_EMPTY_AIRPORTS)
       transparency = 0;
 
+    float xt = x;
+    QVector<TextBoxPos> alternatives;
     if(!flags.testFlag(textflags::ABS_POS))
-      x += size + 2.f;
+    {
+      xt += size + 2.f;
 
-    textBoxF(painter, texts, mapcolors::colorForAirport(airport), x, y, atts, transparency);
+      // Left of the symbol
+      alternatives.append({x - size - 2.f, y, textatt::RIGHT});
+    }
+
+    if(!placeTextBox(painter, labelGrid, texts, atts, xt, y, alternatives,
+                     flags.testFlag(textflags::ROUTE_TEXT)))
+      return;
+
+    textBoxF(painter, texts, mapcolors::colorForAirport(airport), xt, y, atts, transparency);
   }
 }
 
@@ -790,7 +918,10 @@ void SymbolPainter::textBoxF(QPainter *painter, const QStringList& texts, const
     else if(atts.testFlag(textatt::CENTER))
       newx -= w / 2.f;
 
-    painter->drawText(QPointF(newx, y + yoffset), text);
+    if(textCache != nullptr)
+      textCache->drawText(painter, QPointF(newx, y + yoffset), text);
+    else
+      painter->drawText(QPointF(newx, y + yoffset), text);
     yoffset -= h;
   }
 }
@@ -837,6 +968,53 @@ QRect SymbolPainter::textBoxSize(QPainter *painter, const QStringList& texts, te
   return retval;
 }
 
+bool SymbolPainter::placeTextBox(QPainter *painter, LabelGrid *labelGrid, const QStringList& texts,
+                                 textatt::TextAttributes& atts, float& x, float& y,
+                                 const QVector<TextBoxPos>& alternatives, bool force)
+{
+  if(labelGrid == nullptr || texts.isEmpty())
+    return true;
+
+  const textatt::TextAttributes ALIGN = textatt::RIGHT | textatt::LEFT | textatt::CENTER;
+
+  // Get size once for left alignment and move the rectangle for the other alignments
+  QRectF size = textBoxSize(painter, texts, atts & ~ALIGN);
+  QVector<TextBoxPos> positions;
+  positions.append({x, y, atts & ALIGN});
+  positions.append(alternatives);
+
+  for(const TextBoxPos& pos : positions)
+  {
+    float left = pos.x;
+    if(pos.align.testFlag(textatt::RIGHT))
+      left -= size.width();
+    else if(pos.align.testFlag(textatt::CENTER))
+      left -= size.width() / 2.f;
+
+    // Text box is vertically centered at y
+    if(labelGrid->tryInsert(QRectF(left, pos.y - size.height() / 2., size.width(), size.height())))
+    {
+      x = pos.x;
+      y = pos.y;
+      atts = (atts & ~ALIGN) | pos.align;
+      return true;
+    }
+  }
+
+  if(force)
+  {
+    // Keep position but let other labels avoid this one
+    float left = x;
+    if(atts.testFlag(textatt::RIGHT))
+      left -= size.width();
+    else if(atts.testFlag(textatt::CENTER))
+      left -= size.width() / 2.f;
+    labelGrid->insert(QRectF(left, y - size.height() / 2., size.width(), size.height()));
+    return true;
+  }
+  return false;
+}
+
 const QPixmap *SymbolPainter::windPointerFromCache(int size)
 {
   if(windPointerPixmaps.contains(size))
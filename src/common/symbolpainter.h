@@ -24,9 +24,13 @@
 #include <QIcon>
 #include <QApplication>
 #include <QCache>
+#include <QVector>
 
 class QPainter;
 class QPen;
+class LabelGrid;
+class TextSpriteCache;
+class SymbolAtlas;
 
 namespace Marble {
 class GeoPainter;
@@ -116,7 +120,8 @@ public:
   void drawAirportSymbol(QPainter *painter, const map::MapAirport& airport, float x, float y, int size,
                          bool isAirportDiagram, bool fast);
   void drawAirportText(QPainter *painter, const map::MapAirport& airport, float x, float y,
-                       opts::DisplayOptions dispOpts, textflags::TextFlags flags, int size, bool diagram);
+                       opts::DisplayOptions dispOpts, textflags::TextFlags flags, int size, bool diagram,
+                       LabelGrid *labelGrid = nullptr);
 
   /* Waypoint symbol. Can use a different color for invalid waypoints that were not found in the database */
   void drawWaypointSymbol(QPainter *painter, const QColor& col, int x, int y, int size, bool fill, bool fast);
@@ -127,10 +132,11 @@ public:
   /* Aircraft track */
   void drawTrackLine(QPainter *painter, float x, float y, int size, float dir);
 
-  /* Waypoint texts have no background excepts for flight plan */
+  /* Waypoint texts have no background excepts for flight plan.
+   * Text is moved or omitted if it overlaps a label in the optional label grid. */
   void drawWaypointText(QPainter *painter, const map::MapWaypoint& wp, int x, int y,
                         textflags::TextFlags flags, int size, bool fill,
-                        const QStringList *addtionalText = nullptr);
+                        const QStringList *addtionalText = nullptr, LabelGrid *labelGrid = nullptr);
 
   /* VOR with large size has a ring with compass ticks. For VORs part of the route the interior is filled.  */
   void drawVorSymbol(QPainter *painter, const map::MapVor& vor, int x, int y, int size, bool routeFill,
@@ -138,14 +144,16 @@ public:
 
   /* VOR texts have no background excepts for flight plan */
   void drawVorText(QPainter *painter, const map::MapVor& vor, int x, int y, textflags::TextFlags flags,
-                   int size, bool fill, const QStringList *addtionalText = nullptr);
+                   int size, bool fill, const QStringList *addtionalText = nullptr,
+                   LabelGrid *labelGrid = nullptr);
 
   /* NDB with dotted rings or solid rings depending on size. For NDBs part of the route the interior is filled.  */
   void drawNdbSymbol(QPainter *painter, int x, int y, int size, bool routeFill, bool fast);
 
   /* NDB texts have no background excepts for flight plan */
   void drawNdbText(QPainter *painter, const map::MapNdb& ndb, int x, int y, textflags::TextFlags flags,
-                   int size, bool fill, const QStringList *addtionalText = nullptr);
+                   int size, bool fill, const QStringList *addtionalText = nullptr,
+                   LabelGrid *labelGrid = nullptr);
 
   void drawMarkerSymbol(QPainter *painter, const map::MapMarker& marker, int x, int y, int size,
                         bool fast);
@@ -171,7 +179,51 @@ public:
   /* Get dimensions of a custom text box */
   QRect textBoxSize(QPainter *painter, const QStringList& texts, textatt::TextAttributes atts);
 
+  /* Airport, VOR, NDB and waypoint symbols are drawn using pre-rendered images from the atlas if set.
+   * Does not take ownership. */
+  void setSymbolAtlas(SymbolAtlas *value)
+  {
+    symbolAtlas = value;
+  }
+
+  /* Text boxes are drawn using pre-rendered images from the cache if set. Does not take ownership. */
+  void setTextCache(TextSpriteCache *value)
+  {
+    textCache = value;
+  }
+
 private:
+  /* Symbol types for the atlas key */
+  enum SymbolType
+  {
+    SYMBOL_AIRPORT,
+    SYMBOL_VOR,
+    SYMBOL_NDB,
+    SYMBOL_WAYPOINT
+  };
+
+  /* Vector drawing for the symbols */
+  void paintAirportSymbol(QPainter *painter, const map::MapAirport& airport, float x, float y, int size,
+                          bool isAirportDiagram, bool fast);
+  void paintWaypointSymbol(QPainter *painter, const QColor& col, int x, int y, int size, bool fill, bool fast);
+  void paintVorSymbol(QPainter *painter, const map::MapVor& vor, int x, int y, int size, bool routeFill,
+                      bool fast, int largeSize);
+  void paintNdbSymbol(QPainter *painter, int x, int y, int size, bool routeFill, bool fast);
+
+  /* Alternative position and alignment for a text box */
+  struct TextBoxPos
+  {
+    float x, y;
+    textatt::TextAttributes align;
+  };
+
+  /* Find a free position for a text box in the label grid and mark it as occupied. The given position is tried
+   * first and then all alternatives. x, y and the alignment in atts are changed to the free position.
+   * Returns false if all positions overlap other labels. force places the text at the given position in this case. */
+  bool placeTextBox(QPainter *painter, LabelGrid *labelGrid, const QStringList& texts,
+                    textatt::TextAttributes& atts, float& x, float& y,
+                    const QVector<TextBoxPos>& alternatives, bool force);
+
   QStringList airportTexts(opts::DisplayOptions dispOpts, textflags::TextFlags flags,
                            const map::MapAirport& airport);
   const QPixmap *windPointerFromCache(int size);
@@ -179,6 +231,8 @@ private:
 
   QColor iconBackground;
   QCache<int, QPixmap> windPointerPixmaps, trackLinePixmaps;
+  TextSpriteCache *textCache = nullptr;
+  SymbolAtlas *symbolAtlas = nullptr;
   void prepareForIcon(QPainter& painter);
 
 };
@@ -17,12 +17,15 @@
 
 #include "common/coordinateconverter.h"
 #include "common/textplacement.h"
+#include "common/labelgrid.h"
+#include "common/textspritecache.h"
 
 #include "geo/line.h"
 #include "geo/calculations.h"
 #include "geo/linestring.h"
 
 #include <QPainter>
+#include <QTransform>
 
 using atools::geo::Line;
 using atools::geo::Pos;
@@ -150,7 +153,10 @@ void TextPlacement::drawTextAlongOneLine(const QString& text, float bearing,
     painter->rotate(rotate);
 
     QPointF textPos(-metrics.width(newText) / 2.f, yoffset);
-    painter->drawText(textPos, newText);
+    if(textCache != nullptr)
+      textCache->drawText(painter, textPos, newText);
+    else
+      painter->drawText(textPos, newText);
     painter->resetTransform();
   }
 }
@@ -184,69 +190,57 @@ bool TextPlacement::findTextPos(const Pos& pos1, const Pos& pos2, float distance
                                 int textWidth, int textHeight, int& x, int& y, float *bearing)
 {
   int size = std::max(textWidth, textHeight);
-  Pos center = pos1.interpolate(pos2, distanceMeter, 0.5);
-  bool visible = converter->wToS(center, x, y);
-  if(visible && painter->window().contains(QRect(x - size / 2, y - size / 2, size, size)))
-  {
-    // Center point is already visible
-    if(bearing != nullptr)
-    {
-      // Calculate bearing at the center point
-      float xtp1, ytp1, xtp2, ytp2;
-      converter->wToS(pos1.interpolate(pos2, 0.5f - FIND_TEXT_POS_STEP), xtp1, ytp1);
-      converter->wToS(pos1.interpolate(pos2, 0.5f + FIND_TEXT_POS_STEP), xtp2, ytp2);
-      QLineF lineF(xtp1, ytp1, xtp2, ytp2);
 
-      *bearing = static_cast<float>(atools::geo::normalizeCourse(-lineF.angle() + 270.f));
-    }
-    return true;
-  }
-  else
+  // Check for 50 positions along the line starting at the center position and moving outwards
+  for(float i = 0.; i <= 0.5; i += FIND_TEXT_POS_STEP)
   {
-    int x1, y1, x2, y2;
-    // Check for 50 positions along the line starting below and above the center position
-    for(float i = 0.; i <= 0.5; i += FIND_TEXT_POS_STEP)
+    for(float fraction : {0.5f - i, 0.5f + i})
     {
-      center = pos1.interpolate(pos2, distanceMeter, 0.5f - i);
-      visible = converter->wToS(center, x1, y1);
-      if(visible && painter->window().contains(QRect(x1 - size / 2, y1 - size / 2, size, size)))
+      int xt, yt;
+      Pos center = pos1.interpolate(pos2, distanceMeter, fraction);
+      bool visible = converter->wToS(center, xt, yt);
+      if(visible && painter->window().contains(QRect(xt - size / 2, yt - size / 2, size, size)))
       {
-        // Point is visible - return
-        if(bearing != nullptr)
+        float brg = 0.f;
+        if(bearing != nullptr || labelGrid != nullptr)
+          brg = bearingAt(pos1, pos2, fraction);
+
+        if(labelGrid != nullptr)
         {
-          float xtp1, ytp1, xtp2, ytp2;
-          converter->wToS(pos1.interpolate(pos2, 0.5f - i - FIND_TEXT_POS_STEP), xtp1, ytp1);
-          converter->wToS(pos1.interpolate(pos2, 0.5f - i + FIND_TEXT_POS_STEP), xtp2, ytp2);
-          QLineF lineF(xtp1, ytp1, xtp2, ytp2);
-          *bearing = static_cast<float>(atools::geo::normalizeCourse(-lineF.angle() + 270.f));
+          // Text is centered and rotated along the line
+          QTransform transform;
+          transform.translate(xt, yt);
+          transform.rotate(brg - 90.f);
+          if(!labelGrid->tryInsert(QRectF(-textWidth / 2., -textHeight / 2., textWidth, textHeight), transform))
+            // Overlaps other labels - try next position
+            continue;
         }
-        x = x1;
-        y = y1;
-        return true;
-      }
 
-      center = pos1.interpolate(pos2, distanceMeter, 0.5f + i);
-      visible = converter->wToS(center, x2, y2);
-      if(visible && painter->window().contains(QRect(x2 - size / 2, y2 - size / 2, size, size)))
-      {
         // Point is visible - return
         if(bearing != nullptr)
-        {
-          float xtp1, ytp1, xtp2, ytp2;
-          converter->wToS(pos1.interpolate(pos2, 0.5f + i - FIND_TEXT_POS_STEP), xtp1, ytp1);
-          converter->wToS(pos1.interpolate(pos2, 0.5f + i + FIND_TEXT_POS_STEP), xtp2, ytp2);
-          QLineF lineF(xtp1, ytp1, xtp2, ytp2);
-          *bearing = static_cast<float>(atools::geo::normalizeCourse(-lineF.angle() + 270.f));
-        }
-        x = x2;
-        y = y2;
+          *bearing = brg;
+        x = xt;
+        y = yt;
         return true;
       }
+
+      if(i == 0.f)
+        // Center position needs only one check
+        break;
     }
   }
   return false;
 }
 
+float TextPlacement::bearingAt(const Pos& pos1, const Pos& pos2, float fraction)
+{
+  float xtp1, ytp1, xtp2, ytp2;
+  converter->wToS(pos1.interpolate(pos2, fraction - FIND_TEXT_POS_STEP), xtp1, ytp1);
+  converter->wToS(pos1.interpolate(pos2, fraction + FIND_TEXT_POS_STEP), xtp2, ytp2);
+  QLineF lineF(xtp1, ytp1, xtp2, ytp2);
+  return static_cast<float>(atools::geo::normalizeCourse(-lineF.angle() + 270.f));
+}
+
 bool TextPlacement::findTextPosRhumb(const Pos& pos1, const Pos& pos2,
                                      float distanceMeter, int textWidth, int textHeight, int& x, int& y)
 {
@@ -36,6 +36,8 @@ class Pos;
 
 class QPainter;
 class CoordinateConverter;
+class LabelGrid;
+class TextSpriteCache;
 
 /* Contains methods for text placement along line strings. */
 class TextPlacement
@@ -61,7 +63,8 @@ public:
   void drawTextAlongOneLine(const QString& text, float bearing, const QPointF& textCoord,
                             bool bothVisible, int textLineLength);
 
-  /* Find text position along a great circle route
+  /* Find text position along a great circle route. Positions where the text overlaps a label in the label grid
+   *  are skipped if a grid is set. The found position is added to the grid.
    *  @param x,y resulting text position
    *  @param pos1,pos2 start and end coordinates of the line
    *  @param bearing text bearing at the returned position
@@ -127,6 +130,18 @@ public:
     lineWidth = value;
   }
 
+  /* Optional label grid for collision detection in findTextPos. Not used if null which is the default. */
+  void setLabelGrid(LabelGrid *value)
+  {
+    labelGrid = value;
+  }
+
+  /* Optional cache for pre-rendered texts used by drawTextAlongLines. Not used if null which is the default. */
+  void setTextCache(TextSpriteCache *value)
+  {
+    textCache = value;
+  }
+
   /* Set an array of colors with the same size as lines in calculateTextAlongLines */
   void setColors(const QVector<QColor>& value)
   {
@@ -134,6 +149,9 @@ public:
   }
 
 private:
+  /* Bearing of a great circle line at the given fraction */
+  float bearingAt(const atools::geo::Pos& pos1, const atools::geo::Pos& pos2, float fraction);
+
   QList<QPointF> textCoords;
   QList<float> textBearing;
   QStringList texts;
@@ -152,6 +170,8 @@ private:
   bool fast = false, textOnTopOfLine = true;
   QPainter *painter = nullptr;
   CoordinateConverter *converter = nullptr;
+  LabelGrid *labelGrid = nullptr;
+  TextSpriteCache *textCache = nullptr;
   QString arrowRight, arrowLeft;
   float lineWidth = 10.f;
   QVector<QColor> colors;
@@ -0,0 +1,111 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "common/textspritecache.h"
+
+#include <QPainter>
+#include <QHash>
+
+bool TextSpriteKey::operator==(const TextSpriteKey& other) const
+{
+  return text == other.text && color == other.color && background == other.background &&
+         antialias == other.antialias && ratio == other.ratio && font == other.font;
+}
+
+uint qHash(const TextSpriteKey& key)
+{
+  return qHash(key.text) ^ qHash(key.font) ^ key.color ^ (key.background << 1) ^
+         static_cast<uint>(key.antialias) ^ qHash(static_cast<int>(key.ratio * 100.));
+}
+
+TextSpriteCache::TextSpriteCache()
+{
+  sprites.setMaxCost(MAX_CACHE_KB);
+}
+
+TextSpriteCache::~TextSpriteCache()
+{
+}
+
+void TextSpriteCache::drawText(QPainter *painter, const QPointF& pos, const QString& text)
+{
+  if(text.isEmpty())
+    return;
+
+  if(painter->transform().type() > QTransform::TxTranslate)
+  {
+    // Image would be scaled or rotated and look blurry or jagged - draw text directly
+    painter->drawText(pos, text);
+    return;
+  }
+
+  TextSpriteKey key;
+  key.text = text;
+  key.font = painter->font();
+  key.color = painter->pen().color().rgba();
+  key.background = painter->backgroundMode() == Qt::OpaqueMode ? painter->background().color().rgba() : 0;
+  key.antialias = painter->testRenderHint(QPainter::TextAntialiasing);
+  key.ratio = painter->device()->devicePixelRatioF();
+
+  Sprite *sprite = sprites.object(key);
+  if(sprite != nullptr)
+    painter->drawImage(pos + sprite->offset, sprite->image);
+  else
+  {
+    sprite = createSprite(painter, key);
+    painter->drawImage(pos + sprite->offset, sprite->image);
+
+    // Takes ownership and deletes sprite if it is too large for the cache
+    sprites.insert(key, sprite, sprite->image.byteCount() / 1024 + 1);
+  }
+}
+
+void TextSpriteCache::clear()
+{
+  sprites.clear();
+}
+
+TextSpriteCache::Sprite *TextSpriteCache::createSprite(QPainter *painter, const TextSpriteKey& key)
+{
+  QFontMetricsF metrics(painter->fontMetrics());
+
+  // Background rectangle as filled by QPainter::drawText in opaque mode
+  QRectF textRect(0., -metrics.ascent(), metrics.width(key.text), metrics.ascent() + metrics.descent());
+
+  // Glyphs of italic text can extend the background rectangle
+  QRect bounds = metrics.boundingRect(key.text).united(textRect).adjusted(-1., -1., 1., 1.).toAlignedRect();
+
+  Sprite *sprite = new Sprite;
+  sprite->offset = bounds.topLeft();
+  sprite->image = QImage(bounds.size() * key.ratio, QImage::Format_ARGB32_Premultiplied);
+  sprite->image.setDevicePixelRatio(key.ratio);
+  sprite->image.fill(Qt::transparent);
+
+  QPainter imagePainter(&sprite->image);
+  imagePainter.setRenderHint(QPainter::TextAntialiasing, key.antialias);
+  imagePainter.setFont(key.font);
+  imagePainter.translate(-bounds.topLeft());
+
+  if(key.background != 0)
+    imagePainter.fillRect(textRect, QColor::fromRgba(key.background));
+
+  imagePainter.setPen(QColor::fromRgba(key.color));
+  imagePainter.drawText(QPointF(0., 0.), key.text);
+  imagePainter.end();
+
+  return sprite;
+}
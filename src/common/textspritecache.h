@@ -0,0 +1,77 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_TEXTSPRITECACHE_H
+#define LITTLENAVMAP_TEXTSPRITECACHE_H
+
+#include <QCache>
+#include <QFont>
+#include <QImage>
+#include <QPointF>
+
+class QPainter;
+
+/* Key for a pre-rendered text. Background is 0 for transparent background mode. */
+struct TextSpriteKey
+{
+  QString text;
+  QFont font;
+  QRgb color, background;
+  bool antialias;
+  qreal ratio;
+
+  bool operator==(const TextSpriteKey& other) const;
+};
+
+uint qHash(const TextSpriteKey& key);
+
+/*
+ * Cache for pre-rendered map texts. Texts are rendered once into an image using font, pen color and
+ * background of the painter and are drawn as images afterwards.
+ *
+ * Images are used instead of pixmaps since texts are also drawn in render threads. Not thread safe.
+ */
+class TextSpriteCache
+{
+public:
+  TextSpriteCache();
+  ~TextSpriteCache();
+
+  /* Draw text with the baseline starting at pos like QPainter::drawText. Uses font, pen color, background mode,
+   * background color and text antialiasing of the painter. Falls back to QPainter::drawText for
+   * rotated, scaled or projected painters. */
+  void drawText(QPainter *painter, const QPointF& pos, const QString& text);
+
+  void clear();
+
+private:
+  struct Sprite
+  {
+    QImage image;
+    QPoint offset; /* Top left corner of the image relative to the text baseline start */
+  };
+
+  Sprite *createSprite(QPainter *painter, const TextSpriteKey& key);
+
+  /* Cache cost is image size in kB */
+  QCache<TextSpriteKey, Sprite> sprites;
+
+  /* Maximum size of all images in kB */
+  static Q_DECL_CONSTEXPR int MAX_CACHE_KB = 4096;
+};
+
+#endif // LITTLENAVMAP_TEXTSPRITECACHE_H
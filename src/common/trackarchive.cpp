@@ -0,0 +1,421 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "common/trackarchive.h"
+
+#include "common/aircrafttrack.h"
+#include "common/constants.h"
+#include "settings/settings.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/* Write value as zigzag encoded variable length integer. Small negative and positive values need one byte. */
+void writeVarint(QByteArray& out, qint64 value)
+{
+  quint64 zigzag = (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63);
+  while(zigzag >= 0x80)
+  {
+    out.append(static_cast<char>((zigzag & 0x7f) | 0x80));
+    zigzag >>= 7;
+  }
+  out.append(static_cast<char>(zigzag));
+}
+
+bool readVarint(const uchar *& data, const uchar *end, qint64& value)
+{
+  quint64 zigzag = 0;
+  for(int shift = 0; shift < 64 && data < end; shift += 7)
+  {
+    uchar byte = *data++;
+    zigzag |= static_cast<quint64>(byte & 0x7f) << shift;
+    if((byte & 0x80) == 0)
+    {
+      value = static_cast<qint64>(zigzag >> 1) ^ -static_cast<qint64>(zigzag & 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Write one column as differences to the previous value */
+template<typename FUNC>
+void writeColumn(QByteArray& out, const QVector<at::AircraftTrackPos>& positions, FUNC func)
+{
+  qint64 last = 0;
+  for(const at::AircraftTrackPos& trackPos : positions)
+  {
+    qint64 value = func(trackPos);
+    writeVarint(out, value - last);
+    last = value;
+  }
+}
+
+/* Read one column and sum up the differences */
+bool readColumn(const uchar *& data, const uchar *end, QVector<qint64>& column)
+{
+  qint64 value = 0;
+  for(int i = 0; i < column.size(); i++)
+  {
+    qint64 delta;
+    if(!readVarint(data, end, delta))
+      return false;
+    value += delta;
+    column[i] = value;
+  }
+  return true;
+}
+
+}
+
+TrackArchive::TrackArchive()
+{
+  archiveDir = atools::settings::Settings::getPath() + QDir::separator() + lnm::TRACK_ARCHIVE_DIR;
+  indexFilename = archiveDir + QDir::separator() + "little_navmap_tracks.idx";
+  pool.setMaxThreadCount(1);
+}
+
+TrackArchive::~TrackArchive()
+{
+  waitForArchive();
+}
+
+void TrackArchive::archiveTrack(const QVector<at::AircraftTrackPos>& positions)
+{
+  if(positions.size() < MIN_ARCHIVE_POSITIONS)
+    return;
+
+  // Compression and index update can take a while for long flights
+  QtConcurrent::run(&pool, [this, positions]() -> void
+    {
+      writeTrack(positions);
+    });
+}
+
+void TrackArchive::waitForArchive()
+{
+  pool.waitForDone();
+}
+
+bool TrackArchive::writeTrack(const QVector<at::AircraftTrackPos>& positions)
+{
+  if(!QDir().mkpath(archiveDir))
+  {
+    qWarning() << "Cannot create track archive" << archiveDir;
+    return false;
+  }
+
+  at::TrackArchiveEntry entry;
+  entry.start = QDateTime::fromTime_t(positions.first().timestamp, Qt::UTC);
+  entry.end = QDateTime::fromTime_t(positions.last().timestamp, Qt::UTC);
+  entry.numPositions = positions.size();
+  entry.maxAltitude = 0.f;
+  entry.bounding = atools::geo::Rect(positions.first().pos);
+  for(const at::AircraftTrackPos& trackPos : positions)
+  {
+    entry.maxAltitude = std::max(entry.maxAltitude, trackPos.pos.getAltitude());
+    entry.bounding.extend(trackPos.pos);
+  }
+
+  QByteArray compressed = qCompress(encode(positions));
+
+  QMutexLocker locker(&indexMutex);
+
+  // Find a free file name for the start time
+  QString basename = "track_" + entry.start.toString("yyyyMMdd_HHmmss");
+  entry.filename = basename + ".lnmtrack";
+  for(int i = 1; QFileInfo::exists(archiveDir + QDir::separator() + entry.filename); i++)
+    entry.filename = basename + "_" + QString::number(i) + ".lnmtrack";
+
+  QSaveFile file(archiveDir + QDir::separator() + entry.filename);
+  if(!file.open(QIODevice::WriteOnly))
+  {
+    qWarning() << "Cannot write track" << file.fileName() << ":" << file.errorString();
+    return false;
+  }
+
+  QDataStream out(&file);
+  out.setVersion(QDataStream::Qt_5_5);
+  out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+  out << FILE_MAGIC_NUMBER << FILE_VERSION;
+  writeHeader(out, entry);
+  out << compressed;
+
+  if(!file.commit())
+  {
+    qWarning() << "Cannot write track" << file.fileName() << ":" << file.errorString();
+    return false;
+  }
+
+  // Index might have been rebuilt from the files including the new one
+  QVector<at::TrackArchiveEntry> entries = readEntries();
+  if(std::none_of(entries.begin(), entries.end(), [&entry](const at::TrackArchiveEntry& e) -> bool
+    {
+      return e.filename == entry.filename;
+    }))
+    entries.append(entry);
+  writeIndex(entries);
+
+  qInfo() << Q_FUNC_INFO << "Archived track" << entry.filename << "positions" << entry.numPositions
+          << "bytes" << compressed.size();
+  return true;
+}
+
+QVector<at::TrackArchiveEntry> TrackArchive::getEntries() const
+{
+  QMutexLocker locker(&indexMutex);
+  return readEntries();
+}
+
+QVector<at::TrackArchiveEntry> TrackArchive::readEntries() const
+{
+  QVector<at::TrackArchiveEntry> entries;
+  if(!readIndex(entries))
+  {
+    // Index is missing or invalid - rebuild from flight files
+    entries = scanFiles();
+    if(!entries.isEmpty())
+      writeIndex(entries);
+  }
+
+  // Remove flights deleted by the user
+  entries.erase(std::remove_if(entries.begin(), entries.end(),
+                               [this](const at::TrackArchiveEntry& entry) -> bool
+    {
+      return !QFileInfo::exists(archiveDir + QDir::separator() + entry.filename);
+    }), entries.end());
+
+  std::sort(entries.begin(), entries.end(),
+            [](const at::TrackArchiveEntry& e1, const at::TrackArchiveEntry& e2) -> bool
+    {
+      return e1.start < e2.start;
+    });
+  return entries;
+}
+
+bool TrackArchive::loadTrack(const at::TrackArchiveEntry& entry, QVector<at::AircraftTrackPos>& positions) const
+{
+  QFile file(archiveDir + QDir::separator() + entry.filename);
+  if(!file.open(QIODevice::ReadOnly))
+  {
+    qWarning() << "Cannot open track" << file.fileName() << ":" << file.errorString();
+    return false;
+  }
+
+  QDataStream in(&file);
+  in.setVersion(QDataStream::Qt_5_5);
+  in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+  quint32 magic = 0;
+  quint16 version = 0;
+  in >> magic >> version;
+  if(magic != FILE_MAGIC_NUMBER || version != FILE_VERSION)
+  {
+    qWarning() << "Cannot read track" << file.fileName() << ". Invalid magic number or version:"
+               << magic << version;
+    return false;
+  }
+
+  at::TrackArchiveEntry fileEntry;
+  QByteArray compressed;
+  if(!readHeader(in, fileEntry))
+    return false;
+  in >> compressed;
+
+  if(in.status() != QDataStream::Ok ||
+     !decode(qUncompress(compressed), fileEntry.numPositions, positions))
+  {
+    qWarning() << "Cannot read track" << file.fileName() << ". File is truncated or corrupt.";
+    positions.clear();
+    return false;
+  }
+  return true;
+}
+
+void TrackArchive::writeHeader(QDataStream& out, const at::TrackArchiveEntry& entry) const
+{
+  out << static_cast<quint32>(entry.numPositions) << entry.start.toTime_t() << entry.end.toTime_t()
+      << entry.maxAltitude
+      << entry.bounding.getWest() << entry.bounding.getNorth()
+      << entry.bounding.getEast() << entry.bounding.getSouth();
+}
+
+bool TrackArchive::readHeader(QDataStream& in, at::TrackArchiveEntry& entry) const
+{
+  quint32 numPositions, start, end;
+  float west, north, east, south;
+  in >> numPositions >> start >> end >> entry.maxAltitude >> west >> north >> east >> south;
+
+  entry.numPositions = static_cast<int>(numPositions);
+  entry.start = QDateTime::fromTime_t(start, Qt::UTC);
+  entry.end = QDateTime::fromTime_t(end, Qt::UTC);
+  entry.bounding = atools::geo::Rect(west, north, east, south);
+  return in.status() == QDataStream::Ok;
+}
+
+bool TrackArchive::writeIndex(const QVector<at::TrackArchiveEntry>& entries) const
+{
+  QSaveFile file(indexFilename);
+  if(!file.open(QIODevice::WriteOnly))
+  {
+    qWarning() << "Cannot write track index" << file.fileName() << ":" << file.errorString();
+    return false;
+  }
+
+  QDataStream out(&file);
+  out.setVersion(QDataStream::Qt_5_5);
+  out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+  out << INDEX_MAGIC_NUMBER << FILE_VERSION << static_cast<quint32>(entries.size());
+  for(const at::TrackArchiveEntry& entry : entries)
+  {
+    out << entry.filename;
+    writeHeader(out, entry);
+  }
+
+  if(!file.commit())
+  {
+    qWarning() << "Cannot write track index" << file.fileName() << ":" << file.errorString();
+    return false;
+  }
+  return true;
+}
+
+bool TrackArchive::readIndex(QVector<at::TrackArchiveEntry>& entries) const
+{
+  QFile file(indexFilename);
+  if(!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QDataStream in(&file);
+  in.setVersion(QDataStream::Qt_5_5);
+  in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+  quint32 magic = 0, size = 0;
+  quint16 version = 0;
+  in >> magic >> version >> size;
+  if(magic != INDEX_MAGIC_NUMBER || version != FILE_VERSION)
+  {
+    qWarning() << "Cannot read track index" << file.fileName() << ". Invalid magic number or version:"
+               << magic << version;
+    return false;
+  }
+
+  for(quint32 i = 0; i < size && in.status() == QDataStream::Ok; i++)
+  {
+    at::TrackArchiveEntry entry;
+    in >> entry.filename;
+    if(readHeader(in, entry))
+      entries.append(entry);
+  }
+
+  if(in.status() != QDataStream::Ok)
+  {
+    qWarning() << "Cannot read track index" << file.fileName() << ". File is truncated.";
+    entries.clear();
+    return false;
+  }
+  return true;
+}
+
+QVector<at::TrackArchiveEntry> TrackArchive::scanFiles() const
+{
+  QVector<at::TrackArchiveEntry> entries;
+  for(const QFileInfo& fileinfo : QDir(archiveDir).entryInfoList({"*.lnmtrack"}, QDir::Files))
+  {
+    QFile file(fileinfo.absoluteFilePath());
+    if(file.open(QIODevice::ReadOnly))
+    {
+      QDataStream in(&file);
+      in.setVersion(QDataStream::Qt_5_5);
+      in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+      quint32 magic = 0;
+      quint16 version = 0;
+      in >> magic >> version;
+
+      at::TrackArchiveEntry entry;
+      if(magic == FILE_MAGIC_NUMBER && version == FILE_VERSION && readHeader(in, entry))
+      {
+        entry.filename = fileinfo.fileName();
+        entries.append(entry);
+      }
+      else
+        qWarning() << "Cannot read track" << file.fileName() << ". Invalid magic number or version:"
+                   << magic << version;
+    }
+  }
+
+  qInfo() << Q_FUNC_INFO << "Found" << entries.size() << "tracks in" << archiveDir;
+  return entries;
+}
+
+QByteArray TrackArchive::encode(const QVector<at::AircraftTrackPos>& positions) const
+{
+  QByteArray data;
+  data.reserve(positions.size() * 8);
+
+  writeColumn(data, positions, [](const at::AircraftTrackPos& p) -> qint64 {
+    return p.timestamp;
+  });
+  writeColumn(data, positions, [](const at::AircraftTrackPos& p) -> qint64 {
+    return std::lround(p.pos.getLonX() * COORD_FACTOR);
+  });
+  writeColumn(data, positions, [](const at::AircraftTrackPos& p) -> qint64 {
+    return std::lround(p.pos.getLatY() * COORD_FACTOR);
+  });
+  writeColumn(data, positions, [](const at::AircraftTrackPos& p) -> qint64 {
+    return std::lround(p.pos.getAltitude());
+  });
+  writeColumn(data, positions, [](const at::AircraftTrackPos& p) -> qint64 {
+    return p.onGround ? 1 : 0;
+  });
+  return data;
+}
+
+bool TrackArchive::decode(const QByteArray& data, int numPositions,
+                          QVector<at::AircraftTrackPos>& positions) const
+{
+  const uchar *ptr = reinterpret_cast<const uchar *>(data.constData());
+  const uchar *end = ptr + data.size();
+
+  // Each of the five columns needs at least one byte per position
+  if(numPositions < 0 || static_cast<qint64>(numPositions) * 5 > data.size())
+    return false;
+
+  QVector<qint64> timestamps(numPositions), lonx(numPositions), laty(numPositions),
+  altitude(numPositions), onGround(numPositions);
+  if(!readColumn(ptr, end, timestamps) || !readColumn(ptr, end, lonx) || !readColumn(ptr, end, laty) ||
+     !readColumn(ptr, end, altitude) || !readColumn(ptr, end, onGround))
+    return false;
+
+  positions.clear();
+  positions.reserve(numPositions);
+  for(int i = 0; i < numPositions; i++)
+    positions.append({
+      atools::geo::Pos(lonx.at(i) / COORD_FACTOR, laty.at(i) / COORD_FACTOR, static_cast<float>(altitude.at(i))),
+      static_cast<quint32>(timestamps.at(i)), onGround.at(i) != 0
+    });
+  return true;
+}
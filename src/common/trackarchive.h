@@ -0,0 +1,115 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_TRACKARCHIVE_H
+#define LITTLENAVMAP_TRACKARCHIVE_H
+
+#include "geo/rect.h"
+
+#include <QDateTime>
+#include <QMutex>
+#include <QThreadPool>
+#include <QVector>
+
+namespace at {
+struct AircraftTrackPos;
+
+/* Summary of an archived flight as stored in the index and in the header of each flight file */
+struct TrackArchiveEntry
+{
+  QString filename; /* File name without path */
+  QDateTime start, end;
+  int numPositions;
+  float maxAltitude;
+  atools::geo::Rect bounding;
+};
+
+}
+
+Q_DECLARE_TYPEINFO(at::TrackArchiveEntry, Q_MOVABLE_TYPE);
+
+/*
+ * Archive of past flights in the directory little_navmap_tracks below the configuration directory.
+ *
+ * Each flight is stored in a separate file with a small header followed by the zlib compressed positions.
+ * Positions are stored column by column where each column is delta encoded and written as zigzag variable
+ * length integers. Coordinates are quantized to 1/100000 degree (about one meter) and altitude to one foot.
+ * Steady flight results in small deltas which are mostly one or two bytes before compression.
+ *
+ * The index file keeps the headers of all flights to allow listing without reading the flight files.
+ * It is rebuilt from the flight files if missing or invalid.
+ *
+ * Flights are encoded and written in a background thread. Writes are done one after the other.
+ */
+class TrackArchive
+{
+public:
+  TrackArchive();
+  ~TrackArchive();
+
+  /* Write the positions as a new flight in background and add it to the index. Tracks with less than
+   * MIN_ARCHIVE_POSITIONS are ignored. */
+  void archiveTrack(const QVector<at::AircraftTrackPos>& positions);
+
+  /* Wait for all pending writes */
+  void waitForArchive();
+
+  /* All archived flights ordered by start time */
+  QVector<at::TrackArchiveEntry> getEntries() const;
+
+  /* Read all positions of an archived flight */
+  bool loadTrack(const at::TrackArchiveEntry& entry, QVector<at::AircraftTrackPos>& positions) const;
+
+  /* Minimum number of positions of a track to be archived */
+  static Q_DECL_CONSTEXPR int MIN_ARCHIVE_POSITIONS = 10;
+
+private:
+  /* Called in background thread */
+  bool writeTrack(const QVector<at::AircraftTrackPos>& positions);
+
+  /* Read index or rebuild it. indexMutex has to be locked. */
+  QVector<at::TrackArchiveEntry> readEntries() const;
+
+  void writeHeader(QDataStream& out, const at::TrackArchiveEntry& entry) const;
+  bool readHeader(QDataStream& in, at::TrackArchiveEntry& entry) const;
+
+  bool writeIndex(const QVector<at::TrackArchiveEntry>& entries) const;
+  bool readIndex(QVector<at::TrackArchiveEntry>& entries) const;
+
+  /* Read the headers of all flight files */
+  QVector<at::TrackArchiveEntry> scanFiles() const;
+
+  QByteArray encode(const QVector<at::AircraftTrackPos>& positions) const;
+  bool decode(const QByteArray& data, int numPositions, QVector<at::AircraftTrackPos>& positions) const;
+
+  /* Quantization of coordinates */
+  static Q_DECL_CONSTEXPR float COORD_FACTOR = 100000.f;
+
+  static Q_DECL_CONSTEXPR quint32 FILE_MAGIC_NUMBER = 0x5B6C1A3A;
+  static Q_DECL_CONSTEXPR quint32 INDEX_MAGIC_NUMBER = 0x5B6C1A3B;
+  static Q_DECL_CONSTEXPR quint16 FILE_VERSION = 1;
+
+  QString archiveDir, indexFilename;
+
+  /* Single thread to write flights in order */
+  QThreadPool pool;
+
+  /* Synchronizes index access between background thread and caller of getEntries */
+  mutable QMutex indexMutex;
+};
+
+#endif // LITTLENAVMAP_TRACKARCHIVE_H
@@ -19,6 +19,7 @@
 
 #include "common/constants.h"
 #include "connect/connectdialog.h"
+#include "connect/trackreplay.h"
 #include "fs/sc/simconnectreply.h"
 #include "fs/sc/datareaderthread.h"
 #include "gui/dialog.h"
@@ -57,6 +58,11 @@ ConnectClient::ConnectClient(MainWindow *parent)
     connect(dialog, &ConnectDialog::fetchOptionsChanged, this, &ConnectClient::fetchOptionsToDataReader);
   }
 
+  // Replayed packets take the same path as packets from the simulator
+  trackReplay = new TrackReplay(this);
+  connect(trackReplay, &TrackReplay::replayDataPacket, this, &ConnectClient::postSimConnectData);
+  connect(this, &ConnectClient::connectedToSimulator, trackReplay, &TrackReplay::stopReplay);
+
   connect(dialog, &ConnectDialog::disconnectClicked, this, &ConnectClient::disconnectClicked);
   connect(dialog, &ConnectDialog::autoConnectToggled, this, &ConnectClient::autoConnectToggled);
 
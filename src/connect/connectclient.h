@@ -28,6 +28,7 @@
 class QTcpSocket;
 class ConnectDialog;
 class MainWindow;
+class TrackReplay;
 
 namespace atools {
 namespace fs {
@@ -69,6 +70,12 @@ public:
 
   atools::fs::sc::MetarResult requestWeather(const QString& station, const atools::geo::Pos& pos);
 
+  /* Replay of archived flights which sends data packets like a simulator. Stopped when connecting. */
+  TrackReplay *getTrackReplay() const
+  {
+    return trackReplay;
+  }
+
 signals:
   /* Emitted when a new SimConnect data was received from the server (Little Navconnect) */
   void dataPacketReceived(atools::fs::sc::SimConnectData simConnectData);
@@ -113,6 +120,7 @@ private:
   atools::fs::sc::SimConnectData *simConnectData = nullptr;
 
   QTcpSocket *socket = nullptr;
+  TrackReplay *trackReplay = nullptr;
   /* Used to trigger reconnects on socket base connections */
   QTimer reconnectNetworkTimer, flushQueuedRequestsTimer;
   MainWindow *mainWindow;
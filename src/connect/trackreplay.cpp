@@ -0,0 +1,136 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "connect/trackreplay.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+// Definition needed since the value is passed by reference to std::min
+Q_DECL_CONSTEXPR int TrackReplay::MAX_SPEED;
+
+TrackReplay::TrackReplay(QObject *parent)
+  : QObject(parent)
+{
+  timer.setInterval(REPLAY_UPDATE_MS);
+  connect(&timer, &QTimer::timeout, this, &TrackReplay::replayTimeout);
+}
+
+TrackReplay::~TrackReplay()
+{
+  timer.stop();
+}
+
+void TrackReplay::startReplay(const QVector<at::AircraftTrackPos>& trackPositions, int replaySpeed)
+{
+  stopReplay();
+
+  if(trackPositions.isEmpty())
+    return;
+
+  qDebug() << Q_FUNC_INFO << "positions" << trackPositions.size() << "speed" << replaySpeed;
+
+  positions = trackPositions;
+  setSpeed(replaySpeed);
+  index = 0;
+  replayTimeMs = positions.first().timestamp * 1000LL;
+  currentPos = positions.first();
+  lastPos = atools::geo::Pos();
+
+  elapsedTimer.start();
+  timer.start();
+
+  // Let receivers clear their tracks before the first packet
+  emit replayStarted();
+  sendPacket();
+}
+
+void TrackReplay::stopReplay()
+{
+  if(timer.isActive())
+  {
+    qDebug() << Q_FUNC_INFO;
+    timer.stop();
+    positions.clear();
+    emit replayStopped();
+  }
+}
+
+void TrackReplay::setSpeed(int replaySpeed)
+{
+  speed = std::max(1, std::min(replaySpeed, MAX_SPEED));
+}
+
+void TrackReplay::replayTimeout()
+{
+  replayTimeMs += elapsedTimer.restart() * speed;
+
+  // Skip all positions passed since the last packet
+  int lastIndex = positions.size() - 1;
+  while(index < lastIndex && positions.at(index + 1).timestamp * 1000LL <= replayTimeMs)
+    index++;
+
+  if(index >= lastIndex)
+  {
+    // Send the last position and finish
+    currentPos = positions.last();
+    sendPacket();
+    stopReplay();
+    return;
+  }
+
+  const at::AircraftTrackPos& from = positions.at(index);
+  const at::AircraftTrackPos& to = positions.at(index + 1);
+  qint64 fromMs = from.timestamp * 1000LL, toMs = to.timestamp * 1000LL;
+
+  if(toMs - fromMs > MAX_GAP_SEC * 1000LL)
+  {
+    // Jump over gap to the next position
+    index++;
+    replayTimeMs = toMs;
+    currentPos = to;
+  }
+  else
+  {
+    float fraction = toMs > fromMs ? static_cast<float>(replayTimeMs - fromMs) / (toMs - fromMs) : 0.f;
+    float lonDiff = to.pos.getLonX() - from.pos.getLonX();
+
+    atools::geo::Pos pos = from.pos;
+    if(std::abs(lonDiff) < 180.f)
+      // Linear interpolation is sufficient for the short distance between positions
+      pos = atools::geo::Pos(from.pos.getLonX() + lonDiff * fraction,
+                             from.pos.getLatY() + (to.pos.getLatY() - from.pos.getLatY()) * fraction,
+                             from.pos.getAltitude() + (to.pos.getAltitude() - from.pos.getAltitude()) * fraction);
+
+    currentPos = {pos, static_cast<quint32>(replayTimeMs / 1000), from.onGround};
+  }
+
+  sendPacket();
+}
+
+void TrackReplay::sendPacket()
+{
+  // Heading is calculated from the last position
+  atools::fs::sc::SimConnectData data =
+    atools::fs::sc::SimConnectData::buildDebugForPosition(currentPos.pos, lastPos);
+  data.setPacketId(packetId++);
+  lastPos = currentPos.pos;
+
+  emit replayDataPacket(data);
+}
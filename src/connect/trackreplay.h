@@ -0,0 +1,98 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_TRACKREPLAY_H
+#define LITTLENAVMAP_TRACKREPLAY_H
+
+#include "common/aircrafttrack.h"
+#include "fs/sc/simconnectdata.h"
+
+#include <QElapsedTimer>
+#include <QTimer>
+
+/*
+ * Replays an archived flight by emitting simulator data packets like the simulator connection.
+ *
+ * Packets are sent at a fixed rate of REPLAY_UPDATE_MS independent of the replay speed. Each packet
+ * contains the position interpolated for the current replay time. Positions passed between two packets
+ * are skipped, so receivers never get more updates than from a simulator connection and the replay
+ * cannot fall behind at high speeds.
+ */
+class TrackReplay :
+  public QObject
+{
+  Q_OBJECT
+
+public:
+  TrackReplay(QObject *parent);
+  virtual ~TrackReplay();
+
+  /* Start replay with speed as a multiple of real time. Stops any running replay. */
+  void startReplay(const QVector<at::AircraftTrackPos>& trackPositions, int replaySpeed);
+  void stopReplay();
+
+  /* Change speed of a running replay. Clamped to 1 to MAX_SPEED */
+  void setSpeed(int replaySpeed);
+
+  int getSpeed() const
+  {
+    return speed;
+  }
+
+  bool isReplaying() const
+  {
+    return timer.isActive();
+  }
+
+  /* Position of the last sent packet with the recorded time and ground flag */
+  const at::AircraftTrackPos& getCurrentPosition() const
+  {
+    return currentPos;
+  }
+
+  static Q_DECL_CONSTEXPR int MAX_SPEED = 100;
+
+signals:
+  /* Emitted for each replayed position */
+  void replayDataPacket(atools::fs::sc::SimConnectData simConnectData);
+
+  void replayStarted();
+  void replayStopped();
+
+private:
+  void replayTimeout();
+  void sendPacket();
+
+  /* Update rate for packets in real time */
+  static Q_DECL_CONSTEXPR int REPLAY_UPDATE_MS = 100;
+
+  /* Gaps between recorded positions longer than this are skipped - e.g. simulator paused */
+  static Q_DECL_CONSTEXPR int MAX_GAP_SEC = 60;
+
+  QVector<at::AircraftTrackPos> positions;
+  QTimer timer;
+  QElapsedTimer elapsedTimer;
+
+  /* Current replay time in milliseconds since epoch */
+  qint64 replayTimeMs = 0;
+  int index = 0, speed = 1, packetId = 0;
+
+  at::AircraftTrackPos currentPos;
+  atools::geo::Pos lastPos;
+};
+
+#endif // LITTLENAVMAP_TRACKREPLAY_H
@@ -385,6 +385,19 @@ void DatabaseManager::switchSimFromMainMenu()
   }
 }
 
+void DatabaseManager::openDatabaseFile(const QString& filename)
+{
+  qDebug() << Q_FUNC_INFO << filename;
+
+  emit preDatabaseLoad();
+
+  closeDatabase();
+  databaseFile = filename;
+  openDatabase();
+
+  emit postDatabaseLoad(currentFsType);
+}
+
 void DatabaseManager::openDatabase()
 {
   atools::settings::Settings& settings = atools::settings::Settings::instance();
@@ -76,6 +76,10 @@ public:
    * Will not return if an exception is caught during opening. */
   void closeDatabase();
 
+  /* Close the current database and open the given file instead. Sends pre and post database load signals.
+   * Used by the render benchmark to run on a given scenery database. */
+  void openDatabaseFile(const QString& filename);
+
   /* Get the database. Will return null if not opened before. */
   atools::sql::SqlDatabase *getDatabase();
 
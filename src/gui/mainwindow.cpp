@@ -24,6 +24,8 @@
 #include "gui/application.h"
 #include "common/weatherreporter.h"
 #include "connect/connectclient.h"
+#include "connect/trackreplay.h"
+#include "common/trackarchive.h"
 #include "common/elevationprovider.h"
 #include "db/databasemanager.h"
 #include "gui/dialog.h"
@@ -68,6 +70,11 @@
 #include <QDesktopWidget>
 #include <QDir>
 #include <QFileInfoList>
+#include <QDialogButtonBox>
+#include <QInputDialog>
+#include <QLabel>
+#include <QListWidget>
+#include <QVBoxLayout>
 
 #include "ui_mainwindow.h"
 
@@ -689,6 +696,8 @@ void MainWindow::connectAllSlots()
   connect(ui->actionRouteCalcHighAlt, &QAction::triggered, routeController, &RouteController::calculateHighAlt);
   connect(ui->actionRouteCalcLowAlt, &QAction::triggered, routeController, &RouteController::calculateLowAlt);
   connect(ui->actionRouteCalcSetAlt, &QAction::triggered, routeController, &RouteController::calculateSetAlt);
+  connect(ui->actionRouteCalcCancel, &QAction::triggered, routeController, &RouteController::cancelRouteCalc);
+  connect(routeController, &RouteController::routeCalcRunningChanged, this, &MainWindow::updateActionStates);
   connect(ui->actionRouteReverse, &QAction::triggered, routeController, &RouteController::reverseRoute);
 
   connect(ui->actionRouteCopyString, &QAction::triggered, routeController, &RouteController::routeStringToClipboard);
@@ -866,6 +875,17 @@ void MainWindow::connectAllSlots()
 
   connect(mapWidget, &MapWidget::aircraftTrackPruned, profileWidget, &ProfileWidget::aircraftTrackPruned);
 
+  // Flight replay ===================================================================
+  TrackReplay *trackReplay = connectClient->getTrackReplay();
+  connect(ui->actionMapReplayAircraftTrack, &QAction::triggered, this, &MainWindow::replayAircraftTrack);
+  connect(ui->actionMapStopReplayAircraftTrack, &QAction::triggered, trackReplay, &TrackReplay::stopReplay);
+
+  // Map widget needs to archive track first
+  connect(trackReplay, &TrackReplay::replayStarted, mapWidget, &MapWidget::trackReplayStarted);
+  connect(trackReplay, &TrackReplay::replayStarted, profileWidget, &ProfileWidget::deleteAircraftTrack);
+  connect(trackReplay, &TrackReplay::replayStarted, this, &MainWindow::updateActionStates);
+  connect(trackReplay, &TrackReplay::replayStopped, this, &MainWindow::updateActionStates);
+
   connect(weatherReporter, &WeatherReporter::weatherUpdated, mapWidget, &MapWidget::updateTooltip);
   connect(weatherReporter, &WeatherReporter::weatherUpdated, infoController, &InfoController::updateAirport);
 
@@ -1023,9 +1043,12 @@ const ElevationModel *MainWindow::getElevationModel()
 }
 
 /* Called after each query */
-void MainWindow::resultTruncated(int truncatedTo)
+void MainWindow::resultTruncated(int numHidden)
 {
-  if(truncatedTo > 0)
+  if(numHidden > 0)
+    messageLabel->setText(tr("<b style=\"color: red;\">Too many objects. %1 hidden.</b>").arg(numHidden));
+  else
+    // Query row limit reached
     messageLabel->setText(tr("<b style=\"color: red;\">Too many objects.</b>"));
 }
 
@@ -1056,6 +1079,77 @@ void MainWindow::renderStatusChanged(RenderStatus status)
 }
 
 /* Route center action */
+/* Select an archived flight and replay speed and start the replay */
+void MainWindow::replayAircraftTrack()
+{
+  qDebug() << Q_FUNC_INFO;
+
+  const TrackArchive& archive = mapWidget->getAircraftTrack().getArchive();
+  QVector<at::TrackArchiveEntry> entries = archive.getEntries();
+  if(entries.isEmpty())
+  {
+    QMessageBox::information(this, QApplication::applicationName(),
+                             tr("No archived flights found.\n"
+                                "Flights are archived when the aircraft trail is deleted or "
+                                "a new simulator connection is established."));
+    return;
+  }
+
+  // Labels are not unique - select by row
+  QDialog selectDialog(this);
+  selectDialog.setWindowTitle(QApplication::applicationName());
+  QVBoxLayout *layout = new QVBoxLayout(&selectDialog);
+  layout->addWidget(new QLabel(tr("Select flight to replay:"), &selectDialog));
+  QListWidget *listWidget = new QListWidget(&selectDialog);
+  layout->addWidget(listWidget);
+  QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel,
+                                                     &selectDialog);
+  layout->addWidget(buttonBox);
+  connect(buttonBox, &QDialogButtonBox::accepted, &selectDialog, &QDialog::accept);
+  connect(buttonBox, &QDialogButtonBox::rejected, &selectDialog, &QDialog::reject);
+  connect(listWidget, &QListWidget::itemDoubleClicked, &selectDialog, &QDialog::accept);
+
+  // Show latest flight first
+  QLocale locale;
+  for(int i = entries.size() - 1; i >= 0; i--)
+  {
+    const at::TrackArchiveEntry& entry = entries.at(i);
+    listWidget->addItem(tr("%1 to %2 UTC, %3 positions, max. %4").
+                        arg(locale.toString(entry.start, QLocale::ShortFormat)).
+                        arg(locale.toString(entry.end.time(), QLocale::ShortFormat)).
+                        arg(entry.numPositions).
+                        arg(Unit::altFeet(entry.maxAltitude)));
+  }
+  listWidget->setCurrentRow(0);
+
+  if(selectDialog.exec() != QDialog::Accepted || listWidget->currentRow() < 0)
+    return;
+  const at::TrackArchiveEntry& entry = entries.at(entries.size() - 1 - listWidget->currentRow());
+
+  bool ok = false;
+
+  atools::settings::Settings& settings = atools::settings::Settings::instance();
+  int speed = QInputDialog::getInt(this, QApplication::applicationName(),
+                                   tr("Replay speed as multiple of real time:"),
+                                   settings.valueInt(lnm::MAP_TRACK_REPLAY_SPEED, 10),
+                                   1, TrackReplay::MAX_SPEED, 1, &ok);
+  if(!ok)
+    return;
+  settings.setValue(lnm::MAP_TRACK_REPLAY_SPEED, speed);
+
+  QVector<at::AircraftTrackPos> positions;
+  if(!archive.loadTrack(entry, positions))
+  {
+    QMessageBox::warning(this, QApplication::applicationName(),
+                         tr("Cannot read archived flight \"%1\".").arg(entry.filename));
+    return;
+  }
+
+  mapWidget->showRect(entry.bounding, false);
+  NavApp::getConnectClient()->getTrackReplay()->startReplay(positions, speed);
+  setStatusMessage(tr("Replaying flight at %1 times speed.").arg(speed));
+}
+
 void MainWindow::routeCenter()
 {
   if(!NavApp::getRoute().isFlightplanEmpty())
@@ -1880,14 +1974,18 @@ void MainWindow::updateActionStates()
   ui->actionMapShowAircraftAi->setEnabled(true);
   ui->actionMapShowAircraftAiBoat->setEnabled(true);
 #else
-  ui->actionMapShowAircraft->setEnabled(NavApp::isConnected());
-  ui->actionMapAircraftCenter->setEnabled(NavApp::isConnected());
+  // Replay sends user aircraft only
+  bool replaying = NavApp::getConnectClient()->getTrackReplay()->isReplaying();
+  ui->actionMapShowAircraft->setEnabled(NavApp::isConnected() || replaying);
+  ui->actionMapAircraftCenter->setEnabled(NavApp::isConnected() || replaying);
   ui->actionMapShowAircraftAi->setEnabled(NavApp::isConnected());
   ui->actionMapShowAircraftAiBoat->setEnabled(NavApp::isConnected());
 #endif
 
   ui->actionMapShowAircraftTrack->setEnabled(true);
   ui->actionMapDeleteAircraftTrack->setEnabled(!mapWidget->getAircraftTrack().isEmpty());
+  ui->actionMapReplayAircraftTrack->setEnabled(!NavApp::isConnected());
+  ui->actionMapStopReplayAircraftTrack->setEnabled(NavApp::getConnectClient()->getTrackReplay()->isReplaying());
 
   bool canCalcRoute = NavApp::getRoute().canCalcRoute();
   ui->actionRouteCalcDirect->setEnabled(canCalcRoute && NavApp::getRoute().hasEntries());
@@ -1895,6 +1993,8 @@ void MainWindow::updateActionStates()
   ui->actionRouteCalcHighAlt->setEnabled(canCalcRoute);
   ui->actionRouteCalcLowAlt->setEnabled(canCalcRoute);
   ui->actionRouteCalcSetAlt->setEnabled(canCalcRoute && ui->spinBoxRouteAlt->value() > 0);
+  // Enabled only while calculating so the Esc shortcut does not interfere with the map otherwise
+  ui->actionRouteCalcCancel->setEnabled(routeController->isRouteCalcRunning());
   ui->actionRouteReverse->setEnabled(canCalcRoute);
 
   ui->actionMapShowHome->setEnabled(mapWidget->getHomePos().isValid());
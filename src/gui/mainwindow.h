@@ -148,7 +148,7 @@ public:
   /* Render status from marble widget */
   void renderStatusChanged(Marble::RenderStatus status);
 
-  void resultTruncated(int truncatedTo);
+  void resultTruncated(int numHidden);
 
 signals:
   /* Emitted when window is shown the first time */
@@ -198,6 +198,7 @@ private:
   bool routeSaveAsGpx();
 
   void routeCenter();
+  void replayAircraftTrack();
   bool routeCheckForChanges();
   bool routeValidate(bool validateParking = true);
   void showMapLegend();
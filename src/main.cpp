@@ -33,6 +33,10 @@
 #include "fs/sc/simconnectreply.h"
 #include "common/maptypes.h"
 
+#ifdef LNM_RENDERBENCH
+#include "mapgui/maprenderbenchmark.h"
+#endif
+
 #include <QDebug>
 #include <QSplashScreen>
 #include <QSslSocket>
@@ -87,6 +91,12 @@ int main(int argc, char *argv[])
   int retval = 0;
   NavApp app(argc, argv);
 
+#ifdef LNM_RENDERBENCH
+  // Keep settings, databases and logs of the benchmark apart from the user configuration since the
+  // benchmark changes theme, layers and the scenery database which are saved on exit
+  app.setOrganizationName("ABarthel Renderbench");
+#endif
+
   // Start splash screen
   QPixmap pixmap(":/littlenavmap/resources/icons/splash.png");
   QSplashScreen splash(pixmap);
@@ -190,14 +200,26 @@ int main(int argc, char *argv[])
       delete dbManager;
       dbManager = nullptr;
 
+#ifdef LNM_RENDERBENCH
+      // Avoid the first start dialogs which would block the benchmark - only changes the benchmark settings
+      settings.setValue(lnm::MAINWINDOW_FIRSTAPPLICATIONSTART, false);
+
+      // Background loading would make frames depend on thread timing - query the database while painting
+      settings.setValue(lnm::SETTINGS_MAPQUERY + "Prefetch", false);
+#endif
+
       MainWindow mainWindow;
       mainWindow.show();
 
       // Hide splash once main window is shown
       splash.finish(&mainWindow);
 
+#ifdef LNM_RENDERBENCH
+      retval = MapRenderBenchmark(&mainWindow).run(QApplication::arguments()) ? 0 : 1;
+#else
       qDebug() << "Before app.exec()";
       retval = app.exec();
+#endif
     }
 
     qDebug() << "app.exec() done, retval is" << retval << (retval == 0 ? "(ok)" : "(error)");
@@ -0,0 +1,108 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "mapgui/mapdeclutter.h"
+
+#include <QHash>
+
+#include <algorithm>
+#include <cmath>
+
+/* Key for a grid cell */
+static inline quint64 cellKey(qint32 x, qint32 y)
+{
+  return (static_cast<quint64>(static_cast<quint32>(y)) << 32) | static_cast<quint32>(x);
+}
+
+MapDeclutter::MapDeclutter(int maxObjectsParam)
+  : maxObjects(maxObjectsParam)
+{
+}
+
+MapDeclutter::~MapDeclutter()
+{
+}
+
+void MapDeclutter::declutter()
+{
+  hidden.clear();
+
+  if(candidates.size() <= maxObjects)
+    // Enough space for all
+    return;
+
+  // Highest priority first - keep insertion order for equal priorities
+  std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& c1, const Candidate& c2) -> bool
+                   {
+                     return c1.priority > c2.priority;
+                   });
+
+  // Grid cell size is the largest symbol to find all overlaps in the neighbor cells
+  float cellSize = 1.f;
+  for(const Candidate& candidate : candidates)
+    cellSize = std::max(cellSize, candidate.sizePx);
+
+  // Grid cell to indexes of kept candidates with overlap detection
+  QHash<quint64, QVector<int> > grid;
+  int numKept = 0;
+
+  for(int i = 0; i < candidates.size(); i++)
+  {
+    const Candidate& candidate = candidates.at(i);
+    bool mustDraw = candidate.priority >= MUST_DRAW;
+
+    if(!mustDraw && numKept >= maxObjects)
+    {
+      hidden.insert(candidate.id);
+      continue;
+    }
+
+    qint32 cx = static_cast<qint32>(std::floor(candidate.pt.x() / cellSize));
+    qint32 cy = static_cast<qint32>(std::floor(candidate.pt.y() / cellSize));
+
+    bool overlaps = false;
+    if(!mustDraw && candidate.sizePx > 0.f)
+    {
+      for(qint32 y = cy - 1; y <= cy + 1 && !overlaps; y++)
+      {
+        for(qint32 x = cx - 1; x <= cx + 1 && !overlaps; x++)
+        {
+          for(int index : grid.value(cellKey(x, y)))
+          {
+            const Candidate& kept = candidates.at(index);
+            float minDist = (candidate.sizePx + kept.sizePx) / 2.f;
+            QPointF diff = kept.pt - candidate.pt;
+            if(diff.x() * diff.x() + diff.y() * diff.y() < minDist * minDist)
+            {
+              overlaps = true;
+              break;
+            }
+          }
+        }
+      }
+    }
+
+    if(overlaps)
+      hidden.insert(candidate.id);
+    else
+    {
+      numKept++;
+      if(candidate.sizePx > 0.f)
+        grid[cellKey(cx, cy)].append(i);
+    }
+  }
+}
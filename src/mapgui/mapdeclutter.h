@@ -0,0 +1,89 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_MAPDECLUTTER_H
+#define LITTLENAVMAP_MAPDECLUTTER_H
+
+#include <QPointF>
+#include <QSet>
+#include <QVector>
+
+#include <limits>
+
+/*
+ * Selects the map objects to draw if there are more than the maximum number in the visible area.
+ *
+ * All objects are drawn if the number of candidates does not exceed the maximum. Otherwise candidates are
+ * ranked by priority and the highest ones are kept. A candidate is hidden if its symbol overlaps an
+ * already kept one with higher priority. Candidates with priority MUST_DRAW are always kept.
+ */
+class MapDeclutter
+{
+public:
+  MapDeclutter(int maxObjectsParam);
+  ~MapDeclutter();
+
+  /*
+   * Add a candidate.
+   * @param id Id to identify the object in isHidden. Has to be unique for this instance.
+   * @param pt Screen position of the symbol center.
+   * @param priority Higher values are more important.
+   * @param sizePx Symbol size in pixel used for overlap detection. 0 disables the detection for the candidate.
+   */
+  void add(quint32 id, const QPointF& pt, float priority, float sizePx)
+  {
+    candidates.append({id, pt, priority, sizePx});
+  }
+
+  /* Select the objects to draw from all added candidates */
+  void declutter();
+
+  /* true if the object should not be drawn. Call after declutter. */
+  bool isHidden(quint32 id) const
+  {
+    return hidden.contains(id);
+  }
+
+  /* Number of added candidates */
+  int getNumCandidates() const
+  {
+    return candidates.size();
+  }
+
+  /* Number of hidden objects after declutter */
+  int getNumHidden() const
+  {
+    return hidden.size();
+  }
+
+  /* Priority for objects that are drawn regardless of maximum number and overlap */
+  static Q_DECL_CONSTEXPR float MUST_DRAW = std::numeric_limits<float>::max();
+
+private:
+  struct Candidate
+  {
+    quint32 id;
+    QPointF pt;
+    float priority, sizePx;
+  };
+
+  int maxObjects;
+  QVector<Candidate> candidates;
+  QSet<quint32> hidden;
+};
+
+#endif // LITTLENAVMAP_MAPDECLUTTER_H
@@ -0,0 +1,215 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "mapgui/maplayercompositor.h"
+
+#include "common/constants.h"
+#include "common/labelgrid.h"
+#include "mapgui/mappainter.h"
+#include "mapgui/mappaintprofiler.h"
+#include "mapgui/mapquery.h"
+#include "mapgui/mapwidget.h"
+#include "settings/settings.h"
+
+#include <QElapsedTimer>
+#include <QFontDatabase>
+#include <QImage>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <marble/GeoPainter.h>
+#include <marble/ViewportParams.h>
+
+
+MapLayerCompositor::MapLayerCompositor(MapWidget *mapWidgetParam, MapQuery *mapQueryParam)
+  : mapWidget(mapWidgetParam), mapQuery(mapQueryParam)
+{
+  enabled = atools::settings::Settings::instance().getAndStoreValue(
+    lnm::SETTINGS_MAPPAINT + "ParallelLayers", false).toBool();
+
+  if(enabled && !QFontDatabase::supportsThreadedFontRendering())
+  {
+    qInfo() << Q_FUNC_INFO << "Parallel layer rendering disabled. No threaded font rendering.";
+    enabled = false;
+  }
+
+  if(enabled && QThread::idealThreadCount() < 2)
+  {
+    qInfo() << Q_FUNC_INFO << "Parallel layer rendering disabled. Single core.";
+    enabled = false;
+  }
+
+  if(enabled)
+  {
+    using namespace std::placeholders;
+    mapQuery->setDatabaseExecutor(std::bind(&MapLayerCompositor::runInCallingThread, this, _1));
+  }
+}
+
+MapLayerCompositor::~MapLayerCompositor()
+{
+  pool.waitForDone();
+
+  if(enabled)
+    mapQuery->setDatabaseExecutor(MapQuery::DatabaseExecutorFunc());
+}
+
+void MapLayerCompositor::render(const QVector<MapPainter *>& painters, PaintContext *context)
+{
+  // Use the device pixel ratio of the target to avoid blurry images on high resolution screens
+  qreal ratio = context->painter->device()->devicePixelRatioF();
+  QSize size = context->viewport->size() * ratio;
+
+  // One image and context copy for each layer - each render thread writes only its own
+  QVector<QImage> images(painters.size());
+  QVector<PaintContext> contexts(painters.size(), *context);
+  QImage *imageData = images.data();
+  PaintContext *contextData = contexts.data();
+
+  // Label grids are not thread safe - labels are checked for collisions only within each layer
+  QVector<LabelGrid> labelGrids(context->labelGrid != nullptr ? painters.size() : 0);
+  for(int i = 0; i < labelGrids.size(); i++)
+    contextData[i].labelGrid = &labelGrids[i];
+
+  QFont font = context->painter->font();
+  QPainter::RenderHints hints = context->painter->renderHints();
+  Marble::MapQuality quality = mapWidget->mapQuality(context->viewContext);
+
+  for(int i = 0; i < painters.size(); i++)
+  {
+    imageData[i] = QImage(size, QImage::Format_ARGB32_Premultiplied);
+    imageData[i].setDevicePixelRatio(ratio);
+    imageData[i].fill(Qt::transparent);
+  }
+
+  std::exception_ptr exception;
+  QList<QFuture<void> > futures;
+
+  {
+    QMutexLocker locker(&mutex);
+    running = painters.size();
+  }
+
+  for(int i = 0; i < painters.size(); i++)
+  {
+    MapPainter *mapPainter = painters.at(i);
+    futures.append(QtConcurrent::run(&pool, [this, mapPainter, i, imageData, contextData, font, hints, quality,
+                                             &exception]() -> void
+                                     {
+                                       try
+                                       {
+                                         renderLayer(mapPainter, &contextData[i], &imageData[i], font, hints,
+                                                     quality);
+                                       }
+                                       catch(...)
+                                       {
+                                         QMutexLocker locker(&mutex);
+                                         if(!exception)
+                                           exception = std::current_exception();
+                                       }
+
+                                       QMutexLocker locker(&mutex);
+                                       running--;
+                                       taskQueued.wakeAll();
+                                     }));
+  }
+
+  {
+    // Run database queries for the render threads until all are done
+    QMutexLocker locker(&mutex);
+    while(running > 0 || !tasks.isEmpty())
+    {
+      if(tasks.isEmpty())
+      {
+        taskQueued.wait(&mutex);
+        continue;
+      }
+
+      Task *task = tasks.dequeue();
+      locker.unlock();
+
+      try
+      {
+        (*task->func)();
+      }
+      catch(...)
+      {
+        task->exception = std::current_exception();
+      }
+
+      locker.relock();
+      task->done = true;
+      taskDone.wakeAll();
+    }
+  }
+
+  for(QFuture<void>& future : futures)
+    future.waitForFinished();
+
+  if(exception)
+    std::rethrow_exception(exception);
+
+  // Composite in original drawing order
+  int objectsHidden = context->objectsHidden, objectsDrawn = context->objectsDrawn;
+  for(int i = 0; i < painters.size(); i++)
+  {
+    context->painter->drawImage(QPointF(0., 0.), images.at(i));
+    context->objectsHidden += contexts.at(i).objectsHidden - objectsHidden;
+    context->objectsDrawn += contexts.at(i).objectsDrawn - objectsDrawn;
+  }
+}
+
+void MapLayerCompositor::renderLayer(MapPainter *mapPainter, PaintContext *context, QImage *image,
+                                     const QFont& font, QPainter::RenderHints hints, Marble::MapQuality quality)
+{
+  Marble::GeoPainter painter(image, context->viewport, quality);
+  painter.setRenderHints(hints);
+  painter.setFont(font);
+
+  context->painter = &painter;
+  if(profiler != nullptr)
+  {
+    int objectsDrawn = context->objectsDrawn, objectsHidden = context->objectsHidden;
+    QElapsedTimer timer;
+    timer.start();
+
+    mapPainter->render(context);
+
+    profiler->addPainter(mapPainter, timer.nsecsElapsed(), context->objectsDrawn - objectsDrawn,
+                         context->objectsHidden - objectsHidden);
+  }
+  else
+    mapPainter->render(context);
+  context->painter = nullptr;
+}
+
+void MapLayerCompositor::runInCallingThread(const std::function<void()>& func)
+{
+  Task task;
+  task.func = &func;
+  task.done = false;
+
+  QMutexLocker locker(&mutex);
+  tasks.enqueue(&task);
+  taskQueued.wakeAll();
+
+  while(!task.done)
+    taskDone.wait(&mutex);
+  locker.unlock();
+
+  if(task.exception)
+    std::rethrow_exception(task.exception);
+}
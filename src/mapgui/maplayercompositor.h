@@ -0,0 +1,105 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_MAPLAYERCOMPOSITOR_H
+#define LITTLENAVMAP_MAPLAYERCOMPOSITOR_H
+
+#include <QMutex>
+#include <QPainter>
+#include <QQueue>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <exception>
+#include <functional>
+
+#include <marble/MarbleGlobal.h>
+
+class MapPainter;
+class MapPaintProfiler;
+class MapQuery;
+class MapWidget;
+struct PaintContext;
+
+/*
+ * Renders map painters in parallel into separate offscreen images and draws the images in the
+ * original order on the map. Used for the static layers airspace, ILS, navaids and airports.
+ *
+ * The painters must not share any state and each painter has to use different map object types
+ * from map query. Database queries of the painters are executed in the calling thread which owns
+ * the connection while it waits for the render threads.
+ *
+ * Each layer gets its own label grid. Labels of different layers can overlap in this mode.
+ */
+class MapLayerCompositor
+{
+public:
+  MapLayerCompositor(MapWidget *mapWidgetParam, MapQuery *mapQueryParam);
+  ~MapLayerCompositor();
+
+  /* true if enabled in settings and the platform supports text rendering in threads */
+  bool isEnabled() const
+  {
+    return enabled;
+  }
+
+  /* Collect render times of the layers. Does not take ownership. */
+  void setProfiler(MapPaintProfiler *value)
+  {
+    profiler = value;
+  }
+
+  /*
+   * Render all painters in parallel and draw the results in list order using the painter of the context.
+   * Numbers of hidden objects of all layers are added to the context.
+   */
+  void render(const QVector<MapPainter *>& painters, PaintContext *context);
+
+private:
+  /* Function passed from a render thread to the calling thread */
+  struct Task
+  {
+    const std::function<void()> *func;
+    bool done;
+    std::exception_ptr exception;
+  };
+
+  /* Runs in render thread and paints into the image */
+  void renderLayer(MapPainter *mapPainter, PaintContext *context, QImage *image, const QFont& font,
+                   QPainter::RenderHints hints, Marble::MapQuality quality);
+
+  /* Called from render threads. Queues the function for the calling thread and waits until it is done.
+   * Exceptions are passed back to the render thread. */
+  void runInCallingThread(const std::function<void()>& func);
+
+  MapWidget *mapWidget;
+  MapQuery *mapQuery;
+  MapPaintProfiler *profiler = nullptr;
+  QThreadPool pool;
+  bool enabled = false;
+
+  /* Guards all members below */
+  QMutex mutex;
+  QWaitCondition taskQueued, taskDone;
+  QQueue<Task *> tasks;
+
+  /* Number of render threads still working */
+  int running = 0;
+};
+
+#endif // LITTLENAVMAP_MAPLAYERCOMPOSITOR_H
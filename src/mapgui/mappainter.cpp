@@ -19,6 +19,10 @@
 
 #include "mapgui/mapscale.h"
 #include "common/symbolpainter.h"
+#include "common/textspritecache.h"
+#include "common/symbolatlas.h"
+#include "common/constants.h"
+#include "settings/settings.h"
 #include "geo/calculations.h"
 #include "mapgui/mapwidget.h"
 
@@ -56,11 +60,28 @@ MapPainter::MapPainter(MapWidget *parentMapWidget, MapQuery *mapQuery, MapScale
   : CoordinateConverter(parentMapWidget->viewport()), mapWidget(parentMapWidget), query(mapQuery), scale(mapScale)
 {
   symbolPainter = new SymbolPainter();
+
+  // Each painter uses its own cache since painters can run in parallel
+  if(atools::settings::Settings::instance().getAndStoreValue(
+       lnm::SETTINGS_MAPPAINT + "TextSpriteCache", true).toBool())
+  {
+    textCache = new TextSpriteCache;
+    symbolPainter->setTextCache(textCache);
+  }
+
+  if(atools::settings::Settings::instance().getAndStoreValue(
+       lnm::SETTINGS_MAPPAINT + "SymbolAtlas", true).toBool())
+  {
+    symbolAtlas = new SymbolAtlas;
+    symbolPainter->setSymbolAtlas(symbolAtlas);
+  }
 }
 
 MapPainter::~MapPainter()
 {
   delete symbolPainter;
+  delete textCache;
+  delete symbolAtlas;
 }
 
 void MapPainter::paintCircle(GeoPainter *painter, const Pos& centerPos, int radiusNm, bool fast,
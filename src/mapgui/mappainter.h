@@ -39,6 +39,9 @@ class GeoPainter;
 }
 
 class SymbolPainter;
+class LabelGrid;
+class TextSpriteCache;
+class SymbolAtlas;
 class MapLayer;
 class MapQuery;
 class MapScale;
@@ -77,18 +80,29 @@ struct PaintContext
   float thicknessTrail = 1.f;
   float thicknessRangeDistance = 1.f;
 
-  // Needs to be larger than number of highest level airports
-  static Q_DECL_CONSTEXPR int MAX_OBJECT_COUNT = 2500;
-  int objectCount = 0;
-  bool objCount()
-  {
-    objectCount++;
-    return objectCount > MAX_OBJECT_COUNT;
-  }
+  /* Maximum number of objects for each painter. Less important objects are hidden by MapDeclutter
+   * if there are more in the visible area. Airports needs to be larger than number of highest level airports. */
+  static Q_DECL_CONSTEXPR int MAX_AIRPORT_COUNT = 1000;
+  static Q_DECL_CONSTEXPR int MAX_NAVAID_COUNT = 1250;
+  static Q_DECL_CONSTEXPR int MAX_AIRWAY_COUNT = 1500;
+  static Q_DECL_CONSTEXPR int MAX_ILS_COUNT = 250;
+
+  /* Number of objects hidden by decluttering */
+  int objectsHidden = 0;
+
+  /* Map objects were cut at the query row limit */
+  bool queryTruncated = false;
 
-  bool isOverflow()
+  /* Number of airports, navaids, airways, ILS and airspaces drawn. Used for profiling. */
+  int objectsDrawn = 0;
+
+  /* Screen space occupied by navaid, airport and airway labels. Labels overlapping others are moved or
+   * not drawn. null if label collision detection is disabled. */
+  LabelGrid *labelGrid = nullptr;
+
+  bool isOverflow() const
   {
-    return objectCount > MAX_OBJECT_COUNT;
+    return objectsHidden > 0;
   }
 
   bool  dOpt(const opts::DisplayOptions& opts) const
@@ -172,6 +186,12 @@ protected:
   const int CIRCLE_MAX_POINTS = 72;
 
   SymbolPainter *symbolPainter;
+
+  /* Pre-rendered texts for this painter. null if disabled. */
+  TextSpriteCache *textCache = nullptr;
+
+  /* Pre-rendered airport and navaid symbols for this painter. null if disabled. */
+  SymbolAtlas *symbolAtlas = nullptr;
   MapWidget *mapWidget;
   MapQuery *query;
   MapScale *scale;
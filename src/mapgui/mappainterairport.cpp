@@ -21,6 +21,7 @@
 #include "mapgui/mapscale.h"
 #include "mapgui/maplayer.h"
 #include "mapgui/mapquery.h"
+#include "mapgui/mapdeclutter.h"
 #include "geo/calculations.h"
 #include "common/maptypes.h"
 #include "common/mapcolors.h"
@@ -38,6 +39,21 @@ using namespace Marble;
 using namespace atools::geo;
 using namespace map;
 
+/* Rank airports for decluttering. Hard runways, length and tower are more important. */
+static float airportPriority(const MapAirport& airport)
+{
+  float priority = airport.longestRunwayLength;
+  if(airport.hard())
+    priority += 20000.f;
+  if(airport.tower())
+    priority += 10000.f;
+  if(airport.addon())
+    priority += 5000.f;
+  if(airport.closed())
+    priority -= 50000.f;
+  return priority;
+}
+
 MapPainterAirport::MapPainterAirport(MapWidget *mapWidget, MapQuery *mapQuery, MapScale *mapScale,
                                      const Route *routeParam)
   : MapPainter(mapWidget, mapQuery, mapScale), route(routeParam)
@@ -115,6 +131,36 @@ void MapPainterAirport::render(PaintContext *context)
     }
   }
 
+  // Hide less important airports if there are too many in the visible area
+  MapDeclutter declutter(PaintContext::MAX_AIRPORT_COUNT);
+  float symbolSize = context->szF(context->symbolSizeAirport, context->mapLayerEffective->getAirportSymbolSize());
+  for(int i = 0; i < visibleAirports.size(); i++)
+  {
+    const MapAirport *airport = visibleAirports.at(i);
+    declutter.add(static_cast<quint32>(i), visiblePoints.at(i),
+                  routeAirportIds.contains(airport->id) ? MapDeclutter::MUST_DRAW : airportPriority(*airport),
+                  symbolSize);
+  }
+  declutter.declutter();
+
+  if(declutter.getNumHidden() > 0)
+  {
+    QList<const MapAirport *> keptAirports;
+    QList<QPointF> keptPoints;
+    for(int i = 0; i < visibleAirports.size(); i++)
+    {
+      if(!declutter.isHidden(static_cast<quint32>(i)))
+      {
+        keptAirports.append(visibleAirports.at(i));
+        keptPoints.append(visiblePoints.at(i));
+      }
+    }
+    visibleAirports.swap(keptAirports);
+    visiblePoints.swap(keptPoints);
+    context->objectsHidden += declutter.getNumHidden();
+  }
+  context->objectsDrawn += visibleAirports.size();
+
   if(context->mapLayerEffective->isAirportDiagram())
   {
     // In diagram mode draw background first to avoid overwriting other airports
@@ -169,7 +215,7 @@ void MapPainterAirport::render(PaintContext *context)
                                      flags,
                                      context->sz(context->symbolSizeAirport,
                                                  context->mapLayerEffective->getAirportSymbolSize()),
-                                     context->mapLayerEffective->isAirportDiagram());
+                                     context->mapLayerEffective->isAirportDiagram(), context->labelGrid);
     }
   }
 }
@@ -900,9 +946,6 @@ void MapPainterAirport::drawAirportSymbol(PaintContext *context, const map::MapA
      ap.waterOnly() || ap.longestRunwayLength < RUNWAY_OVERVIEW_MIN_LENGTH_FEET ||
      context->mapLayerEffective->isAirportDiagram())
   {
-    if(context->objCount())
-      return;
-
     int size = context->sz(context->symbolSizeAirport, context->mapLayerEffective->getAirportSymbolSize());
     bool isAirportDiagram = context->mapLayerEffective->isAirportDiagram();
 
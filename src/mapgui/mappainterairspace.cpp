@@ -21,6 +21,8 @@
 #include "util/paintercontextsaver.h"
 #include "route/route.h"
 #include "mapgui/mapquery.h"
+#include "mapgui/mapscale.h"
+#include "common/maptools.h"
 
 #include <marble/GeoDataLineString.h>
 #include <marble/GeoPainter.h>
@@ -33,10 +35,14 @@ using namespace Marble;
 using namespace atools::geo;
 using namespace map;
 
+// Definition needed since the array is indexed
+Q_DECL_CONSTEXPR float MapPainterAirspace::SIMPLIFY_TOLERANCE_DEG[];
+
 MapPainterAirspace::MapPainterAirspace(MapWidget *mapWidget, MapQuery *mapQuery, MapScale *mapScale,
                                        const Route *routeParam)
   : MapPainter(mapWidget, mapQuery, mapScale), route(routeParam)
 {
+  geometryCache.setMaxCost(GEOMETRY_CACHE_SIZE);
 }
 
 MapPainterAirspace::~MapPainterAirspace()
@@ -52,7 +58,7 @@ void MapPainterAirspace::render(PaintContext *context)
   const GeoDataLatLonAltBox& curBox = context->viewport->viewLatLonAltBox();
   const QList<MapAirspace> *airspaces =
     query->getAirspaces(curBox, context->mapLayer, context->airspaceTypesByLayer, route->getCruisingAltitudeFeet(),
-                        context->viewContext == Marble::Animation);
+                        context->lazyUpdate || context->viewContext == Marble::Animation);
   if(airspaces != nullptr)
   {
     Marble::GeoPainter *painter = context->painter;
@@ -61,6 +67,8 @@ void MapPainterAirspace::render(PaintContext *context)
 
     painter->setBackgroundMode(Qt::TransparentMode);
 
+    updateScreenCache(context->viewport);
+
     for(const MapAirspace& airspace : *airspaces)
     {
       if(!(airspace.type & context->airspaceTypesByLayer))
@@ -68,21 +76,105 @@ void MapPainterAirspace::render(PaintContext *context)
 
       if(context->viewportRect.overlaps(airspace.bounding))
       {
-        Marble::GeoDataLinearRing linearRing;
-        linearRing.setTessellate(true);
-
         painter->setPen(mapcolors::penForAirspace(airspace));
 
         if(!context->drawFast)
           painter->setBrush(mapcolors::colorForAirspaceFill(airspace));
 
-        const LineString *lines = query->getAirspaceGeometry(airspace.id);
+        auto it = screenCache.find(airspace.id);
+        if(it == screenCache.end())
+        {
+          // Project tessellated ring to screen polygons which are valid until the viewport changes
+          QVector<QPolygonF> polygons;
+          const GeoDataLinearRing *ring = airspaceRing(airspace.id, lastLevel);
+          if(ring != nullptr)
+          {
+            QVector<QPolygonF *> screenPolygons;
+            context->viewport->screenCoordinates(*ring, screenPolygons);
+            for(QPolygonF *polygon : screenPolygons)
+              polygons.append(*polygon);
+            qDeleteAll(screenPolygons);
+          }
+          it = screenCache.insert(airspace.id, polygons);
+        }
+
+        for(const QPolygonF& polygon : it.value())
+          static_cast<QPainter *>(painter)->drawPolygon(polygon);
+        context->objectsDrawn++;
+      }
+    }
+  }
+}
 
-        for(const Pos& pos : *lines)
-          linearRing.append(Marble::GeoDataCoordinates(pos.getLonX(), pos.getLatY(), 0, DEG));
+void MapPainterAirspace::clearCache()
+{
+  geometryCache.clear();
+  screenCache.clear();
+}
 
-        painter->drawPolygon(linearRing);
-      }
+const GeoDataLinearRing *MapPainterAirspace::airspaceRing(int airspaceId, int level)
+{
+  QVector<GeoDataLinearRing> *rings = geometryCache.object(airspaceId);
+  if(rings == nullptr)
+  {
+    const LineString *lines = query->getAirspaceGeometry(airspaceId);
+    if(lines == nullptr)
+      return nullptr;
+
+    rings = new QVector<GeoDataLinearRing>;
+    int cost = 0;
+    LineString simplified;
+    for(int i = 0; i < SIMPLIFY_LEVELS; i++)
+    {
+      maptools::simplifyLine(*lines, SIMPLIFY_TOLERANCE_DEG[i], simplified);
+
+      GeoDataLinearRing linearRing;
+      linearRing.setTessellate(true);
+      for(const Pos& pos : simplified)
+        linearRing.append(GeoDataCoordinates(pos.getLonX(), pos.getLatY(), 0, DEG));
+      rings->append(linearRing);
+      cost += simplified.size();
     }
+    geometryCache.insert(airspaceId, rings, cost);
+
+    // Object might be deleted by the cache if too large
+    rings = geometryCache.object(airspaceId);
+    if(rings == nullptr)
+      return nullptr;
+  }
+  return &rings->at(level);
+}
+
+int MapPainterAirspace::simplifyLevel() const
+{
+  // One degree latitude is 60 NM
+  float pixelPerDeg = scale->getPixelForNm(60.f);
+  if(!(pixelPerDeg > 0.f))
+    return 0;
+
+  float maxToleranceDeg = SIMPLIFY_MAX_ERROR_PIXEL / pixelPerDeg;
+  int level = 0;
+  for(int i = 1; i < SIMPLIFY_LEVELS; i++)
+  {
+    if(SIMPLIFY_TOLERANCE_DEG[i] <= maxToleranceDeg)
+      level = i;
+  }
+  return level;
+}
+
+void MapPainterAirspace::updateScreenCache(const ViewportParams *viewport)
+{
+  int level = simplifyLevel();
+  if(viewport->centerLongitude() != lastCenterLonX || viewport->centerLatitude() != lastCenterLatY ||
+     viewport->radius() != lastRadius || viewport->size() != lastSize ||
+     viewport->projection() != lastProjection || level != lastLevel)
+  {
+    lastCenterLonX = viewport->centerLongitude();
+    lastCenterLatY = viewport->centerLatitude();
+    lastRadius = viewport->radius();
+    lastSize = viewport->size();
+    lastProjection = viewport->projection();
+    lastLevel = level;
+    screenCache.clear();
   }
 }
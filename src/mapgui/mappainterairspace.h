@@ -20,6 +20,12 @@
 
 #include "mapgui/mappainter.h"
 
+#include <QCache>
+#include <QHash>
+#include <QPolygonF>
+
+#include <marble/GeoDataLinearRing.h>
+
 namespace Marble {
 class GeoDataLineString;
 }
@@ -29,6 +35,9 @@ class Route;
 
 /*
  * Paints all airspaces/boundaries.
+ *
+ * Keeps simplified boundary rings for several levels of detail which are selected by map scale.
+ * The projected screen polygons are kept until the viewport changes.
  */
 class MapPainterAirspace :
   public MapPainter
@@ -39,8 +48,42 @@ public:
 
   virtual void render(PaintContext *context) override;
 
+  /* Clear all geometry caches. Needed if the database changes. */
+  void clearCache();
+
 private:
+  /* Get the ring for the airspace boundary simplified for the given level */
+  const Marble::GeoDataLinearRing *airspaceRing(int airspaceId, int level);
+
+  /* Get the level of detail for the current map scale */
+  int simplifyLevel() const;
+
+  /* Clear screen polygons if the viewport has changed */
+  void updateScreenCache(const Marble::ViewportParams *viewport);
+
+  /* Maximum distance in degree of removed points for each level. Level 0 uses all points. */
+  static Q_DECL_CONSTEXPR int SIMPLIFY_LEVELS = 5;
+  static Q_DECL_CONSTEXPR float SIMPLIFY_TOLERANCE_DEG[SIMPLIFY_LEVELS] = {0.f, 0.002f, 0.01f, 0.05f, 0.2f};
+
+  /* Maximum error in pixel when selecting a simplified ring */
+  static Q_DECL_CONSTEXPR float SIMPLIFY_MAX_ERROR_PIXEL = 0.5f;
+
+  /* Maximum number of coordinates in geometryCache */
+  static Q_DECL_CONSTEXPR int GEOMETRY_CACHE_SIZE = 500000;
+
   const Route *route;
+
+  /* Rings for all levels by airspace id. Cost is number of coordinates. */
+  QCache<int, QVector<Marble::GeoDataLinearRing> > geometryCache;
+
+  /* Projected polygons by airspace id for the current viewport and level */
+  QHash<int, QVector<QPolygonF> > screenCache;
+
+  /* Used to detect viewport changes */
+  double lastCenterLonX = 0., lastCenterLatY = 0.;
+  int lastRadius = 0, lastLevel = -1;
+  QSize lastSize;
+  Marble::Projection lastProjection = Marble::VerticalPerspective;
 };
 
 #endif // LITTLENAVMAP_MAPPAINTERAIRSPACE_H
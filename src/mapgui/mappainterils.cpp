@@ -18,6 +18,7 @@
 #include "mappainterils.h"
 
 #include "mapgui/mapscale.h"
+#include "mapgui/mapdeclutter.h"
 #include "mapgui/maplayer.h"
 #include "mapgui/mapquery.h"
 #include "geo/calculations.h"
@@ -57,24 +58,38 @@ void MapPainterIls::render(PaintContext *context)
       atools::util::PainterContextSaver saver(context->painter);
       Q_UNUSED(saver);
 
-      for(const MapIls& ils : *ilsList)
+      // Keep the number of ILS bounded - ILS with glideslope and longer range are more important
+      MapDeclutter declutter(PaintContext::MAX_ILS_COUNT);
+      QVector<int> visibleIndexes;
+      for(int i = 0; i < ilsList->size(); i++)
       {
+        const MapIls& ils = ilsList->at(i);
         int x, y;
         // Need to get the real ILS size on the screen for mercator projection - otherwise feather may vanish
         bool visible = wToS(ils.position, x, y, scale->getScreeenSizeForRect(ils.bounding));
 
+        // Hide feathers with overlapping origin - size is the width of the feather end
+        float size = visible ? scale->getPixelForMeter(ils.pos1.distanceMeterTo(ils.pos2)) : 0.f;
+
         if(!visible)
-          // Check bounding rect for visibility
+          // Check bounding rect for visibility - origin not usable for overlap detection
           visible = ils.bounding.overlaps(context->viewportRect);
 
         if(visible)
         {
-          if(context->objCount())
-            return;
-
-          drawIlsSymbol(context, ils);
+          declutter.add(static_cast<quint32>(i), QPointF(x, y), (ils.slope > 0.f ? 1000.f : 0.f) + ils.range, size);
+          visibleIndexes.append(i);
         }
       }
+      declutter.declutter();
+      context->objectsHidden += declutter.getNumHidden();
+      context->objectsDrawn += declutter.getNumCandidates() - declutter.getNumHidden();
+
+      for(int index : visibleIndexes)
+      {
+        if(!declutter.isHidden(static_cast<quint32>(index)))
+          drawIlsSymbol(context, ilsList->at(index));
+      }
     }
   }
 }
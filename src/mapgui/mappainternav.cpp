@@ -22,6 +22,8 @@
 #include "common/unit.h"
 #include "mapgui/mapwidget.h"
 #include "common/textplacement.h"
+#include "common/textspritecache.h"
+#include "mapgui/mapdeclutter.h"
 #include "util/paintercontextsaver.h"
 
 #include <QElapsedTimer>
@@ -61,6 +63,7 @@ void MapPainterNav::render(PaintContext *context)
   {
     // Draw airway lines
     const QList<MapAirway> *airways = query->getAirways(curBox, context->mapLayer,
+                                                        context->lazyUpdate ||
                                                         context->viewContext == Marble::Animation);
     if(airways != nullptr)
       paintAirways(context, airways, context->drawFast);
@@ -68,37 +71,106 @@ void MapPainterNav::render(PaintContext *context)
 
   // Waypoints -------------------------------------------------
   bool drawWaypoint = context->mapLayer->isWaypoint() && context->objectTypes.testFlag(map::WAYPOINT);
+  const QList<MapWaypoint> *waypoints = nullptr;
   if(drawWaypoint || drawAirway)
-  {
     // If airways are drawn we also have to go through waypoints
-    const QList<MapWaypoint> *waypoints = query->getWaypoints(curBox, context->mapLayer, context->lazyUpdate);
-    if(waypoints != nullptr)
-      paintWaypoints(context, waypoints, drawWaypoint, context->drawFast);
-  }
+    waypoints = query->getWaypoints(curBox, context->mapLayer, context->lazyUpdate);
 
   // VOR -------------------------------------------------
+  const QList<MapVor> *vors = nullptr;
   if(context->mapLayer->isVor() && context->objectTypes.testFlag(map::VOR))
-  {
-    const QList<MapVor> *vors = query->getVors(curBox, context->mapLayer, context->lazyUpdate);
-    if(vors != nullptr)
-      paintVors(context, vors, context->drawFast);
-  }
+    vors = query->getVors(curBox, context->mapLayer, context->lazyUpdate);
 
   // NDB -------------------------------------------------
+  const QList<MapNdb> *ndbs = nullptr;
   if(context->mapLayer->isNdb() && context->objectTypes.testFlag(map::NDB))
-  {
-    const QList<MapNdb> *ndbs = query->getNdbs(curBox, context->mapLayer, context->lazyUpdate);
-    if(ndbs != nullptr)
-      paintNdbs(context, ndbs, context->drawFast);
-  }
+    ndbs = query->getNdbs(curBox, context->mapLayer, context->lazyUpdate);
 
   // Marker -------------------------------------------------
+  const QList<MapMarker> *markers = nullptr;
   if(context->mapLayer->isMarker() && context->objectTypes.testFlag(map::ILS))
+    markers = query->getMarkers(curBox, context->mapLayer, context->lazyUpdate);
+
+  // Hide less important navaids if there are too many in the visible area
+  MapDeclutter declutter(PaintContext::MAX_NAVAID_COUNT);
+  declutterNavaids(context, declutter, waypoints, drawWaypoint, vors, ndbs, markers);
+
+  if(waypoints != nullptr)
+    paintWaypoints(context, declutter, waypoints, drawWaypoint, context->drawFast);
+
+  if(vors != nullptr)
+    paintVors(context, declutter, vors, context->drawFast);
+
+  if(ndbs != nullptr)
+    paintNdbs(context, declutter, ndbs, context->drawFast);
+
+  if(markers != nullptr)
+    paintMarkers(context, declutter, markers, context->drawFast);
+}
+
+/* Add all visible navaids to the declutter and select the ones to draw. VORs have the highest priority
+ * followed by NDBs, markers and waypoints. Waypoints on airways are more important than others. */
+void MapPainterNav::declutterNavaids(PaintContext *context, MapDeclutter& declutter,
+                                     const QList<MapWaypoint> *waypoints, bool drawWaypoint,
+                                     const QList<MapVor> *vors, const QList<MapNdb> *ndbs,
+                                     const QList<MapMarker> *markers)
+{
+  const MapLayer *layer = context->mapLayerEffective;
+  int x, y;
+
+  if(waypoints != nullptr)
   {
-    const QList<MapMarker> *markers = query->getMarkers(curBox, context->mapLayer, context->lazyUpdate);
-    if(markers != nullptr)
-      paintMarkers(context, markers, context->drawFast);
+    bool drawAirwayV = context->mapLayer->isAirway() && context->objectTypes.testFlag(map::AIRWAYV);
+    bool drawAirwayJ = context->mapLayer->isAirway() && context->objectTypes.testFlag(map::AIRWAYJ);
+    float size = context->szF(context->symbolSizeNavaid, layer->getWaypointSymbolSize());
+
+    for(int i = 0; i < waypoints->size(); i++)
+    {
+      const MapWaypoint& waypoint = waypoints->at(i);
+      if(!(drawWaypoint || (drawAirwayV && waypoint.hasVictorAirways) || (drawAirwayJ && waypoint.hasJetAirways)))
+        continue;
+
+      if(wToS(waypoint.position, x, y))
+        declutter.add(navaidId(i, NAV_WAYPOINT), QPointF(x, y),
+                      waypoint.hasVictorAirways || waypoint.hasJetAirways ? 1000.f : 0.f, size);
+    }
   }
+
+  if(vors != nullptr)
+  {
+    float size = context->szF(context->symbolSizeNavaid, layer->getVorSymbolSize());
+    for(int i = 0; i < vors->size(); i++)
+    {
+      const MapVor& vor = vors->at(i);
+      if(wToS(vor.position, x, y))
+        declutter.add(navaidId(i, NAV_VOR), QPointF(x, y), (vor.dmeOnly ? 20000.f : 30000.f) + vor.range, size);
+    }
+  }
+
+  if(ndbs != nullptr)
+  {
+    float size = context->szF(context->symbolSizeNavaid, layer->getNdbSymbolSize());
+    for(int i = 0; i < ndbs->size(); i++)
+    {
+      const MapNdb& ndb = ndbs->at(i);
+      if(wToS(ndb.position, x, y))
+        declutter.add(navaidId(i, NAV_NDB), QPointF(x, y), 10000.f + ndb.range, size);
+    }
+  }
+
+  if(markers != nullptr)
+  {
+    float size = context->szF(context->symbolSizeNavaid, layer->getMarkerSymbolSize());
+    for(int i = 0; i < markers->size(); i++)
+    {
+      if(wToS(markers->at(i).position, x, y))
+        declutter.add(navaidId(i, NAV_MARKER), QPointF(x, y), 5000.f, size);
+    }
+  }
+
+  declutter.declutter();
+  context->objectsHidden += declutter.getNumHidden();
+  context->objectsDrawn += declutter.getNumCandidates() - declutter.getNumHidden();
 }
 
 /* Draw airways and texts */
@@ -114,6 +186,27 @@ void MapPainterNav::paintAirways(PaintContext *context, const QList<MapAirway> *
   // points to index or airway in airway list
   QList<int> airwayIndex;
 
+  // Hide shorter airway segments if there are too many in the visible area
+  MapDeclutter declutter(PaintContext::MAX_AIRWAY_COUNT);
+  for(int i = 0; i < airways->size(); i++)
+  {
+    const MapAirway& airway = airways->at(i);
+    if((airway.type == map::JET && !context->objectTypes.testFlag(map::AIRWAYJ)) ||
+       (airway.type == map::VICTOR && !context->objectTypes.testFlag(map::AIRWAYV)))
+      continue;
+
+    float x1, y1, x2, y2;
+    bool visible1 = wToS(airway.from, x1, y1);
+    bool visible2 = wToS(airway.to, x2, y2);
+    if(visible1 || visible2 || airway.bounding.overlaps(context->viewportRect))
+      // Longer segments are more important - use the length on the earth since screen coordinates of
+      // invisible points are not valid. No overlap detection.
+      declutter.add(static_cast<quint32>(i), QPointF(x1, y1), airway.from.distanceMeterTo(airway.to), 0.f);
+  }
+  declutter.declutter();
+  context->objectsHidden += declutter.getNumHidden();
+  context->objectsDrawn += declutter.getNumCandidates() - declutter.getNumHidden();
+
   for(int i = 0; i < airways->size(); i++)
   {
     const MapAirway& airway = airways->at(i);
@@ -139,11 +232,8 @@ void MapPainterNav::paintAirways(PaintContext *context, const QList<MapAirway> *
       // Check bounding rect for visibility
       visible1 = airway.bounding.overlaps(context->viewportRect);
 
-    if(visible1 || visible2)
+    if((visible1 || visible2) && !declutter.isHidden(static_cast<quint32>(i)))
     {
-      if(context->objCount())
-        return;
-
       // Draw line if both points are visible or line intersects screen coordinates
       GeoDataCoordinates from(airway.from.getLonX(), airway.from.getLatY(), 0, DEG);
       GeoDataCoordinates to(airway.to.getLonX(), airway.to.getLatY(), 0, DEG);
@@ -199,6 +289,7 @@ void MapPainterNav::paintAirways(PaintContext *context, const QList<MapAirway> *
   }
 
   TextPlacement textPlacement(context->painter, this);
+  textPlacement.setLabelGrid(context->labelGrid);
 
   // Draw texts ----------------------------------------
   int i = 0;
@@ -219,8 +310,12 @@ void MapPainterNav::paintAirways(PaintContext *context, const QList<MapAirway> *
 
       context->painter->translate(xt, yt);
       context->painter->rotate(rotate);
-      context->painter->drawText(-context->painter->fontMetrics().width(text) / 2,
-                                 context->painter->fontMetrics().ascent(), text);
+      QPointF textPos(-context->painter->fontMetrics().width(text) / 2,
+                      context->painter->fontMetrics().ascent());
+      if(textCache != nullptr)
+        textCache->drawText(context->painter, textPos, text);
+      else
+        context->painter->drawText(textPos, text);
       context->painter->resetTransform();
     }
     i++;
@@ -228,49 +323,54 @@ void MapPainterNav::paintAirways(PaintContext *context, const QList<MapAirway> *
 }
 
 /* Draw waypoints. If airways are enabled corresponding waypoints are drawn too */
-void MapPainterNav::paintWaypoints(PaintContext *context, const QList<MapWaypoint> *waypoints,
-                                   bool drawWaypoint, bool drawFast)
+void MapPainterNav::paintWaypoints(PaintContext *context, const MapDeclutter& declutter,
+                                   const QList<MapWaypoint> *waypoints, bool drawWaypoint, bool drawFast)
 {
   bool drawAirwayV = context->mapLayer->isAirway() && context->objectTypes.testFlag(map::AIRWAYV);
   bool drawAirwayJ = context->mapLayer->isAirway() && context->objectTypes.testFlag(map::AIRWAYJ);
 
-  for(const MapWaypoint& waypoint : *waypoints)
+  for(int i = 0; i < waypoints->size(); i++)
   {
+    const MapWaypoint& waypoint = waypoints->at(i);
+
     // If waypoints are off, airways are on and waypoint has no airways skip it
     if(!(drawWaypoint || (drawAirwayV && waypoint.hasVictorAirways) || (drawAirwayJ && waypoint.hasJetAirways)))
       continue;
 
+    if(declutter.isHidden(navaidId(i, NAV_WAYPOINT)))
+      continue;
+
     int x, y;
     bool visible = wToS(waypoint.position, x, y);
 
     if(visible)
     {
-      if(context->objCount())
-        return;
-
       int size = context->sz(context->symbolSizeNavaid, context->mapLayerEffective->getWaypointSymbolSize());
       symbolPainter->drawWaypointSymbol(context->painter, QColor(), x, y, size, false, drawFast);
 
       // If airways are drawn force display of the respecive waypoints
       if(context->mapLayer->isWaypointName() ||
          (context->mapLayer->isAirwayIdent() && (drawAirwayV || drawAirwayJ)))
-        symbolPainter->drawWaypointText(context->painter, waypoint, x, y, textflags::IDENT, size, false);
+        symbolPainter->drawWaypointText(context->painter, waypoint, x, y, textflags::IDENT, size, false,
+                                        nullptr, context->labelGrid);
     }
   }
 }
 
-void MapPainterNav::paintVors(PaintContext *context, const QList<MapVor> *vors, bool drawFast)
+void MapPainterNav::paintVors(PaintContext *context, const MapDeclutter& declutter, const QList<MapVor> *vors,
+                              bool drawFast)
 {
-  for(const MapVor& vor : *vors)
+  for(int i = 0; i < vors->size(); i++)
   {
+    const MapVor& vor = vors->at(i);
+    if(declutter.isHidden(navaidId(i, NAV_VOR)))
+      continue;
+
     int x, y;
     bool visible = wToS(vor.position, x, y);
 
     if(visible)
     {
-      if(context->objCount())
-        return;
-
       int size = context->sz(context->symbolSizeNavaid, context->mapLayerEffective->getVorSymbolSize());
       symbolPainter->drawVorSymbol(context->painter, vor, x, y,
                                    size, false, drawFast,
@@ -283,23 +383,25 @@ void MapPainterNav::paintVors(PaintContext *context, const QList<MapVor> *vors,
       else if(context->mapLayer->isVorIdent())
         flags = textflags::IDENT;
 
-      symbolPainter->drawVorText(context->painter, vor, x, y, flags, size, false);
+      symbolPainter->drawVorText(context->painter, vor, x, y, flags, size, false, nullptr, context->labelGrid);
     }
   }
 }
 
-void MapPainterNav::paintNdbs(PaintContext *context, const QList<MapNdb> *ndbs, bool drawFast)
+void MapPainterNav::paintNdbs(PaintContext *context, const MapDeclutter& declutter, const QList<MapNdb> *ndbs,
+                              bool drawFast)
 {
-  for(const MapNdb& ndb : *ndbs)
+  for(int i = 0; i < ndbs->size(); i++)
   {
+    const MapNdb& ndb = ndbs->at(i);
+    if(declutter.isHidden(navaidId(i, NAV_NDB)))
+      continue;
+
     int x, y;
     bool visible = wToS(ndb.position, x, y);
 
     if(visible)
     {
-      if(context->objCount())
-        return;
-
       int size = context->sz(context->symbolSizeNavaid, context->mapLayerEffective->getNdbSymbolSize());
       symbolPainter->drawNdbSymbol(context->painter, x, y, size, false, drawFast);
 
@@ -310,23 +412,25 @@ void MapPainterNav::paintNdbs(PaintContext *context, const QList<MapNdb> *ndbs,
       else if(context->mapLayer->isNdbIdent())
         flags = textflags::IDENT;
 
-      symbolPainter->drawNdbText(context->painter, ndb, x, y, flags, size, false);
+      symbolPainter->drawNdbText(context->painter, ndb, x, y, flags, size, false, nullptr, context->labelGrid);
     }
   }
 }
 
-void MapPainterNav::paintMarkers(PaintContext *context, const QList<MapMarker> *markers, bool drawFast)
+void MapPainterNav::paintMarkers(PaintContext *context, const MapDeclutter& declutter,
+                                 const QList<MapMarker> *markers, bool drawFast)
 {
-  for(const MapMarker& marker : *markers)
+  for(int i = 0; i < markers->size(); i++)
   {
+    const MapMarker& marker = markers->at(i);
+    if(declutter.isHidden(navaidId(i, NAV_MARKER)))
+      continue;
+
     int x, y;
     bool visible = wToS(marker.position, x, y);
 
     if(visible)
     {
-      if(context->objCount())
-        return;
-
       int size = context->sz(context->symbolSizeNavaid, context->mapLayerEffective->getMarkerSymbolSize());
       symbolPainter->drawMarkerSymbol(context->painter, marker, x, y, size, drawFast);
 
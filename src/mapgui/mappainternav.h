@@ -23,6 +23,7 @@
 #include "mapgui/mapquery.h"
 
 class SymbolPainter;
+class MapDeclutter;
 
 /*
  * Draws VOR, NDB, markers, waypoints and airways. Flight plan navaids are drawn separately in MapPainterRoute.
@@ -39,11 +40,32 @@ public:
   virtual void render(PaintContext *context) override;
 
 private:
-  void paintMarkers(PaintContext *context, const QList<map::MapMarker> *markers, bool drawFast);
-  void paintNdbs(PaintContext *context, const QList<map::MapNdb> *ndbs, bool drawFast);
-  void paintVors(PaintContext *context, const QList<map::MapVor> *vors, bool drawFast);
-  void paintWaypoints(PaintContext *context, const QList<map::MapWaypoint> *waypoints,
-                      bool drawWaypoint, bool drawFast);
+  /* Navaid type used to build unique ids for the declutter */
+  enum NavaidType
+  {
+    NAV_WAYPOINT,
+    NAV_VOR,
+    NAV_NDB,
+    NAV_MARKER
+  };
+
+  static quint32 navaidId(int index, NavaidType type)
+  {
+    return static_cast<quint32>(index) * 4 + type;
+  }
+
+  void declutterNavaids(PaintContext *context, MapDeclutter& declutter, const QList<map::MapWaypoint> *waypoints,
+                        bool drawWaypoint, const QList<map::MapVor> *vors, const QList<map::MapNdb> *ndbs,
+                        const QList<map::MapMarker> *markers);
+
+  void paintMarkers(PaintContext *context, const MapDeclutter& declutter, const QList<map::MapMarker> *markers,
+                    bool drawFast);
+  void paintNdbs(PaintContext *context, const MapDeclutter& declutter, const QList<map::MapNdb> *ndbs,
+                 bool drawFast);
+  void paintVors(PaintContext *context, const MapDeclutter& declutter, const QList<map::MapVor> *vors,
+                 bool drawFast);
+  void paintWaypoints(PaintContext *context, const MapDeclutter& declutter,
+                      const QList<map::MapWaypoint> *waypoints, bool drawWaypoint, bool drawFast);
   void paintAirways(PaintContext *context, const QList<map::MapAirway> *airways, bool fast);
 
 };
@@ -159,6 +159,7 @@ void MapPainterRoute::paintRoute(const PaintContext *context)
   // Collect coordinates for text placement and lines first
   TextPlacement textPlacement(painter, this);
   textPlacement.setDrawFast(context->drawFast);
+  textPlacement.setTextCache(textCache);
   textPlacement.setLineWidth(outerlinewidth);
   textPlacement.calculateTextPositions(positions);
   textPlacement.calculateTextAlongLines(lines, routeTexts);
@@ -369,6 +370,7 @@ void MapPainterRoute::paintApproach(const PaintContext *context, const proc::Map
 
     TextPlacement textPlacement(painter, this);
     textPlacement.setDrawFast(context->drawFast);
+    textPlacement.setTextCache(textCache);
     textPlacement.setTextOnTopOfLine(false);
     textPlacement.setLineWidth(outerlinewidth);
     textPlacement.setColors(textColors);
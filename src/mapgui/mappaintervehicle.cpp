@@ -122,61 +122,70 @@ void MapPainterVehicle::paintTrack(const PaintContext *context)
 
   if(!aircraftTrack.isEmpty())
   {
-    QPolygon polyline;
+    const AircraftTrackPyramid& pyramid = aircraftTrack.getPyramid();
 
-    GeoPainter *painter = context->painter;
+    // Use the most simplified level where the deviation from the track is not visible
+    int level = 0;
+    for(int i = pyramid.getNumLevels() - 1; i > 0; i--)
+    {
+      if(scale->getPixelForMeter(pyramid.getToleranceMeter(i)) < AIRCRAFT_TRACK_MAX_ERROR)
+      {
+        level = i;
+        break;
+      }
+    }
+
+    const QVector<int>& indexes = pyramid.getIndexes(level);
+    const QVector<AircraftTrackPyramid::Chunk>& chunks = pyramid.getChunks(level);
 
+    GeoPainter *painter = context->painter;
     float size = context->sz(context->thicknessTrail, 2);
     painter->setPen(mapcolors::aircraftTrailPen(size));
-    bool lastVisible = false;
 
-    int x1, y1;
-    int x2 = -1, y2 = -1;
-    QRect vpRect(painter->viewport());
-    wToS(aircraftTrack.first().pos, x1, y1);
-
-    for(int i = 1; i < aircraftTrack.size(); i++)
+    QPolygon polyline;
+    int x, y;
+    for(const AircraftTrackPyramid::Chunk& chunk : chunks)
     {
-      const at::AircraftTrackPos& trackPos = aircraftTrack.at(i);
-      wToS(trackPos.pos, x2, y2);
-
-      QRect rect(QPoint(x1, y1), QPoint(x2, y2));
-      rect = rect.normalized();
-      rect.adjust(-1, -1, 1, 1);
-
-      // Current line is visible (most likely)
-      bool nowVisible = rect.intersects(vpRect);
+      if(!chunk.bounding.overlaps(context->viewportRect))
+      {
+        // Not visible - draw the collected visible chunks
+        if(polyline.size() > 1)
+          painter->drawPolyline(polyline);
+        polyline.clear();
+        continue;
+      }
 
-      if(lastVisible || nowVisible)
+      // Chunk covers the first position of the next chunk too - skip first if already added by previous chunk
+      int last = std::min(chunk.first + AircraftTrackPyramid::CHUNK_SIZE, indexes.size() - 1);
+      for(int i = polyline.isEmpty() ? chunk.first : chunk.first + 1; i <= last; i++)
       {
-        if(!polyline.isEmpty())
+        wToS(aircraftTrack.at(indexes.at(i)).pos, x, y);
+
+        if(!polyline.isEmpty() && aircraftTrack.isTrackBreak(indexes.at(i)))
         {
-          const QPoint& lastPt = polyline.last();
-          // Last line or this one are visible add coords
-          if(atools::geo::manhattanDistance(lastPt.x(), lastPt.y(), x2, y2) > AIRCRAFT_TRACK_MIN_LINE_LENGTH)
-            polyline.append(QPoint(x1, y1));
+          // Jump in a replayed flight - start a new line
+          if(polyline.size() > 1)
+            painter->drawPolyline(polyline);
+          polyline.clear();
         }
-        else
-          // Always add first visible point
-          polyline.append(QPoint(x1, y1));
-      }
 
-      if(lastVisible && !nowVisible)
-      {
-        // Not visible anymore draw previous line segment
-        painter->drawPolyline(polyline);
-        polyline.clear();
+        // Always add first and last point of a chunk to keep chunks connected
+        if(polyline.isEmpty() || i == last ||
+           atools::geo::manhattanDistance(polyline.last().x(), polyline.last().y(), x, y) >
+           AIRCRAFT_TRACK_MIN_LINE_LENGTH)
+          polyline.append(QPoint(x, y));
       }
-
-      lastVisible = nowVisible;
-      x1 = x2;
-      y1 = y2;
     }
 
     // Draw rest
     if(!polyline.isEmpty())
     {
-      polyline.append(QPoint(x2, y2));
+      // Connect to the current position which might be skipped in simplified levels
+      if(indexes.last() != aircraftTrack.size() - 1)
+      {
+        wToS(aircraftTrack.last().pos, x, y);
+        polyline.append(QPoint(x, y));
+      }
       painter->drawPolyline(polyline);
     }
   }
@@ -101,6 +101,9 @@ protected:
   /* Minimum length in pixel of a track segment to be drawn */
   static Q_DECL_CONSTEXPR int AIRCRAFT_TRACK_MIN_LINE_LENGTH = 5;
 
+  /* Maximum deviation in pixel from the track when using a simplified track level */
+  static Q_DECL_CONSTEXPR float AIRCRAFT_TRACK_MAX_ERROR = 1.f;
+
   static Q_DECL_CONSTEXPR int WIND_POINTER_SIZE = 40;
 
 private:
@@ -19,6 +19,7 @@
 
 #include "navapp.h"
 #include "connect/connectclient.h"
+#include "connect/trackreplay.h"
 #include "mapgui/mapwidget.h"
 #include "mapgui/maplayersettings.h"
 #include "mapgui/mappainteraircraft.h"
@@ -30,8 +31,14 @@
 #include "mapgui/mappainternav.h"
 #include "mapgui/mappainterroute.h"
 #include "mapgui/mapscale.h"
+#include "mapgui/mapqueryprefetch.h"
+#include "mapgui/maplayercompositor.h"
+#include "mapgui/mappaintprofiler.h"
 #include "route/route.h"
 #include "options/optiondata.h"
+#include "common/constants.h"
+#include "common/labelgrid.h"
+#include "settings/settings.h"
 
 #include <QElapsedTimer>
 
@@ -58,12 +65,57 @@ MapPaintLayer::MapPaintLayer(MapWidget *widget, MapQuery *mapQueries)
   mapPainterAircraft = new MapPainterAircraft(mapWidget, mapQuery, mapScale);
   mapPainterShip = new MapPainterShip(mapWidget, mapQuery, mapScale);
 
+  // Optional frame time and query statistics
+  profiler = new MapPaintProfiler;
+  if(profiler->isEnabled())
+  {
+    profiler->setPainterName(mapPainterNav, "Navaids");
+    profiler->setPainterName(mapPainterIls, "ILS");
+    profiler->setPainterName(mapPainterAirport, "Airports");
+    profiler->setPainterName(mapPainterAirspace, "Airspaces");
+    profiler->setPainterName(mapPainterMark, "Marks");
+    profiler->setPainterName(mapPainterRoute, "Route");
+    profiler->setPainterName(mapPainterAircraft, "Aircraft");
+    profiler->setPainterName(mapPainterShip, "Ships");
+    mapQuery->setProfiler(profiler);
+  }
+
+  // Optional parallel rendering of the static layers
+  compositor = new MapLayerCompositor(mapWidget, mapQuery);
+  if(profiler->isEnabled())
+    compositor->setProfiler(profiler);
+
+  staticLayerCacheEnabled = atools::settings::Settings::instance().getAndStoreValue(
+    lnm::SETTINGS_MAPPAINT + "StaticLayerCache", true).toBool();
+
+  // Move or hide overlapping labels
+  if(atools::settings::Settings::instance().getAndStoreValue(
+       lnm::SETTINGS_MAPPAINT + "LabelCollision", true).toBool())
+    labelGrid = new LabelGrid;
+
+  // Repaint when new objects were loaded in background
+  prefetch = new MapQueryPrefetch(mapQuery, NavApp::getDatabase());
+  QObject::connect(prefetch, &MapQueryPrefetch::tilesLoaded, mapWidget, [ = ]()
+                   {
+                     invalidateStaticLayers();
+                     mapWidget->update();
+                   });
+
   // Default for visible object types
   objectTypes = map::MapObjectTypes(map::AIRPORT | map::VOR | map::NDB | map::AP_ILS | map::MARKER | map::WAYPOINT);
 }
 
 MapPaintLayer::~MapPaintLayer()
 {
+  // Stop thread before deleting layers
+  delete prefetch;
+  delete compositor;
+  delete labelGrid;
+
+  if(profiler->isEnabled())
+    mapQuery->setProfiler(nullptr);
+  delete profiler;
+
   delete mapPainterIls;
   delete mapPainterNav;
   delete mapPainterAirport;
@@ -80,11 +132,17 @@ MapPaintLayer::~MapPaintLayer()
 void MapPaintLayer::preDatabaseLoad()
 {
   databaseLoadStatus = true;
+  prefetch->preDatabaseLoad();
 }
 
 void MapPaintLayer::postDatabaseLoad()
 {
   databaseLoadStatus = false;
+  prefetch->postDatabaseLoad();
+  invalidateStaticLayers();
+
+  // Airspace ids are not valid anymore
+  mapPainterAirspace->clearCache();
 }
 
 void MapPaintLayer::setShowMapObjects(map::MapObjectTypes type, bool show)
@@ -93,17 +151,20 @@ void MapPaintLayer::setShowMapObjects(map::MapObjectTypes type, bool show)
     objectTypes |= type;
   else
     objectTypes &= ~type;
+  invalidateStaticLayers();
 }
 
 void MapPaintLayer::setShowAirspaces(map::MapAirspaceTypes types)
 {
   airspaceTypes = types;
+  invalidateStaticLayers();
 }
 
 void MapPaintLayer::setDetailFactor(int factor)
 {
   detailFactor = factor;
   updateLayers();
+  invalidateStaticLayers();
 }
 
 map::MapAirspaceTypes MapPaintLayer::getShownAirspacesTypesByLayer() const
@@ -326,6 +387,9 @@ bool MapPaintLayer::render(GeoPainter *painter, ViewportParams *viewport,
     {
       updateLayers();
 
+      if(profiler->isEnabled())
+        profiler->beginFrame();
+
       PaintContext context;
       context.mapLayer = mapLayer;
       context.mapLayerEffective = mapLayerEffective;
@@ -336,7 +400,11 @@ bool MapPaintLayer::render(GeoPainter *painter, ViewportParams *viewport,
       context.viewContext = mapWidget->viewContext();
       context.drawFast = (mapScrollDetail == opts::FULL || mapScrollDetail == opts::HIGHER) ?
                          false : mapWidget->viewContext() == Marble::Animation;
-      context.lazyUpdate = mapScrollDetail == opts::FULL ? false : mapWidget->viewContext() == Marble::Animation;
+      if(prefetch->isActive())
+        // Use only cached objects - missing ones are loaded in background
+        context.lazyUpdate = true;
+      else
+        context.lazyUpdate = mapScrollDetail == opts::FULL ? false : mapWidget->viewContext() == Marble::Animation;
       context.mapScrollDetail = mapScrollDetail;
 
       // Copy default font
@@ -367,6 +435,12 @@ bool MapPaintLayer::render(GeoPainter *painter, ViewportParams *viewport,
 
       context.dispOpts = od.getDisplayOptions();
 
+      if(labelGrid != nullptr)
+      {
+        labelGrid->clear();
+        context.labelGrid = labelGrid;
+      }
+
       if(mapWidget->viewContext() == Marble::Still)
       {
         painter->setRenderHint(QPainter::Antialiasing, true);
@@ -380,50 +454,67 @@ bool MapPaintLayer::render(GeoPainter *painter, ViewportParams *viewport,
         painter->setRenderHint(QPainter::SmoothPixmapTransform, false);
       }
 
-      mapPainterShip->render(&context);
+      renderPainter(mapPainterShip, &context);
 
       if(mapWidget->distance() < layer::DISTANCE_CUT_OFF_LIMIT)
       {
-        if(!context.isOverflow())
-          mapPainterAirspace->render(&context);
-
-        if(context.mapLayerEffective->isAirportDiagram())
+        StaticLayerKey key = staticLayerKey(&context);
+        if(staticLayerCacheEnabled && staticLayersReusable && staticLayersValid && key == lastStaticLayerKey)
         {
-          // Put ILS below and navaids on top of airport diagram
-          mapPainterIls->render(&context);
-
-          if(!context.isOverflow())
-            mapPainterAirport->render(&context);
-
-          if(!context.isOverflow())
-            mapPainterNav->render(&context);
+          // Nothing has changed except simulator data - draw cached layers
+          painter->drawPixmap(0, 0, staticLayerPixmap);
+          context.objectsHidden += staticLayerObjectsHidden;
+          context.queryTruncated = staticLayerQueryTruncated;
+        }
+        else if(staticLayerCacheEnabled &&
+                (NavApp::isConnected() || NavApp::getConnectClient()->getTrackReplay()->isReplaying()))
+        {
+          // Keep a copy of the static layers for the following simulator updates
+          qreal ratio = painter->device()->devicePixelRatioF();
+          staticLayerPixmap = QPixmap(viewport->size() * ratio);
+          staticLayerPixmap.setDevicePixelRatio(ratio);
+          staticLayerPixmap.fill(Qt::transparent);
+
+          GeoPainter staticPainter(&staticLayerPixmap, viewport, mapWidget->mapQuality(context.viewContext));
+          staticPainter.setRenderHints(painter->renderHints());
+          staticPainter.setFont(painter->font());
+
+          int objectsHidden = context.objectsHidden;
+          context.painter = &staticPainter;
+          renderStaticLayers(&context);
+          context.painter = painter;
+          staticPainter.end();
+
+          staticLayerObjectsHidden = context.objectsHidden - objectsHidden;
+          staticLayerQueryTruncated = context.queryTruncated;
+          lastStaticLayerKey = key;
+          staticLayersValid = true;
+
+          painter->drawPixmap(0, 0, staticLayerPixmap);
         }
         else
         {
-          // Airports on top of all
-          if(!context.isOverflow())
-            mapPainterIls->render(&context);
-
-          if(!context.isOverflow())
-            mapPainterNav->render(&context);
-
-          if(!context.isOverflow())
-            mapPainterAirport->render(&context);
+          invalidateStaticLayers();
+          renderStaticLayers(&context);
         }
+        staticLayersReusable = false;
+
+        // Request objects for this and the expected next viewport
+        prefetch->viewportChanged(viewport->viewLatLonAltBox(), mapLayer, mapLayerEffective, objectTypes,
+                                  context.airspaceTypesByLayer, NavApp::getRoute().getCruisingAltitudeFeet());
       }
 
-      // if(!context.isOverflow()) always paint route even if number of objets is too large
-      mapPainterRoute->render(&context);
+      renderPainter(mapPainterRoute, &context);
+      renderPainter(mapPainterMark, &context);
 
-      // if(!context.isOverflow())
-      mapPainterMark->render(&context);
+      renderPainter(mapPainterAircraft, &context);
 
-      mapPainterAircraft->render(&context);
+      // Number of less important objects that were not drawn
+      overflow = context.objectsHidden;
+      truncated = context.queryTruncated;
 
-      if(context.isOverflow())
-        overflow = PaintContext::MAX_OBJECT_COUNT;
-      else
-        overflow = 0;
+      if(profiler->isEnabled())
+        profiler->endFrame(context.objectsDrawn, context.objectsHidden);
     }
 
     // Dim the map by drawing a semi-transparent black rectangle
@@ -434,6 +525,84 @@ bool MapPaintLayer::render(GeoPainter *painter, ViewportParams *viewport,
       painter->fillRect(QRect(0, 0, painter->device()->width(), painter->device()->height()), col);
     }
 
+    if(profiler->isEnabled())
+      profiler->paintOverlay(painter);
+
   }
   return true;
 }
+
+void MapPaintLayer::renderPainter(MapPainter *mapPainter, PaintContext *context)
+{
+  if(profiler->isEnabled())
+  {
+    int objectsDrawn = context->objectsDrawn, objectsHidden = context->objectsHidden;
+    QElapsedTimer timer;
+    timer.start();
+
+    mapPainter->render(context);
+
+    profiler->addPainter(mapPainter, timer.nsecsElapsed(), context->objectsDrawn - objectsDrawn,
+                         context->objectsHidden - objectsHidden);
+  }
+  else
+    mapPainter->render(context);
+}
+
+/* Draw airspaces, ILS, navaids and airports which do not depend on simulator data */
+void MapPaintLayer::renderStaticLayers(PaintContext *context)
+{
+  mapQuery->resetTruncated();
+
+  if(compositor->isEnabled())
+  {
+    // Draw static layers in parallel into separate images and composite them in the same order
+    QVector<MapPainter *> painters({mapPainterAirspace});
+    if(context->mapLayerEffective->isAirportDiagram())
+      painters << mapPainterIls << mapPainterAirport << mapPainterNav;
+    else
+      painters << mapPainterIls << mapPainterNav << mapPainterAirport;
+
+    compositor->render(painters, context);
+  }
+  else
+  {
+    renderPainter(mapPainterAirspace, context);
+
+    if(context->mapLayerEffective->isAirportDiagram())
+    {
+      // Put ILS below and navaids on top of airport diagram
+      renderPainter(mapPainterIls, context);
+      renderPainter(mapPainterAirport, context);
+      renderPainter(mapPainterNav, context);
+    }
+    else
+    {
+      // Airports on top of all
+      renderPainter(mapPainterIls, context);
+      renderPainter(mapPainterNav, context);
+      renderPainter(mapPainterAirport, context);
+    }
+  }
+
+  // All render threads are finished here
+  context->queryTruncated = mapQuery->isTruncated();
+}
+
+MapPaintLayer::StaticLayerKey MapPaintLayer::staticLayerKey(const PaintContext *context) const
+{
+  StaticLayerKey key;
+  key.centerLonRad = context->viewport->centerLongitude();
+  key.centerLatRad = context->viewport->centerLatitude();
+  key.radius = context->viewport->radius();
+  key.size = context->viewport->size();
+  key.projection = context->viewport->projection();
+  key.mapLayer = context->mapLayer;
+  key.mapLayerEffective = context->mapLayerEffective;
+  key.objectTypes = context->objectTypes;
+  key.airspaceTypes = context->airspaceTypesByLayer;
+  key.viewContext = context->viewContext;
+  key.drawFast = context->drawFast;
+  key.lazyUpdate = context->lazyUpdate;
+  return key;
+}
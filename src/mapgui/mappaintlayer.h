@@ -21,6 +21,7 @@
 #include "mapgui/mappainter.h"
 
 #include <QPen>
+#include <QPixmap>
 
 #include <marble/LayerInterface.h>
 
@@ -43,6 +44,10 @@ class MapPainterMark;
 class MapPainterRoute;
 class MapPainterAircraft;
 class MapPainterShip;
+class MapQueryPrefetch;
+class MapLayerCompositor;
+class LabelGrid;
+class MapPaintProfiler;
 
 /*
  * Implements the Marble layer interface that paints upon the Marble map. Contains all painter instances
@@ -98,15 +103,64 @@ public:
     return mapScale;
   }
 
+  /* Number of objects hidden by decluttering in the last paint event */
   int getOverflow() const
   {
     return overflow;
   }
 
+  /* Objects were not loaded from the database in the last paint event because of the query row limit */
+  bool isQueryTruncated() const
+  {
+    return truncated;
+  }
+
+  /* Draw the cached image of airspaces, ILS, navaids and airports in the next paint event if the viewport
+   * and all parameters are unchanged. Call before updates caused by simulator data only. */
+  void setStaticLayersReusable()
+  {
+    staticLayersReusable = true;
+  }
+
+  /* Static layers will be redrawn in the next paint event. Call if route or options were changed. */
+  void invalidateStaticLayers()
+  {
+    staticLayersValid = false;
+  }
+
 private:
+  /* Parameters defining the content of the cached static layers */
+  struct StaticLayerKey
+  {
+    qreal centerLonRad = 0., centerLatRad = 0.;
+    int radius = 0;
+    QSize size;
+    Marble::Projection projection = Marble::Spherical;
+    const MapLayer *mapLayer = nullptr, *mapLayerEffective = nullptr;
+    map::MapObjectTypes objectTypes = map::NONE;
+    map::MapAirspaceTypes airspaceTypes = map::AIRSPACE_NONE;
+    Marble::ViewContext viewContext = Marble::Still;
+    bool drawFast = false, lazyUpdate = false;
+
+    bool operator==(const StaticLayerKey& other) const
+    {
+      return centerLonRad == other.centerLonRad && centerLatRad == other.centerLatRad &&
+             radius == other.radius && size == other.size && projection == other.projection &&
+             mapLayer == other.mapLayer && mapLayerEffective == other.mapLayerEffective &&
+             objectTypes == other.objectTypes && airspaceTypes == other.airspaceTypes &&
+             viewContext == other.viewContext && drawFast == other.drawFast && lazyUpdate == other.lazyUpdate;
+    }
+  };
+
   void initMapLayerSettings();
   void updateLayers();
 
+  void renderStaticLayers(PaintContext *context);
+  StaticLayerKey staticLayerKey(const PaintContext *context) const;
+
+  /* Render a painter and collect timing and object counts if profiling is enabled */
+  void renderPainter(MapPainter *mapPainter, PaintContext *context);
+
   /* Implemented from LayerInterface: We  draw above all but below user tools */
   virtual QStringList renderPosition() const override
   {
@@ -139,11 +193,31 @@ private:
   /* Database source */
   MapQuery *mapQuery = nullptr;
 
+  /* Loads map objects in background */
+  MapQueryPrefetch *prefetch = nullptr;
+
+  /* Renders static layers in parallel if enabled */
+  MapLayerCompositor *compositor = nullptr;
+
+  /* Label collision detection for each frame. null if disabled. */
+  LabelGrid *labelGrid = nullptr;
+
+  /* Frame statistics. Does nothing if disabled. */
+  MapPaintProfiler *profiler = nullptr;
+
+  /* Static layers painted while connected to a simulator. Reused for aircraft and track updates. */
+  QPixmap staticLayerPixmap;
+  StaticLayerKey lastStaticLayerKey;
+  int staticLayerObjectsHidden = 0;
+  bool staticLayerQueryTruncated = false;
+  bool staticLayerCacheEnabled = true, staticLayersReusable = false, staticLayersValid = false;
+
   MapScale *mapScale = nullptr;
   MapLayerSettings *layers = nullptr;
   MapWidget *mapWidget = nullptr;
   const MapLayer *mapLayer = nullptr, *mapLayerEffective = nullptr;
   int overflow = 0;
+  bool truncated = false;
 
 };
 
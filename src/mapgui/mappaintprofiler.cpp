@@ -0,0 +1,252 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "mapgui/mappaintprofiler.h"
+
+#include "common/constants.h"
+#include "settings/settings.h"
+#include "util/paintercontextsaver.h"
+
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+
+/* Nanoseconds to milliseconds */
+static inline double toMs(qint64 nsecs)
+{
+  return static_cast<double>(nsecs) / 1000000.;
+}
+
+MapPaintProfiler::MapPaintProfiler()
+{
+  atools::settings::Settings& settings = atools::settings::Settings::instance();
+
+  enabled = settings.getAndStoreValue(lnm::SETTINGS_MAPPAINT + "Profiling", false).toBool();
+  overlay = settings.getAndStoreValue(lnm::SETTINGS_MAPPAINT + "ProfilingOverlay", true).toBool();
+  json = settings.getAndStoreValue(lnm::SETTINGS_MAPPAINT + "ProfilingLogFormat", "csv").toString().
+         toLower() == "json";
+  maxLogFrames = settings.getAndStoreValue(lnm::SETTINGS_MAPPAINT + "ProfilingLogFrames", 10000).toInt();
+
+  if(enabled)
+  {
+    logFilename = atools::settings::Settings::getConfigFilename(json ? "_profile.json" : "_profile.csv");
+    openLog();
+  }
+}
+
+MapPaintProfiler::~MapPaintProfiler()
+{
+  if(logFile.isOpen())
+  {
+    logStream.flush();
+    logFile.close();
+  }
+}
+
+void MapPaintProfiler::setPainterName(const MapPainter *painter, const QString& name)
+{
+  painterNames.insert(painter, name);
+}
+
+void MapPaintProfiler::beginFrame()
+{
+  QMutexLocker locker(&mutex);
+  currentFrame = Frame();
+  currentFrame.number = ++frameNumber;
+  currentFrame.timestamp = QDateTime::currentDateTime();
+  frameTimer.start();
+}
+
+void MapPaintProfiler::addPainter(const MapPainter *painter, qint64 nsecs, int objectsDrawn, int objectsHidden)
+{
+  QMutexLocker locker(&mutex);
+  addEntry(currentFrame.painters, painterNames.value(painter, QString("Unknown")), nsecs, objectsDrawn,
+           objectsHidden);
+}
+
+void MapPaintProfiler::addQuery(const QString& name, qint64 nsecs, int rows)
+{
+  QMutexLocker locker(&mutex);
+  addEntry(currentFrame.queries, name, nsecs, rows, 0);
+}
+
+void MapPaintProfiler::endFrame(int objectsDrawn, int objectsHidden)
+{
+  {
+    QMutexLocker locker(&mutex);
+    currentFrame.nsecs = frameTimer.nsecsElapsed();
+    currentFrame.objectsDrawn = objectsDrawn;
+    currentFrame.objectsHidden = objectsHidden;
+    lastFrame = currentFrame;
+  }
+
+  writeLog(lastFrame);
+}
+
+void MapPaintProfiler::addEntry(QVector<Entry>& entries, const QString& name, qint64 nsecs, int objects,
+                                int hidden)
+{
+  for(Entry& entry : entries)
+  {
+    if(entry.name == name)
+    {
+      entry.nsecs += nsecs;
+      entry.calls++;
+      entry.objects += objects;
+      entry.hidden += hidden;
+      return;
+    }
+  }
+  entries.append({name, nsecs, 1, objects, hidden});
+}
+
+void MapPaintProfiler::paintOverlay(QPainter *painter)
+{
+  if(!overlay || lastFrame.number == 0)
+    return;
+
+  QStringList lines;
+  lines.append(QString("Frame %1: %2 ms, %3 objects, %4 hidden").
+               arg(lastFrame.number).arg(toMs(lastFrame.nsecs), 0, 'f', 1).
+               arg(lastFrame.objectsDrawn).arg(lastFrame.objectsHidden));
+
+  for(const Entry& entry : lastFrame.painters)
+    lines.append(QString("%1: %2 ms, %3 objects, %4 hidden").
+                 arg(entry.name).arg(toMs(entry.nsecs), 0, 'f', 1).arg(entry.objects).arg(entry.hidden));
+
+  for(const Entry& entry : lastFrame.queries)
+    lines.append(QString("Query %1: %2 ms, %3 calls, %4 rows").
+                 arg(entry.name).arg(toMs(entry.nsecs), 0, 'f', 1).arg(entry.calls).arg(entry.objects));
+
+  atools::util::PainterContextSaver saver(painter);
+  Q_UNUSED(saver);
+
+  QFont font = painter->font();
+  font.setBold(false);
+  painter->setFont(font);
+
+  QFontMetrics metrics = painter->fontMetrics();
+  int width = 0;
+  for(const QString& line : lines)
+    width = std::max(width, metrics.width(line));
+
+  QRect rect(5, 5, width + 10, lines.size() * metrics.height() + 10);
+  painter->setPen(Qt::NoPen);
+  painter->setBrush(QColor(255, 255, 255, 200));
+  painter->drawRect(rect);
+
+  painter->setPen(Qt::black);
+  int y = rect.top() + 5 + metrics.ascent();
+  for(const QString& line : lines)
+  {
+    painter->drawText(rect.left() + 5, y, line);
+    y += metrics.height();
+  }
+}
+
+void MapPaintProfiler::openLog()
+{
+  logFile.setFileName(logFilename);
+  if(logFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+  {
+    logStream.setDevice(&logFile);
+    logStream.setCodec("UTF-8");
+    logFrames = 0;
+    logFlushTimer.start();
+
+    if(!json)
+      logStream << "frame;timestamp;type;name;ms;calls;objects;hidden" << endl;
+  }
+  else
+    qWarning() << Q_FUNC_INFO << "Cannot open profiling log" << logFilename << logFile.errorString();
+}
+
+void MapPaintProfiler::writeLog(const Frame& frame)
+{
+  if(!logFile.isOpen())
+    return;
+
+  if(logFrames >= maxLogFrames)
+  {
+    // Keep the current file as backup and start a new one
+    logStream.flush();
+    logFile.close();
+    QFile::remove(logFilename + ".1");
+    QFile::rename(logFilename, logFilename + ".1");
+    openLog();
+    if(!logFile.isOpen())
+      return;
+  }
+
+  if(json)
+    writeJson(frame);
+  else
+    writeCsv(frame);
+
+  logFrames++;
+
+  // Avoid a write for each frame
+  if(logFlushTimer.elapsed() > LOG_FLUSH_INTERVAL_MS)
+  {
+    logStream.flush();
+    logFlushTimer.start();
+  }
+}
+
+void MapPaintProfiler::writeCsv(const Frame& frame)
+{
+  QString time = frame.timestamp.toString("yyyy-MM-ddTHH:mm:ss.zzz");
+
+  logStream << frame.number << ";" << time << ";frame;;" << toMs(frame.nsecs) << ";1;"
+            << frame.objectsDrawn << ";" << frame.objectsHidden << "\n";
+
+  for(const Entry& entry : frame.painters)
+    logStream << frame.number << ";" << time << ";painter;" << entry.name << ";" << toMs(entry.nsecs) << ";"
+              << entry.calls << ";" << entry.objects << ";" << entry.hidden << "\n";
+
+  for(const Entry& entry : frame.queries)
+    logStream << frame.number << ";" << time << ";query;" << entry.name << ";" << toMs(entry.nsecs) << ";"
+              << entry.calls << ";" << entry.objects << ";0\n";
+}
+
+void MapPaintProfiler::writeJson(const Frame& frame)
+{
+  QJsonArray painters;
+  for(const Entry& entry : frame.painters)
+    painters.append(QJsonObject({{"name", entry.name}, {"ms", toMs(entry.nsecs)}, {"calls", entry.calls},
+                                 {"objects", entry.objects}, {"hidden", entry.hidden}}));
+
+  QJsonArray queries;
+  for(const Entry& entry : frame.queries)
+    queries.append(QJsonObject({{"name", entry.name}, {"ms", toMs(entry.nsecs)}, {"calls", entry.calls},
+                                {"rows", entry.objects}}));
+
+  QJsonObject object({
+    {"frame", frame.number},
+    {"timestamp", frame.timestamp.toString("yyyy-MM-ddTHH:mm:ss.zzz")},
+    {"ms", toMs(frame.nsecs)},
+    {"objects", frame.objectsDrawn},
+    {"hidden", frame.objectsHidden},
+    {"painters", painters},
+    {"queries", queries}
+  });
+
+  // One object per line
+  logStream << QJsonDocument(object).toJson(QJsonDocument::Compact) << "\n";
+}
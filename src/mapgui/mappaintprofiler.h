@@ -0,0 +1,120 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_MAPPAINTPROFILER_H
+#define LITTLENAVMAP_MAPPAINTPROFILER_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QTextStream>
+#include <QVector>
+
+class MapPainter;
+class QPainter;
+
+/*
+ * Collects render times of map painters, query times and row counts of map query and object counts
+ * for each frame. Shows the values of the last frame as an overlay on the map and writes all frames to
+ * a rolling log file in the settings directory in CSV or JSON lines format.
+ *
+ * Disabled by default. Enabled by setting "Settings/MapPaintProfiling" to true. Further keys are
+ * "Settings/MapPaintProfilingOverlay", "Settings/MapPaintProfilingLogFormat" ("csv" or "json") and
+ * "Settings/MapPaintProfilingLogFrames".
+ *
+ * The log is buffered and written every LOG_FLUSH_INTERVAL_MS, on rotation and on destruction.
+ * The add methods are thread safe.
+ */
+class MapPaintProfiler
+{
+public:
+  MapPaintProfiler();
+  ~MapPaintProfiler();
+
+  bool isEnabled() const
+  {
+    return enabled;
+  }
+
+  /* Name shown in overlay and log for a painter */
+  void setPainterName(const MapPainter *painter, const QString& name);
+
+  /* Start collecting values for a new frame */
+  void beginFrame();
+
+  /* Add render time and object counts of a painter to the current frame */
+  void addPainter(const MapPainter *painter, qint64 nsecs, int objectsDrawn, int objectsHidden);
+
+  /* Add time and number of fetched rows for a query to the current frame */
+  void addQuery(const QString& name, qint64 nsecs, int rows);
+
+  /* Finish frame and write it to the log */
+  void endFrame(int objectsDrawn, int objectsHidden);
+
+  /* Draw values of the last frame into the top left corner */
+  void paintOverlay(QPainter *painter);
+
+private:
+  /* Time and counts for one painter or query. Values are summed up for repeated calls in a frame. */
+  struct Entry
+  {
+    QString name;
+    qint64 nsecs;
+    int calls, objects, hidden;
+  };
+
+  struct Frame
+  {
+    qint64 number = 0;
+    QDateTime timestamp;
+    qint64 nsecs = 0;
+    int objectsDrawn = 0, objectsHidden = 0;
+    QVector<Entry> painters, queries;
+  };
+
+  static void addEntry(QVector<Entry>& entries, const QString& name, qint64 nsecs, int objects, int hidden);
+
+  void openLog();
+  void writeLog(const Frame& frame);
+  void writeCsv(const Frame& frame);
+  void writeJson(const Frame& frame);
+
+  /* Minimum time between writes of the buffered log */
+  static Q_DECL_CONSTEXPR qint64 LOG_FLUSH_INTERVAL_MS = 5000;
+
+  bool enabled = false, overlay = true, json = false;
+
+  /* Log file is moved to a backup file after this number of frames */
+  int maxLogFrames = 10000;
+  int logFrames = 0;
+  QFile logFile;
+  QTextStream logStream;
+  QString logFilename;
+  QElapsedTimer logFlushTimer;
+
+  QHash<const MapPainter *, QString> painterNames;
+  QElapsedTimer frameTimer;
+  qint64 frameNumber = 0;
+
+  /* Guards the current frame */
+  QMutex mutex;
+  Frame currentFrame, lastFrame;
+};
+
+#endif // LITTLENAVMAP_MAPPAINTPROFILER_H
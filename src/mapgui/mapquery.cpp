@@ -19,13 +19,18 @@
 
 #include "common/constants.h"
 #include "common/maptypesfactory.h"
+#include "mapgui/mappaintprofiler.h"
 #include "common/maptools.h"
 #include "sql/sqlquery.h"
 #include "common/maptools.h"
 #include "settings/settings.h"
 
-#include <QDataStream>
+#include <QElapsedTimer>
 #include <QRegularExpression>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
 
 using namespace Marble;
 using namespace atools::sql;
@@ -39,9 +44,61 @@ using map::MapIls;
 using map::MapParking;
 using map::MapHelipad;
 
-double MapQuery::queryRectInflationFactor = 0.3;
-double MapQuery::queryRectInflationIncrement = 0.1;
-int MapQuery::queryRowLimit = 5000;
+// Definition needed since the array is indexed
+Q_DECL_CONSTEXPR float MapQuery::TILE_SIZE_DEG[];
+
+static const QString airspaceQueryBase(
+  "boundary_id, type, name, com_type, com_frequency, com_name, "
+  "min_altitude_type, max_altitude_type, max_altitude, max_lonx, max_laty, min_altitude, min_lonx, min_laty ");
+
+/* Drawing order of airspaces as case expression using the type column */
+static QString buildAirspaceOrderBy()
+{
+  QStringList cases;
+  for(int i = 0; i <= map::MAP_AIRSPACE_TYPE_BITS; i++)
+  {
+    map::MapAirspaceTypes type(1 << i);
+    const QString& dbType = map::airspaceTypeToDatabase(type);
+    if(!dbType.isEmpty())
+      cases.append(QString("when '%1' then %2").arg(dbType).arg(map::airspaceDrawingOrder(type)));
+  }
+  return QString(" order by case type %1 else %2 end").
+         arg(cases.join(" ")).arg(map::airspaceDrawingOrder(map::AIRSPACE_NONE));
+}
+
+/* Read a big endian float from the unaligned buffer */
+static inline float readFloatBigEndian(const uchar *data)
+{
+  quint32 value = qFromBigEndian<quint32>(data);
+  float result;
+  memcpy(&result, &value, sizeof(float));
+  return result;
+}
+
+/*
+ * Decode a geometry blob as written by QDataStream using single precision: a big endian quint32 number
+ * of points followed by big endian float lonx/laty pairs. Reads directly from the buffer into
+ * preallocated memory. Stops at the end of truncated data.
+ */
+static void readGeometry(const QByteArray& bytes, LineString& lines)
+{
+  if(bytes.size() < static_cast<int>(sizeof(quint32)))
+    return;
+
+  const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+  quint32 size = qFromBigEndian<quint32>(data);
+  data += sizeof(quint32);
+
+  quint32 available = static_cast<quint32>(bytes.size()) - sizeof(quint32);
+  size = std::min(size, available / static_cast<quint32>(2 * sizeof(float)));
+
+  lines.reserve(static_cast<int>(size));
+  for(quint32 i = 0; i < size; i++)
+  {
+    lines.append(readFloatBigEndian(data), readFloatBigEndian(data + sizeof(float)));
+    data += 2 * sizeof(float);
+  }
+}
 
 struct MapAirspaceCoordinate
 {
@@ -50,27 +107,147 @@ struct MapAirspaceCoordinate
   QString type;
 };
 
-MapQuery::MapQuery(QObject *parent, atools::sql::SqlDatabase *sqlDb)
-  : QObject(parent), db(sqlDb)
+template<typename TYPE>
+typename MapQuery::TileCache<TYPE>::TileFetchFunc MapQuery::fetchInDatabaseThread(
+  const QString& name, const typename TileCache<TYPE>::TileFetchFunc& func)
 {
-  mapTypesFactory = new MapTypesFactory();
-  atools::settings::Settings& settings = atools::settings::Settings::instance();
-
-  runwayCache.setMaxCost(settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "RunwayCache", 2000).toInt());
-  runwayOverwiewCache.setMaxCost(settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "RunwayOverwiewCache", 1000).toInt());
-  apronCache.setMaxCost(settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "ApronCache", 1000).toInt());
-  taxipathCache.setMaxCost(settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "TaxipathCache", 1000).toInt());
-  parkingCache.setMaxCost(settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "ParkingCache", 1000).toInt());
-  startCache.setMaxCost(settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "StartCache", 1000).toInt());
-  helipadCache.setMaxCost(settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "HelipadCache", 1000).toInt());
-  airspaceLineCache.setMaxCost(settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "AirspaceLineCache", 10000).toInt());
+  return [this, name, func](const GeoDataLatLonBox& rect, const MapLayer *mapLayer, QList<TYPE>& objects)
+         {
+           QElapsedTimer timer;
+           int rows = objects.size();
+           if(profiler != nullptr)
+             timer.start();
+
+           if(isDatabaseThread())
+             func(rect, mapLayer, objects);
+           else
+             databaseExecutor([&func, &rect, mapLayer, &objects]()
+                              {
+                                func(rect, mapLayer, objects);
+                              });
+
+           if(profiler != nullptr)
+             profiler->addQuery(name, timer.nsecsElapsed(), objects.size() - rows);
+         };
+}
 
-  queryRectInflationFactor = settings.getAndStoreValue(
+MapQuery::QueryConfig MapQuery::readConfig()
+{
+  atools::settings::Settings& settings = atools::settings::Settings::instance();
+  QueryConfig cfg;
+
+  cfg.runwayCache = settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "RunwayCache", 2000).toInt();
+  cfg.runwayOverviewCache = settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "RunwayOverwiewCache", 1000).toInt();
+  cfg.apronCache = settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "ApronCache", 1000).toInt();
+  cfg.taxipathCache = settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "TaxipathCache", 1000).toInt();
+  cfg.parkingCache = settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "ParkingCache", 1000).toInt();
+  cfg.startCache = settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "StartCache", 1000).toInt();
+  cfg.helipadCache = settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "HelipadCache", 1000).toInt();
+  cfg.airspaceLineCache = settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "AirspaceLineCache", 10000).toInt();
+
+  cfg.queryRectInflationFactor = settings.getAndStoreValue(
     lnm::SETTINGS_MAPQUERY + "QueryRectInflationFactor", 0.3).toDouble();
-  queryRectInflationIncrement = settings.getAndStoreValue(
+  cfg.queryRectInflationIncrement = settings.getAndStoreValue(
     lnm::SETTINGS_MAPQUERY + "QueryRectInflationIncrement", 0.1).toDouble();
-  queryRowLimit = settings.getAndStoreValue(
+  cfg.queryRowLimit = settings.getAndStoreValue(
     lnm::SETTINGS_MAPQUERY + "QueryRowLimit", 5000).toInt();
+
+  cfg.tileCacheObjects = settings.getAndStoreValue(lnm::SETTINGS_MAPQUERY + "TileCacheObjects", 50000).toInt();
+  return cfg;
+}
+
+MapQuery::MapQuery(QObject *parent, atools::sql::SqlDatabase *sqlDb, const QueryConfig& queryConfig)
+  : QObject(parent), db(sqlDb), databaseThread(QThread::currentThread()), config(queryConfig)
+{
+  mapTypesFactory = new MapTypesFactory();
+
+  runwayCache.setMaxCost(config.runwayCache);
+  runwayOverwiewCache.setMaxCost(config.runwayOverviewCache);
+  apronCache.setMaxCost(config.apronCache);
+  taxipathCache.setMaxCost(config.taxipathCache);
+  parkingCache.setMaxCost(config.parkingCache);
+  startCache.setMaxCost(config.startCache);
+  helipadCache.setMaxCost(config.helipadCache);
+  airspaceLineCache.setMaxCost(config.airspaceLineCache);
+
+  airportCache.setMaxObjects(config.tileCacheObjects);
+  waypointCache.setMaxObjects(config.tileCacheObjects);
+  vorCache.setMaxObjects(config.tileCacheObjects);
+  ndbCache.setMaxObjects(config.tileCacheObjects);
+  markerCache.setMaxObjects(config.tileCacheObjects);
+  ilsCache.setMaxObjects(config.tileCacheObjects);
+  airwayCache.setMaxObjects(config.tileCacheObjects);
+  airspaceCache.setMaxObjects(config.tileCacheObjects);
+
+  airportCache.rowLimit = config.queryRowLimit;
+  waypointCache.rowLimit = config.queryRowLimit;
+  vorCache.rowLimit = config.queryRowLimit;
+  ndbCache.rowLimit = config.queryRowLimit;
+  markerCache.rowLimit = config.queryRowLimit;
+  ilsCache.rowLimit = config.queryRowLimit;
+  airwayCache.rowLimit = config.queryRowLimit;
+  airspaceCache.rowLimit = config.queryRowLimit;
+
+  // Query parameters for each object type
+  airportCache.funcSameLayer = [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
+                               {
+                                 return curLayer->hasSameQueryParametersAirport(newLayer);
+                               };
+  waypointCache.funcSameLayer = [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
+                                {
+                                  return curLayer->hasSameQueryParametersWaypoint(newLayer);
+                                };
+  vorCache.funcSameLayer = [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
+                           {
+                             return curLayer->hasSameQueryParametersVor(newLayer);
+                           };
+  ndbCache.funcSameLayer = [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
+                           {
+                             return curLayer->hasSameQueryParametersNdb(newLayer);
+                           };
+  markerCache.funcSameLayer = [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
+                              {
+                                return curLayer->hasSameQueryParametersMarker(newLayer);
+                              };
+  ilsCache.funcSameLayer = [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
+                           {
+                             return curLayer->hasSameQueryParametersIls(newLayer);
+                           };
+  airwayCache.funcSameLayer = [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
+                              {
+                                return curLayer->hasSameQueryParametersAirway(newLayer);
+                              };
+  airspaceCache.funcSameLayer = [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
+                                {
+                                  return curLayer->hasSameQueryParametersAirspace(newLayer);
+                                };
+
+  // Database queries for a tile - passed to the database thread if called from a render thread
+  using namespace std::placeholders;
+  airportCache.funcFetch =
+    fetchInDatabaseThread<map::MapAirport>("Airports", std::bind(&MapQuery::fetchAirports, this, _1, _2, _3));
+  waypointCache.funcFetch =
+    fetchInDatabaseThread<map::MapWaypoint>("Waypoints", std::bind(&MapQuery::fetchWaypoints, this, _1, _3));
+  vorCache.funcFetch =
+    fetchInDatabaseThread<map::MapVor>("VOR", std::bind(&MapQuery::fetchVors, this, _1, _3));
+  ndbCache.funcFetch =
+    fetchInDatabaseThread<map::MapNdb>("NDB", std::bind(&MapQuery::fetchNdbs, this, _1, _3));
+  markerCache.funcFetch =
+    fetchInDatabaseThread<map::MapMarker>("Markers", std::bind(&MapQuery::fetchMarkers, this, _1, _3));
+  ilsCache.funcFetch =
+    fetchInDatabaseThread<map::MapIls>("ILS", std::bind(&MapQuery::fetchIls, this, _1, _3));
+  airwayCache.funcFetch =
+    fetchInDatabaseThread<map::MapAirway>("Airways", std::bind(&MapQuery::fetchAirways, this, _1, _3));
+  airspaceCache.funcFetch =
+    fetchInDatabaseThread<map::MapAirspace>("Airspaces", std::bind(&MapQuery::fetchAirspaces, this, _1, _3));
+
+  // Sort airspaces by importance - tiles are already sorted by the query
+  airspaceCache.tilesSorted = true;
+  airspaceCache.funcLess = [] (const map::MapAirspace& airspace1, const map::MapAirspace& airspace2)->bool
+                           {
+                             return map::airspaceDrawingOrder(airspace1.type) <
+                                    map::airspaceDrawingOrder(airspace2.type);
+                           };
 }
 
 MapQuery::~MapQuery()
@@ -489,10 +666,19 @@ void MapQuery::getNearestObjects(const CoordinateConverter& conv, const MapLayer
   using maptools::insertSortedByDistance;
   using maptools::insertSortedByTowerDistance;
 
+  // Look only at objects in the neighbourhood of the cursor before projecting
+  atools::geo::Rect rect = nearestObjectsRect(conv, xs, ys, screenDistance, NEAREST_RECT_MARGIN_DEG);
+  QVector<int> indexes;
+
   int x, y;
   if(mapLayer->isAirport() && types.testFlag(map::AIRPORT))
   {
-    for(int i = airportCache.list.size() - 1; i >= 0; i--)
+    if(airportDiagram)
+      // Tower can be some distance away from the airport center
+      airportCache.getIndexes(nearestObjectsRect(conv, xs, ys, screenDistance, AIRPORT_TOWER_MARGIN_DEG), indexes);
+    else
+      airportCache.getIndexes(rect, indexes);
+    for(int i : indexes)
     {
       const MapAirport& airport = airportCache.list.at(i);
 
@@ -515,7 +701,9 @@ void MapQuery::getNearestObjects(const CoordinateConverter& conv, const MapLayer
 
   if(mapLayer->isVor() && types.testFlag(map::VOR))
   {
-    for(int i = vorCache.list.size() - 1; i >= 0; i--)
+    indexes.clear();
+    vorCache.getIndexes(rect, indexes);
+    for(int i : indexes)
     {
       const MapVor& vor = vorCache.list.at(i);
       if(conv.wToS(vor.position, x, y))
@@ -526,7 +714,9 @@ void MapQuery::getNearestObjects(const CoordinateConverter& conv, const MapLayer
 
   if(mapLayer->isNdb() && types.testFlag(map::NDB))
   {
-    for(int i = ndbCache.list.size() - 1; i >= 0; i--)
+    indexes.clear();
+    ndbCache.getIndexes(rect, indexes);
+    for(int i : indexes)
     {
       const MapNdb& ndb = ndbCache.list.at(i);
       if(conv.wToS(ndb.position, x, y))
@@ -535,9 +725,15 @@ void MapQuery::getNearestObjects(const CoordinateConverter& conv, const MapLayer
     }
   }
 
+  if((mapLayer->isWaypoint() && types.testFlag(map::WAYPOINT)) || mapLayer->isAirway())
+  {
+    indexes.clear();
+    waypointCache.getIndexes(rect, indexes);
+  }
+
   if(mapLayer->isWaypoint() && types.testFlag(map::WAYPOINT))
   {
-    for(int i = waypointCache.list.size() - 1; i >= 0; i--)
+    for(int i : indexes)
     {
       const MapWaypoint& wp = waypointCache.list.at(i);
       if(conv.wToS(wp.position, x, y))
@@ -548,7 +744,7 @@ void MapQuery::getNearestObjects(const CoordinateConverter& conv, const MapLayer
 
   if(mapLayer->isAirway())
   {
-    for(int i = waypointCache.list.size() - 1; i >= 0; i--)
+    for(int i : indexes)
     {
       const MapWaypoint& wp = waypointCache.list.at(i);
       if((wp.hasVictorAirways && types.testFlag(map::AIRWAYV)) ||
@@ -561,7 +757,9 @@ void MapQuery::getNearestObjects(const CoordinateConverter& conv, const MapLayer
 
   if(mapLayer->isMarker() && types.testFlag(map::MARKER))
   {
-    for(int i = markerCache.list.size() - 1; i >= 0; i--)
+    indexes.clear();
+    markerCache.getIndexes(rect, indexes);
+    for(int i : indexes)
     {
       const MapMarker& wp = markerCache.list.at(i);
       if(conv.wToS(wp.position, x, y))
@@ -572,7 +770,9 @@ void MapQuery::getNearestObjects(const CoordinateConverter& conv, const MapLayer
 
   if(mapLayer->isIls() && types.testFlag(map::ILS))
   {
-    for(int i = ilsCache.list.size() - 1; i >= 0; i--)
+    indexes.clear();
+    ilsCache.getIndexes(rect, indexes);
+    for(int i : indexes)
     {
       const MapIls& wp = ilsCache.list.at(i);
       if(conv.wToS(wp.position, x, y))
@@ -609,369 +809,473 @@ void MapQuery::getNearestObjects(const CoordinateConverter& conv, const MapLayer
   }
 }
 
-const QList<map::MapAirport> *MapQuery::getAirports(const Marble::GeoDataLatLonBox& rect,
-                                                    const MapLayer *mapLayer, bool lazy)
+atools::geo::Rect MapQuery::nearestObjectsRect(const CoordinateConverter& conv, int xs, int ys,
+                                              int screenDistance, float marginDeg) const
 {
-  airportCache.updateCache(rect, mapLayer, lazy,
-                           [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
-                           {
-                             return curLayer->hasSameQueryParametersAirport(newLayer);
-                           });
+  atools::geo::Rect rect;
+  float west = 180.f, east = -180.f, north = -90.f, south = 90.f;
 
-  switch(mapLayer->getDataSource())
+  // Check center, corners and edge centers of the search area
+  for(int dy = -1; dy <= 1; dy++)
   {
-    case layer::ALL:
-      airportByRectQuery->bindValue(":minlength", mapLayer->getMinRunwayLength());
-      return fetchAirports(rect, airportByRectQuery, true /* reverse */, lazy, false /* overview */);
+    for(int dx = -1; dx <= 1; dx++)
+    {
+      atools::geo::Pos pos = conv.sToW(xs + dx * screenDistance, ys + dy * screenDistance);
+      if(!pos.isValid())
+        // Partially outside of the globe
+        return rect;
+
+      west = std::min(west, pos.getLonX());
+      east = std::max(east, pos.getLonX());
+      north = std::max(north, pos.getLatY());
+      south = std::min(south, pos.getLatY());
+    }
+  }
 
-    case layer::MEDIUM:
-      // Airports > 4000 ft
-      return fetchAirports(rect, airportMediumByRectQuery, false /* reverse */, lazy, true /* overview */);
+  west -= marginDeg;
+  east += marginDeg;
+  if(east - west > 180.f || west < -180.f || east > 180.f)
+    // Crosses the anti-meridian or a pole
+    return rect;
 
-    case layer::LARGE:
-      // Airports > 8000 ft
-      return fetchAirports(rect, airportLargeByRectQuery, false /* reverse */, lazy, true /* overview */);
+  rect = atools::geo::Rect(west, std::min(north + marginDeg, 90.f), east, std::max(south - marginDeg, -90.f));
+  return rect;
+}
 
-  }
-  return nullptr;
+const QList<map::MapAirport> *MapQuery::getAirports(const Marble::GeoDataLatLonBox& rect,
+                                                    const MapLayer *mapLayer, bool lazy)
+{
+  if(mapLayer->getDataSource() == layer::ALL)
+    // Tiles are merged in position order - put unimportant airports without facilities and short runways
+    // first to have them below in painting order
+    airportCache.funcLess = [] (const MapAirport& airport1, const MapAirport& airport2)->bool
+                            {
+                              if(airport1.empty() != airport2.empty())
+                                return airport1.empty();
+                              else
+                                return airport1.longestRunwayLength < airport2.longestRunwayLength;
+                            };
+  else
+    airportCache.funcLess = nullptr;
+
+  return airportCache.updateCache(splitAtAntiMeridian(rect), mapLayer, lazy);
 }
 
 const QList<map::MapWaypoint> *MapQuery::getWaypoints(const GeoDataLatLonBox& rect,
                                                       const MapLayer *mapLayer, bool lazy)
 {
-  waypointCache.updateCache(rect, mapLayer, lazy,
-                            [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
-                            {
-                              return curLayer->hasSameQueryParametersWaypoint(newLayer);
-                            });
-
-  if(waypointCache.list.isEmpty() && !lazy)
-  {
-    for(const GeoDataLatLonBox& r : splitAtAntiMeridian(rect))
-    {
-      bindCoordinatePointInRect(r, waypointsByRectQuery);
-      waypointsByRectQuery->exec();
-      while(waypointsByRectQuery->next())
-      {
-        map::MapWaypoint wp;
-        mapTypesFactory->fillWaypoint(waypointsByRectQuery->record(), wp);
-        waypointCache.list.append(wp);
-      }
-    }
-  }
-  waypointCache.validate();
-  return &waypointCache.list;
+  return waypointCache.updateCache(splitAtAntiMeridian(rect), mapLayer, lazy);
 }
 
 const QList<map::MapVor> *MapQuery::getVors(const GeoDataLatLonBox& rect, const MapLayer *mapLayer,
                                             bool lazy)
 {
-  vorCache.updateCache(rect, mapLayer, lazy,
-                       [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
-                       {
-                         return curLayer->hasSameQueryParametersVor(newLayer);
-                       });
+  return vorCache.updateCache(splitAtAntiMeridian(rect), mapLayer, lazy);
+}
+
+const QList<map::MapNdb> *MapQuery::getNdbs(const GeoDataLatLonBox& rect, const MapLayer *mapLayer,
+                                            bool lazy)
+{
+  return ndbCache.updateCache(splitAtAntiMeridian(rect), mapLayer, lazy);
+}
+
+const QList<map::MapMarker> *MapQuery::getMarkers(const GeoDataLatLonBox& rect, const MapLayer *mapLayer,
+                                                  bool lazy)
+{
+  return markerCache.updateCache(splitAtAntiMeridian(rect), mapLayer, lazy);
+}
+
+const QList<map::MapIls> *MapQuery::getIls(const GeoDataLatLonBox& rect, const MapLayer *mapLayer, bool lazy)
+{
+  return ilsCache.updateCache(splitAtAntiMeridian(rect), mapLayer, lazy);
+}
+
+const QList<map::MapAirway> *MapQuery::getAirways(const GeoDataLatLonBox& rect, const MapLayer *mapLayer, bool lazy)
+{
+  return airwayCache.updateCache(splitAtAntiMeridian(rect), mapLayer, lazy);
+}
 
-  if(vorCache.list.isEmpty() && !lazy)
+const QList<map::MapAirspace> *MapQuery::getAirspaces(const GeoDataLatLonBox& rect, const MapLayer *mapLayer,
+                                                      map::MapAirspaceTypes types, float flightPlanAltitude, bool lazy)
+{
+  if(types != lastAirspaceTypes || atools::almostNotEqual(lastFlightplanAltitude, flightPlanAltitude))
   {
-    for(const GeoDataLatLonBox& r : splitAtAntiMeridian(rect))
-    {
-      bindCoordinatePointInRect(r, vorsByRectQuery);
-      vorsByRectQuery->exec();
-      while(vorsByRectQuery->next())
-      {
-        map::MapVor vor;
-        mapTypesFactory->fillVor(vorsByRectQuery->record(), vor);
-        vorCache.list.append(vor);
-      }
-    }
+    // Need a few more parameters to clear the cache which is different to other map features
+    airspaceCache.clear();
+    lastAirspaceTypes = types;
+    lastFlightplanAltitude = flightPlanAltitude;
   }
-  vorCache.validate();
-  return &vorCache.list;
+
+  if(types == map::AIRSPACE_NONE)
+    return &airspaceCache.list;
+
+  // Get the airspace objects without geometry
+  return airspaceCache.updateCache(splitAtAntiMeridian(rect), mapLayer, lazy);
 }
 
-const QList<map::MapNdb> *MapQuery::getNdbs(const GeoDataLatLonBox& rect, const MapLayer *mapLayer,
-                                            bool lazy)
+bool MapQuery::isTruncated() const
+{
+  return (airportCache.used && airportCache.truncated) || (waypointCache.used && waypointCache.truncated) ||
+         (vorCache.used && vorCache.truncated) || (ndbCache.used && ndbCache.truncated) ||
+         (markerCache.used && markerCache.truncated) || (ilsCache.used && ilsCache.truncated) ||
+         (airwayCache.used && airwayCache.truncated) || (airspaceCache.used && airspaceCache.truncated);
+}
+
+void MapQuery::resetTruncated()
+{
+  airportCache.used = waypointCache.used = vorCache.used = ndbCache.used = markerCache.used =
+    ilsCache.used = airwayCache.used = airspaceCache.used = false;
+}
+
+MapQuery::PrefetchTiles *MapQuery::getMissingTiles(const QList<Marble::GeoDataLatLonBox>& rects,
+                                                   const MapLayer *mapLayer, const MapLayer *mapLayerEffective,
+                                                   map::MapObjectTypes types, map::MapAirspaceTypes airspaceTypes,
+                                                   float flightPlanAltitude)
 {
-  ndbCache.updateCache(rect, mapLayer, lazy,
-                       [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
-                       {
-                         return curLayer->hasSameQueryParametersNdb(newLayer);
-                       });
+  QList<GeoDataLatLonBox> queryRects;
+  for(const GeoDataLatLonBox& rect : rects)
+    queryRects.append(splitAtAntiMeridian(rect));
+
+  PrefetchTiles *prefetchTiles = new PrefetchTiles;
+
+  // Same conditions as in the painters
+  if(mapLayerEffective->isAirportDiagram())
+    airportCache.missingTiles(queryRects, mapLayerEffective, prefetchTiles->airports);
+  else if(types.testFlag(map::AIRPORT) && mapLayer->isAirport())
+    airportCache.missingTiles(queryRects, mapLayer, prefetchTiles->airports);
+
+  bool airway = mapLayer->isAirway() && (types.testFlag(map::AIRWAYJ) || types.testFlag(map::AIRWAYV));
+  if(airway)
+    airwayCache.missingTiles(queryRects, mapLayer, prefetchTiles->airways);
+
+  if((mapLayer->isWaypoint() && types.testFlag(map::WAYPOINT)) || airway)
+    waypointCache.missingTiles(queryRects, mapLayer, prefetchTiles->waypoints);
+
+  if(mapLayer->isVor() && types.testFlag(map::VOR))
+    vorCache.missingTiles(queryRects, mapLayer, prefetchTiles->vors);
+
+  if(mapLayer->isNdb() && types.testFlag(map::NDB))
+    ndbCache.missingTiles(queryRects, mapLayer, prefetchTiles->ndbs);
 
-  if(ndbCache.list.isEmpty() && !lazy)
+  if(mapLayer->isMarker() && types.testFlag(map::ILS))
+    markerCache.missingTiles(queryRects, mapLayer, prefetchTiles->markers);
+
+  if(mapLayer->isIls() && types.testFlag(map::ILS))
+    ilsCache.missingTiles(queryRects, mapLayer, prefetchTiles->ils);
+
+  // Airspace tiles are only valid for the parameters of the current cache
+  if(mapLayer->isAirspace() && types.testFlag(map::AIRSPACE) && airspaceTypes != map::AIRSPACE_NONE &&
+     airspaceTypes == lastAirspaceTypes && !atools::almostNotEqual(lastFlightplanAltitude, flightPlanAltitude))
   {
-    for(const GeoDataLatLonBox& r : splitAtAntiMeridian(rect))
-    {
-      bindCoordinatePointInRect(r, ndbsByRectQuery);
-      ndbsByRectQuery->exec();
-      while(ndbsByRectQuery->next())
-      {
-        map::MapNdb ndb;
-        mapTypesFactory->fillNdb(ndbsByRectQuery->record(), ndb);
-        ndbCache.list.append(ndb);
-      }
-    }
+    airspaceCache.missingTiles(queryRects, mapLayer, prefetchTiles->airspaces);
+    prefetchTiles->airspaceTypes = airspaceTypes;
+    prefetchTiles->flightPlanAltitude = flightPlanAltitude;
+  }
+
+  if(prefetchTiles->isEmpty())
+  {
+    delete prefetchTiles;
+    return nullptr;
   }
-  ndbCache.validate();
-  return &ndbCache.list;
+  return prefetchTiles;
 }
 
-const QList<map::MapMarker> *MapQuery::getMarkers(const GeoDataLatLonBox& rect, const MapLayer *mapLayer,
-                                                  bool lazy)
+void MapQuery::loadTiles(PrefetchTiles& prefetchTiles)
+{
+  lastAirspaceTypes = prefetchTiles.airspaceTypes;
+  lastFlightplanAltitude = prefetchTiles.flightPlanAltitude;
+
+  airportCache.loadTiles(prefetchTiles.airports);
+  waypointCache.loadTiles(prefetchTiles.waypoints);
+  vorCache.loadTiles(prefetchTiles.vors);
+  ndbCache.loadTiles(prefetchTiles.ndbs);
+  markerCache.loadTiles(prefetchTiles.markers);
+  ilsCache.loadTiles(prefetchTiles.ils);
+  airwayCache.loadTiles(prefetchTiles.airways);
+  airspaceCache.loadTiles(prefetchTiles.airspaces);
+}
+
+void MapQuery::insertTiles(const PrefetchTiles& prefetchTiles)
+{
+  airportCache.insertTiles(prefetchTiles.airports);
+  waypointCache.insertTiles(prefetchTiles.waypoints);
+  vorCache.insertTiles(prefetchTiles.vors);
+  ndbCache.insertTiles(prefetchTiles.ndbs);
+  markerCache.insertTiles(prefetchTiles.markers);
+  ilsCache.insertTiles(prefetchTiles.ils);
+  airwayCache.insertTiles(prefetchTiles.airways);
+
+  // Airspace parameters might have changed while loading
+  if(prefetchTiles.airspaceTypes == lastAirspaceTypes &&
+     !atools::almostNotEqual(lastFlightplanAltitude, prefetchTiles.flightPlanAltitude))
+    airspaceCache.insertTiles(prefetchTiles.airspaces);
+}
+
+void MapQuery::fetchWaypoints(const GeoDataLatLonBox& rect, QList<map::MapWaypoint>& waypoints)
 {
-  markerCache.updateCache(rect, mapLayer, lazy,
-                          [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
-                          {
-                            return curLayer->hasSameQueryParametersMarker(newLayer);
-                          });
+  bindCoordinatePointInRect(rect, waypointsByRectQuery);
+  waypointsByRectQuery->exec();
+  while(waypointsByRectQuery->next())
+  {
+    map::MapWaypoint wp;
+    mapTypesFactory->fillWaypoint(waypointsByRectQuery->record(), wp);
+    waypoints.append(wp);
+  }
+}
 
-  if(markerCache.list.isEmpty() && !lazy)
+void MapQuery::fetchVors(const GeoDataLatLonBox& rect, QList<map::MapVor>& vors)
+{
+  bindCoordinatePointInRect(rect, vorsByRectQuery);
+  vorsByRectQuery->exec();
+  while(vorsByRectQuery->next())
   {
-    for(const GeoDataLatLonBox& r : splitAtAntiMeridian(rect))
-    {
-      bindCoordinatePointInRect(r, markersByRectQuery);
-      markersByRectQuery->exec();
-      while(markersByRectQuery->next())
-      {
-        map::MapMarker marker;
-        mapTypesFactory->fillMarker(markersByRectQuery->record(), marker);
-        markerCache.list.append(marker);
-      }
-    }
+    map::MapVor vor;
+    mapTypesFactory->fillVor(vorsByRectQuery->record(), vor);
+    vors.append(vor);
   }
-  markerCache.validate();
-  return &markerCache.list;
 }
 
-const QList<map::MapIls> *MapQuery::getIls(const GeoDataLatLonBox& rect, const MapLayer *mapLayer, bool lazy)
+void MapQuery::fetchNdbs(const GeoDataLatLonBox& rect, QList<map::MapNdb>& ndbs)
 {
-  ilsCache.updateCache(rect, mapLayer, lazy,
-                       [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
-                       {
-                         return curLayer->hasSameQueryParametersIls(newLayer);
-                       });
+  bindCoordinatePointInRect(rect, ndbsByRectQuery);
+  ndbsByRectQuery->exec();
+  while(ndbsByRectQuery->next())
+  {
+    map::MapNdb ndb;
+    mapTypesFactory->fillNdb(ndbsByRectQuery->record(), ndb);
+    ndbs.append(ndb);
+  }
+}
 
-  if(ilsCache.list.isEmpty() && !lazy)
+void MapQuery::fetchMarkers(const GeoDataLatLonBox& rect, QList<map::MapMarker>& markers)
+{
+  bindCoordinatePointInRect(rect, markersByRectQuery);
+  markersByRectQuery->exec();
+  while(markersByRectQuery->next())
   {
-    for(const GeoDataLatLonBox& r : splitAtAntiMeridian(rect))
-    {
-      bindCoordinatePointInRect(r, ilsByRectQuery);
-      ilsByRectQuery->exec();
-      while(ilsByRectQuery->next())
-      {
-        map::MapIls ils;
-        mapTypesFactory->fillIls(ilsByRectQuery->record(), ils);
-        ilsCache.list.append(ils);
-      }
-    }
+    map::MapMarker marker;
+    mapTypesFactory->fillMarker(markersByRectQuery->record(), marker);
+    markers.append(marker);
   }
-  ilsCache.validate();
-  return &ilsCache.list;
 }
 
-const QList<map::MapAirway> *MapQuery::getAirways(const GeoDataLatLonBox& rect, const MapLayer *mapLayer, bool lazy)
+void MapQuery::fetchIls(const GeoDataLatLonBox& rect, QList<map::MapIls>& ilsList)
 {
-  airwayCache.updateCache(rect, mapLayer, lazy,
-                          [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
-                          {
-                            return curLayer->hasSameQueryParametersAirway(newLayer);
-                          });
+  bindCoordinatePointInRect(rect, ilsByRectQuery);
+  ilsByRectQuery->exec();
+  while(ilsByRectQuery->next())
+  {
+    map::MapIls ils;
+    mapTypesFactory->fillIls(ilsByRectQuery->record(), ils);
+    ilsList.append(ils);
+  }
+}
 
-  if(airwayCache.list.isEmpty() && !lazy)
+void MapQuery::fetchAirways(const GeoDataLatLonBox& rect, QList<map::MapAirway>& airways)
+{
+  bindCoordinatePointInRect(rect, airwayByRectQuery);
+  airwayByRectQuery->exec();
+  while(airwayByRectQuery->next())
   {
-    for(const GeoDataLatLonBox& r : splitAtAntiMeridian(rect))
-    {
-      bindCoordinatePointInRect(r, airwayByRectQuery);
-      airwayByRectQuery->exec();
-      while(airwayByRectQuery->next())
-      {
-        map::MapAirway airway;
-        mapTypesFactory->fillAirway(airwayByRectQuery->record(), airway);
-        airwayCache.list.append(airway);
-      }
-    }
+    map::MapAirway airway;
+    mapTypesFactory->fillAirway(airwayByRectQuery->record(), airway);
+    airways.append(airway);
   }
-  airwayCache.validate();
-  return &airwayCache.list;
 }
 
-const QList<map::MapAirspace> *MapQuery::getAirspaces(const GeoDataLatLonBox& rect, const MapLayer *mapLayer,
-                                                      map::MapAirspaceTypes types, float flightPlanAltitude, bool lazy)
+/* Uses the airspace types and altitude of the last request */
+void MapQuery::fetchAirspaces(const GeoDataLatLonBox& rect, QList<map::MapAirspace>& airspaces)
 {
-  airspaceCache.updateCache(rect, mapLayer, lazy,
-                            [] (const MapLayer * curLayer, const MapLayer * newLayer)->bool
-                            {
-                              return curLayer->hasSameQueryParametersAirspace(newLayer);
-                            });
+  map::MapAirspaceTypes types = lastAirspaceTypes;
 
-  if(types != lastAirspaceTypes || atools::almostNotEqual(lastFlightplanAltitude, flightPlanAltitude))
+  // Only the type bits define the query - altitude flags select one of the queries below
+  map::MapAirspaceTypes queryTypes = map::AIRSPACE_NONE;
+  for(int i = 0; i <= map::MAP_AIRSPACE_TYPE_BITS; i++)
+    queryTypes |= types & map::MapAirspaceTypes(1 << i);
+  if(types == map::AIRSPACE_ALL)
+    queryTypes = map::AIRSPACE_ALL;
+
+  if(airspaceByRectQuery == nullptr || queryTypes != airspaceQueryTypes)
+    prepareAirspaceQueries(queryTypes);
+
+  SqlQuery *query = nullptr;
+  int alt;
+  if(types & map::AIRSPACE_AT_FLIGHTPLAN)
   {
-    // Need a few more parameters to clear the cache which is different to other map features
-    airspaceCache.list.clear();
-    lastAirspaceTypes = types;
-    lastFlightplanAltitude = flightPlanAltitude;
+    query = airspaceByRectAtAltQuery;
+    alt = atools::roundToInt(lastFlightplanAltitude);
+  }
+  else if(types & map::AIRSPACE_BELOW_10000)
+  {
+    query = airspaceByRectBelowAltQuery;
+    alt = 10000;
+  }
+  else if(types & map::AIRSPACE_BELOW_18000)
+  {
+    query = airspaceByRectBelowAltQuery;
+    alt = 18000;
+  }
+  else if(types & map::AIRSPACE_ABOVE_10000)
+  {
+    query = airspaceByRectAboveAltQuery;
+    alt = 10000;
+  }
+  else if(types & map::AIRSPACE_ABOVE_18000)
+  {
+    query = airspaceByRectAboveAltQuery;
+    alt = 18000;
+  }
+  else
+  {
+    query = airspaceByRectQuery;
+    alt = 0;
+  }
+
+  // One query for all types - result is already sorted by drawing order
+  bindCoordinatePointInRect(rect, query);
+  if(alt > 0)
+    query->bindValue(":alt", alt);
+
+  query->exec();
+  while(query->next())
+  {
+    map::MapAirspace airspace;
+    mapTypesFactory->fillAirspace(query->record(), airspace);
+    airspaces.append(airspace);
   }
+}
 
-  if(airspaceCache.list.isEmpty() && !lazy)
+/* Prepare the airspace rectangle queries for the given types. Types are filtered with an "in" clause and
+ * the result is sorted by drawing order in the database. */
+void MapQuery::prepareAirspaceQueries(map::MapAirspaceTypes types)
+{
+  // Initialized once in a thread safe way since this is called from the prefetch and render threads too
+  static const QString orderBy = buildAirspaceOrderBy();
+
+  QString typeFilter;
+  if(types != map::AIRSPACE_ALL)
   {
     QStringList typeStrings;
-
-    if(types != map::AIRSPACE_NONE)
+    for(int i = 0; i <= map::MAP_AIRSPACE_TYPE_BITS; i++)
     {
-      // Build a list of query strings based on the bitfield
-      if(types == map::AIRSPACE_ALL)
-        typeStrings.append("%");
-      else
+      map::MapAirspaceTypes type(1 << i);
+      if(types & type)
       {
-        for(int i = 0; i <= map::MAP_AIRSPACE_TYPE_BITS; i++)
-        {
-          map::MapAirspaceTypes t(1 << i);
-          if(types & t)
-            typeStrings.append(map::airspaceTypeToDatabase(t));
-        }
+        const QString& dbType = map::airspaceTypeToDatabase(type);
+        if(!dbType.isEmpty())
+          typeStrings.append("'" + dbType + "'");
       }
+    }
 
-      SqlQuery *query = nullptr;
-      int alt;
-      if(types & map::AIRSPACE_AT_FLIGHTPLAN)
-      {
-        query = airspaceByRectAtAltQuery;
-        alt = atools::roundToInt(flightPlanAltitude);
-      }
-      else if(types & map::AIRSPACE_BELOW_10000)
-      {
-        query = airspaceByRectBelowAltQuery;
-        alt = 10000;
-      }
-      else if(types & map::AIRSPACE_BELOW_18000)
-      {
-        query = airspaceByRectBelowAltQuery;
-        alt = 18000;
-      }
-      else if(types & map::AIRSPACE_ABOVE_10000)
-      {
-        query = airspaceByRectAboveAltQuery;
-        alt = 10000;
-      }
-      else if(types & map::AIRSPACE_ABOVE_18000)
-      {
-        query = airspaceByRectAboveAltQuery;
-        alt = 18000;
-      }
-      else
-      {
-        query = airspaceByRectQuery;
-        alt = 0;
-      }
+    // Nothing selected gives an empty result
+    typeFilter = " and type in (" + (typeStrings.isEmpty() ? QString("null") : typeStrings.join(",")) + ")";
+  }
 
-      // Get the airspace objects without geometry
-      for(const GeoDataLatLonBox& r : splitAtAntiMeridian(rect))
-      {
-        for(const QString& typeStr : typeStrings)
-        {
-          bindCoordinatePointInRect(r, query);
-          query->bindValue(":type", typeStr);
-
-          if(alt > 0)
-            query->bindValue(":alt", alt);
-
-          query->exec();
-          while(query->next())
-          {
-            map::MapAirspace airspace;
-            mapTypesFactory->fillAirspace(query->record(), airspace);
-            airspaceCache.list.append(airspace);
-          }
-        }
-      }
+  static const QString whereRect("where not (max_lonx < :leftx or min_lonx > :rightx or "
+                                 "min_laty > :topy or max_laty < :bottomy)");
+  QString queryBase = "select " + airspaceQueryBase + "from boundary " + whereRect + typeFilter;
 
-      // Sort by importance
-      std::sort(airspaceCache.list.begin(), airspaceCache.list.end(),
-                [] (const map::MapAirspace & airspace1, const map::MapAirspace & airspace2)->bool
-                {
-                  return map::airspaceDrawingOrder(airspace1.type) < map::airspaceDrawingOrder(airspace2.type);
-                });
-    }
-  }
-  airspaceCache.validate();
-  return &airspaceCache.list;
+  delete airspaceByRectQuery;
+  airspaceByRectQuery = new SqlQuery(db);
+  airspaceByRectQuery->prepare(queryBase + orderBy);
+
+  delete airspaceByRectBelowAltQuery;
+  airspaceByRectBelowAltQuery = new SqlQuery(db);
+  airspaceByRectBelowAltQuery->prepare(queryBase + " and min_altitude < :alt" + orderBy);
+
+  delete airspaceByRectAboveAltQuery;
+  airspaceByRectAboveAltQuery = new SqlQuery(db);
+  airspaceByRectAboveAltQuery->prepare(queryBase + " and max_altitude > :alt" + orderBy);
+
+  delete airspaceByRectAtAltQuery;
+  airspaceByRectAtAltQuery = new SqlQuery(db);
+  airspaceByRectAtAltQuery->prepare(queryBase + " and :alt between min_altitude and max_altitude" + orderBy);
+
+  airspaceQueryTypes = types;
 }
 
 const LineString *MapQuery::getAirspaceGeometry(int boundaryId)
 {
   if(airspaceLineCache.contains(boundaryId))
     return airspaceLineCache.object(boundaryId);
+  else if(!isDatabaseThread())
+    // Called from a render thread
+    return callInDatabaseThread<const LineString *>(std::bind(&MapQuery::getAirspaceGeometry, this, boundaryId));
   else
   {
+    QElapsedTimer timer;
+    if(profiler != nullptr)
+      timer.start();
+
     LineString *lines = new LineString;
 
     airspaceLinesByIdQuery->bindValue(":id", boundaryId);
     airspaceLinesByIdQuery->exec();
     if(airspaceLinesByIdQuery->next())
     {
-      QByteArray vertices = airspaceLinesByIdQuery->value("geometry").toByteArray();
-      QDataStream in(&vertices, QIODevice::ReadOnly);
-      in.setVersion(QDataStream::Qt_5_5);
-      in.setFloatingPointPrecision(QDataStream::SinglePrecision);
-
-      quint32 size;
-      float lonx, laty;
-      in >> size;
-      for(unsigned int i = 0; i < size; i++)
-      {
-        in >> lonx >> laty;
-        lines->append(lonx, laty);
-      }
+      readGeometry(airspaceLinesByIdQuery->value("geometry").toByteArray(), *lines);
     }
 
+    if(profiler != nullptr)
+      profiler->addQuery("Airspace geometry", timer.nsecsElapsed(), 1);
+
     airspaceLineCache.insert(boundaryId, lines);
 
     return lines;
   }
 }
 
-/*
- * Get airport cache
- * @param reverse reverse order of airports to have unimportant small ones below in painting order
- * @param lazy do not update cache - instead return incomplete resut
- * @param overview fetch only incomplete data for overview airports
- * @return pointer to the airport cache
- */
-const QList<map::MapAirport> *MapQuery::fetchAirports(const Marble::GeoDataLatLonBox& rect,
-                                                      atools::sql::SqlQuery *query, bool reverse,
-                                                      bool lazy, bool overview)
+/* Fetch airports for a tile. Query depends on the data source of the layer. */
+void MapQuery::fetchAirports(const Marble::GeoDataLatLonBox& rect, const MapLayer *mapLayer,
+                             QList<map::MapAirport>& airports)
 {
-  if(airportCache.list.isEmpty() && !lazy)
+  SqlQuery *query = nullptr;
+  bool overview = true;
+  switch(mapLayer->getDataSource())
   {
-    for(const GeoDataLatLonBox& r : splitAtAntiMeridian(rect))
-    {
-      bindCoordinatePointInRect(r, query);
-      query->exec();
-      while(query->next())
-      {
-        map::MapAirport ap;
-        if(overview)
-          // Fill only a part of the object
-          mapTypesFactory->fillAirportForOverview(query->record(), ap);
-        else
-          mapTypesFactory->fillAirport(query->record(), ap, true);
-
-        if(reverse)
-          airportCache.list.prepend(ap);
-        else
-          airportCache.list.append(ap);
-      }
-    }
+    case layer::ALL:
+      query = airportByRectQuery;
+      query->bindValue(":minlength", mapLayer->getMinRunwayLength());
+      overview = false;
+      break;
+
+    case layer::MEDIUM:
+      // Airports > 4000 ft
+      query = airportMediumByRectQuery;
+      break;
+
+    case layer::LARGE:
+      // Airports > 8000 ft
+      query = airportLargeByRectQuery;
+      break;
+  }
+
+  if(query == nullptr)
+    return;
+
+  bindCoordinatePointInRect(rect, query);
+  query->exec();
+  while(query->next())
+  {
+    map::MapAirport ap;
+    if(overview)
+      // Fill only a part of the object
+      mapTypesFactory->fillAirportForOverview(query->record(), ap);
+    else
+      mapTypesFactory->fillAirport(query->record(), ap, true);
+
+    airports.append(ap);
   }
-  airportCache.validate();
-  return &airportCache.list;
 }
 
 const QList<map::MapRunway> *MapQuery::getRunwaysForOverview(int airportId)
 {
   if(runwayOverwiewCache.contains(airportId))
     return runwayOverwiewCache.object(airportId);
+  else if(!isDatabaseThread())
+    // Called from a render thread
+    return callInDatabaseThread<const QList<map::MapRunway> *>(
+      std::bind(&MapQuery::getRunwaysForOverview, this, airportId));
   else
   {
     using atools::geo::Pos;
@@ -995,6 +1299,9 @@ const QList<map::MapApron> *MapQuery::getAprons(int airportId)
 {
   if(apronCache.contains(airportId))
     return apronCache.object(airportId);
+  else if(!isDatabaseThread())
+    // Called from a render thread
+    return callInDatabaseThread<const QList<map::MapApron> *>(std::bind(&MapQuery::getAprons, this, airportId));
   else
   {
     apronQuery->bindValue(":airportId", airportId);
@@ -1009,19 +1316,7 @@ const QList<map::MapApron> *MapQuery::getAprons(int airportId)
       ap.drawSurface = apronQuery->value("is_draw_surface").toInt() > 0;
 
       // Decode vertices into a position list
-
-      QByteArray vertices = apronQuery->value("vertices").toByteArray();
-      QDataStream in(&vertices, QIODevice::ReadOnly);
-      in.setFloatingPointPrecision(QDataStream::SinglePrecision);
-
-      quint32 size;
-      float lonx, laty;
-      in >> size;
-      for(unsigned int i = 0; i < size; i++)
-      {
-        in >> lonx >> laty;
-        ap.vertices.append(lonx, laty);
-      }
+      readGeometry(apronQuery->value("vertices").toByteArray(), ap.vertices);
       aprons->append(ap);
     }
     apronCache.insert(airportId, aprons);
@@ -1033,6 +1328,10 @@ const QList<map::MapParking> *MapQuery::getParkingsForAirport(int airportId)
 {
   if(parkingCache.contains(airportId))
     return parkingCache.object(airportId);
+  else if(!isDatabaseThread())
+    // Called from a render thread
+    return callInDatabaseThread<const QList<map::MapParking> *>(
+      std::bind(&MapQuery::getParkingsForAirport, this, airportId));
   else
   {
     parkingQuery->bindValue(":airportId", airportId);
@@ -1186,6 +1485,9 @@ const QList<map::MapHelipad> *MapQuery::getHelipads(int airportId)
 {
   if(helipadCache.contains(airportId))
     return helipadCache.object(airportId);
+  else if(!isDatabaseThread())
+    // Called from a render thread
+    return callInDatabaseThread<const QList<map::MapHelipad> *>(std::bind(&MapQuery::getHelipads, this, airportId));
   else
   {
     helipadQuery->bindValue(":airportId", airportId);
@@ -1223,6 +1525,9 @@ const QList<map::MapTaxiPath> *MapQuery::getTaxiPaths(int airportId)
 {
   if(taxipathCache.contains(airportId))
     return taxipathCache.object(airportId);
+  else if(!isDatabaseThread())
+    // Called from a render thread
+    return callInDatabaseThread<const QList<map::MapTaxiPath> *>(std::bind(&MapQuery::getTaxiPaths, this, airportId));
   else
   {
     taxiparthQuery->bindValue(":airportId", airportId);
@@ -1252,6 +1557,9 @@ const QList<map::MapRunway> *MapQuery::getRunways(int airportId)
 {
   if(runwayCache.contains(airportId))
     return runwayCache.object(airportId);
+  else if(!isDatabaseThread())
+    // Called from a render thread
+    return callInDatabaseThread<const QList<map::MapRunway> *>(std::bind(&MapQuery::getRunways, this, airportId));
   else
   {
     runwaysQuery->bindValue(":airportId", airportId);
@@ -1319,8 +1627,10 @@ QList<Marble::GeoDataLatLonBox> MapQuery::splitAtAntiMeridian(const Marble::GeoD
 {
   GeoDataLatLonBox newRect = rect;
   inflateRect(newRect,
-              newRect.width(GeoDataCoordinates::Degree) * queryRectInflationFactor + queryRectInflationIncrement,
-              newRect.height(GeoDataCoordinates::Degree) * queryRectInflationFactor + queryRectInflationIncrement);
+              newRect.width(GeoDataCoordinates::Degree) * config.queryRectInflationFactor +
+              config.queryRectInflationIncrement,
+              newRect.height(GeoDataCoordinates::Degree) * config.queryRectInflationFactor +
+              config.queryRectInflationIncrement);
 
   if(newRect.crossesDateLine())
   {
@@ -1357,7 +1667,7 @@ void MapQuery::initQueries()
   // Common where clauses
   static const QString whereRect("lonx between :leftx and :rightx and laty between :bottomy and :topy");
   static const QString whereIdentRegion("ident = :ident and region like :region");
-  static const QString whereLimit("limit " + QString::number(queryRowLimit));
+  const QString whereLimit("limit " + QString::number(config.queryRowLimit));
 
   // Common select statements
   static const QString airportQueryBase(
@@ -1385,10 +1695,6 @@ void MapQuery::initQueries()
     "airway_id, airway_name, airway_type, airway_fragment_no, sequence_no, from_waypoint_id, to_waypoint_id, "
     "minimum_altitude, from_lonx, from_laty, to_lonx, to_laty ");
 
-  static const QString airspaceQueryBase(
-    "boundary_id, type, name, com_type, com_frequency, com_name, "
-    "min_altitude_type, max_altitude_type, max_altitude, max_lonx, max_laty, min_altitude, min_lonx, min_laty ");
-
   static const QString waypointQueryBase(
     "waypoint_id, ident, region, type, num_victor_airway, num_jet_airway, "
     "mag_var, lonx, laty ");
@@ -1603,33 +1909,6 @@ void MapQuery::initQueries()
   airwayWaypointsQuery->prepare("select " + airwayQueryBase + " from airway where airway_name = :name "
                                                               " order by airway_fragment_no, sequence_no");
 
-  airspaceByRectQuery = new SqlQuery(db);
-  airspaceByRectQuery->prepare(
-    "select " + airspaceQueryBase + "from boundary "
-                                    "where not (max_lonx < :leftx or min_lonx > :rightx or "
-                                    "min_laty > :topy or max_laty < :bottomy) and type like :type");
-
-  airspaceByRectBelowAltQuery = new SqlQuery(db);
-  airspaceByRectBelowAltQuery->prepare(
-    "select " + airspaceQueryBase + "from boundary "
-                                    "where not (max_lonx < :leftx or min_lonx > :rightx or "
-                                    "min_laty > :topy or max_laty < :bottomy) and type like :type and "
-                                    "min_altitude < :alt");
-
-  airspaceByRectAboveAltQuery = new SqlQuery(db);
-  airspaceByRectAboveAltQuery->prepare(
-    "select " + airspaceQueryBase + "from boundary "
-                                    "where not (max_lonx < :leftx or min_lonx > :rightx or "
-                                    "min_laty > :topy or max_laty < :bottomy) and type like :type and "
-                                    "max_altitude > :alt");
-
-  airspaceByRectAtAltQuery = new SqlQuery(db);
-  airspaceByRectAtAltQuery->prepare(
-    "select " + airspaceQueryBase + "from boundary "
-                                    "where not (max_lonx < :leftx or min_lonx > :rightx or "
-                                    "min_laty > :topy or max_laty < :bottomy) and type like :type and "
-                                    ":alt between min_altitude and max_altitude");
-
   airspaceLinesByIdQuery = new SqlQuery(db);
   airspaceLinesByIdQuery->prepare("select geometry from boundary where boundary_id = :id");
 
@@ -20,18 +20,20 @@
 
 #include "common/maptypes.h"
 #include "mapgui/maplayer.h"
+#include "geo/rect.h"
 
 #include <QCache>
+#include <QHash>
+#include <QSet>
 #include <QList>
+#include <QThread>
 
+#include <algorithm>
 #include <functional>
 
 #include <marble/GeoDataLatLonBox.h>
 
 namespace atools {
-namespace geo {
-class Rect;
-}
 namespace sql {
 class SqlDatabase;
 class SqlQuery;
@@ -41,6 +43,7 @@ class SqlQuery;
 class CoordinateConverter;
 class MapTypesFactory;
 class MapLayer;
+class MapPaintProfiler;
 
 /*
  * Provides map related database queries. Fill objects of the maptypes namespace and maintains a cache.
@@ -54,7 +57,25 @@ class MapQuery
   Q_OBJECT
 
 public:
-  MapQuery(QObject *parent, atools::sql::SqlDatabase *sqlDb);
+  /* Cache sizes and query limits from the settings */
+  struct QueryConfig
+  {
+    int runwayCache = 2000, runwayOverviewCache = 1000, apronCache = 1000, taxipathCache = 1000,
+        parkingCache = 1000, startCache = 1000, helipadCache = 1000, airspaceLineCache = 10000;
+
+    /* Maximum number of objects in all tiles of each tile cache */
+    int tileCacheObjects = 50000;
+
+    /* Inflate bounding rectangle before passing it to query */
+    double queryRectInflationFactor = 0.3, queryRectInflationIncrement = 0.1;
+    int queryRowLimit = 5000;
+  };
+
+  /* Read configuration from the settings. Call only in the GUI thread and pass the result to instances
+   * created in other threads. */
+  static QueryConfig readConfig();
+
+  MapQuery(QObject *parent, atools::sql::SqlDatabase *sqlDb, const QueryConfig& queryConfig);
   ~MapQuery();
 
   void getAirportAdminNamesById(int airportId, QString& city, QString& state, QString& country);
@@ -202,6 +223,48 @@ public:
 
   const QList<map::MapHelipad> *getHelipads(int airportId);
 
+  /* Tiles for loading map objects in a background thread. See MapQueryPrefetch. */
+  struct PrefetchTiles;
+
+  /*
+   * Get all tiles that are needed to draw the map objects inside the rectangles but are not cached yet.
+   * Uses the same layer and type conditions as the map painters.
+   * @return null if all tiles are cached. Caller takes ownership.
+   */
+  PrefetchTiles *getMissingTiles(const QList<Marble::GeoDataLatLonBox>& rects, const MapLayer *mapLayer,
+                                 const MapLayer *mapLayerEffective, map::MapObjectTypes types,
+                                 map::MapAirspaceTypes airspaceTypes, float flightPlanAltitude);
+
+  /* Load objects for all tiles. Used in a background thread on an instance with its own database connection. */
+  void loadTiles(PrefetchTiles& prefetchTiles);
+
+  /* Add tiles loaded by another instance to the caches */
+  void insertTiles(const PrefetchTiles& prefetchTiles);
+
+  /* Runs a function in the thread owning the database connection and returns when it is done */
+  typedef std::function<void (const std::function<void()>& func)> DatabaseExecutorFunc;
+
+  /*
+   * Set an executor that is used if a map object getter needs the database when called from another thread
+   * than the one which created this instance. Used by the render threads of MapLayerCompositor.
+   * The getters can be used from several threads at once if each thread uses different object types.
+   */
+  void setDatabaseExecutor(const DatabaseExecutorFunc& value)
+  {
+    databaseExecutor = value;
+  }
+
+  /* Report time and row count of tile and airspace geometry queries. Does not take ownership. */
+  void setProfiler(MapPaintProfiler *value)
+  {
+    profiler = value;
+  }
+
+  /* true if a list returned by one of the map object getters above was truncated by the row limit
+   * since the last call of resetTruncated */
+  bool isTruncated() const;
+  void resetTruncated();
+
   /* Close all query objects thus disconnecting from the database */
   void initQueries();
 
@@ -209,31 +272,129 @@ public:
   void deInitQueries();
 
 private:
-  /* Simple spatial cache that deals with objects in a bounding rectangle but does not run any queries to load data */
+  /*
+   * Spatial cache that splits the world into tiles on a fixed degree grid. Tiles are keyed by the query parameters
+   * of the map layer, the tile level and the tile x/y coordinates and are evicted in least recently used order.
+   * Panning loads only the newly exposed tiles. The tile size depends on the size of the requested rectangle.
+   *
+   * The merged result for the last request is kept in list. A grid index on the list is used for hit testing
+   * and is built on first use after the list was changed.
+   */
   template<typename TYPE>
-  struct SimpleRectCache
+  struct TileCache
   {
     typedef std::function<bool (const MapLayer *curLayer, const MapLayer *mapLayer)> LayerCompareFunc;
 
+    /* Load all objects for the tile rectangle which never crosses the anti-meridian */
+    typedef std::function<void (const Marble::GeoDataLatLonBox& rect, const MapLayer *mapLayer,
+                                QList<TYPE>& objects)> TileFetchFunc;
+
+    typedef std::function<bool (const TYPE& obj1, const TYPE& obj2)> LessFunc;
+
+    /* Tiles to be loaded by another cache. Keys do not contain the layer index. */
+    struct Batch
+    {
+      const MapLayer *mapLayer = nullptr;
+      QVector<quint64> keys;
+      QVector<QList<TYPE> > objects;
+    };
+
     /*
-     * @param rect bounding rectangle - all objects inside this rectangle are returned
+     * @param rects bounding rectangles already inflated and split at the anti-meridian
      * @param mapLayer current map layer
-     * @param lazy if true do not fetch new data but return the old potentially incomplete dataset
-     * @return true after clearing the cache. The caller has to request new data
+     * @param lazy if true do not fetch new tiles. Return the merged tiles if all are already loaded or
+     * the old potentially incomplete dataset otherwise.
+     * @return list of all objects in the tiles covering rects
      */
-    bool updateCache(const Marble::GeoDataLatLonBox& rect, const MapLayer *mapLayer, bool lazy,
-                     LayerCompareFunc funcSameLayer);
+    const QList<TYPE> *updateCache(const QList<Marble::GeoDataLatLonBox>& rects, const MapLayer *mapLayer, bool lazy);
     void clear();
-    void validate();
 
-    Marble::GeoDataLatLonBox curRect;
-    const MapLayer *curMapLayer = nullptr;
+    /* Maximum number of objects in all tiles */
+    void setMaxObjects(int value)
+    {
+      tiles.setMaxCost(value);
+    }
+
+    /* Add all tiles needed to cover rects which are not loaded yet to the batch */
+    void missingTiles(const QList<Marble::GeoDataLatLonBox>& rects, const MapLayer *mapLayer, Batch& batch);
+
+    /* Load objects for all tiles of the batch. Does not use or change the cached tiles. */
+    void loadTiles(Batch& batch) const;
+
+    /* Insert tiles filled by loadTiles of another cache */
+    void insertTiles(const Batch& batch);
+
+    /* Get indexes into list of all objects inside the rectangle in descending order.
+     * Returns all indexes if the rectangle is not valid. */
+    void getIndexes(const atools::geo::Rect& rect, QVector<int>& indexes);
+
+    /* Has to be set before using the cache */
+    LayerCompareFunc funcSameLayer;
+    TileFetchFunc funcFetch;
+
+    /* Optional sort order for the merged list */
+    LessFunc funcLess;
+
+    /* Objects of each tile are already sorted by funcLess. Tiles are merged instead of sorting the whole list. */
+    bool tilesSorted = false;
+
+    /* Row limit of the tile fetch queries and of the merged list. Tiles reaching the limit are truncated. */
+    int rowLimit = 5000;
+
+    /* Merged list was cut at rowLimit or contains truncated tiles */
+    bool truncated = false;
+
+    /* updateCache was called since the last resetTruncated */
+    bool used = false;
     QList<TYPE> list;
+
+private:
+    void buildIndex();
+    quint64 layerKey(const MapLayer *mapLayer);
+    void tileKeys(const QList<Marble::GeoDataLatLonBox>& rects, QVector<quint64>& keys) const;
+    static Marble::GeoDataLatLonBox tileRect(quint64 key);
+
+    static int gridCell(int x, int y)
+    {
+      return y * 360 + x;
+    }
+
+    static int gridX(float lonx)
+    {
+      return std::max(0, std::min(359, static_cast<int>(lonx + 180.f)));
+    }
+
+    static int gridY(float laty)
+    {
+      return std::max(0, std::min(179, static_cast<int>(laty + 90.f)));
+    }
+
+    /* One layer for each distinct set of query parameters. Index is used in the tile key. */
+    QVector<const MapLayer *> layers;
+
+    /* Complete tiles with cost being the number of objects */
+    QCache<quint64, QList<TYPE> > tiles;
+
+    /* Tiles merged into list and false if a tile was missing or truncated by the row limit */
+    QVector<quint64> listTiles;
+    bool listComplete = false;
+
+    /* One degree grid cell to indexes into list. Not valid if indexedSize does not match list. */
+    QHash<int, QVector<int> > grid;
+    int indexedSize = -1;
   };
 
-  const QList<map::MapAirport> *fetchAirports(const Marble::GeoDataLatLonBox& rect,
-                                              atools::sql::SqlQuery *query, bool reverse,
-                                              bool lazy, bool overview);
+  /* Tile fetch functions. rect does not cross the anti-meridian. */
+  void fetchAirports(const Marble::GeoDataLatLonBox& rect, const MapLayer *mapLayer,
+                     QList<map::MapAirport>& airports);
+  void fetchWaypoints(const Marble::GeoDataLatLonBox& rect, QList<map::MapWaypoint>& waypoints);
+  void fetchVors(const Marble::GeoDataLatLonBox& rect, QList<map::MapVor>& vors);
+  void fetchNdbs(const Marble::GeoDataLatLonBox& rect, QList<map::MapNdb>& ndbs);
+  void fetchMarkers(const Marble::GeoDataLatLonBox& rect, QList<map::MapMarker>& markers);
+  void fetchIls(const Marble::GeoDataLatLonBox& rect, QList<map::MapIls>& ilsList);
+  void fetchAirways(const Marble::GeoDataLatLonBox& rect, QList<map::MapAirway>& airways);
+  void fetchAirspaces(const Marble::GeoDataLatLonBox& rect, QList<map::MapAirspace>& airspaces);
+  void prepareAirspaceQueries(map::MapAirspaceTypes types);
 
   void bindCoordinatePointInRect(const Marble::GeoDataLatLonBox& rect, atools::sql::SqlQuery *query,
                                  const QString& prefix = QString());
@@ -242,21 +403,57 @@ private:
 
   static void inflateRect(Marble::GeoDataLatLonBox& rect, double width, double height);
 
+  /* Get bounding rectangle for the screen search area. Returns an invalid rectangle if the
+   * area is not completely covered by the globe or crosses the anti-meridian. */
+  atools::geo::Rect nearestObjectsRect(const CoordinateConverter& conv, int xs, int ys, int screenDistance,
+                                       float marginDeg) const;
+
   bool runwayCompare(const map::MapRunway& r1, const map::MapRunway& r2);
 
+  /* true if queries can be executed directly in the current thread */
+  bool isDatabaseThread() const
+  {
+    return !databaseExecutor || QThread::currentThread() == databaseThread;
+  }
+
+  /* Call function using the database executor and return its result */
+  template<typename RESULT>
+  RESULT callInDatabaseThread(const std::function<RESULT()>& func)
+  {
+    RESULT result = RESULT();
+    databaseExecutor([&result, &func]()
+                     {
+                       result = func();
+                     });
+    return result;
+  }
+
+  /* Wrap tile fetch function to run in the database thread if needed. Name is used for profiling. */
+  template<typename TYPE>
+  typename TileCache<TYPE>::TileFetchFunc fetchInDatabaseThread(
+    const QString& name, const typename TileCache<TYPE>::TileFetchFunc& func);
+
   MapTypesFactory *mapTypesFactory;
   atools::sql::SqlDatabase *db;
 
-  /* Simple bounding rectangle caches */
-  SimpleRectCache<map::MapAirport> airportCache;
-  SimpleRectCache<map::MapWaypoint> waypointCache;
-  SimpleRectCache<map::MapVor> vorCache;
-  SimpleRectCache<map::MapNdb> ndbCache;
-  SimpleRectCache<map::MapMarker> markerCache;
-  SimpleRectCache<map::MapIls> ilsCache;
-  SimpleRectCache<map::MapAirway> airwayCache;
-  SimpleRectCache<map::MapAirspace> airspaceCache;
+  /* Thread that created this object and owns the database connection */
+  QThread *databaseThread;
+  DatabaseExecutorFunc databaseExecutor;
+  MapPaintProfiler *profiler = nullptr;
+
+  /* Tiled bounding rectangle caches */
+  TileCache<map::MapAirport> airportCache;
+  TileCache<map::MapWaypoint> waypointCache;
+  TileCache<map::MapVor> vorCache;
+  TileCache<map::MapNdb> ndbCache;
+  TileCache<map::MapMarker> markerCache;
+  TileCache<map::MapIls> ilsCache;
+  TileCache<map::MapAirway> airwayCache;
+  TileCache<map::MapAirspace> airspaceCache;
   map::MapAirspaceTypes lastAirspaceTypes = map::AIRSPACE_NONE;
+
+  /* Types used to prepare the airspace rectangle queries */
+  map::MapAirspaceTypes airspaceQueryTypes = map::AIRSPACE_NONE;
   float lastFlightplanAltitude = 0.f;
 
   /* ID/object caches */
@@ -269,10 +466,18 @@ private:
   QCache<int, QList<map::MapHelipad> > helipadCache;
   QCache<int, atools::geo::LineString> airspaceLineCache;
 
-  /* Inflate bounding rectangle before passing it to query */
-  static double queryRectInflationFactor;
-  static double queryRectInflationIncrement;
-  static int queryRowLimit;
+  /* Tile sizes in degree for the tile caches. All have to divide 180 without remainder. */
+  static Q_DECL_CONSTEXPR int TILE_LEVELS = 4;
+  static Q_DECL_CONSTEXPR float TILE_SIZE_DEG[TILE_LEVELS] = {1.f, 3.f, 9.f, 45.f};
+
+  /* Use the next larger tile size if more tiles are needed to cover a rectangle */
+  static Q_DECL_CONSTEXPR int TILE_MAX_NUMBER = 36;
+
+  /* Margins in degree for the hit testing search area */
+  static Q_DECL_CONSTEXPR float NEAREST_RECT_MARGIN_DEG = 0.01f;
+  static Q_DECL_CONSTEXPR float AIRPORT_TOWER_MARGIN_DEG = 0.05f;
+
+  QueryConfig config;
 
   /* Database queries */
   atools::sql::SqlQuery *airportByRectQuery = nullptr, *airportMediumByRectQuery = nullptr,
@@ -303,49 +508,275 @@ private:
   *airwayByNameQuery = nullptr;
 };
 
+struct MapQuery::PrefetchTiles
+{
+  TileCache<map::MapAirport>::Batch airports;
+  TileCache<map::MapWaypoint>::Batch waypoints;
+  TileCache<map::MapVor>::Batch vors;
+  TileCache<map::MapNdb>::Batch ndbs;
+  TileCache<map::MapMarker>::Batch markers;
+  TileCache<map::MapIls>::Batch ils;
+  TileCache<map::MapAirway>::Batch airways;
+  TileCache<map::MapAirspace>::Batch airspaces;
+
+  /* Parameters for the airspace query */
+  map::MapAirspaceTypes airspaceTypes = map::AIRSPACE_NONE;
+  float flightPlanAltitude = 0.f;
+
+  bool isEmpty() const
+  {
+    return airports.keys.isEmpty() && waypoints.keys.isEmpty() && vors.keys.isEmpty() && ndbs.keys.isEmpty() &&
+           markers.keys.isEmpty() && ils.keys.isEmpty() && airways.keys.isEmpty() && airspaces.keys.isEmpty();
+  }
+};
+
 // ---------------------------------------------------------------------------------
 template<typename TYPE>
-bool MapQuery::SimpleRectCache<TYPE>::updateCache(const Marble::GeoDataLatLonBox& rect, const MapLayer *mapLayer,
-                                                  bool lazy, LayerCompareFunc funcSameLayer)
+const QList<TYPE> *MapQuery::TileCache<TYPE>::updateCache(const QList<Marble::GeoDataLatLonBox>& rects,
+                                                          const MapLayer *mapLayer, bool lazy)
 {
+  used = true;
+
+  QVector<quint64> keys;
+  tileKeys(rects, keys);
+
+  quint64 lkey = layerKey(mapLayer);
+  for(quint64& key : keys)
+    key |= lkey;
+
+  if(keys == listTiles && listComplete)
+    // Nothing changed
+    return &list;
+
   if(lazy)
-    // Nothing changed11
-    return false;
+  {
+    for(quint64 key : keys)
+    {
+      if(!tiles.contains(key))
+        // Return old data while moving the map
+        return &list;
+    }
+  }
+
+  list.clear();
+  indexedSize = -1;
+  listTiles = keys;
+  listComplete = true;
+  truncated = false;
+
+  // Objects like airways or airspaces can be part of more than one tile
+  QSet<int> ids;
+  for(quint64 key : keys)
+  {
+    QList<TYPE> *objects = tiles.object(key);
+    bool insertTile = false;
+    if(objects == nullptr)
+    {
+      objects = new QList<TYPE>;
+      funcFetch(tileRect(key), mapLayer, *objects);
+
+      // Load truncated tiles again on the next request
+      insertTile = objects->size() < rowLimit;
+      listComplete &= insertTile;
+    }
+
+    // Prefetched tiles are inserted even if truncated
+    truncated |= objects->size() >= rowLimit;
+
+    int tileStart = list.size();
+    for(const TYPE& obj : *objects)
+    {
+      if(!ids.contains(obj.id))
+      {
+        ids.insert(obj.id);
+        list.append(obj);
+      }
+    }
+
+    if(funcLess && tilesSorted)
+      std::inplace_merge(list.begin(), list.begin() + tileStart, list.end(), funcLess);
+
+    if(insertTile)
+      // Might delete the tile immediately if the cache is too small
+      tiles.insert(key, objects, std::max(1, objects->size()));
+    else if(!tiles.contains(key))
+      delete objects;
+  }
+
+  if(funcLess && !tilesSorted)
+    std::stable_sort(list.begin(), list.end(), funcLess);
+
+  if(list.size() > rowLimit)
+  {
+    // One row budget for all tiles like a single query - sorted lists keep the most important objects
+    // at the end which are drawn last
+    if(funcLess)
+      list.erase(list.begin(), list.end() - rowLimit);
+    else
+      list.erase(list.begin() + rowLimit, list.end());
+    truncated = true;
+  }
+
+  return &list;
+}
+
+template<typename TYPE>
+void MapQuery::TileCache<TYPE>::clear()
+{
+  list.clear();
+  grid.clear();
+  indexedSize = -1;
+  tiles.clear();
+  layers.clear();
+  listTiles.clear();
+  listComplete = false;
+  truncated = false;
+}
 
-  // Store bounding rectangle and inflate it
-  Marble::GeoDataLatLonBox cur(curRect);
-  MapQuery::inflateRect(cur, cur.width(Marble::GeoDataCoordinates::Degree) *
-                        queryRectInflationFactor + queryRectInflationIncrement,
-                        cur.height(Marble::GeoDataCoordinates::Degree) *
-                        queryRectInflationFactor + queryRectInflationIncrement);
+template<typename TYPE>
+void MapQuery::TileCache<TYPE>::missingTiles(const QList<Marble::GeoDataLatLonBox>& rects,
+                                             const MapLayer *mapLayer, Batch& batch)
+{
+  QVector<quint64> keys;
+  tileKeys(rects, keys);
 
-  if(curRect.isEmpty() || !cur.contains(rect) || !funcSameLayer(curMapLayer, mapLayer))
+  quint64 lkey = layerKey(mapLayer);
+  for(quint64 key : keys)
   {
-    // Rectangle not covered by loaded data or new layer selected
-    list.clear();
-    curRect = rect;
-    curMapLayer = mapLayer;
-    return true;
+    if(!tiles.contains(key | lkey) && !batch.keys.contains(key))
+    {
+      batch.mapLayer = mapLayer;
+      batch.keys.append(key);
+    }
   }
-  return false;
 }
 
 template<typename TYPE>
-void MapQuery::SimpleRectCache<TYPE>::validate()
+void MapQuery::TileCache<TYPE>::loadTiles(Batch& batch) const
 {
-  if(list.size() >= queryRowLimit)
+  batch.objects.resize(batch.keys.size());
+  for(int i = 0; i < batch.keys.size(); i++)
+    funcFetch(tileRect(batch.keys.at(i)), batch.mapLayer, batch.objects[i]);
+}
+
+template<typename TYPE>
+void MapQuery::TileCache<TYPE>::insertTiles(const Batch& batch)
+{
+  if(batch.keys.isEmpty() || batch.objects.size() != batch.keys.size())
+    return;
+
+  // Truncated tiles are inserted too since they cannot be loaded again in the background
+  quint64 lkey = layerKey(batch.mapLayer);
+  for(int i = 0; i < batch.keys.size(); i++)
   {
-    curRect.clear();
-    curMapLayer = nullptr;
+    const QList<TYPE>& objects = batch.objects.at(i);
+    tiles.insert(batch.keys.at(i) | lkey, new QList<TYPE>(objects), std::max(1, objects.size()));
   }
 }
 
 template<typename TYPE>
-void MapQuery::SimpleRectCache<TYPE>::clear()
+quint64 MapQuery::TileCache<TYPE>::layerKey(const MapLayer *mapLayer)
 {
-  list.clear();
-  curRect.clear();
-  curMapLayer = nullptr;
+  int index = -1;
+  for(int i = 0; i < layers.size(); i++)
+  {
+    if(funcSameLayer(layers.at(i), mapLayer))
+    {
+      index = i;
+      break;
+    }
+  }
+
+  if(index == -1)
+  {
+    layers.append(mapLayer);
+    index = layers.size() - 1;
+  }
+  return static_cast<quint64>(index) << 40;
+}
+
+/* Select the smallest tile size that covers the rectangles with not more than TILE_MAX_NUMBER tiles */
+template<typename TYPE>
+void MapQuery::TileCache<TYPE>::tileKeys(const QList<Marble::GeoDataLatLonBox>& rects,
+                                         QVector<quint64>& keys) const
+{
+  for(int level = 0; level < TILE_LEVELS; level++)
+  {
+    float size = TILE_SIZE_DEG[level];
+    int maxX = static_cast<int>(360.f / size) - 1, maxY = static_cast<int>(180.f / size) - 1;
+
+    keys.clear();
+    for(const Marble::GeoDataLatLonBox& rect : rects)
+    {
+      int x1 = std::max(0, static_cast<int>((rect.west(Marble::GeoDataCoordinates::Degree) + 180.) / size));
+      int x2 = std::min(maxX, static_cast<int>((rect.east(Marble::GeoDataCoordinates::Degree) + 180.) / size));
+      int y1 = std::max(0, static_cast<int>((rect.south(Marble::GeoDataCoordinates::Degree) + 90.) / size));
+      int y2 = std::min(maxY, static_cast<int>((rect.north(Marble::GeoDataCoordinates::Degree) + 90.) / size));
+
+      for(int y = y1; y <= y2; y++)
+      {
+        for(int x = x1; x <= x2; x++)
+          keys.append(static_cast<quint64>(level) << 32 | static_cast<quint64>(y) << 16 | static_cast<quint64>(x));
+      }
+    }
+
+    if(keys.size() <= TILE_MAX_NUMBER)
+      break;
+  }
+}
+
+template<typename TYPE>
+Marble::GeoDataLatLonBox MapQuery::TileCache<TYPE>::tileRect(quint64 key)
+{
+  double size = TILE_SIZE_DEG[(key >> 32) & 0xff];
+  double x = static_cast<double>(key & 0xffff) * size - 180., y = static_cast<double>((key >> 16) & 0xffff) * size - 90.;
+
+  Marble::GeoDataLatLonBox rect;
+  rect.setBoundaries(y + size, y, x + size, x, Marble::GeoDataCoordinates::Degree);
+  return rect;
+}
+
+template<typename TYPE>
+void MapQuery::TileCache<TYPE>::buildIndex()
+{
+  grid.clear();
+  for(int i = 0; i < list.size(); i++)
+  {
+    const atools::geo::Pos& pos = list.at(i).position;
+    grid[gridCell(gridX(pos.getLonX()), gridY(pos.getLatY()))].append(i);
+  }
+  indexedSize = list.size();
+}
+
+template<typename TYPE>
+void MapQuery::TileCache<TYPE>::getIndexes(const atools::geo::Rect& rect, QVector<int>& indexes)
+{
+  if(!rect.isValid())
+  {
+    for(int i = list.size() - 1; i >= 0; i--)
+      indexes.append(i);
+    return;
+  }
+
+  if(indexedSize != list.size())
+    // List was changed by the caller
+    buildIndex();
+
+  for(const atools::geo::Rect& r : rect.splitAtAntiMeridian())
+  {
+    for(int y = gridY(r.getSouth()); y <= gridY(r.getNorth()); y++)
+    {
+      for(int x = gridX(r.getWest()); x <= gridX(r.getEast()); x++)
+      {
+        auto it = grid.constFind(gridCell(x, y));
+        if(it != grid.constEnd())
+          indexes.append(it.value());
+      }
+    }
+  }
+
+  // Keep the order of a full scan
+  std::sort(indexes.begin(), indexes.end(), std::greater<int>());
 }
 
 #endif // LITTLENAVMAP_MAPQUERY_H
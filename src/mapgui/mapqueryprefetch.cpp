@@ -0,0 +1,302 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "mapgui/mapqueryprefetch.h"
+
+#include "common/constants.h"
+#include "exception.h"
+#include "settings/settings.h"
+#include "sql/sqldatabase.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+using atools::sql::SqlDatabase;
+using Marble::GeoDataLatLonBox;
+using Marble::GeoDataCoordinates;
+
+/* Separate connection used only in the prefetch thread */
+static const QString DATABASE_NAME("LNMDBPREFETCH");
+static const QString DATABASE_TYPE("QSQLITE");
+
+/* Normalize longitude to -180 to 180 degree */
+static double normalizeLonDeg(double lonx)
+{
+  while(lonx > 180.)
+    lonx -= 360.;
+  while(lonx < -180.)
+    lonx += 360.;
+  return lonx;
+}
+
+MapQueryPrefetchWorker::MapQueryPrefetchWorker(const MapQuery::QueryConfig& queryConfig)
+  : config(queryConfig)
+{
+}
+
+MapQueryPrefetchWorker::~MapQueryPrefetchWorker()
+{
+  closeDatabase();
+}
+
+void MapQueryPrefetchWorker::openDatabase(const QString& filename)
+{
+  closeDatabase();
+
+  try
+  {
+    qDebug() << Q_FUNC_INFO << "Opening prefetch database" << filename;
+
+    db = new SqlDatabase(SqlDatabase::addDatabase(DATABASE_TYPE, DATABASE_NAME));
+    db->setDatabaseName(filename);
+
+    // Do not use exclusive locking like the main connection and never write
+    db->open({"PRAGMA query_only=ON", "PRAGMA cache_size=-20000"});
+
+    mapQuery = new MapQuery(this, db, config);
+    mapQuery->initQueries();
+
+    emit databaseOpened(true);
+  }
+  catch(atools::Exception& e)
+  {
+    qWarning() << Q_FUNC_INFO << "Cannot open prefetch database" << e.what();
+    closeDatabase();
+    emit databaseOpened(false);
+  }
+  catch(...)
+  {
+    qWarning() << Q_FUNC_INFO << "Cannot open prefetch database. Unknown exception.";
+    closeDatabase();
+    emit databaseOpened(false);
+  }
+}
+
+void MapQueryPrefetchWorker::closeDatabase()
+{
+  // Deletes all queries
+  delete mapQuery;
+  mapQuery = nullptr;
+
+  if(db != nullptr)
+  {
+    qDebug() << Q_FUNC_INFO << "Closing prefetch database";
+
+    if(db->isOpen())
+      db->close();
+    delete db;
+    db = nullptr;
+    SqlDatabase::removeDatabase(DATABASE_NAME);
+  }
+}
+
+void MapQueryPrefetchWorker::loadTiles(PrefetchTilesPtr prefetchTiles)
+{
+  if(mapQuery != nullptr)
+  {
+    try
+    {
+      mapQuery->loadTiles(*prefetchTiles);
+    }
+    catch(atools::Exception& e)
+    {
+      qWarning() << Q_FUNC_INFO << "Error loading tiles" << e.what();
+
+      // Do not insert partially loaded tiles
+      *prefetchTiles = MapQuery::PrefetchTiles();
+    }
+    catch(...)
+    {
+      qWarning() << Q_FUNC_INFO << "Error loading tiles. Unknown exception.";
+      *prefetchTiles = MapQuery::PrefetchTiles();
+    }
+  }
+  else
+    *prefetchTiles = MapQuery::PrefetchTiles();
+
+  emit tilesLoaded(prefetchTiles);
+}
+
+// ---------------------------------------------------------------------------------
+MapQueryPrefetch::MapQueryPrefetch(MapQuery *mapQueryParam, atools::sql::SqlDatabase *sqlDb)
+  : mapQuery(mapQueryParam), db(sqlDb)
+{
+  qRegisterMetaType<PrefetchTilesPtr>();
+
+  enabled = atools::settings::Settings::instance().getAndStoreValue(
+    lnm::SETTINGS_MAPQUERY + "Prefetch", true).toBool();
+
+  worker = new MapQueryPrefetchWorker(MapQuery::readConfig());
+  worker->moveToThread(&thread);
+
+  connect(this, &MapQueryPrefetch::openDatabaseRequested, worker, &MapQueryPrefetchWorker::openDatabase);
+  // Wait until the database is closed to allow replacing the file
+  connect(this, &MapQueryPrefetch::closeDatabaseRequested, worker, &MapQueryPrefetchWorker::closeDatabase,
+          Qt::BlockingQueuedConnection);
+  connect(this, &MapQueryPrefetch::loadTilesRequested, worker, &MapQueryPrefetchWorker::loadTiles);
+
+  connect(worker, &MapQueryPrefetchWorker::databaseOpened, this, &MapQueryPrefetch::workerDatabaseOpened);
+  connect(worker, &MapQueryPrefetchWorker::tilesLoaded, this, &MapQueryPrefetch::workerTilesLoaded);
+
+  if(enabled)
+  {
+    thread.start(QThread::LowPriority);
+    postDatabaseLoad();
+  }
+}
+
+MapQueryPrefetch::~MapQueryPrefetch()
+{
+  if(thread.isRunning())
+  {
+    emit closeDatabaseRequested();
+    thread.quit();
+    thread.wait();
+  }
+  delete worker;
+}
+
+void MapQueryPrefetch::preDatabaseLoad()
+{
+  databaseOpen = false;
+
+  // Ignore results for the old database
+  pendingTiles.clear();
+  lastRequest = Request();
+
+  if(thread.isRunning())
+    emit closeDatabaseRequested();
+}
+
+void MapQueryPrefetch::postDatabaseLoad()
+{
+  if(thread.isRunning() && db->isOpen())
+    emit openDatabaseRequested(db->databaseName());
+}
+
+void MapQueryPrefetch::workerDatabaseOpened(bool success)
+{
+  databaseOpen = success;
+
+  if(success)
+    // Load tiles for the current viewport
+    emit tilesLoaded();
+}
+
+void MapQueryPrefetch::workerTilesLoaded(PrefetchTilesPtr prefetchTiles)
+{
+  if(prefetchTiles != pendingTiles)
+    // Outdated or database was changed
+    return;
+
+  pendingTiles.clear();
+  if(!prefetchTiles->isEmpty())
+  {
+    mapQuery->insertTiles(*prefetchTiles);
+    emit tilesLoaded();
+  }
+}
+
+void MapQueryPrefetch::viewportChanged(const GeoDataLatLonBox& box, const MapLayer *mapLayer,
+                                       const MapLayer *mapLayerEffective, map::MapObjectTypes types,
+                                       map::MapAirspaceTypes airspaceTypes, float flightPlanAltitude)
+{
+  GeoDataLatLonBox predicted = predictViewport(box);
+
+  if(!isActive() || !pendingTiles.isNull())
+    return;
+
+  Request request;
+  request.box = box;
+  request.predicted = predicted;
+  request.mapLayer = mapLayer;
+  request.mapLayerEffective = mapLayerEffective;
+  request.types = types;
+  request.airspaceTypes = airspaceTypes;
+  request.flightPlanAltitude = flightPlanAltitude;
+
+  if(request == lastRequest)
+    // Already loaded - avoid loading tiles endlessly if they do not fit into the cache
+    return;
+
+  QList<GeoDataLatLonBox> rects({box});
+  if(!predicted.isEmpty())
+    rects.append(predicted);
+
+  MapQuery::PrefetchTiles *prefetchTiles =
+    mapQuery->getMissingTiles(rects, mapLayer, mapLayerEffective, types, airspaceTypes, flightPlanAltitude);
+
+  if(prefetchTiles != nullptr)
+  {
+    lastRequest = request;
+    pendingTiles = PrefetchTilesPtr(prefetchTiles);
+    emit loadTilesRequested(pendingTiles);
+  }
+}
+
+GeoDataLatLonBox MapQueryPrefetch::predictViewport(const GeoDataLatLonBox& box)
+{
+  GeoDataLatLonBox predicted;
+
+  if(!lastBox.isEmpty() && lastBoxTimer.isValid() && lastBoxTimer.elapsed() < PREDICT_MAX_INTERVAL_MS)
+  {
+    double factor = PREDICT_TIME_MS / std::max(lastBoxTimer.elapsed(), static_cast<qint64>(1));
+
+    // Movement of the center
+    double dx = normalizeLonDeg(box.center().longitude(GeoDataCoordinates::Degree) -
+                                lastBox.center().longitude(GeoDataCoordinates::Degree)) * factor;
+    double dy = (box.center().latitude(GeoDataCoordinates::Degree) -
+                 lastBox.center().latitude(GeoDataCoordinates::Degree)) * factor;
+
+    // Growth when zooming out
+    double dw = std::max(0., box.width(GeoDataCoordinates::Degree) -
+                         lastBox.width(GeoDataCoordinates::Degree)) * factor;
+    double dh = std::max(0., box.height(GeoDataCoordinates::Degree) -
+                         lastBox.height(GeoDataCoordinates::Degree)) * factor;
+
+    if(std::abs(dx) > 0.0001 || std::abs(dy) > 0.0001 || dw > 0.0001 || dh > 0.0001)
+    {
+      double west = box.west(GeoDataCoordinates::Degree) + dx - dw / 2.;
+      double east = box.east(GeoDataCoordinates::Degree) + dx + dw / 2.;
+      if(box.crossesDateLine())
+        east += 360.;
+
+      if(east - west >= 360.)
+      {
+        west = -180.;
+        east = 180.;
+      }
+      else
+      {
+        west = normalizeLonDeg(west);
+        east = normalizeLonDeg(east);
+      }
+
+      double north = std::min(box.north(GeoDataCoordinates::Degree) + dy + dh / 2., 89.);
+      double south = std::max(box.south(GeoDataCoordinates::Degree) + dy - dh / 2., -89.);
+
+      if(north > south)
+        predicted.setBoundaries(north, south, east, west, GeoDataCoordinates::Degree);
+    }
+  }
+
+  lastBox = box;
+  lastBoxTimer.start();
+  return predicted;
+}
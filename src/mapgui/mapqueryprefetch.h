@@ -0,0 +1,157 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_MAPQUERYPREFETCH_H
+#define LITTLENAVMAP_MAPQUERYPREFETCH_H
+
+#include "mapgui/mapquery.h"
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSharedPointer>
+#include <QThread>
+
+namespace atools {
+namespace sql {
+class SqlDatabase;
+}
+}
+
+typedef QSharedPointer<MapQuery::PrefetchTiles> PrefetchTilesPtr;
+Q_DECLARE_METATYPE(PrefetchTilesPtr)
+
+/*
+ * Runs in the prefetch thread. Uses its own read only database connection and map query instance
+ * to load tiles for the map query caches of the GUI thread.
+ */
+class MapQueryPrefetchWorker :
+  public QObject
+{
+  Q_OBJECT
+
+public:
+  /* Configuration has to be read in the GUI thread since the settings are not thread safe */
+  MapQueryPrefetchWorker(const MapQuery::QueryConfig& queryConfig);
+  virtual ~MapQueryPrefetchWorker();
+
+  /* Open database and prepare queries. Emits databaseOpened. */
+  void openDatabase(const QString& filename);
+  void closeDatabase();
+
+  /* Load all tiles and emit tilesLoaded */
+  void loadTiles(PrefetchTilesPtr prefetchTiles);
+
+signals:
+  void databaseOpened(bool success);
+  void tilesLoaded(PrefetchTilesPtr prefetchTiles);
+
+private:
+  atools::sql::SqlDatabase *db = nullptr;
+  MapQuery *mapQuery = nullptr;
+  MapQuery::QueryConfig config;
+};
+
+/*
+ * Loads map objects for the visible and the predicted next viewport in a background thread and adds them
+ * to the map query caches. The prediction is based on the pan velocity and zoom direction of the last frames.
+ *
+ * The paint layer uses only cached objects while prefetching is active. A repaint is requested
+ * once new tiles are available.
+ */
+class MapQueryPrefetch :
+  public QObject
+{
+  Q_OBJECT
+
+public:
+  MapQueryPrefetch(MapQuery *mapQueryParam, atools::sql::SqlDatabase *sqlDb);
+  virtual ~MapQueryPrefetch();
+
+  /* Closes the database connection of the worker */
+  void preDatabaseLoad();
+  void postDatabaseLoad();
+
+  /* true if the worker is ready to load tiles. Map painting should not query the database in this case. */
+  bool isActive() const
+  {
+    return enabled && databaseOpen;
+  }
+
+  /*
+   * Call after each paint event. Requests all missing tiles for the visible and the predicted viewport
+   * if the worker is not busy.
+   */
+  void viewportChanged(const Marble::GeoDataLatLonBox& box, const MapLayer *mapLayer,
+                       const MapLayer *mapLayerEffective, map::MapObjectTypes types,
+                       map::MapAirspaceTypes airspaceTypes, float flightPlanAltitude);
+
+signals:
+  /* New tiles are available in the map query caches */
+  void tilesLoaded();
+
+  /* Signals to the worker thread */
+  void openDatabaseRequested(const QString& filename);
+  void closeDatabaseRequested();
+  void loadTilesRequested(PrefetchTilesPtr prefetchTiles);
+
+private:
+  /* Parameters of a tile request */
+  struct Request
+  {
+    Marble::GeoDataLatLonBox box, predicted;
+    const MapLayer *mapLayer = nullptr, *mapLayerEffective = nullptr;
+    map::MapObjectTypes types = map::NONE;
+    map::MapAirspaceTypes airspaceTypes = map::AIRSPACE_NONE;
+    float flightPlanAltitude = 0.f;
+
+    bool operator==(const Request& other) const
+    {
+      return box == other.box && predicted == other.predicted && mapLayer == other.mapLayer &&
+             mapLayerEffective == other.mapLayerEffective && types == other.types &&
+             airspaceTypes == other.airspaceTypes && flightPlanAltitude == other.flightPlanAltitude;
+    }
+  };
+
+  void workerDatabaseOpened(bool success);
+  void workerTilesLoaded(PrefetchTilesPtr prefetchTiles);
+
+  /* Get viewport for the next frames based on the movement since the last call */
+  Marble::GeoDataLatLonBox predictViewport(const Marble::GeoDataLatLonBox& box);
+
+  /* Ignore movements older than this */
+  static Q_DECL_CONSTEXPR qint64 PREDICT_MAX_INTERVAL_MS = 500;
+
+  /* Look ahead time for the predicted viewport */
+  static Q_DECL_CONSTEXPR double PREDICT_TIME_MS = 500.;
+
+  MapQuery *mapQuery;
+  atools::sql::SqlDatabase *db;
+
+  MapQueryPrefetchWorker *worker;
+  QThread thread;
+
+  bool enabled = true, databaseOpen = false;
+
+  /* Request currently loaded by the worker or null if idle */
+  PrefetchTilesPtr pendingTiles;
+  Request lastRequest;
+
+  Marble::GeoDataLatLonBox lastBox;
+  QElapsedTimer lastBoxTimer;
+};
+
+#endif // LITTLENAVMAP_MAPQUERYPREFETCH_H
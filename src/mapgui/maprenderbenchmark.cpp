@@ -0,0 +1,376 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "mapgui/maprenderbenchmark.h"
+
+#include "navapp.h"
+#include "gui/mainwindow.h"
+#include "mapgui/mapwidget.h"
+#include "mapgui/maplayersettings.h"
+#include "db/databasemanager.h"
+#include "ui_mainwindow.h"
+#include "common/constants.h"
+#include "settings/settings.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+
+// =====================================================================
+// Allocation counting
+// Wraps the glibc allocation functions for the whole process including Qt and Marble libraries
+// since Qt containers do not use operator new.
+#if defined(Q_OS_LINUX) && defined(__GLIBC__)
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static std::atomic<qint64> allocationCount(0), allocationBytes(0);
+
+extern "C" {
+void *malloc(size_t size)
+{
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  allocationBytes.fetch_add(static_cast<qint64>(size), std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  allocationBytes.fetch_add(static_cast<qint64>(num * size), std::memory_order_relaxed);
+  return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  allocationBytes.fetch_add(static_cast<qint64>(size), std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+  __libc_free(ptr);
+}
+
+}
+
+static qint64 currentAllocationCount()
+{
+  return allocationCount.load(std::memory_order_relaxed);
+}
+
+static qint64 currentAllocationBytes()
+{
+  return allocationBytes.load(std::memory_order_relaxed);
+}
+
+#else
+
+static qint64 currentAllocationCount()
+{
+  return 0;
+}
+
+static qint64 currentAllocationBytes()
+{
+  return 0;
+}
+
+#endif
+
+// =====================================================================
+
+/* Script names for layers to menu actions */
+static QHash<QString, QAction *> layerActions(Ui::MainWindow *ui)
+{
+  return QHash<QString, QAction *>(
+  {
+    {"airports", ui->actionMapShowAirports},
+    {"softairports", ui->actionMapShowSoftAirports},
+    {"emptyairports", ui->actionMapShowEmptyAirports},
+    {"addonairports", ui->actionMapShowAddonAirports},
+    {"vor", ui->actionMapShowVor},
+    {"ndb", ui->actionMapShowNdb},
+    {"waypoints", ui->actionMapShowWp},
+    {"ils", ui->actionMapShowIls},
+    {"victorairways", ui->actionMapShowVictorAirways},
+    {"jetairways", ui->actionMapShowJetAirways},
+    {"airspaces", ui->actionShowAirspaces},
+    {"route", ui->actionMapShowRoute},
+    {"aircrafttrack", ui->actionMapShowAircraftTrack},
+    {"grid", ui->actionMapShowGrid},
+    {"cities", ui->actionMapShowCities},
+    {"hillshading", ui->actionMapShowHillshading}
+  });
+}
+
+/* Script names for themes to menu actions */
+static QHash<QString, QAction *> themeActions(Ui::MainWindow *ui)
+{
+  return QHash<QString, QAction *>(
+  {
+    {"openstreetmap", ui->actionMapThemeOpenStreetMap},
+    {"openstreetmaproads", ui->actionMapThemeOpenStreetMapRoads},
+    {"opentopomap", ui->actionMapThemeOpenTopoMap},
+    {"stamenterrain", ui->actionMapThemeStamenTerrain},
+    {"simple", ui->actionMapThemeSimple},
+    {"plain", ui->actionMapThemePlain},
+    {"atlas", ui->actionMapThemeAtlas}
+  });
+}
+
+MapRenderBenchmark::MapRenderBenchmark(MainWindow *parentWindow)
+  : mainWindow(parentWindow)
+{
+}
+
+MapRenderBenchmark::~MapRenderBenchmark()
+{
+}
+
+bool MapRenderBenchmark::run(const QStringList& arguments)
+{
+  QCommandLineParser parser;
+  parser.setApplicationDescription(QObject::tr("Headless map rendering benchmark"));
+  parser.addHelpOption();
+
+  QCommandLineOption scriptOpt("script", QObject::tr("JSON file containing the viewports to render."),
+                               QObject::tr("file"));
+  QCommandLineOption databaseOpt("database", QObject::tr("Scenery library database file."), QObject::tr("file"));
+  QCommandLineOption outputOpt("output", QObject::tr("CSV report file. Default is stdout."), QObject::tr("file"));
+  QCommandLineOption widthOpt("width", QObject::tr("Map width in pixel."), QObject::tr("pixel"), "1024");
+  QCommandLineOption heightOpt("height", QObject::tr("Map height in pixel."), QObject::tr("pixel"), "768");
+  parser.addOptions({scriptOpt, databaseOpt, outputOpt, widthOpt, heightOpt});
+  parser.process(arguments);
+
+  if(!parser.isSet(scriptOpt))
+  {
+    qWarning() << Q_FUNC_INFO << "No script given";
+    parser.showHelp(1);
+  }
+
+  if(!parser.isSet(databaseOpt))
+  {
+    qWarning() << Q_FUNC_INFO << "No database given";
+    parser.showHelp(1);
+  }
+
+  if(!readScript(parser.value(scriptOpt)))
+    return false;
+
+  size = QSize(parser.value(widthOpt).toInt(), parser.value(heightOpt).toInt());
+  if(size.isEmpty())
+  {
+    qWarning() << Q_FUNC_INFO << "Invalid map size" << size;
+    return false;
+  }
+
+  if(!QFile::exists(parser.value(databaseOpt)))
+  {
+    qWarning() << Q_FUNC_INFO << "Database not found" << parser.value(databaseOpt);
+    return false;
+  }
+  NavApp::getDatabaseManager()->openDatabaseFile(parser.value(databaseOpt));
+
+  QFile outFile;
+  if(parser.isSet(outputOpt))
+  {
+    outFile.setFileName(parser.value(outputOpt));
+    if(!outFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+      qWarning() << Q_FUNC_INFO << "Cannot open" << outFile.fileName() << outFile.errorString();
+      return false;
+    }
+  }
+  else if(!outFile.open(stdout, QIODevice::WriteOnly | QIODevice::Text))
+    return false;
+
+  // Map widget keeps this size in the main window layout
+  MapWidget *mapWidget = NavApp::getMapWidget();
+  mapWidget->setFixedSize(size);
+
+  // Let the main window do all delayed initialization after showing
+  QApplication::processEvents();
+
+  // Disabled in main for the benchmark configuration - report the mode actually used
+  QString prefetch = atools::settings::Settings::instance().valueBool(lnm::SETTINGS_MAPQUERY + "Prefetch", true) ?
+                     "on" : "off";
+  qInfo() << Q_FUNC_INFO << "Map query prefetch" << prefetch;
+
+  QTextStream out(&outFile);
+  out << "viewport;frame;prefetch;ms;allocations;allocated_kb" << endl;
+
+  for(const Viewport& viewport : viewports)
+  {
+    if(!applyViewport(viewport))
+      return false;
+
+    QVector<FrameResult> results;
+    for(int frame = 0; frame < viewport.frames; frame++)
+    {
+      FrameResult result = renderFrame();
+      results.append(result);
+
+      out << viewport.name << ";" << frame << ";" << prefetch << ";"
+          << QString::number(result.nsecs / 1000000., 'f', 3) << ";" << result.allocations << ";" << result.allocatedBytes / 1024 << endl;
+    }
+    logSummary(viewport.name, results);
+  }
+
+  return true;
+}
+
+bool MapRenderBenchmark::readScript(const QString& filename)
+{
+  QFile file(filename);
+  if(!file.open(QIODevice::ReadOnly))
+  {
+    qWarning() << Q_FUNC_INFO << "Cannot open" << filename << file.errorString();
+    return false;
+  }
+
+  QJsonParseError error;
+  QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+  if(doc.isNull())
+  {
+    qWarning() << Q_FUNC_INFO << "Error reading" << filename << error.errorString() << "at" << error.offset;
+    return false;
+  }
+
+  for(const QJsonValue& value : doc.object().value("viewports").toArray())
+  {
+    QJsonObject obj = value.toObject();
+
+    Viewport viewport;
+    viewport.name = obj.value("name").toString(QString("Viewport %1").arg(viewports.size() + 1));
+    viewport.lonX = obj.value("lonx").toDouble();
+    viewport.latY = obj.value("laty").toDouble();
+    viewport.distance = obj.value("distance").toDouble(viewport.distance);
+    viewport.frames = std::max(obj.value("frames").toInt(viewport.frames), 1);
+    viewport.theme = obj.value("theme").toString().toLower();
+    viewport.hasDetail = obj.contains("detail");
+    viewport.detail = obj.value("detail").toInt();
+
+    QJsonObject layers = obj.value("layers").toObject();
+    for(auto it = layers.constBegin(); it != layers.constEnd(); ++it)
+      viewport.layers.insert(it.key().toLower(), it.value().toBool());
+
+    viewports.append(viewport);
+  }
+
+  if(viewports.isEmpty())
+  {
+    qWarning() << Q_FUNC_INFO << "No viewports in" << filename;
+    return false;
+  }
+  return true;
+}
+
+bool MapRenderBenchmark::applyViewport(const Viewport& viewport)
+{
+  Ui::MainWindow *ui = mainWindow->getUi();
+  MapWidget *mapWidget = NavApp::getMapWidget();
+
+  if(!viewport.theme.isEmpty())
+  {
+    QAction *action = themeActions(ui).value(viewport.theme);
+    if(action == nullptr)
+    {
+      qWarning() << Q_FUNC_INFO << "Unknown theme" << viewport.theme;
+      return false;
+    }
+    action->trigger();
+  }
+
+  QHash<QString, QAction *> actions = layerActions(ui);
+  for(auto it = viewport.layers.constBegin(); it != viewport.layers.constEnd(); ++it)
+  {
+    QAction *action = actions.value(it.key());
+    if(action == nullptr)
+    {
+      qWarning() << Q_FUNC_INFO << "Unknown layer" << it.key();
+      return false;
+    }
+    action->setChecked(it.value());
+  }
+
+  if(viewport.hasDetail)
+    mapWidget->setMapDetail(MapLayerSettings::MAP_DEFAULT_DETAIL_FACTOR + viewport.detail);
+
+  mapWidget->setDistance(viewport.distance);
+  mapWidget->centerOn(viewport.lonX, viewport.latY, false);
+
+  // Process all updates caused by changed options
+  QApplication::processEvents();
+  return true;
+}
+
+MapRenderBenchmark::FrameResult MapRenderBenchmark::renderFrame()
+{
+  MapWidget *mapWidget = NavApp::getMapWidget();
+  QImage image(mapWidget->size(), QImage::Format_ARGB32_Premultiplied);
+
+  qint64 allocations = currentAllocationCount(), allocatedBytes = currentAllocationBytes();
+  QElapsedTimer timer;
+  timer.start();
+
+  // Calls paintEvent and all map painters synchronously
+  mapWidget->render(&image);
+
+  FrameResult result;
+  result.nsecs = timer.nsecsElapsed();
+  result.allocations = currentAllocationCount() - allocations;
+  result.allocatedBytes = currentAllocationBytes() - allocatedBytes;
+
+  // Process events caused by the frame like screen index updates before the next frame
+  QApplication::processEvents();
+  return result;
+}
+
+void MapRenderBenchmark::logSummary(const QString& name, const QVector<FrameResult>& results)
+{
+  qint64 minNs = std::numeric_limits<qint64>::max(), maxNs = 0, sumNs = 0, sumAllocations = 0;
+  for(const FrameResult& result : results)
+  {
+    minNs = std::min(minNs, result.nsecs);
+    maxNs = std::max(maxNs, result.nsecs);
+    sumNs += result.nsecs;
+    sumAllocations += result.allocations;
+  }
+
+  qInfo().noquote() << QString("Render benchmark %1: %2 frames, min %3 ms, avg %4 ms, max %5 ms, "
+                               "avg %6 allocations").
+    arg(name).arg(results.size()).
+    arg(minNs / 1000000., 0, 'f', 3).arg(sumNs / results.size() / 1000000., 0, 'f', 3).
+    arg(maxNs / 1000000., 0, 'f', 3).arg(sumAllocations / results.size());
+}
@@ -0,0 +1,106 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_MAPRENDERBENCHMARK_H
+#define LITTLENAVMAP_MAPRENDERBENCHMARK_H
+
+#include <QHash>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+class MainWindow;
+
+/*
+ * Headless map rendering benchmark. Replays a scripted sequence of viewports on the map widget of the
+ * main window, renders each one into an offscreen image and reports render time and heap allocations
+ * for each frame.
+ *
+ * Only available in the littlenavmap_renderbench binary which is built with "qmake CONFIG+=renderbench".
+ * Runs without display and GPU using QT_QPA_PLATFORM=offscreen.
+ *
+ * Command line:
+ * littlenavmap_renderbench --script viewports.json --database file.sqlite [--output report.csv]
+ *                          [--width 1024] [--height 768]
+ *
+ * The benchmark uses its own configuration directory "ABarthel Renderbench" and does not touch the
+ * settings or databases of Little Navmap. The database has therefore to be given on the command line.
+ *
+ * Map query prefetching is disabled to get reproducible frames since background loading depends on thread
+ * timing. The mode is written to the "prefetch" column of the report.
+ *
+ * Script format (JSON):
+ * {
+ *   "viewports": [
+ *     {"name": "EDDF", "lonx": 8.57, "laty": 50.03, "distance": 100, "frames": 5,
+ *      "theme": "simple", "detail": 0, "layers": {"waypoints": false, "airspaces": true}}
+ *   ]
+ * }
+ * "distance" is the map view distance in km. "theme", "detail" and "layers" are optional and keep their
+ * values for the following viewports. "detail" is relative to the default map detail level.
+ *
+ * Themes: openstreetmap, openstreetmaproads, opentopomap, stamenterrain, simple, plain, atlas.
+ * Online themes download tiles in background and will give inconsistent results.
+ *
+ * Layers: airports, softairports, emptyairports, addonairports, vor, ndb, waypoints, ils, victorairways,
+ * jetairways, airspaces, route, aircrafttrack, grid, cities, hillshading.
+ *
+ * The report is written in CSV format to the output file or stdout. A summary for each viewport is written
+ * to the log. The first frame of each viewport includes queries and cache fills while the following frames
+ * show the warm cache performance.
+ *
+ * Allocations are counted by wrapping malloc and are only available on Linux with glibc. Zero otherwise.
+ */
+class MapRenderBenchmark
+{
+public:
+  MapRenderBenchmark(MainWindow *parentWindow);
+  ~MapRenderBenchmark();
+
+  /* Parse command line, run all viewports and write the report. Returns false on error. */
+  bool run(const QStringList& arguments);
+
+private:
+  struct Viewport
+  {
+    QString name, theme;
+    double lonX = 0., latY = 0., distance = 1000.;
+    int frames = 1;
+    int detail = 0;
+    bool hasDetail = false;
+
+    /* Layer name to visibility */
+    QHash<QString, bool> layers;
+  };
+
+  struct FrameResult
+  {
+    qint64 nsecs;
+    qint64 allocations, allocatedBytes;
+  };
+
+  bool readScript(const QString& filename);
+  bool applyViewport(const Viewport& viewport);
+  FrameResult renderFrame();
+  void logSummary(const QString& name, const QVector<FrameResult>& results);
+
+  MainWindow *mainWindow;
+  QVector<Viewport> viewports;
+  QSize size = QSize(1024, 768);
+};
+
+#endif // LITTLENAVMAP_MAPRENDERBENCHMARK_H
@@ -29,6 +29,7 @@
 #include "common/maptools.h"
 #include "common/mapcolors.h"
 #include "connect/connectclient.h"
+#include "connect/trackreplay.h"
 #include "fs/sc/simconnectuseraircraft.h"
 #include "route/route.h"
 #include "route/routecontroller.h"
@@ -36,6 +37,7 @@
 #include "mapgui/mapquery.h"
 #include "mapgui/maptooltip.h"
 #include "common/symbolpainter.h"
+#include "common/symbolatlas.h"
 #include "mapgui/mapscreenindex.h"
 #include "ui_mainwindow.h"
 #include "gui/actiontextsaver.h"
@@ -208,6 +210,10 @@ void MapWidget::optionsChanged()
   screenSearchDistanceTooltip = OptionData::instance().getMapTooltipSensitivity();
 
   updateCacheSizes();
+
+  // Symbol colors might have changed
+  SymbolAtlas::invalidateAll();
+  paintLayer->invalidateStaticLayers();
   update();
 }
 
@@ -431,7 +437,6 @@ void MapWidget::saveState()
 
   history.saveState(atools::settings::Settings::getConfigFilename(".history"));
   screenIndex->saveState();
-  aircraftTrack.saveState();
 
   overlayStateToMenu();
   atools::gui::WidgetState state(lnm::MAP_OVERLAY_VISIBLE, false /*save visibility*/, true /*block signals*/);
@@ -855,6 +860,9 @@ void MapWidget::routeChanged(bool geometryChanged)
 {
   qDebug() << Q_FUNC_INFO;
 
+  // Airports of the route are always shown
+  paintLayer->invalidateStaticLayers();
+
   if(geometryChanged)
   {
     cancelDragAll();
@@ -872,6 +880,9 @@ void MapWidget::routeAltitudeChanged(float altitudeFeet)
 
   qDebug() << Q_FUNC_INFO;
   screenIndex->updateAirspaceScreenGeometry(currentViewBoundingBox);
+
+  // Airspaces are filtered by cruise altitude
+  paintLayer->invalidateStaticLayers();
   update();
 }
 
@@ -888,9 +899,19 @@ void MapWidget::simDataChanged(const atools::fs::sc::SimConnectData& simulatorDa
   QPointF curPos = conv.wToSF(userAircraft.getPosition());
   QPointF diff = curPos - conv.wToSF(lastUserAircraft.getPosition());
 
+  QDateTime zuluTime = userAircraft.getZuluTime();
+  bool onGround = userAircraft.isOnGround();
+
+  const TrackReplay *trackReplay = NavApp::getConnectClient()->getTrackReplay();
+  if(trackReplay->isReplaying())
+  {
+    // Replayed packets do not carry the recorded time and ground flag
+    zuluTime = QDateTime::fromTime_t(trackReplay->getCurrentPosition().timestamp, Qt::UTC);
+    onGround = trackReplay->getCurrentPosition().onGround;
+  }
+
   bool wasEmpty = aircraftTrack.isEmpty();
-  bool trackPruned = aircraftTrack.appendTrackPos(userAircraft.getPosition(),
-                                                  userAircraft.getZuluTime(), userAircraft.isOnGround());
+  bool trackPruned = aircraftTrack.appendTrackPos(userAircraft.getPosition(), zuluTime, onGround);
 
   if(trackPruned)
     emit aircraftTrackPruned();
@@ -961,7 +982,11 @@ void MapWidget::simDataChanged(const atools::fs::sc::SimConnectData& simulatorDa
              centerAircraft) // Centering wanted
             centerOn(userAircraft.getPosition().getLonX(), userAircraft.getPosition().getLatY(), false);
           else
+          {
+            // Only aircraft, track and route progress need an update
+            paintLayer->setStaticLayersReusable();
             update();
+          }
         }
       }
     }
@@ -972,6 +997,7 @@ void MapWidget::simDataChanged(const atools::fs::sc::SimConnectData& simulatorDa
     if(!lastUserAircraft.getPosition().isValid() || diff.manhattanLength() > 4)
     {
       screenIndex->updateLastSimData(simulatorData);
+      paintLayer->setStaticLayersReusable();
       update();
     }
   }
@@ -2344,11 +2370,24 @@ const QVector<atools::fs::sc::SimConnectAircraft>& MapWidget::getAiAircraft() co
 void MapWidget::deleteAircraftTrack()
 {
   aircraftTrack.clearTrack();
+
+  // Following positions are still replayed and must not be archived - keep flag until replay is stopped
+  if(NavApp::getConnectClient()->getTrackReplay()->isReplaying())
+    aircraftTrack.setReplayTrack(true);
   emit updateActionStates();
   update();
   mainWindow->setStatusMessage(QString(tr("Aircraft track removed from map.")));
 }
 
+void MapWidget::trackReplayStarted()
+{
+  qDebug() << Q_FUNC_INFO;
+  aircraftTrack.clearTrack();
+  aircraftTrack.setReplayTrack(true);
+  emit updateActionStates();
+  update();
+}
+
 bool MapWidget::event(QEvent *event)
 {
   if(event->type() == QEvent::ToolTip)
@@ -2684,7 +2723,7 @@ void MapWidget::paintEvent(QPaintEvent *paintEvent)
     screenIndex->updateAirspaceScreenGeometry(currentViewBoundingBox);
   }
 
-  if(paintLayer->getOverflow() > 0)
+  if(paintLayer->getOverflow() > 0 || paintLayer->isQueryTruncated())
     emit resultTruncated(paintLayer->getOverflow());
 }
 
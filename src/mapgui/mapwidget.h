@@ -171,6 +171,9 @@ public:
   /* Delete the current aircraft track. Will not stop collecting new track points */
   void deleteAircraftTrack();
 
+  /* Archives the current aircraft track and starts a new one for the replayed flight */
+  void trackReplayStarted();
+
   /* Add general (red) range ring */
   void addRangeRing(const atools::geo::Pos& pos);
 
@@ -288,8 +291,9 @@ public:
   void resetSettingActionsToDefault();
 
 signals:
-  /* Emitted whenever the result exceeds the limit clause in the queries */
-  void resultTruncated(int truncatedTo);
+  /* Emitted whenever less important objects were hidden because there are too many on the map or
+   * objects were not loaded because of the query row limit. numHidden is zero in the latter case. */
+  void resultTruncated(int numHidden);
 
   /* Search center has changed by context menu */
   void searchMarkChanged(const atools::geo::Pos& mark);
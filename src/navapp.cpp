@@ -68,7 +68,7 @@ void NavApp::init(MainWindow *mainWindowParam)
 
   databaseMeta = new atools::fs::db::DatabaseMeta(getDatabase());
 
-  mapQuery = new MapQuery(mainWindow, databaseManager->getDatabase());
+  mapQuery = new MapQuery(mainWindow, databaseManager->getDatabase(), MapQuery::readConfig());
   mapQuery->initQueries();
 
   infoQuery = new InfoQuery(databaseManager->getDatabase());
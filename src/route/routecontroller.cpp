@@ -38,6 +38,7 @@
 #include "route/routefinder.h"
 #include "route/routenetworkairway.h"
 #include "route/routenetworkradio.h"
+#include "route/routenetworkbenchmark.h"
 #include "settings/settings.h"
 #include "ui_mainwindow.h"
 #include "gui/dialog.h"
@@ -50,6 +51,7 @@
 #include "common/mapcolors.h"
 #include "common/unit.h"
 
+#include <QtConcurrent/QtConcurrentRun>
 #include <QClipboard>
 #include <QFile>
 #include <QStandardItemModel>
@@ -124,8 +126,18 @@ RouteController::RouteController(QMainWindow *parentWindow, QTableView *tableVie
   view->setContextMenuPolicy(Qt::CustomContextMenu);
 
   // Create flight plan calculation caches
-  routeNetworkRadio = new RouteNetworkRadio(NavApp::getDatabase());
-  routeNetworkAirway = new RouteNetworkAirway(NavApp::getDatabase());
+  // Load whole network into memory after loading a database instead of fetching nodes on demand
+  // Key is "Settings/RouteNetworkPreload"
+  bool preloadNetwork = atools::settings::Settings::instance().getAndStoreValue(
+    lnm::SETTINGS_ROUTENETWORK + "Preload", true).toBool();
+  // Use landmark index stored next to the database for a better A* estimate - needs preloading
+  // Index is loaded or built in background. Key is "Settings/RouteNetworkLandmarks"
+  bool landmarks = atools::settings::Settings::instance().getAndStoreValue(
+    lnm::SETTINGS_ROUTENETWORK + "Landmarks", true).toBool();
+  routeNetworkRadio = new RouteNetworkRadio(NavApp::getDatabase(), preloadNetwork, landmarks);
+  routeNetworkAirway = new RouteNetworkAirway(NavApp::getDatabase(), preloadNetwork, landmarks);
+  routeFinderRadio = new RouteFinder(routeNetworkRadio);
+  routeFinderAirway = new RouteFinder(routeNetworkAirway);
 
   // Set up undo/redo framework
   undoStack = new QUndoStack(mainWindow);
@@ -140,6 +152,10 @@ RouteController::RouteController(QMainWindow *parentWindow, QTableView *tableVie
   redoAction->setShortcut(QKeySequence("Ctrl+Y"));
 
   connect(redoAction, &QAction::triggered, this, &RouteController::redoTriggered);
+
+  // Background flight plan calculation
+  connect(&routeCalcWatcher, &QFutureWatcher<bool>::finished, this, &RouteController::routeCalcThreadFinished);
+  connect(this, &RouteController::routeCalcProgress, this, &RouteController::routeCalcProgressUpdate);
   connect(undoAction, &QAction::triggered, this, &RouteController::undoTriggered);
 
   Ui::MainWindow *ui = NavApp::getMainUi();
@@ -212,6 +228,11 @@ RouteController::RouteController(QMainWindow *parentWindow, QTableView *tableVie
 
 RouteController::~RouteController()
 {
+  // Do not notify the main window which is being destroyed
+  blockSignals(true);
+  stopRouteCalc(true);
+  delete routeFinderRadio;
+  delete routeFinderAirway;
   routeAltDelayTimer.stop();
   delete entryBuilder;
   delete model;
@@ -895,6 +916,9 @@ void RouteController::calculateDirect()
 {
   qDebug() << "calculateDirect";
 
+  // Drop a running calculation which would replace the direct flight plan
+  stopRouteCalc(true);
+
   // Stop any background tasks
   beforeRouteCalc();
 
@@ -922,54 +946,33 @@ void RouteController::beforeRouteCalc()
 void RouteController::calculateRadionav()
 {
   qDebug() << "calculateRadionav";
-  // Changing mode might need a clear
-  routeNetworkRadio->setMode(nw::ROUTE_RADIONAV);
-
-  RouteFinder routeFinder(routeNetworkRadio);
-
-  if(calculateRouteInternal(&routeFinder, atools::fs::pln::VOR, tr("Radionnav Flight Plan Calculation"),
-                            false /* fetch airways */, false /* Use altitude */))
-    NavApp::setStatusMessage(tr("Calculated radio navaid flight plan."));
-  else
-    NavApp::setStatusMessage(tr("No route found."));
+  calculateRouteInternal(routeNetworkRadio, nw::ROUTE_RADIONAV, atools::fs::pln::VOR,
+                         tr("Radionnav Flight Plan Calculation"),
+                         tr("Calculated radio navaid flight plan."),
+                         false /* fetch airways */, false /* Use altitude */);
 }
 
 void RouteController::calculateHighAlt()
 {
   qDebug() << "calculateHighAlt";
-  routeNetworkAirway->setMode(nw::ROUTE_JET);
-
-  RouteFinder routeFinder(routeNetworkAirway);
-
-  if(calculateRouteInternal(&routeFinder, atools::fs::pln::HIGH_ALTITUDE,
-                            tr("High altitude Flight Plan Calculation"),
-                            true /* fetch airways */, false /* Use altitude */))
-    NavApp::setStatusMessage(tr("Calculated high altitude (Jet airways) flight plan."));
-  else
-    NavApp::setStatusMessage(tr("No route found."));
+  calculateRouteInternal(routeNetworkAirway, nw::ROUTE_JET, atools::fs::pln::HIGH_ALTITUDE,
+                         tr("High altitude Flight Plan Calculation"),
+                         tr("Calculated high altitude (Jet airways) flight plan."),
+                         true /* fetch airways */, false /* Use altitude */);
 }
 
 void RouteController::calculateLowAlt()
 {
   qDebug() << "calculateLowAlt";
-  routeNetworkAirway->setMode(nw::ROUTE_VICTOR);
-
-  RouteFinder routeFinder(routeNetworkAirway);
-
-  if(calculateRouteInternal(&routeFinder, atools::fs::pln::LOW_ALTITUDE,
-                            tr("Low altitude Flight Plan Calculation"),
-                            /* fetch airways */ true, false /* Use altitude */))
-    NavApp::setStatusMessage(tr("Calculated low altitude (Victor airways) flight plan."));
-  else
-    NavApp::setStatusMessage(tr("No route found."));
+  calculateRouteInternal(routeNetworkAirway, nw::ROUTE_VICTOR, atools::fs::pln::LOW_ALTITUDE,
+                         tr("Low altitude Flight Plan Calculation"),
+                         tr("Calculated low altitude (Victor airways) flight plan."),
+                         true /* fetch airways */, false /* Use altitude */);
 }
 
 void RouteController::calculateSetAlt()
 {
   qDebug() << "calculateSetAlt";
-  routeNetworkAirway->setMode(nw::ROUTE_VICTOR | nw::ROUTE_JET);
-
-  RouteFinder routeFinder(routeNetworkAirway);
 
   // Just decide by given altiude if this is a high or low plan
   atools::fs::pln::RouteType type;
@@ -978,35 +981,148 @@ void RouteController::calculateSetAlt()
   else
     type = atools::fs::pln::LOW_ALTITUDE;
 
-  if(calculateRouteInternal(&routeFinder, type, tr("Low altitude flight plan"),
-                            true /* fetch airways */, true /* Use altitude */))
-    NavApp::setStatusMessage(tr("Calculated high/low flight plan for given altitude."));
-  else
-    NavApp::setStatusMessage(tr("No route found."));
+  calculateRouteInternal(routeNetworkAirway, nw::ROUTE_VICTOR | nw::ROUTE_JET, type,
+                         tr("Low altitude flight plan"),
+                         tr("Calculated high/low flight plan for given altitude."),
+                         true /* fetch airways */, true /* Use altitude */);
+}
+
+void RouteController::cancelRouteCalc()
+{
+  if(routeCalcRunning)
+  {
+    stopRouteCalc(true);
+    NavApp::setStatusMessage(tr("Flight plan calculation canceled."));
+  }
 }
 
-/* Calculate a flight plan to all types */
-bool RouteController::calculateRouteInternal(RouteFinder *routeFinder, atools::fs::pln::RouteType type,
-                                             const QString& commandName, bool fetchAirways,
-                                             bool useSetAltitude)
+/* Cancel and wait for the calculation thread. The result is dropped. */
+void RouteController::stopRouteCalc(bool canceled)
 {
-  // Create wait cursor if calculation takes too long
-  QGuiApplication::setOverrideCursor(Qt::WaitCursor);
+  if(routeCalcRunning)
+  {
+    if(canceled && routeFinder != nullptr)
+      routeFinder->cancel();
+    routeCalcWatcher.waitForFinished();
+
+    // Ignore the pending finished signal of the watcher
+    routeCalcRunning = false;
+    QGuiApplication::restoreOverrideCursor();
+    emit routeCalcRunningChanged();
+  }
+}
+
+/* Calculate a flight plan to all types. Runs in background if the network is loaded into memory
+ * and calls routeCalcFinished when done. */
+void RouteController::calculateRouteInternal(RouteNetwork *network, nw::Modes mode,
+                                             atools::fs::pln::RouteType type,
+                                             const QString& commandName, const QString& successMessage,
+                                             bool fetchAirways, bool useSetAltitude)
+{
+  // Stop a running calculation since the networks cannot be shared
+  stopRouteCalc(true);
 
   // Stop any background tasks
   beforeRouteCalc();
 
+  // Changing mode might need a clear
+  network->setMode(mode);
+
   Flightplan& flightplan = route.getFlightplan();
 
   int cruiseFt = atools::roundToInt(Unit::rev(flightplan.getCruisingAltitude(), Unit::altFeetF));
   int altitude = useSetAltitude ? cruiseFt : 0;
 
+  routeFinder = network == routeNetworkRadio ? routeFinderRadio : routeFinderAirway;
+  routeFinder->resetCancel();
   routeFinder->setPreferVorToAirway(OptionData::instance().getFlags() & opts::ROUTE_PREFER_VOR);
   routeFinder->setPreferNdbToAirway(OptionData::instance().getFlags() & opts::ROUTE_PREFER_NDB);
 
-  Pos departurePos = route.getStartAfterProcedure().getPosition();
-  Pos destinationPos = route.getDestinationBeforeProcedure().getPosition();
-  bool found = routeFinder->calculateRoute(departurePos, destinationPos, altitude);
+  // Remember parameters to apply the result later
+  routeCalcParams.type = type;
+  routeCalcParams.commandName = commandName;
+  routeCalcParams.successMessage = successMessage;
+  routeCalcParams.fetchAirways = fetchAirways;
+  routeCalcParams.useSetAltitude = useSetAltitude;
+  routeCalcParams.departurePos = route.getStartAfterProcedure().getPosition();
+  routeCalcParams.destinationPos = route.getDestinationBeforeProcedure().getPosition();
+  routeCalcParams.startRouteType = flightplan.getRouteType();
+  routeCalcParams.cruisingAltitude = flightplan.getCruisingAltitude();
+  routeCalcParams.network = network;
+  routeCalcParams.mode = mode;
+
+  if(network->isGraphLoaded())
+  {
+    // Memory only network does not access the database and can be used in another thread
+    RouteFinder *finder = routeFinder;
+    Pos departurePos = routeCalcParams.departurePos, destinationPos = routeCalcParams.destinationPos;
+
+    finder->setProgressCallback([this](int numNodesExplored, int numNodesTotal) -> void
+                                {
+                                  // Queued to the GUI thread
+                                  emit routeCalcProgress(numNodesExplored, numNodesTotal);
+                                });
+
+    // Application is still usable
+    QGuiApplication::setOverrideCursor(Qt::BusyCursor);
+    NavApp::setStatusMessage(tr("Calculating flight plan."));
+
+    routeCalcRunning = true;
+    emit routeCalcRunningChanged();
+    routeCalcWatcher.setFuture(QtConcurrent::run([finder, departurePos, destinationPos, altitude]() -> bool
+                                                 {
+                                                   return finder->calculateRoute(departurePos, destinationPos,
+                                                                                 altitude);
+                                                 }));
+  }
+  else
+  {
+    // Network loads nodes on demand from the database which can be used in this thread only
+    // Create wait cursor if calculation takes too long
+    QGuiApplication::setOverrideCursor(Qt::WaitCursor);
+    bool found = routeFinder->calculateRoute(routeCalcParams.departurePos, routeCalcParams.destinationPos,
+                                             altitude);
+    QGuiApplication::restoreOverrideCursor();
+    routeCalcFinished(found);
+  }
+}
+
+/* Called by watcher when the calculation thread is finished */
+void RouteController::routeCalcThreadFinished()
+{
+  if(!routeCalcRunning)
+    // Was stopped and result dropped
+    return;
+
+  routeCalcRunning = false;
+  QGuiApplication::restoreOverrideCursor();
+  emit routeCalcRunningChanged();
+  routeCalcFinished(routeCalcWatcher.result());
+}
+
+void RouteController::routeCalcProgressUpdate(int numNodesExplored, int numNodesTotal)
+{
+  if(routeCalcRunning)
+    NavApp::setStatusMessage(tr("Calculating flight plan. Explored %L1 of %L2 nodes.").
+                             arg(numNodesExplored).arg(numNodesTotal));
+}
+
+/* Apply the calculated route to the flight plan and undo stack */
+void RouteController::routeCalcFinished(bool found)
+{
+  const Flightplan& fp = route.getFlightplan();
+  if(routeCalcParams.departurePos != route.getStartAfterProcedure().getPosition() ||
+     routeCalcParams.destinationPos != route.getDestinationBeforeProcedure().getPosition() ||
+     routeCalcParams.startRouteType != fp.getRouteType() ||
+     routeCalcParams.cruisingAltitude != fp.getCruisingAltitude() ||
+     routeCalcParams.mode != routeCalcParams.network->getMode())
+  {
+    // Flight plan was changed while calculating in background
+    NavApp::setStatusMessage(tr("Flight plan changed. Calculation result dropped."));
+    return;
+  }
+
+  Flightplan& flightplan = route.getFlightplan();
 
   if(found)
   {
@@ -1018,19 +1134,22 @@ bool RouteController::calculateRouteInternal(RouteFinder *routeFinder, atools::f
     routeFinder->extractRoute(calculatedRoute, distance);
 
     // Compare to direct connection and check if route is too long
-    float directDistance = departurePos.distanceMeterTo(destinationPos);
+    float directDistance = routeCalcParams.departurePos.distanceMeterTo(routeCalcParams.destinationPos);
     float ratio = distance / directDistance;
     qDebug() << "route distance" << QString::number(distance, 'f', 0)
              << "direct distance" << QString::number(directDistance, 'f', 0) << "ratio" << ratio;
 
-    if(ratio < MAX_DISTANCE_DIRECT_RATIO)
+    if(ratio < RouteFinder::MAX_DISTANCE_DIRECT_RATIO)
     {
+      // Create wait cursor if building the flight plan takes too long
+      QGuiApplication::setOverrideCursor(Qt::WaitCursor);
+
       // Start undo
-      RouteCommand *undoCommand = preChange(commandName);
+      RouteCommand *undoCommand = preChange(routeCalcParams.commandName);
 
       QList<FlightplanEntry>& entries = flightplan.getEntries();
 
-      flightplan.setRouteType(type);
+      flightplan.setRouteType(routeCalcParams.type);
       // Erase all but start and destination
       entries.erase(flightplan.getEntries().begin() + 1, entries.end() - 1);
 
@@ -1039,8 +1158,8 @@ bool RouteController::calculateRouteInternal(RouteFinder *routeFinder, atools::f
       {
         FlightplanEntry flightplanEntry;
         entryBuilder->buildFlightplanEntry(routeEntry.ref.id, atools::geo::EMPTY_POS, routeEntry.ref.type,
-                                           flightplanEntry, fetchAirways);
-        if(fetchAirways && routeEntry.airwayId != -1)
+                                           flightplanEntry, routeCalcParams.fetchAirways);
+        if(routeCalcParams.fetchAirways && routeEntry.airwayId != -1)
           // Get airway by id - needed to fetch the name first
           updateFlightplanEntryAirway(routeEntry.airwayId, flightplanEntry);
         entries.insert(entries.end() - 1, flightplanEntry);
@@ -1052,7 +1171,7 @@ bool RouteController::calculateRouteInternal(RouteFinder *routeFinder, atools::f
 
       route.removeDuplicateRouteLegs();
       route.updateAll();
-      updateAirwaysAndAltitude(!useSetAltitude /* adjustRouteAltitude */);
+      updateAirwaysAndAltitude(!routeCalcParams.useSetAltitude /* adjustRouteAltitude */);
 
       updateTableModel();
       route.updateActiveLegAndPos(true /* force update */);
@@ -1066,14 +1185,16 @@ bool RouteController::calculateRouteInternal(RouteFinder *routeFinder, atools::f
       found = false;
   }
 
-  QGuiApplication::restoreOverrideCursor();
-  if(!found)
+  if(found)
+    NavApp::setStatusMessage(routeCalcParams.successMessage);
+  else
+  {
+    NavApp::setStatusMessage(tr("No route found."));
     atools::gui::Dialog(mainWindow).showInfoMsgBox(lnm::ACTIONS_SHOWROUTE_ERROR,
                                                    tr("Cannot find a route.\n"
                                                       "Try another routing type or create the flight plan manually."),
                                                    tr("Do not &show this dialog again."));
-
-  return found;
+  }
 }
 
 void RouteController::adjustFlightplanAltitude()
@@ -1224,6 +1345,8 @@ QString RouteController::buildDefaultFilenameShort(const QString& sep, const QSt
 
 void RouteController::preDatabaseLoad()
 {
+  // Networks are used by the calculation thread
+  stopRouteCalc(true);
   routeNetworkRadio->deInitQueries();
   routeNetworkAirway->deInitQueries();
   routeAltDelayTimer.stop();
@@ -1234,6 +1357,10 @@ void RouteController::postDatabaseLoad()
   routeNetworkRadio->initQueries();
   routeNetworkAirway->initQueries();
 
+#ifdef DEBUG_ROUTE_NETWORK_BENCHMARK
+  RouteNetworkBenchmark(NavApp::getDatabase()).run();
+#endif
+
   // Remove the legs but keep the properties
   route.clearProcedureLegs(proc::PROCEDURE_ALL);
 
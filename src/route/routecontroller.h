@@ -20,7 +20,9 @@
 
 #include "route/routecommand.h"
 #include "route/route.h"
+#include "route/routenetwork.h"
 
+#include <QFutureWatcher>
 #include <QIcon>
 #include <QObject>
 #include <QTimer>
@@ -183,6 +185,15 @@ public:
    *  the spin box as minimum altitude */
   void calculateSetAlt();
 
+  /* Stop a running background flight plan calculation. The flight plan is not changed. */
+  void cancelRouteCalc();
+
+  /* true if a flight plan is calculated in background */
+  bool isRouteCalcRunning() const
+  {
+    return routeCalcRunning;
+  }
+
   /* Reverse order of all waypoints, swap departure and destination and automatically
    * select a new start position (best runway) */
   void reverseRoute();
@@ -242,6 +253,12 @@ signals:
   /* Emitted before route calculation to stop any background tasks */
   void preRouteCalc();
 
+  /* Emitted from the calculation thread while a flight plan is calculated in background */
+  void routeCalcProgress(int numNodesExplored, int numNodesTotal);
+
+  /* Emitted when a background calculation is started or finished */
+  void routeCalcRunningChanged();
+
 private:
   friend class RouteCommand;
 
@@ -304,9 +321,13 @@ private:
   int adjustAltitude(const atools::geo::Pos& departurePos, const atools::geo::Pos& destinationPos,
                      const atools::fs::pln::Flightplan& flightplan, int minAltitude);
 
-  bool calculateRouteInternal(RouteFinder *routeFinder, atools::fs::pln::RouteType type,
-                              const QString& commandName,
+  void calculateRouteInternal(RouteNetwork *network, nw::Modes mode, atools::fs::pln::RouteType type,
+                              const QString& commandName, const QString& successMessage,
                               bool fetchAirways, bool useSetAltitude);
+  void routeCalcFinished(bool found);
+  void routeCalcThreadFinished();
+  void routeCalcProgressUpdate(int numNodesExplored, int numNodesTotal);
+  void stopRouteCalc(bool canceled);
 
   void updateModelRouteTime();
 
@@ -346,9 +367,6 @@ private:
   int calculateInsertIndex(const atools::geo::Pos& pos, int legIndex);
   proc::MapProcedureTypes affectedProcedures(const QList<int>& indexes);
 
-  /* If route distance / direct distance if bigger than this value fail routing */
-  static Q_DECL_CONSTEXPR float MAX_DISTANCE_DIRECT_RATIO = 1.5f;
-
   static Q_DECL_CONSTEXPR int ROUTE_UNDO_LIMIT = 50;
 
   atools::gui::ItemViewZoomHandler *zoomHandler = nullptr;
@@ -361,6 +379,29 @@ private:
   /* Network cache for flight plan calculation */
   RouteNetwork *routeNetworkRadio = nullptr, *routeNetworkAirway = nullptr;
 
+  /* Parameters of the running flight plan calculation that are needed to apply the result */
+  struct RouteCalcParams
+  {
+    atools::fs::pln::RouteType type;
+    QString commandName, successMessage;
+    bool fetchAirways, useSetAltitude;
+    atools::geo::Pos departurePos, destinationPos;
+
+    /* Flight plan and network state at start of calculation to detect changes while calculating */
+    atools::fs::pln::RouteType startRouteType;
+    int cruisingAltitude;
+    RouteNetwork *network;
+    nw::Modes mode;
+  };
+
+  /* Finders are kept for each network to allow incremental calculation if only the destination changes.
+   * routeFinder points to the one used in the last calculation which runs in background
+   * if the network is loaded into memory. */
+  RouteFinder *routeFinderRadio = nullptr, *routeFinderAirway = nullptr, *routeFinder = nullptr;
+  RouteCalcParams routeCalcParams;
+  QFutureWatcher<bool> routeCalcWatcher;
+  bool routeCalcRunning = false;
+
   /* Flightplan and route objects */
   Route route; /* real route containing all segments */
 
@@ -19,19 +19,15 @@
 #include "geo/calculations.h"
 #include "atools.h"
 
+#include <algorithm>
+
 using nw::Node;
 using nw::Edge;
 using atools::geo::Pos;
 
 RouteFinder::RouteFinder(RouteNetwork *routeNetwork)
-  : network(routeNetwork), openNodesHeap(5000)
+  : network(routeNetwork)
 {
-  closedNodes.reserve(10000);
-  nodeCosts.reserve(10000);
-  nodePredecessor.reserve(10000);
-  nodeAirwayId.reserve(10000);
-  nodeAirwayName.reserve(10000);
-
   successorNodes.reserve(500);
   successorEdges.reserve(500);
 }
@@ -41,8 +37,24 @@ RouteFinder::~RouteFinder()
 
 }
 
+/* Resize all index arrays if needed and set them to the initial state */
+void RouteFinder::resetState(int numIndexes)
+{
+  openNodesHeap.resize(numIndexes);
+  nodes.fill(Node(), numIndexes);
+  nodeStates.fill(UNVISITED, numIndexes);
+  nodeCosts.fill(0.f, numIndexes);
+  nodePredecessor.fill(-1, numIndexes);
+  nodeAirwayId.fill(-1, numIndexes);
+  nodeAirwayName.fill(QString(), numIndexes);
+  numClosedNodes = 0;
+}
+
 bool RouteFinder::calculateRoute(const atools::geo::Pos& from, const atools::geo::Pos& to, int flownAltitude)
 {
+  // Check before adding the new destination if the last search can be continued
+  bool incremental = canContinueSearch(from, flownAltitude);
+
   altitude = flownAltitude;
   network->addDepartureAndDestinationNodes(from, to);
   Node startNode = network->getDepartureNode();
@@ -50,18 +62,43 @@ bool RouteFinder::calculateRoute(const atools::geo::Pos& from, const atools::geo
 
   int numNodesTotal = network->getNumberOfNodesDatabase();
 
-  if(startNode.edges.isEmpty())
-    return false;
+  // The in-memory network is cheap to explore - do not give up on long routes
+  bool limitClosedNodes = !network->isGraphLoaded();
 
-  openNodesHeap.push(startNode, 0.f);
-  nodeCosts[startNode.id] = 0.f;
+  // Remember search parameters for the next call
+  searchValid = false;
+  lastDeparture = from;
+  lastMode = network->getMode();
+  lastPreferVorToAirway = preferVorToAirway;
+  lastPreferNdbToAirway = preferNdbToAirway;
+  lastGraph = network->isGraphLoaded() ? network->getSharedGraph() : QSharedPointer<const RouteNetworkGraph>();
+
+  if(incremental)
+    // Keep closed nodes and their costs and update open nodes for the new destination
+    continueSearch(destNode);
+  else
+  {
+    resetState(network->getNumberOfNodeIndexes());
+
+    if(startNode.edges.isEmpty())
+      return false;
+
+    int startIndex = network->getNodeIndex(startNode.id);
+    nodes[startIndex] = startNode;
+    nodeStates[startIndex] = OPEN;
+    nodeCosts[startIndex] = 0.f;
+    openNodesHeap.push(startIndex, 0.f);
+  }
 
-  Node currentNode;
   bool destinationFound = false;
   while(!openNodesHeap.isEmpty())
   {
+    if(isCanceled())
+      break;
+
     // Contains known nodes
-    openNodesHeap.pop(currentNode);
+    int currentIndex = openNodesHeap.pop();
+    Node currentNode = nodes.at(currentIndex);
 
     if(currentNode.id == destNode.id)
     {
@@ -70,18 +107,25 @@ bool RouteFinder::calculateRoute(const atools::geo::Pos& from, const atools::geo
     }
 
     // Contains nodes with known shortest path
-    closedNodes.insert(currentNode.id);
+    nodeStates[currentIndex] = CLOSED;
+    numClosedNodes++;
 
-    if(closedNodes.size() > numNodesTotal / 2)
+    if(limitClosedNodes && numClosedNodes > numNodesTotal / 2)
       // If we read too much nodes routing will fail
       break;
 
+    if(progressCallback && numClosedNodes % PROGRESS_NODES == 0)
+      progressCallback(numClosedNodes, numNodesTotal);
+
     // Work on successors
-    expandNode(currentNode, destNode);
+    expandNode(currentNode, currentIndex, destNode);
   }
 
-  qDebug() << "found" << destinationFound << "heap size" << openNodesHeap.size()
-           << "close nodes size" << closedNodes.size();
+  // Closed nodes are complete if not canceled and can be reused by the next search
+  searchValid = !isCanceled() && !(limitClosedNodes && numClosedNodes > numNodesTotal / 2);
+
+  qDebug() << "found" << destinationFound << "incremental" << incremental << "canceled" << isCanceled()
+           << "heap size" << openNodesHeap.size() << "close nodes size" << numClosedNodes;
 
   qDebug() << "num nodes database" << network->getNumberOfNodesDatabase()
            << "num nodes cache" << network->getNumberOfNodesCache();
@@ -89,6 +133,61 @@ bool RouteFinder::calculateRoute(const atools::geo::Pos& from, const atools::geo
   return destinationFound;
 }
 
+/* The search tree can be reused if only the destination changed. Needs the in-memory network since
+ * nodes from the cache carry the edges to the old destination. */
+bool RouteFinder::canContinueSearch(const atools::geo::Pos& from, int flownAltitude)
+{
+  return searchValid && network->isGraphLoaded() &&
+         lastGraph == network->getSharedGraph() &&
+         lastDeparture == from &&
+         altitude == flownAltitude &&
+         lastMode == network->getMode() &&
+         lastPreferVorToAirway == preferVorToAirway &&
+         lastPreferNdbToAirway == preferNdbToAirway;
+}
+
+/* Update the last search for a new destination. Costs from departure to all closed nodes do not depend
+ * on the destination. Open nodes get new estimates and closed nodes near the destination get their edges
+ * to the new destination. */
+void RouteFinder::continueSearch(const nw::Node& destNode)
+{
+  int destIndex = network->getNodeIndex(destNode.id);
+
+  // Collect open nodes except the old destination before clearing the heap
+  QVector<int> openIndexes;
+  openIndexes.reserve(openNodesHeap.size());
+  for(int i = 0; i < nodeStates.size(); i++)
+  {
+    if(nodeStates.at(i) == OPEN && i != destIndex)
+      openIndexes.append(i);
+  }
+  openNodesHeap.clear();
+
+  // Forget the old destination
+  nodes[destIndex] = Node();
+  nodeStates[destIndex] = UNVISITED;
+  nodeCosts[destIndex] = 0.f;
+  nodePredecessor[destIndex] = -1;
+  nodeAirwayId[destIndex] = -1;
+  nodeAirwayName[destIndex].clear();
+
+  // Estimate changed for all open nodes
+  for(int index : openIndexes)
+    openNodesHeap.push(index, nodeCosts.at(index) + costEstimate(nodes.at(index), index, destNode));
+
+  // Closed nodes near the destination will not be expanded again - add the virtual edges here
+  for(int id : network->getDestinationPredecessors())
+  {
+    int index = network->getNodeIndex(id);
+    if(index != -1 && nodeStates.at(index) == CLOSED)
+    {
+      const Node& node = nodes.at(index);
+      Edge edge(destNode.id, static_cast<int>(node.pos.distanceMeterTo(destNode.pos)));
+      updateSuccessor(node, index, destNode, destIndex, edge, destNode);
+    }
+  }
+}
+
 void RouteFinder::extractRoute(QVector<rf::RouteEntry>& route, float& distanceMeter)
 {
   distanceMeter = 0.f;
@@ -106,11 +205,11 @@ void RouteFinder::extractRoute(QVector<rf::RouteEntry>& route, float& distanceMe
     {
       rf::RouteEntry entry;
       entry.ref = {navId, toMapObjectType(type)};
-      entry.airwayId = nodeAirwayId.value(pred.id, -1);
+      entry.airwayId = nodeAirwayId.at(network->getNodeIndex(pred.id));
       route.prepend(entry);
     }
 
-    nw::Node next = network->getNode(nodePredecessor.value(pred.id, -1));
+    nw::Node next = network->getNode(nodePredecessor.at(network->getNodeIndex(pred.id)));
     if(next.pos.isValid())
       distanceMeter += pred.pos.distanceMeterTo(next.pos);
     pred = next;
@@ -118,63 +217,81 @@ void RouteFinder::extractRoute(QVector<rf::RouteEntry>& route, float& distanceMe
 }
 
 /* Expands a node by investigating all successors */
-void RouteFinder::expandNode(const nw::Node& currentNode, const nw::Node& destNode)
+void RouteFinder::expandNode(const nw::Node& currentNode, int currentIndex, const nw::Node& destNode)
 {
   successorNodes.clear();
   successorEdges.clear();
   network->getNeighbours(currentNode, successorNodes, successorEdges);
 
-  QString currentNodeAirway;
-  if(network->isAirwayRouting())
-    currentNodeAirway = nodeAirwayName[currentNode.id];
-
   for(int i = 0; i < successorNodes.size(); i++)
   {
     const Node& successor = successorNodes.at(i);
+    int successorIndex = network->getNodeIndex(successor.id);
 
-    if(closedNodes.contains(successor.id))
+    if(successorIndex == -1)
+    {
+      qWarning() << Q_FUNC_INFO << "Node not found in index" << successor.id;
+      continue;
+    }
+
+    if(nodeStates.at(successorIndex) == CLOSED)
       // Already has a shortest path
       continue;
 
-    const Edge& edge = successorEdges.at(i);
+    updateSuccessor(currentNode, currentIndex, successor, successorIndex, successorEdges.at(i), destNode);
+  }
+}
 
-    if(altitude > 0 && edge.minAltFt > 0 && altitude < edge.minAltFt)
-      // Altitude restrictions do not match - ignore this edge to the node
-      continue;
+/* Calculate costs to the successor and add it to the open nodes or update it if the new path is cheaper */
+void RouteFinder::updateSuccessor(const nw::Node& currentNode, int currentIndex, const nw::Node& successor,
+                                  int successorIndex, const nw::Edge& edge, const nw::Node& destNode)
+{
+  NodeState successorState = nodeStates.at(successorIndex);
+
+  if(altitude > 0 && edge.minAltFt > 0 && altitude < edge.minAltFt)
+    // Altitude restrictions do not match - ignore this edge to the node
+    return;
 
-    int lengthMeter = edge.lengthMeter;
+  int lengthMeter = edge.lengthMeter;
 
-    if(lengthMeter == 0)
-      // No distance given for airways - have to calculate this here
-      lengthMeter = static_cast<int>(currentNode.pos.distanceMeterTo(successor.pos));
+  if(lengthMeter == 0)
+    // No distance given for airways - have to calculate this here
+    lengthMeter = static_cast<int>(currentNode.pos.distanceMeterTo(successor.pos));
 
-    float successorEdgeCosts = calculateEdgeCost(currentNode, successor, lengthMeter);
+  float successorEdgeCosts = calculateEdgeCost(currentNode, successor, lengthMeter);
 
-    // Avoid jumping between equal airways
+  // Avoid jumping between equal airways
+  if(network->isAirwayRouting())
+  {
+    const QString& currentNodeAirway = nodeAirwayName.at(currentIndex);
     if(!currentNodeAirway.isEmpty() && !edge.airwayName.isEmpty() && currentNodeAirway != edge.airwayName)
       successorEdgeCosts *= COST_FACTOR_AIRWAY_CHANGE;
+  }
 
-    float successorNodeCosts = nodeCosts.value(currentNode.id) + successorEdgeCosts;
+  float successorNodeCosts = nodeCosts.at(currentIndex) + successorEdgeCosts;
 
-    if(successorNodeCosts >= nodeCosts.value(successor.id) && openNodesHeap.contains(successor))
-      // New path is not cheaper
-      continue;
+  if(successorState == OPEN && successorNodeCosts >= nodeCosts.at(successorIndex))
+    // New path is not cheaper
+    return;
 
-    // New path is cheaper - update node
-    nodeAirwayId[successor.id] = successorEdges.at(i).airwayId;
-    if(network->isAirwayRouting())
-      nodeAirwayName[successor.id] = successorEdges.at(i).airwayName;
-    nodePredecessor[successor.id] = currentNode.id;
-    nodeCosts[successor.id] = successorNodeCosts;
-
-    // Costs from start to successor + estimate to destination = sort order in heap
-    float totalCost = successorNodeCosts + costEstimate(successor, destNode);
-
-    if(openNodesHeap.contains(successor))
-      // Update node and resort heap
-      openNodesHeap.change(successor, totalCost);
-    else
-      openNodesHeap.push(successor, totalCost);
+  // New path is cheaper - update node
+  nodeAirwayId[successorIndex] = edge.airwayId;
+  if(network->isAirwayRouting())
+    nodeAirwayName[successorIndex] = edge.airwayName;
+  nodePredecessor[successorIndex] = currentNode.id;
+  nodeCosts[successorIndex] = successorNodeCosts;
+
+  // Costs from start to successor + estimate to destination = sort order in heap
+  float totalCost = successorNodeCosts + costEstimate(successor, successorIndex, destNode);
+
+  if(successorState == OPEN)
+    // Update node and resort heap
+    openNodesHeap.change(successorIndex, totalCost);
+  else
+  {
+    nodes[successorIndex] = successor;
+    nodeStates[successorIndex] = OPEN;
+    openNodesHeap.push(successorIndex, totalCost);
   }
 }
 
@@ -248,10 +365,11 @@ float RouteFinder::calculateEdgeCost(const nw::Node& currentNode, const nw::Node
   return costs;
 }
 
-/* GC distance in meter as costs between nodes */
-float RouteFinder::costEstimate(const nw::Node& currentNode, const nw::Node& destNode)
+/* GC distance in meter or landmark lower bound as costs between nodes. Both never overestimate
+ * since all cost factors are >= 1. */
+float RouteFinder::costEstimate(const nw::Node& currentNode, int currentIndex, const nw::Node& destNode)
 {
-  return currentNode.pos.distanceMeterTo(destNode.pos);
+  return std::max(currentNode.pos.distanceMeterTo(destNode.pos), network->landmarkEstimate(currentIndex));
 }
 
 /* Convert internal network type to MapObjectTypes for extract route */
@@ -18,9 +18,13 @@
 #ifndef LITTLENAVMAP_ROUTEFINDER_H
 #define LITTLENAVMAP_ROUTEFINDER_H
 
-#include "util/heap.h"
+#include "route/routeheap.h"
 #include "route/routenetwork.h"
 
+#include <QAtomicInt>
+
+#include <functional>
+
 namespace rf {
 /* Used when fetching the route points after calculation. Adds airway id to node */
 struct RouteEntry
@@ -34,6 +38,13 @@ struct RouteEntry
 /*
  * Calculates flight plans within a route network which can be an airway or radio navaid network.
  * Use A* algorithm and several cost factor adjustments to get reasonable routes.
+ *
+ * Node ids are mapped to dense indexes by the network. All bookkeeping for the algorithm is done in
+ * flat arrays accessed by these indexes.
+ *
+ * The search tree is kept after a calculation. If only the destination changes in the next calculation
+ * the closed nodes are reused and only the open nodes are updated for the new destination.
+ * This needs a network that is loaded into memory.
  */
 class RouteFinder
 {
@@ -68,10 +79,52 @@ public:
     preferNdbToAirway = value;
   }
 
+  /* Called every PROGRESS_NODES explored nodes with the number of explored (closed) nodes and
+   * the number of nodes in the network. Called in the thread running calculateRoute. */
+  typedef std::function<void (int numNodesExplored, int numNodesTotal)> ProgressFunc;
+
+  void setProgressCallback(const ProgressFunc& func)
+  {
+    progressCallback = func;
+  }
+
+  /* Stop a running calculation. Can be called from another thread. calculateRoute will return false. */
+  void cancel()
+  {
+    canceled.store(1);
+  }
+
+  bool isCanceled() const
+  {
+    return canceled.load() != 0;
+  }
+
+  /* Reset the cancel flag before starting a new calculation */
+  void resetCancel()
+  {
+    canceled.store(0);
+  }
+
+  /* If route distance / direct distance if bigger than this value fail routing */
+  static Q_DECL_CONSTEXPR float MAX_DISTANCE_DIRECT_RATIO = 1.5f;
+
 private:
-  void expandNode(const nw::Node& node, const nw::Node& destNode);
+  /* Node state in the algorithm */
+  enum NodeState : quint8
+  {
+    UNVISITED,
+    OPEN,
+    CLOSED
+  };
+
+  void expandNode(const nw::Node& node, int nodeIndex, const nw::Node& destNode);
+  void updateSuccessor(const nw::Node& currentNode, int currentIndex, const nw::Node& successor,
+                       int successorIndex, const nw::Edge& edge, const nw::Node& destNode);
+  bool canContinueSearch(const atools::geo::Pos& from, int flownAltitude);
+  void continueSearch(const nw::Node& destNode);
+  void resetState(int numIndexes);
   float calculateEdgeCost(const nw::Node& node, const nw::Node& successorNode, int lengthMeter);
-  float costEstimate(const nw::Node& currentNode, const nw::Node& destNode);
+  float costEstimate(const nw::Node& currentNode, int currentIndex, const nw::Node& destNode);
   map::MapObjectTypes toMapObjectType(nw::NodeType type);
 
   /* Force algortihm to avoid direct route from start to destination */
@@ -106,26 +159,45 @@ private:
   /* Distance to define a long airway segment in meter */
   static Q_DECL_CONSTEXPR float DISTANCE_LONG_AIRWAY_METER = atools::geo::nmToMeter(200.f);
 
+  /* Report progress every number of closed nodes */
+  static Q_DECL_CONSTEXPR int PROGRESS_NODES = 5000;
+
   int altitude = 0;
 
+  QAtomicInt canceled;
+  ProgressFunc progressCallback;
+
+  /* Parameters of the last search to check if it can be continued for a new destination */
+  bool searchValid = false;
+  atools::geo::Pos lastDeparture;
+  nw::Modes lastMode = nw::ROUTE_NONE;
+  bool lastPreferVorToAirway = false, lastPreferNdbToAirway = false;
+  QWeakPointer<const RouteNetworkGraph> lastGraph;
+
   RouteNetwork *network;
 
-  /* Heap structure storing open nodes.
+  /* Heap structure storing indexes of open nodes.
    * Sort order is defined by costs from start to node + estimate to destination */
-  atools::util::Heap<nw::Node> openNodesHeap;
+  RouteHeap openNodesHeap;
+
+  /* All following arrays are accessed by node index */
+
+  /* Nodes that were added to the heap. Needed to get the node back when popping the index from the heap */
+  QVector<nw::Node> nodes;
+
+  /* Unvisited, open or closed. Closed nodes have been processed already and have a known shortest path. */
+  QVector<NodeState> nodeStates;
+  int numClosedNodes = 0;
 
-  /* Nodes that have been processed already and have a known shortest path */
-  QSet<int> closedNodes;
+  /* Costs from start to this node. Costs are distance in meter adjusted by some factors. */
+  QVector<float> nodeCosts;
 
-  /* Costs from start to this node. Maps node id to costs. Costs are distance in meter
-   * adjusted by some factors. */
-  QHash<int, float> nodeCosts;
+  /* Predecessor node id or -1 */
+  QVector<int> nodePredecessor;
 
-  /* Maps node id to predecessor node id */
-  QHash<int, int> nodePredecessor;
-  /* Maps node id to predecessor airway id */
-  QHash<int, int> nodeAirwayId;
-  QHash<int, QString> nodeAirwayName;
+  /* Airway id and name to predecessor */
+  QVector<int> nodeAirwayId;
+  QVector<QString> nodeAirwayName;
 
   /* For RouteNetwork::getNeighbours to avoid instantiations */
   QVector<nw::Node> successorNodes;
@@ -0,0 +1,111 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "route/routefinderbatch.h"
+
+#include "geo/pos.h"
+
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <algorithm>
+
+RouteFinderBatch::RouteFinderBatch(RouteNetwork *radioNetwork, RouteNetwork *airwayNetwork)
+{
+  radioGraph = radioNetwork->getSharedGraph();
+  airwayGraph = airwayNetwork->getSharedGraph();
+  radioLandmarks = radioNetwork->getSharedLandmarks();
+  airwayLandmarks = airwayNetwork->getSharedLandmarks();
+}
+
+RouteFinderBatch::~RouteFinderBatch()
+{
+  pool.waitForDone();
+}
+
+QVector<rf::BatchResult> RouteFinderBatch::calculate(const QVector<rf::BatchJob>& jobs)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  QVector<rf::BatchResult> results(jobs.size());
+
+  // Each worker writes only its own results - avoid detaching in worker threads
+  rf::BatchResult *resultData = results.data();
+
+  nextJob.store(0);
+  int numWorkers = std::min(pool.maxThreadCount(), jobs.size());
+
+  QList<QFuture<void> > futures;
+  for(int i = 0; i < numWorkers; i++)
+    futures.append(QtConcurrent::run(&pool, [this, &jobs, resultData]() -> void
+                                     {
+                                       runWorker(jobs, resultData);
+                                     }));
+
+  for(QFuture<void>& future : futures)
+    future.waitForFinished();
+
+  qDebug() << Q_FUNC_INFO << "jobs" << jobs.size() << "workers" << numWorkers << "in" << timer.elapsed() << "ms";
+
+  return results;
+}
+
+void RouteFinderBatch::runWorker(const QVector<rf::BatchJob>& jobs, rf::BatchResult *results)
+{
+  // Create networks and finders for this thread only - the graphs are shared
+  RouteNetwork radioNetwork(radioGraph, radioLandmarks), airwayNetwork(airwayGraph, airwayLandmarks);
+  RouteFinder radioFinder(&radioNetwork), airwayFinder(&airwayNetwork);
+
+  for(RouteFinder *finder : {&radioFinder, &airwayFinder})
+  {
+    finder->setPreferVorToAirway(preferVorToAirway);
+    finder->setPreferNdbToAirway(preferNdbToAirway);
+  }
+
+  int index;
+  while((index = nextJob.fetchAndAddOrdered(1)) < jobs.size())
+  {
+    const rf::BatchJob& job = jobs.at(index);
+
+    if(job.mode & nw::ROUTE_RADIONAV)
+      calculateJob(radioFinder, radioNetwork, job, results[index]);
+    else
+      calculateJob(airwayFinder, airwayNetwork, job, results[index]);
+  }
+}
+
+void RouteFinderBatch::calculateJob(RouteFinder& finder, RouteNetwork& network, const rf::BatchJob& job,
+                                    rf::BatchResult& result)
+{
+  network.setMode(job.mode);
+
+  result.found = finder.calculateRoute(job.departure, job.destination, job.altitudeFt);
+  if(result.found)
+  {
+    finder.extractRoute(result.route, result.distanceMeter);
+
+    // Compare to direct connection and check if route is too long like RouteController does
+    float directDistance = job.departure.distanceMeterTo(job.destination);
+    if(result.distanceMeter / directDistance >= RouteFinder::MAX_DISTANCE_DIRECT_RATIO)
+    {
+      result.found = false;
+      result.route.clear();
+      result.distanceMeter = 0.f;
+    }
+  }
+}
@@ -0,0 +1,109 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_ROUTEFINDERBATCH_H
+#define LITTLENAVMAP_ROUTEFINDERBATCH_H
+
+#include "route/routefinder.h"
+
+#include <QAtomicInt>
+#include <QThreadPool>
+
+namespace rf {
+
+/* A single route calculation job for the batch */
+struct BatchJob
+{
+  atools::geo::Pos departure, destination;
+
+  /* Create a flight plan using airways for the given altitude. Set to 0 to ignore. */
+  int altitudeFt = 0;
+
+  /* ROUTE_RADIONAV uses the radio navaid network. ROUTE_VICTOR and/or ROUTE_JET use the airway network. */
+  nw::Modes mode = nw::ROUTE_JET;
+};
+
+/* Result for a batch job */
+struct BatchResult
+{
+  /* false if no route was found or if the route is too long compared to the direct distance */
+  bool found = false;
+
+  /* Route points excluding departure and destination */
+  QVector<rf::RouteEntry> route;
+  float distanceMeter = 0.f;
+};
+
+}
+
+/*
+ * Headless batch route calculation without GUI involvement. Uses the same network, cost model and
+ * distance checks as the flight plan calculation in RouteController.
+ *
+ * Jobs are distributed on a thread pool. Each worker thread uses its own memory only networks and
+ * route finders on top of the shared read only graphs.
+ */
+class RouteFinderBatch
+{
+public:
+  /*
+   * Takes the in-memory graphs from both networks or loads them if the networks are not preloaded.
+   * Has to be created in the thread owning the database of the networks. The networks are not used afterwards.
+   */
+  RouteFinderBatch(RouteNetwork *radioNetwork, RouteNetwork *airwayNetwork);
+  ~RouteFinderBatch();
+
+  /* Calculate all jobs concurrently and wait until all are done.
+   * Results are returned in the same order as the jobs. */
+  QVector<rf::BatchResult> calculate(const QVector<rf::BatchJob>& jobs);
+
+  /* Maximum number of threads. Default is number of CPU cores. */
+  void setMaxThreads(int value)
+  {
+    pool.setMaxThreadCount(value);
+  }
+
+  /* Prefer VORs to transition from departure to airway network */
+  void setPreferVorToAirway(bool value)
+  {
+    preferVorToAirway = value;
+  }
+
+  /* Prefer NDBs to transition from departure to airway network */
+  void setPreferNdbToAirway(bool value)
+  {
+    preferNdbToAirway = value;
+  }
+
+private:
+  /* Runs in worker thread and fetches jobs until all are done */
+  void runWorker(const QVector<rf::BatchJob>& jobs, rf::BatchResult *results);
+
+  void calculateJob(RouteFinder& finder, RouteNetwork& network, const rf::BatchJob& job, rf::BatchResult& result);
+
+  QSharedPointer<const RouteNetworkGraph> radioGraph, airwayGraph;
+
+  /* Landmark indexes which might be still loading or null */
+  QSharedPointer<RouteLandmarks> radioLandmarks, airwayLandmarks;
+  QThreadPool pool;
+
+  /* Index of the next job to fetch by a worker */
+  QAtomicInt nextJob;
+  bool preferVorToAirway = false, preferNdbToAirway = false;
+};
+
+#endif // LITTLENAVMAP_ROUTEFINDERBATCH_H
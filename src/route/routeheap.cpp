@@ -0,0 +1,115 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "route/routeheap.h"
+
+#include <utility>
+
+RouteHeap::RouteHeap()
+{
+}
+
+RouteHeap::~RouteHeap()
+{
+}
+
+void RouteHeap::resize(int maxIndexes)
+{
+  entries.clear();
+  positions.fill(-1, maxIndexes);
+}
+
+void RouteHeap::clear()
+{
+  for(const Entry& entry : entries)
+    positions[entry.index] = -1;
+  entries.clear();
+}
+
+void RouteHeap::push(int index, float cost)
+{
+  positions[index] = entries.size();
+  entries.append({cost, index});
+  moveUp(entries.size() - 1);
+}
+
+int RouteHeap::pop()
+{
+  int index = entries.first().index;
+  swap(0, entries.size() - 1);
+  entries.removeLast();
+  positions[index] = -1;
+
+  if(!entries.isEmpty())
+    moveDown(0);
+  return index;
+}
+
+void RouteHeap::change(int index, float cost)
+{
+  int pos = positions.at(index);
+  float oldCost = entries.at(pos).cost;
+  entries[pos].cost = cost;
+
+  if(cost < oldCost)
+    moveUp(pos);
+  else
+    moveDown(pos);
+}
+
+void RouteHeap::moveUp(int pos)
+{
+  while(pos > 0)
+  {
+    int parent = (pos - 1) / 2;
+    if(entries.at(parent).cost <= entries.at(pos).cost)
+      break;
+
+    swap(parent, pos);
+    pos = parent;
+  }
+}
+
+void RouteHeap::moveDown(int pos)
+{
+  int size = entries.size();
+  while(true)
+  {
+    int left = 2 * pos + 1, right = left + 1, smallest = pos;
+
+    if(left < size && entries.at(left).cost < entries.at(smallest).cost)
+      smallest = left;
+    if(right < size && entries.at(right).cost < entries.at(smallest).cost)
+      smallest = right;
+
+    if(smallest == pos)
+      break;
+
+    swap(smallest, pos);
+    pos = smallest;
+  }
+}
+
+void RouteHeap::swap(int pos1, int pos2)
+{
+  if(pos1 != pos2)
+  {
+    std::swap(entries[pos1], entries[pos2]);
+    positions[entries.at(pos1).index] = pos1;
+    positions[entries.at(pos2).index] = pos2;
+  }
+}
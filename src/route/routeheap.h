@@ -0,0 +1,90 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_ROUTEHEAP_H
+#define LITTLENAVMAP_ROUTEHEAP_H
+
+#include <QVector>
+
+/*
+ * Indexed binary min heap for the route finder. Stores dense node indexes sorted by costs.
+ * Keeps the position of each index in the heap which allows contains in constant time and
+ * changing the costs of an index in O(log n).
+ *
+ * Indexes have to be in the range of 0 to size given in resize (exclusive).
+ */
+class RouteHeap
+{
+public:
+  RouteHeap();
+  ~RouteHeap();
+
+  /* Allow indexes in range 0 to maxIndexes - 1 and remove all entries */
+  void resize(int maxIndexes);
+
+  /* Remove all entries. Runs in O(number of entries). */
+  void clear();
+
+  /* Add index with costs. Index must not be in the heap. */
+  void push(int index, float cost);
+
+  /* Remove and return the index with the lowest costs */
+  int pop();
+
+  /* Change costs for an index that is already in the heap and restore heap order */
+  void change(int index, float cost);
+
+  bool contains(int index) const
+  {
+    return positions.at(index) != -1;
+  }
+
+  /* Costs of index. Index has to be in the heap. */
+  float cost(int index) const
+  {
+    return entries.at(positions.at(index)).cost;
+  }
+
+  bool isEmpty() const
+  {
+    return entries.isEmpty();
+  }
+
+  int size() const
+  {
+    return entries.size();
+  }
+
+private:
+  struct Entry
+  {
+    float cost;
+    int index;
+  };
+
+  void moveUp(int pos);
+  void moveDown(int pos);
+  void swap(int pos1, int pos2);
+
+  /* Binary heap of entries */
+  QVector<Entry> entries;
+
+  /* Maps index to position in entries or -1 if not in heap */
+  QVector<int> positions;
+};
+
+#endif // LITTLENAVMAP_ROUTEHEAP_H
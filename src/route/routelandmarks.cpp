@@ -0,0 +1,279 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "route/routelandmarks.h"
+
+#include "route/routeheap.h"
+#include "route/routenetworkgraph.h"
+#include "geo/pos.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include <algorithm>
+
+using atools::geo::Pos;
+
+// Definition needed since INF is passed by reference
+Q_DECL_CONSTEXPR float RouteLandmarks::INF;
+
+RouteLandmarks::RouteLandmarks()
+{
+}
+
+RouteLandmarks::~RouteLandmarks()
+{
+}
+
+void RouteLandmarks::clear()
+{
+  numLandmarks = 0;
+  numNodes = 0;
+  landmarkIndexes.clear();
+  distances.clear();
+  distances.squeeze();
+}
+
+void RouteLandmarks::loadOrBuild(const RouteNetworkGraph& graph, const QString& filename, qint64 timestamp)
+{
+  clear();
+
+  if(!load(graph, filename, timestamp))
+  {
+    build(graph);
+    save(graph, filename, timestamp);
+  }
+
+  ready.storeRelease(1);
+}
+
+void RouteLandmarks::build(const RouteNetworkGraph& graph)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  clear();
+  numNodes = graph.size();
+  selectLandmarks(graph);
+  numLandmarks = landmarkIndexes.size();
+
+  distances.fill(INF, numNodes * numLandmarks);
+  for(int i = 0; i < numLandmarks; i++)
+  {
+    if(canceled.loadAcquire() == 1)
+    {
+      qDebug() << Q_FUNC_INFO << "canceled";
+      clear();
+      return;
+    }
+    calculateDistances(graph, i);
+  }
+
+  qDebug() << Q_FUNC_INFO << "landmarks" << numLandmarks << "nodes" << numNodes << "in" << timer.elapsed() << "ms";
+}
+
+/* Select landmarks spread over the whole network by picking the node with the largest great circle
+ * distance to all already selected landmarks (farthest point selection) */
+void RouteLandmarks::selectLandmarks(const RouteNetworkGraph& graph)
+{
+  landmarkIndexes.clear();
+
+  // Minimum distance to all selected landmarks for each node or -1 for nodes without edges
+  QVector<float> minDistance(numNodes, -1.f);
+  int start = -1;
+  for(int i = 0; i < numNodes; i++)
+  {
+    if(graph.edgesBegin(i) < graph.edgesEnd(i))
+    {
+      minDistance[i] = INF;
+      if(start == -1)
+        start = i;
+    }
+  }
+
+  if(start == -1)
+    return;
+
+  // Use the node farthest away from an arbitrary start node as first landmark
+  int next = start;
+  for(int round = 0; round <= NUM_LANDMARKS; round++)
+  {
+    const nw::GraphNode& node = graph.nodeAt(next);
+    Pos pos(node.lonx, node.laty);
+
+    if(round > 0)
+      landmarkIndexes.append(next);
+
+    int farthest = -1;
+    float farthestDistance = 0.f;
+    for(int i = 0; i < numNodes; i++)
+    {
+      if(minDistance.at(i) < 0.f)
+        continue;
+
+      const nw::GraphNode& other = graph.nodeAt(i);
+      float dist = pos.distanceMeterTo(Pos(other.lonx, other.laty));
+
+      if(round > 0)
+        minDistance[i] = std::min(minDistance.at(i), dist);
+
+      float compare = round == 0 ? dist : minDistance.at(i);
+      if(compare > farthestDistance)
+      {
+        farthestDistance = compare;
+        farthest = i;
+      }
+    }
+
+    if(farthest == -1)
+      // All nodes are landmarks or in the same position
+      break;
+    next = farthest;
+  }
+}
+
+/* Dijkstra from the landmark using plain edge lengths */
+void RouteLandmarks::calculateDistances(const RouteNetworkGraph& graph, int landmark)
+{
+  RouteHeap heap;
+  heap.resize(numNodes);
+
+  QVector<float> nodeDistances(numNodes, INF);
+  QVector<bool> closed(numNodes, false);
+
+  int landmarkIndex = landmarkIndexes.at(landmark);
+  nodeDistances[landmarkIndex] = 0.f;
+  heap.push(landmarkIndex, 0.f);
+
+  while(!heap.isEmpty())
+  {
+    int current = heap.pop();
+    closed[current] = true;
+
+    const nw::GraphNode& currentNode = graph.nodeAt(current);
+    Pos currentPos(currentNode.lonx, currentNode.laty);
+
+    for(int i = graph.edgesBegin(current); i < graph.edgesEnd(current); i++)
+    {
+      const nw::GraphEdge& edge = graph.edgeAt(i);
+      if(closed.at(edge.toIndex))
+        continue;
+
+      // Use the same length as RouteFinder to keep the estimate a lower bound
+      int lengthMeter = edge.lengthMeter;
+      if(lengthMeter == 0)
+      {
+        const nw::GraphNode& toNode = graph.nodeAt(edge.toIndex);
+        lengthMeter = static_cast<int>(currentPos.distanceMeterTo(Pos(toNode.lonx, toNode.laty)));
+      }
+
+      float dist = nodeDistances.at(current) + lengthMeter;
+      if(dist < nodeDistances.at(edge.toIndex))
+      {
+        if(heap.contains(edge.toIndex))
+          heap.change(edge.toIndex, dist);
+        else
+          heap.push(edge.toIndex, dist);
+        nodeDistances[edge.toIndex] = dist;
+      }
+    }
+  }
+
+  for(int i = 0; i < numNodes; i++)
+    distances[i * numLandmarks + landmark] = nodeDistances.at(i);
+}
+
+bool RouteLandmarks::load(const RouteNetworkGraph& graph, const QString& filename, qint64 timestamp)
+{
+  QFile file(filename);
+  if(!file.exists())
+    return false;
+
+  if(!file.open(QIODevice::ReadOnly))
+  {
+    qWarning() << "Cannot read landmarks" << file.fileName() << ":" << file.errorString();
+    return false;
+  }
+
+  bool valid = false;
+  quint32 magic;
+  quint16 version;
+  QDataStream in(&file);
+  in.setVersion(QDataStream::Qt_5_5);
+  in >> magic;
+
+  if(magic == FILE_MAGIC_NUMBER)
+  {
+    in >> version;
+    if(version == FILE_VERSION)
+    {
+      qint64 fileTimestamp;
+      qint32 fileNumNodes, fileNumEdges, fileNumLandmarks;
+      in >> fileTimestamp >> fileNumNodes >> fileNumEdges >> fileNumLandmarks;
+
+      if(fileTimestamp == timestamp && fileNumNodes == graph.size() && fileNumEdges == graph.sizeEdges() &&
+         fileNumLandmarks > 0 && fileNumLandmarks <= NUM_LANDMARKS)
+      {
+        numNodes = fileNumNodes;
+        numLandmarks = fileNumLandmarks;
+        in >> landmarkIndexes;
+
+        // Distances are stored in native byte order since the file is a local cache only
+        distances.resize(numNodes * numLandmarks);
+        int bytes = distances.size() * static_cast<int>(sizeof(float));
+        valid = in.readRawData(reinterpret_cast<char *>(distances.data()), bytes) == bytes &&
+                landmarkIndexes.size() == numLandmarks && in.status() == QDataStream::Ok;
+      }
+      else
+        qInfo() << "Landmarks" << file.fileName() << "outdated. Rebuilding.";
+    }
+    else
+      qWarning() << "Cannot read landmarks" << file.fileName() << ". Invalid version number:" << version;
+  }
+  else
+    qWarning() << "Cannot read landmarks" << file.fileName() << ". Invalid magic number:" << magic;
+
+  file.close();
+
+  if(!valid)
+    clear();
+  return valid;
+}
+
+void RouteLandmarks::save(const RouteNetworkGraph& graph, const QString& filename, qint64 timestamp) const
+{
+  if(!isValid())
+    return;
+
+  QFile file(filename);
+  if(file.open(QIODevice::WriteOnly))
+  {
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_5);
+
+    out << FILE_MAGIC_NUMBER << FILE_VERSION << timestamp
+        << static_cast<qint32>(graph.size()) << static_cast<qint32>(graph.sizeEdges())
+        << static_cast<qint32>(numLandmarks) << landmarkIndexes;
+    out.writeRawData(reinterpret_cast<const char *>(distances.constData()),
+                     distances.size() * static_cast<int>(sizeof(float)));
+    file.close();
+  }
+  else
+    qWarning() << "Cannot write landmarks" << file.fileName() << ":" << file.errorString();
+}
@@ -0,0 +1,108 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_ROUTELANDMARKS_H
+#define LITTLENAVMAP_ROUTELANDMARKS_H
+
+#include <QAtomicInt>
+#include <QString>
+#include <QVector>
+
+#include <limits>
+
+class RouteNetworkGraph;
+
+/*
+ * Landmark index for the A* landmark heuristic (ALT). Contains the shortest distances from a small set of
+ * landmark nodes to all nodes of a route network graph.
+ *
+ * Distances are calculated on all edges regardless of airway type and altitude restrictions and use the
+ * plain edge length. Since all cost factors in RouteFinder are >= 1 the triangle inequality gives a lower
+ * bound of the remaining costs that can be combined with the great circle estimate.
+ *
+ * The index is saved to a file next to the scenery database and rebuilt if it does not match the graph.
+ *
+ * loadOrBuild is usually called in a background thread. Other threads can use the index once isReady
+ * returns true.
+ */
+class RouteLandmarks
+{
+public:
+  RouteLandmarks();
+  ~RouteLandmarks();
+
+  /* Load index from file if it matches the graph and timestamp. Otherwise calculate it and save it to the file. */
+  void loadOrBuild(const RouteNetworkGraph& graph, const QString& filename, qint64 timestamp);
+
+  /* Stop a running loadOrBuild. The index will not be valid. Thread safe. */
+  void cancel()
+  {
+    canceled.storeRelease(1);
+  }
+
+  /* loadOrBuild is finished. The index might still be invalid if building failed or was canceled. Thread safe. */
+  bool isReady() const
+  {
+    return ready.loadAcquire() == 1;
+  }
+
+  void clear();
+
+  bool isValid() const
+  {
+    return numLandmarks > 0;
+  }
+
+  /* Number of landmarks */
+  int size() const
+  {
+    return numLandmarks;
+  }
+
+  /* Shortest distance in meter from landmark to the node at the given graph index. INF if not reachable. */
+  float distance(int nodeIndex, int landmark) const
+  {
+    return distances.at(nodeIndex * numLandmarks + landmark);
+  }
+
+  /* Value for unreachable nodes */
+  static Q_DECL_CONSTEXPR float INF = std::numeric_limits<float>::max();
+
+private:
+  void build(const RouteNetworkGraph& graph);
+  void selectLandmarks(const RouteNetworkGraph& graph);
+  void calculateDistances(const RouteNetworkGraph& graph, int landmark);
+
+  bool load(const RouteNetworkGraph& graph, const QString& filename, qint64 timestamp);
+  void save(const RouteNetworkGraph& graph, const QString& filename, qint64 timestamp) const;
+
+  static Q_DECL_CONSTEXPR int NUM_LANDMARKS = 16;
+  static Q_DECL_CONSTEXPR quint32 FILE_MAGIC_NUMBER = 0x4C4E4D4C;
+  static Q_DECL_CONSTEXPR quint16 FILE_VERSION = 1;
+
+  int numLandmarks = 0, numNodes = 0;
+
+  /* Graph node indexes of the landmarks */
+  QVector<int> landmarkIndexes;
+
+  /* Ordered by node index then landmark to keep all values for one node together */
+  QVector<float> distances;
+
+  QAtomicInt canceled, ready;
+};
+
+#endif // LITTLENAVMAP_ROUTELANDMARKS_H
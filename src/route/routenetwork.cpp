@@ -17,6 +17,8 @@
 
 #include "routenetwork.h"
 
+#include "route/routelandmarks.h"
+
 #include "sql/sqldatabase.h"
 #include "sql/sqlquery.h"
 #include "sql/sqlrecord.h"
@@ -26,6 +28,11 @@
 #include "geo/rect.h"
 
 #include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDir>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <algorithm>
 
 using atools::sql::SqlDatabase;
 using atools::sql::SqlQuery;
@@ -37,9 +44,9 @@ using namespace nw;
 
 RouteNetwork::RouteNetwork(atools::sql::SqlDatabase *sqlDb, const QString& nodeTableName,
                            const QString& edgeTableName, const QStringList& nodeExtraColumns,
-                           const QStringList& edgeExtraColumns)
-  : db(sqlDb), nodeTable(nodeTableName), edgeTable(edgeTableName), nodeExtraCols(nodeExtraColumns),
-    edgeExtraCols(edgeExtraColumns)
+                           const QStringList& edgeExtraColumns, bool preloadGraph, bool useLandmarks)
+  : db(sqlDb), preload(preloadGraph), landmarks(useLandmarks), nodeTable(nodeTableName), edgeTable(edgeTableName),
+    nodeExtraCols(nodeExtraColumns), edgeExtraCols(edgeExtraColumns)
 {
   nodeCache.reserve(60000);
   destinationNodePredecessors.reserve(1000);
@@ -47,6 +54,26 @@ RouteNetwork::RouteNetwork(atools::sql::SqlDatabase *sqlDb, const QString& nodeT
   initQueries();
 }
 
+RouteNetwork::RouteNetwork(const QSharedPointer<const RouteNetworkGraph>& sharedGraph,
+                           const QSharedPointer<RouteLandmarks>& sharedLandmarks)
+  : db(nullptr), graph(sharedGraph), landmarkIndex(sharedLandmarks)
+{
+  nodeCache.reserve(100);
+  destinationNodePredecessors.reserve(1000);
+  airwayRouting = mode & nw::ROUTE_JET || mode & nw::ROUTE_VICTOR;
+}
+
+QSharedPointer<const RouteNetworkGraph> RouteNetwork::getSharedGraph()
+{
+  if(isGraphLoaded())
+    return graph;
+
+  // Load a separate graph without changing the lazy behavior of this network
+  QSharedPointer<RouteNetworkGraph> loadedGraph(new RouteNetworkGraph);
+  loadedGraph->load(db, nodeTable, edgeTable, nodeExtraCols, edgeExtraCols);
+  return loadedGraph;
+}
+
 RouteNetwork::~RouteNetwork()
 {
   deInitQueries();
@@ -55,7 +82,12 @@ RouteNetwork::~RouteNetwork()
 int RouteNetwork::getNumberOfNodesDatabase()
 {
   if(numNodesDb == -1)
-    numNodesDb = atools::sql::SqlUtil(db).rowCount(nodeTable);
+  {
+    if(isGraphLoaded())
+      numNodesDb = graph->size();
+    else
+      numNodesDb = atools::sql::SqlUtil(db).rowCount(nodeTable);
+  }
   return numNodesDb;
 }
 
@@ -64,6 +96,41 @@ int RouteNetwork::getNumberOfNodesCache() const
   return nodeCache.size();
 }
 
+int RouteNetwork::getNumberOfNodeIndexes()
+{
+  if(maxNodeIdDb == -1)
+  {
+    if(isGraphLoaded())
+      // Index into the graph node array
+      maxNodeIdDb = graph->size() - 1;
+    else
+    {
+      // Database ids are dense enough to be used as index
+      SqlQuery query(db);
+      query.exec("select max(node_id) from " + nodeTable);
+      maxNodeIdDb = query.next() ? query.value(0).toInt() : 0;
+      query.finish();
+    }
+  }
+
+  // Add departure and destination
+  return maxNodeIdDb + 3;
+}
+
+int RouteNetwork::getNodeIndex(int id)
+{
+  int size = getNumberOfNodeIndexes();
+
+  if(id == DEPARTURE_NODE_ID)
+    return size - 2;
+  else if(id == DESTINATION_NODE_ID)
+    return size - 1;
+  else if(isGraphLoaded())
+    return graph->indexOf(id);
+  else
+    return id >= 0 && id < size - 2 ? id : -1;
+}
+
 void RouteNetwork::setMode(nw::Modes routeMode)
 {
   mode = routeMode;
@@ -75,8 +142,11 @@ void RouteNetwork::clearStartAndDestinationNodes()
   departurePos = atools::geo::EMPTY_POS;
   destinationPos = atools::geo::EMPTY_POS;
   nodeCache.clear();
+  nodeCacheGrid.clear();
   destinationNodePredecessors.clear();
+  destLandmarkDistances.clear();
   numNodesDb = -1;
+  maxNodeIdDb = -1;
   nodeIndexesCreated = false;
   edgeIndexesCreated = false;
   nodeCache.reserve(60000);
@@ -86,21 +156,16 @@ void RouteNetwork::clearStartAndDestinationNodes()
 void RouteNetwork::getNeighbours(const nw::Node& from, QVector<nw::Node>& neighbours,
                                  QVector<Edge>& edges)
 {
-  for(const Edge& e : from.edges)
+  if(isGraphLoaded() && from.id >= 0)
   {
-    bool add = false;
-
-    // Handle airways differently to keep cache for low and high alt routes together
-    if(e.type == AIRWAY_BOTH)
-      add = mode & ROUTE_JET || mode & ROUTE_VICTOR;
-    else if(e.type == AIRWAY_JET)
-      add = mode & ROUTE_JET;
-    else if(e.type == AIRWAY_VICTOR)
-      add = mode & ROUTE_VICTOR;
-    else
-      add = true;
+    // Not a virtual node - read directly from the in-memory network
+    graphNeighbours(from, neighbours, edges);
+    return;
+  }
 
-    if(add)
+  for(const Edge& e : from.edges)
+  {
+    if(testEdgeType(e.type))
     {
       // Add nodes and edges only if they match airway mode
       neighbours.append(fetchNode(e.toNodeId));
@@ -109,6 +174,92 @@ void RouteNetwork::getNeighbours(const nw::Node& from, QVector<nw::Node>& neighb
   }
 }
 
+/* Get all adjacent nodes for the given node from the in-memory network including the virtual destination */
+void RouteNetwork::graphNeighbours(const nw::Node& from, QVector<nw::Node>& neighbours, QVector<nw::Edge>& edges)
+{
+  int index = graph->indexOf(from.id);
+  if(index == -1)
+    return;
+
+  for(int i = graph->edgesBegin(index); i < graph->edgesEnd(index); i++)
+  {
+    const nw::GraphEdge& graphEdge = graph->edgeAt(i);
+    const nw::GraphNode& toNode = graph->nodeAt(graphEdge.toIndex);
+
+    if(testEdgeType(static_cast<nw::EdgeType>(graphEdge.type)) &&
+       testType(static_cast<nw::NodeType>(toNode.type)))
+    {
+      Edge edge;
+      edge.toNodeId = toNode.id;
+      edge.lengthMeter = graphEdge.lengthMeter;
+      edge.minAltFt = graphEdge.minAltFt;
+      edge.airwayId = graphEdge.airwayId;
+      edge.type = static_cast<nw::EdgeType>(graphEdge.type);
+      edge.airwayName = graph->airwayName(graphEdge.airwayNameIndex);
+
+      neighbours.append(graphNode(graphEdge.toIndex));
+      edges.append(edge);
+    }
+  }
+
+  if(destinationNodePredecessors.contains(from.id))
+  {
+    // Near destination - add virtual edge
+    neighbours.append(nodeCache.value(DESTINATION_NODE_ID));
+    edges.append(Edge(DESTINATION_NODE_ID, static_cast<int>(from.pos.distanceMeterTo(destinationPos))));
+  }
+}
+
+/* Create a node without edges from the in-memory network */
+nw::Node RouteNetwork::graphNode(int index) const
+{
+  const nw::GraphNode& loaded = graph->nodeAt(index);
+  Node node;
+  node.id = loaded.id;
+  node.range = loaded.range;
+  node.pos = Pos(loaded.lonx, loaded.laty);
+
+  if(airwayRouting)
+  {
+    node.type = static_cast<nw::NodeType>(loaded.type >> 4);
+    node.subtype = static_cast<nw::NodeType>(loaded.type & 0x0f);
+  }
+  else
+    node.type = static_cast<nw::NodeType>(loaded.type);
+  return node;
+}
+
+/* Get indexes of all nodes from the in-memory network that are inside the rectangle and usable for the mode */
+void RouteNetwork::graphNearestNodes(const atools::geo::Rect& rect, QVector<int>& indexes)
+{
+  QVector<int> found;
+  graph->nodesInRect(rect, found);
+
+  for(int index : found)
+  {
+    if(testType(static_cast<nw::NodeType>(graph->nodeAt(index).type)))
+      indexes.append(index);
+  }
+}
+
+/* Get ids of all cached database nodes in the grid cells covered by the rectangle */
+void RouteNetwork::cachedNearestNodes(const atools::geo::Rect& rect, QVector<int>& ids) const
+{
+  QVector<int> cells;
+  RouteNetworkGraph::gridCells(rect, cells);
+  for(int cell : cells)
+    ids.append(nodeCacheGrid.value(cell));
+}
+
+/* Add node to cache and grid index */
+void RouteNetwork::cacheNode(const nw::Node& node)
+{
+  nodeCache.insert(node.id, node);
+
+  if(node.id >= 0)
+    nodeCacheGrid[RouteNetworkGraph::gridCell(node.pos.getLonX(), node.pos.getLatY())].append(node.id);
+}
+
 void RouteNetwork::addDepartureAndDestinationNodes(const atools::geo::Pos& from, const atools::geo::Pos& to)
 {
   qDebug() << "adding start and  destination to network";
@@ -129,9 +280,26 @@ void RouteNetwork::addDepartureAndDestinationNodes(const atools::geo::Pos& from,
     // Will use the bounding rectangle to add any neighbor nodes to dest
     fetchNode(to.getLonX(), to.getLatY(), false, DESTINATION_NODE_ID);
 
-    for(int id : nodeCache.keys())
-      // Fill destination node predecessor index
-      addDestNodeEdges(nodeCache[id]);
+    // Fill destination node predecessor index - only cached nodes near the destination can get an edge
+    QVector<int> ids;
+    cachedNearestNodes(destinationNodeRect, ids);
+    ids.append(DEPARTURE_NODE_ID);
+    for(int id : ids)
+    {
+      if(nodeCache.contains(id))
+        addDestNodeEdges(nodeCache[id]);
+    }
+
+    if(isGraphLoaded())
+    {
+      // Remember all nodes near destination - virtual edges are added in getNeighbours
+      QVector<int> indexes;
+      graphNearestNodes(destinationNodeRect, indexes);
+      for(int index : indexes)
+        destinationNodePredecessors.insert(graph->nodeAt(index).id);
+
+      updateDestLandmarkDistances();
+    }
   }
 
   if(departurePos != from)
@@ -142,6 +310,62 @@ void RouteNetwork::addDepartureAndDestinationNodes(const atools::geo::Pos& from,
   qDebug() << "adding start and  destination to network done";
 }
 
+/* Calculate the landmark distances to the virtual destination node using the virtual edges from all predecessors */
+void RouteNetwork::updateDestLandmarkDistances()
+{
+  destLandmarkDistances.clear();
+
+  const RouteLandmarks *landmarks = readyLandmarks();
+  if(landmarks == nullptr)
+    // Use great circle estimate only until the index is ready
+    return;
+
+  const RouteLandmarks& index = *landmarks;
+  destLandmarkDistances.fill(RouteLandmarks::INF, index.size());
+  for(int id : destinationNodePredecessors)
+  {
+    int nodeIndex = graph->indexOf(id);
+    const nw::GraphNode& node = graph->nodeAt(nodeIndex);
+
+    // Same length as the virtual edge in graphNeighbours
+    int lengthMeter = static_cast<int>(Pos(node.lonx, node.laty).distanceMeterTo(destinationPos));
+
+    for(int l = 0; l < index.size(); l++)
+    {
+      float dist = index.distance(nodeIndex, l);
+      if(dist < RouteLandmarks::INF)
+        destLandmarkDistances[l] = std::min(destLandmarkDistances.at(l), dist + lengthMeter);
+    }
+  }
+}
+
+float RouteNetwork::landmarkEstimate(int nodeIndex) const
+{
+  // Virtual departure and destination nodes are outside of the graph index range
+  if(destLandmarkDistances.isEmpty() || nodeIndex < 0 || nodeIndex >= graph->size())
+    return 0.f;
+
+  // Triangle inequality: dist(node, dest) >= dist(landmark, dest) - dist(landmark, node)
+  // Index is ready if destLandmarkDistances is not empty
+  const RouteLandmarks& index = *landmarkIndex;
+  float estimate = 0.f;
+  for(int l = 0; l < destLandmarkDistances.size(); l++)
+  {
+    float destDist = destLandmarkDistances.at(l), nodeDist = index.distance(nodeIndex, l);
+    if(destDist < RouteLandmarks::INF && nodeDist < RouteLandmarks::INF)
+      estimate = std::max(estimate, destDist - nodeDist);
+  }
+  return estimate;
+}
+
+const RouteLandmarks *RouteNetwork::readyLandmarks() const
+{
+  if(!landmarkIndex.isNull() && landmarkIndex->isReady() && landmarkIndex->isValid() && isGraphLoaded())
+    return landmarkIndex.data();
+  else
+    return nullptr;
+}
+
 nw::Node RouteNetwork::getDepartureNode() const
 {
   return nodeCache.value(DEPARTURE_NODE_ID);
@@ -182,7 +406,8 @@ void RouteNetwork::cleanDestNodeEdges()
       else
         edges.erase(it, edges.end());
     }
-    else
+    else if(!isGraphLoaded())
+      // Nodes from the in-memory network are not cached and get their virtual edges in getNeighbours
       qWarning() << "No node destination found" << nodeCache.value(i).id;
   }
 
@@ -247,6 +472,21 @@ void RouteNetwork::getNavIdAndTypeForNode(int nodeId, int& navId, nw::NodeType&
     type = DESTINATION;
     navId = -1; // No database id available
   }
+  else if(isGraphLoaded())
+  {
+    int index = graph->indexOf(nodeId);
+    if(index != -1)
+    {
+      const nw::GraphNode& node = graph->nodeAt(index);
+      navId = node.navId;
+      type = static_cast<nw::NodeType>(airwayRouting ? node.type >> 4 : node.type);
+    }
+    else
+    {
+      navId = -1;
+      type = nw::NONE;
+    }
+  }
   else
   {
     nodeNavIdAndTypeQuery->bindValue(":id", nodeId);
@@ -301,17 +541,30 @@ nw::Node RouteNetwork::fetchNode(float lonx, float laty, bool loadSuccessors, in
     QSet<Edge> tempEdges;
     tempEdges.reserve(1000);
 
-    for(const Rect& rect : queryRect.splitAtAntiMeridian())
+    if(isGraphLoaded())
     {
-      bindCoordRect(rect, nearestNodesQuery);
-      nearestNodesQuery->exec();
-      while(nearestNodesQuery->next())
+      QVector<int> indexes;
+      graphNearestNodes(queryRect, indexes);
+      for(int index : indexes)
       {
-        int nodeId = nearestNodesQuery->value("node_id").toInt();
-        if(testType(static_cast<nw::NodeType>(nearestNodesQuery->value("type").toInt())))
+        const nw::GraphNode& other = graph->nodeAt(index);
+        tempEdges.insert(Edge(other.id, static_cast<int>(node.pos.distanceMeterTo(Pos(other.lonx, other.laty)))));
+      }
+    }
+    else
+    {
+      for(const Rect& rect : queryRect.splitAtAntiMeridian())
+      {
+        bindCoordRect(rect, nearestNodesQuery);
+        nearestNodesQuery->exec();
+        while(nearestNodesQuery->next())
         {
-          Pos otherPos(nearestNodesQuery->value("lonx").toFloat(), nearestNodesQuery->value("laty").toFloat());
-          tempEdges.insert(Edge(nodeId, static_cast<int>(node.pos.distanceMeterTo(otherPos))));
+          int nodeId = nearestNodesQuery->value("node_id").toInt();
+          if(testType(static_cast<nw::NodeType>(nearestNodesQuery->value("type").toInt())))
+          {
+            Pos otherPos(nearestNodesQuery->value("lonx").toFloat(), nearestNodesQuery->value("laty").toFloat());
+            tempEdges.insert(Edge(nodeId, static_cast<int>(node.pos.distanceMeterTo(otherPos))));
+          }
         }
       }
     }
@@ -332,6 +585,13 @@ nw::Node RouteNetwork::fetchNode(int id)
   if(nodeCache.contains(id))
     return nodeCache.value(id);
 
+  if(isGraphLoaded())
+  {
+    // Nodes from the in-memory network are not cached
+    int index = graph->indexOf(id);
+    return index != -1 ? graphNode(index) : nw::Node();
+  }
+
   nodeByIdQuery->bindValue(":id", id);
   nodeByIdQuery->exec();
   nw::Node node;
@@ -369,7 +629,7 @@ nw::Node RouteNetwork::fetchNode(int id)
     node.edges = tempEdges.values().toVector();
     addDestNodeEdges(node);
 
-    nodeCache.insert(node.id, node);
+    cacheNode(node);
   }
   nodeByIdQuery->finish();
   return node;
@@ -409,12 +669,52 @@ void RouteNetwork::initQueries()
   edgeFromQuery->prepare(
     "select " + edgeCols + " from_node_id, from_node_type from " + edgeTable +
     " where to_node_id = :id");
+
+  if(preload)
+  {
+    QSharedPointer<RouteNetworkGraph> loadedGraph(new RouteNetworkGraph);
+    if(loadedGraph->load(db, nodeTable, edgeTable, nodeExtraCols, edgeExtraCols))
+    {
+      graph = loadedGraph;
+
+      if(landmarks)
+      {
+        // Keep the index next to the database and rebuild it if the database changes
+        QFileInfo dbFile(db->databaseName());
+        QString filename = dbFile.dir().filePath(dbFile.completeBaseName() + "_" + nodeTable + ".landmarks");
+        qint64 timestamp = dbFile.lastModified().toMSecsSinceEpoch();
+
+        // Building can take a few seconds on large databases - do it in background and keep the graph alive
+        QSharedPointer<RouteLandmarks> index(new RouteLandmarks);
+        QSharedPointer<const RouteNetworkGraph> indexGraph = graph;
+        landmarkIndex = index;
+        landmarkFuture = QtConcurrent::run([index, indexGraph, filename, timestamp]() -> void
+                                           {
+                                             index->loadOrBuild(*indexGraph, filename, timestamp);
+                                           });
+      }
+    }
+  }
 }
 
 void RouteNetwork::deInitQueries()
 {
   clearStartAndDestinationNodes();
 
+  if(db != nullptr)
+  {
+    // Keep the graph and landmarks for memory only networks
+    graph.reset();
+
+    if(!landmarkIndex.isNull())
+    {
+      // Stop building the index since the database is about to change
+      landmarkIndex->cancel();
+      landmarkFuture.waitForFinished();
+      landmarkIndex.reset();
+    }
+  }
+
   delete nodeByNavIdQuery;
   nodeByNavIdQuery = nullptr;
 
@@ -526,6 +826,20 @@ void RouteNetwork::updateEdgeIndexes(const atools::sql::SqlRecord& rec)
   }
 }
 
+/* Check if the edge type is usable for the current mode */
+bool RouteNetwork::testEdgeType(nw::EdgeType type)
+{
+  // Handle airways differently to keep cache for low and high alt routes together
+  if(type == AIRWAY_BOTH)
+    return mode & ROUTE_JET || mode & ROUTE_VICTOR;
+  else if(type == AIRWAY_JET)
+    return mode & ROUTE_JET;
+  else if(type == AIRWAY_VICTOR)
+    return mode & ROUTE_VICTOR;
+  else
+    return true;
+}
+
 /* Check if the node type is part of the network and usable for the current mode */
 bool RouteNetwork::testType(nw::NodeType type)
 {
@@ -20,8 +20,12 @@
 
 #include "common/maptypes.h"
 #include "geo/calculations.h"
+#include "route/routenetworkgraph.h"
 
+#include <QFuture>
 #include <QHash>
+#include <QSet>
+#include <QSharedPointer>
 #include <QVector>
 
 namespace  atools {
@@ -36,6 +40,8 @@ class Rect;
 }
 }
 
+class RouteLandmarks;
+
 namespace nw {
 
 /* Network mode. Changes some internal behavior of the network. */
@@ -156,6 +162,17 @@ Q_DECLARE_TYPEINFO(nw::Edge, Q_MOVABLE_TYPE);
 /*
  * Routing network that loads and caches nodes and edges from the database.
  * Allows to resolve relations between objects and walk through the network.
+ *
+ * Nodes are either fetched lazily from the database when needed or, if preloading is enabled,
+ * the whole network is loaded once into a RouteNetworkGraph when initializing the queries.
+ * The node cache contains only the virtual departure and destination nodes in the latter case.
+ *
+ * The graph is read only and can be shared between several networks. Each network keeps its own
+ * departure and destination nodes. Memory only networks sharing a graph can be used concurrently
+ * in different threads (one network per thread).
+ *
+ * A landmark index can be built for the graph which allows a better cost estimate for the A* search.
+ * The index is loaded or built in a background thread. The plain great circle estimate is used until it is ready.
  */
 class RouteNetwork
 {
@@ -167,19 +184,38 @@ public:
    * @param edgeTableName Where edges are loaded from
    * @param nodeExtraColumns Extra columns that are loaded with the nodes
    * @param edgeExtraColumns Extra columns that are loaded with the edges
+   * @param preloadGraph Load the whole network into memory in initQueries instead of fetching nodes on demand
+   * @param useLandmarks Load or build the landmark index for a preloaded graph in background. The index is
+   * stored next to the database file.
    */
   RouteNetwork(atools::sql::SqlDatabase *sqlDb, const QString& nodeTableName,
                const QString& edgeTableName, const QStringList& nodeExtraColumns,
-               const QStringList& edgeExtraColumns);
+               const QStringList& edgeExtraColumns, bool preloadGraph = false, bool useLandmarks = false);
+
+  /* Create a memory only network that uses the shared graph and landmarks and does not access the database.
+   * Mode has to be set before use. */
+  explicit RouteNetwork(const QSharedPointer<const RouteNetworkGraph>& sharedGraph,
+                        const QSharedPointer<RouteLandmarks>& sharedLandmarks = QSharedPointer<RouteLandmarks>());
+
   virtual ~RouteNetwork();
 
+  /* Get the in-memory graph. Loads a new graph from the database which is not used by this network
+   * if preloading is disabled. Has to be called in the thread owning the database. */
+  QSharedPointer<const RouteNetworkGraph> getSharedGraph();
+
+  /* Get the landmark index for the graph which might be still loading. null if landmarks are not used. */
+  const QSharedPointer<RouteLandmarks>& getSharedLandmarks() const
+  {
+    return landmarkIndex;
+  }
+
   /* Get the navaid id and type for the given network node id. */
   void getNavIdAndTypeForNode(int nodeId, int& navId, nw::NodeType& type);
 
-  /* Set up and prepare all queries */
+  /* Set up and prepare all queries. Loads the whole network if preloading is enabled. */
   void initQueries();
 
-  /* Disconnect queries from database and remove departure and destination nodes */
+  /* Disconnect queries from database, remove departure and destination nodes and unload the network */
   void deInitQueries();
 
   /* Get all adjacent nodes and attached edges for the given node */
@@ -203,6 +239,13 @@ public:
   /* Number of nodes in the memory cache */
   int getNumberOfNodesCache() const;
 
+  /* Get a dense index in the range 0 to getNumberOfNodeIndexes() - 1 for a node id including the virtual
+   * departure and destination nodes. Returns -1 if the id is not part of the network. */
+  int getNodeIndex(int id);
+
+  /* Size needed for arrays that are accessed by getNodeIndex */
+  int getNumberOfNodeIndexes();
+
   /* true if mode is either ROUTE_VICTOR, ROUTE_JET  or both flags */
   bool isAirwayRouting() const
   {
@@ -212,6 +255,28 @@ public:
   /* Sets the route mode. This will change some internal behavior like checking subtypes and more */
   void setMode(nw::Modes routeMode);
 
+  nw::Modes getMode() const
+  {
+    return mode;
+  }
+
+  /* Ids of all nodes having a virtual edge to the destination node */
+  const QSet<int>& getDestinationPredecessors() const
+  {
+    return destinationNodePredecessors;
+  }
+
+  /* Lower bound in meter for the distance from the node at the given index (see getNodeIndex)
+   * to the destination node. Uses the landmark index and returns 0 if no index is available or
+   * the index was not ready when the destination was added. */
+  float landmarkEstimate(int nodeIndex) const;
+
+  /* true if the whole network was loaded into memory */
+  bool isGraphLoaded() const
+  {
+    return !graph.isNull() && graph->isLoaded();
+  }
+
 private:
   void clearStartAndDestinationNodes();
 
@@ -219,11 +284,23 @@ private:
   nw::Node fetchNode(int id);
   nw::Node fetchNode(float lonx, float laty, bool loadSuccessors, int id);
 
+  /* Create a node without edges from the in-memory graph */
+  nw::Node graphNode(int index) const;
+  void graphNeighbours(const nw::Node& from, QVector<nw::Node>& neighbours, QVector<nw::Edge>& edges);
+  void graphNearestNodes(const atools::geo::Rect& rect, QVector<int>& indexes);
+  void cachedNearestNodes(const atools::geo::Rect& rect, QVector<int>& ids) const;
+  void cacheNode(const nw::Node& node);
+
   void addDestNodeEdges(nw::Node& node);
+  void updateDestLandmarkDistances();
+
+  /* Landmark index if finished loading and valid. Otherwise null. */
+  const RouteLandmarks *readyLandmarks() const;
   void cleanDestNodeEdges();
 
   void bindCoordRect(const atools::geo::Rect& rect, atools::sql::SqlQuery *query);
   bool testType(nw::NodeType type);
+  bool testEdgeType(nw::EdgeType type);
   nw::Node createNode(const atools::sql::SqlRecord& rec);
   nw::Edge createEdge(const atools::sql::SqlRecord& rec, int toNodeId);
 
@@ -241,6 +318,9 @@ private:
   /* Cache the number of nodes in the database */
   int numNodesDb = -1;
 
+  /* Cache the highest node id in the database. Used as index base for the virtual nodes if not preloaded. */
+  int maxNodeIdDb = -1;
+
   atools::sql::SqlQuery *nodeByNavIdQuery = nullptr, *nodeNavIdAndTypeQuery = nullptr,
   *nearestNodesQuery = nullptr, *nodeByIdQuery = nullptr, *edgeToQuery = nullptr,
   *edgeFromQuery = nullptr;
@@ -255,9 +335,24 @@ private:
   atools::sql::SqlDatabase *db;
   nw::Modes mode;
 
-  /* Cache for nodes (also containing edges) for the whole network. Filled on demand. */
+  /* Cache for nodes (also containing edges) for the whole network. Filled on demand.
+   * Contains only departure and destination if the graph is preloaded. */
   QHash<int, nw::Node> nodeCache;
 
+  /* Ids of cached database nodes by RouteNetworkGraph::gridCell. Used to find cached nodes near the destination. */
+  QHash<int, QVector<int> > nodeCacheGrid;
+
+  /* Whole network if preloading is enabled. Shared and read only. */
+  QSharedPointer<const RouteNetworkGraph> graph;
+  bool preload = false, landmarks = false;
+
+  /* Landmark index filled in background by landmarkFuture. Shared with memory only networks. */
+  QSharedPointer<RouteLandmarks> landmarkIndex;
+  QFuture<void> landmarkFuture;
+
+  /* Shortest distance from each landmark to the destination or INF if not reachable */
+  QVector<float> destLandmarkDistances;
+
   /* Database tables and extra columns */
   QString nodeTable, edgeTable;
   QStringList nodeExtraCols, edgeExtraCols;
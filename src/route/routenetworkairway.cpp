@@ -19,9 +19,9 @@
 
 #include "sql/sqldatabase.h"
 
-RouteNetworkAirway::RouteNetworkAirway(atools::sql::SqlDatabase *sqlDb)
+RouteNetworkAirway::RouteNetworkAirway(atools::sql::SqlDatabase *sqlDb, bool preloadGraph, bool useLandmarks)
   : RouteNetwork(sqlDb, "route_node_airway", "route_edge_airway", {},
-                 {"type", "minimum_altitude", "airway_id", "airway_name"})
+                 {"type", "minimum_altitude", "airway_id", "airway_name"}, preloadGraph, useLandmarks)
 {
 }
 
@@ -31,7 +31,7 @@ class RouteNetworkAirway :
   public RouteNetwork
 {
 public:
-  RouteNetworkAirway(atools::sql::SqlDatabase *sqlDb);
+  RouteNetworkAirway(atools::sql::SqlDatabase *sqlDb, bool preloadGraph = false, bool useLandmarks = false);
   virtual ~RouteNetworkAirway();
 
 };
@@ -0,0 +1,112 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "route/routenetworkbenchmark.h"
+
+#include "route/routefinder.h"
+#include "route/routenetworkairway.h"
+#include "route/routenetworkradio.h"
+#include "geo/pos.h"
+
+#include <QElapsedTimer>
+
+using atools::geo::Pos;
+
+namespace {
+struct CityPair
+{
+  QString name;
+  Pos from, to;
+};
+
+/* Fixed set of short, medium and long haul airport pairs */
+const QVector<CityPair> CITY_PAIRS(
+{
+  {"EDDF-EDDM", Pos(8.5706f, 50.0333f), Pos(11.7861f, 48.3538f)},
+  {"LEMD-EGLL", Pos(-3.5676f, 40.4719f), Pos(-0.4614f, 51.4775f)},
+  {"KORD-KATL", Pos(-87.9048f, 41.9786f), Pos(-84.4281f, 33.6367f)},
+  {"KSFO-KLAX", Pos(-122.375f, 37.619f), Pos(-118.4081f, 33.9425f)},
+  {"EDDF-KJFK", Pos(8.5706f, 50.0333f), Pos(-73.7789f, 40.6398f)},
+  {"EGLL-KLAX", Pos(-0.4614f, 51.4775f), Pos(-118.4081f, 33.9425f)},
+  {"LFPG-RJTT", Pos(2.55f, 49.0097f), Pos(139.7798f, 35.5533f)},
+  {"WSSS-YSSY", Pos(103.9940f, 1.3502f), Pos(151.1772f, -33.9461f)},
+  {"PHNL-KSFO", Pos(-157.9224f, 21.3187f), Pos(-122.375f, 37.619f)}
+});
+
+}
+
+RouteNetworkBenchmark::RouteNetworkBenchmark(atools::sql::SqlDatabase *sqlDb)
+  : db(sqlDb)
+{
+}
+
+RouteNetworkBenchmark::~RouteNetworkBenchmark()
+{
+}
+
+void RouteNetworkBenchmark::run()
+{
+  qInfo() << Q_FUNC_INFO << "Starting route network benchmark";
+
+  QElapsedTimer timer;
+  for(bool preload : {false, true})
+  {
+    QString prefix = preload ? "preloaded" : "lazy";
+
+    timer.start();
+    RouteNetworkRadio radioNetwork(db, preload);
+    RouteNetworkAirway airwayNetwork(db, preload);
+    qInfo() << prefix << "network init" << timer.elapsed() << "ms";
+
+    qint64 total = runPairs(&radioNetwork, nw::ROUTE_RADIONAV, prefix + " radionav");
+    total += runPairs(&airwayNetwork, nw::ROUTE_VICTOR, prefix + " victor");
+    total += runPairs(&airwayNetwork, nw::ROUTE_JET, prefix + " jet");
+
+    qInfo() << prefix << "total" << total << "ms";
+  }
+  qInfo() << Q_FUNC_INFO << "Route network benchmark done";
+}
+
+qint64 RouteNetworkBenchmark::runPairs(RouteNetwork *network, nw::Modes mode, const QString& name)
+{
+  qint64 total = 0;
+  network->setMode(mode);
+
+  for(const CityPair& pair : CITY_PAIRS)
+  {
+    QElapsedTimer timer;
+    timer.start();
+
+    RouteFinder finder(network);
+    bool found = finder.calculateRoute(pair.from, pair.to, 0);
+
+    QVector<rf::RouteEntry> route;
+    float distanceMeter = 0.f;
+    if(found)
+      finder.extractRoute(route, distanceMeter);
+
+    qint64 elapsed = timer.elapsed();
+    total += elapsed;
+
+    qInfo().noquote().nospace() << name << " " << pair.name << ": found " << found
+                                << ", waypoints " << route.size()
+                                << ", distance " << atools::geo::meterToNm(distanceMeter) << " nm"
+                                << ", " << elapsed << " ms";
+  }
+  qInfo().noquote().nospace() << name << " all pairs " << total << " ms";
+  return total;
+}
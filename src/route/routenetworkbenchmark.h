@@ -0,0 +1,51 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_ROUTENETWORKBENCHMARK_H
+#define LITTLENAVMAP_ROUTENETWORKBENCHMARK_H
+
+#include "route/routenetwork.h"
+
+namespace  atools {
+namespace sql {
+class SqlDatabase;
+}
+}
+
+/*
+ * Calculates routes for a fixed set of city pairs using the lazy loading network and the preloaded
+ * in-memory network and prints the timing results to the log.
+ *
+ * Enabled by DEBUG_ROUTE_NETWORK_BENCHMARK in constants.h.
+ */
+class RouteNetworkBenchmark
+{
+public:
+  RouteNetworkBenchmark(atools::sql::SqlDatabase *sqlDb);
+  ~RouteNetworkBenchmark();
+
+  /* Run all city pairs for radio navaid, low and high altitude routing for both networks */
+  void run();
+
+private:
+  /* Calculate all city pairs in the given mode and return total time in milliseconds */
+  qint64 runPairs(RouteNetwork *network, nw::Modes mode, const QString& name);
+
+  atools::sql::SqlDatabase *db;
+};
+
+#endif // LITTLENAVMAP_ROUTENETWORKBENCHMARK_H
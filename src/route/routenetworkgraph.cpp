@@ -0,0 +1,319 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#include "route/routenetworkgraph.h"
+
+#include "sql/sqldatabase.h"
+#include "sql/sqlquery.h"
+#include "sql/sqlrecord.h"
+#include "geo/rect.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+
+#include <algorithm>
+
+using atools::sql::SqlDatabase;
+using atools::sql::SqlQuery;
+using atools::sql::SqlRecord;
+using atools::geo::Rect;
+using nw::GraphNode;
+using nw::GraphEdge;
+
+namespace {
+/* Temporary edge used while loading. Refers to nodes by index. */
+struct LoadEdge
+{
+  int fromIndex, toIndex, lengthMeter, minAltFt, airwayId, airwayNameIndex, type;
+};
+
+}
+
+RouteNetworkGraph::RouteNetworkGraph()
+{
+}
+
+RouteNetworkGraph::~RouteNetworkGraph()
+{
+}
+
+void RouteNetworkGraph::clear()
+{
+  nodes.clear();
+  nodes.squeeze();
+  edgeOffsets.clear();
+  edgeOffsets.squeeze();
+  edges.clear();
+  edges.squeeze();
+  idToIndex.clear();
+  idToIndex.squeeze();
+  airwayNames.clear();
+  airwayNames.squeeze();
+  gridOffsets.clear();
+  gridOffsets.squeeze();
+  gridNodes.clear();
+  gridNodes.squeeze();
+}
+
+bool RouteNetworkGraph::load(SqlDatabase *db, const QString& nodeTable, const QString& edgeTable,
+                             const QStringList& nodeExtraColumns, const QStringList& edgeExtraColumns)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  clear();
+
+  // Load nodes ==============================================================
+  QString nodeCols = nodeExtraColumns.join(",");
+  if(!nodeExtraColumns.isEmpty())
+    nodeCols.append(", ");
+
+  SqlQuery nodeQuery(db);
+  nodeQuery.exec("select " + nodeCols + " node_id, nav_id, type, lonx, laty from " + nodeTable +
+                 " order by node_id");
+
+  int nodeIdIndex = -1, navIdIndex = -1, typeIndex = -1, rangeIndex = -1, lonxIndex = -1, latyIndex = -1;
+  int maxNodeId = -1;
+  while(nodeQuery.next())
+  {
+    if(nodeIdIndex == -1)
+    {
+      // Update index caches to avoid string lookups in SqlRecord
+      SqlRecord rec = nodeQuery.record();
+      nodeIdIndex = rec.indexOf("node_id");
+      navIdIndex = rec.indexOf("nav_id");
+      typeIndex = rec.indexOf("type");
+      rangeIndex = rec.contains("range") ? rec.indexOf("range") : -1;
+      lonxIndex = rec.indexOf("lonx");
+      latyIndex = rec.indexOf("laty");
+    }
+
+    GraphNode node;
+    node.id = nodeQuery.value(nodeIdIndex).toInt();
+    node.navId = nodeQuery.value(navIdIndex).toInt();
+    node.type = nodeQuery.value(typeIndex).toInt();
+    node.range = rangeIndex != -1 ? nodeQuery.value(rangeIndex).toInt() : 0;
+    node.lonx = nodeQuery.value(lonxIndex).toFloat();
+    node.laty = nodeQuery.value(latyIndex).toFloat();
+
+    if(node.id < 0 || node.id > MAX_NODE_ID)
+    {
+      qWarning() << Q_FUNC_INFO << "Node id out of range" << node.id << "in" << nodeTable;
+      clear();
+      return false;
+    }
+
+    maxNodeId = std::max(maxNodeId, node.id);
+    nodes.append(node);
+  }
+  nodeQuery.finish();
+
+  idToIndex.fill(-1, maxNodeId + 1);
+  for(int i = 0; i < nodes.size(); i++)
+    idToIndex[nodes.at(i).id] = i;
+
+  // Load edges ==============================================================
+  QString edgeCols = edgeExtraColumns.join(",");
+  if(!edgeExtraColumns.isEmpty())
+    edgeCols.append(", ");
+
+  SqlQuery edgeQuery(db);
+  edgeQuery.exec("select " + edgeCols + " from_node_id, to_node_id from " + edgeTable);
+
+  int fromIdIndex = -1, toIdIndex = -1, edgeTypeIndex = -1,
+      minAltIndex = -1, airwayIdIndex = -1, airwayNameIndex = -1, distanceIndex = -1;
+
+  QHash<QString, int> airwayNameMap;
+  QVector<LoadEdge> loadEdges;
+  QVector<int> degree(nodes.size(), 0);
+
+  while(edgeQuery.next())
+  {
+    if(fromIdIndex == -1)
+    {
+      SqlRecord rec = edgeQuery.record();
+      fromIdIndex = rec.indexOf("from_node_id");
+      toIdIndex = rec.indexOf("to_node_id");
+      edgeTypeIndex = rec.contains("type") ? rec.indexOf("type") : -1;
+      minAltIndex = rec.contains("minimum_altitude") ? rec.indexOf("minimum_altitude") : -1;
+      airwayIdIndex = rec.contains("airway_id") ? rec.indexOf("airway_id") : -1;
+      airwayNameIndex = rec.contains("airway_name") ? rec.indexOf("airway_name") : -1;
+      distanceIndex = rec.contains("distance") ? rec.indexOf("distance") : -1;
+    }
+
+    int fromIndex = indexOf(edgeQuery.value(fromIdIndex).toInt());
+    int toIndex = indexOf(edgeQuery.value(toIdIndex).toInt());
+
+    if(fromIndex == -1 || toIndex == -1 || fromIndex == toIndex)
+      // Dangling edge or loop
+      continue;
+
+    LoadEdge edge;
+    edge.fromIndex = fromIndex;
+    edge.toIndex = toIndex;
+    edge.type = edgeTypeIndex != -1 ? edgeQuery.value(edgeTypeIndex).toInt() : 0;
+    edge.minAltFt = minAltIndex != -1 ? edgeQuery.value(minAltIndex).toInt() : 0;
+    edge.airwayId = airwayIdIndex != -1 ? edgeQuery.value(airwayIdIndex).toInt() : -1;
+    edge.lengthMeter = distanceIndex != -1 ? edgeQuery.value(distanceIndex).toInt() : 0;
+    edge.airwayNameIndex = -1;
+
+    if(airwayNameIndex != -1)
+    {
+      QString name = edgeQuery.value(airwayNameIndex).toString();
+      if(!name.isEmpty())
+      {
+        // Intern airway name
+        auto it = airwayNameMap.constFind(name);
+        if(it == airwayNameMap.constEnd())
+        {
+          edge.airwayNameIndex = airwayNames.size();
+          airwayNameMap.insert(name, edge.airwayNameIndex);
+          airwayNames.append(name);
+        }
+        else
+          edge.airwayNameIndex = it.value();
+      }
+    }
+    loadEdges.append(edge);
+
+    // Edges are used in both directions
+    degree[fromIndex]++;
+    degree[toIndex]++;
+  }
+  edgeQuery.finish();
+
+  // Build offsets from node degree
+  edgeOffsets.resize(nodes.size() + 1);
+  edgeOffsets[0] = 0;
+  for(int i = 0; i < nodes.size(); i++)
+    edgeOffsets[i + 1] = edgeOffsets.at(i) + degree.at(i);
+
+  // Fill edge array for both directions
+  edges.resize(edgeOffsets.last());
+  QVector<int> fillPos(edgeOffsets);
+  for(const LoadEdge& le : loadEdges)
+  {
+    GraphEdge edge;
+    edge.lengthMeter = le.lengthMeter;
+    edge.minAltFt = le.minAltFt;
+    edge.airwayId = le.airwayId;
+    edge.airwayNameIndex = le.airwayNameIndex;
+    edge.type = le.type;
+
+    edge.toIndex = le.toIndex;
+    edges[fillPos[le.fromIndex]++] = edge;
+
+    edge.toIndex = le.fromIndex;
+    edges[fillPos[le.toIndex]++] = edge;
+  }
+  loadEdges.clear();
+
+  // Remove duplicates having the same target node and type like RouteNetwork does with QSet<Edge>
+  int writeIndex = 0;
+  for(int i = 0; i < nodes.size(); i++)
+  {
+    int begin = edgeOffsets.at(i), end = edgeOffsets.at(i + 1);
+    std::sort(edges.begin() + begin, edges.begin() + end, [](const GraphEdge& e1, const GraphEdge& e2) -> bool
+              {
+                return e1.toIndex == e2.toIndex ? e1.type < e2.type : e1.toIndex < e2.toIndex;
+              });
+
+    edgeOffsets[i] = writeIndex;
+    for(int j = begin; j < end; j++)
+    {
+      if(writeIndex > edgeOffsets.at(i) &&
+         edges.at(writeIndex - 1).toIndex == edges.at(j).toIndex &&
+         edges.at(writeIndex - 1).type == edges.at(j).type)
+        continue;
+
+      edges[writeIndex++] = edges.at(j);
+    }
+  }
+  edgeOffsets[nodes.size()] = writeIndex;
+  edges.resize(writeIndex);
+  edges.squeeze();
+
+  buildGrid();
+
+  qDebug() << Q_FUNC_INFO << nodeTable << "nodes" << nodes.size() << "edges" << edges.size()
+           << "airway names" << airwayNames.size() << "in" << timer.elapsed() << "ms";
+
+  return isLoaded();
+}
+
+/* Sort node indexes into grid cells using the same offset layout as the edges */
+void RouteNetworkGraph::buildGrid()
+{
+  int numCells = GRID_CELLS_X * GRID_CELLS_Y;
+  QVector<int> cells(nodes.size());
+  QVector<int> cellSize(numCells, 0);
+  for(int i = 0; i < nodes.size(); i++)
+  {
+    cells[i] = gridCell(nodes.at(i).lonx, nodes.at(i).laty);
+    cellSize[cells.at(i)]++;
+  }
+
+  gridOffsets.resize(numCells + 1);
+  gridOffsets[0] = 0;
+  for(int i = 0; i < numCells; i++)
+    gridOffsets[i + 1] = gridOffsets.at(i) + cellSize.at(i);
+
+  gridNodes.resize(nodes.size());
+  QVector<int> fillPos(gridOffsets);
+  for(int i = 0; i < nodes.size(); i++)
+    gridNodes[fillPos[cells.at(i)]++] = i;
+}
+
+void RouteNetworkGraph::gridCells(const atools::geo::Rect& rect, QVector<int>& cells)
+{
+  for(const Rect& r : rect.splitAtAntiMeridian())
+  {
+    int west = gridCellX(r.getWest()), east = gridCellX(r.getEast());
+    int south = gridCellY(r.getSouth()), north = gridCellY(r.getNorth());
+
+    for(int y = south; y <= north; y++)
+    {
+      for(int x = west; x <= east; x++)
+        cells.append(y * GRID_CELLS_X + x);
+    }
+  }
+}
+
+void RouteNetworkGraph::nodesInRect(const atools::geo::Rect& rect, QVector<int>& indexes) const
+{
+  if(gridOffsets.isEmpty())
+    return;
+
+  for(const Rect& r : rect.splitAtAntiMeridian())
+  {
+    float west = r.getWest(), east = r.getEast(), south = r.getSouth(), north = r.getNorth();
+
+    QVector<int> cells;
+    gridCells(r, cells);
+    for(int cell : cells)
+    {
+      for(int i = gridOffsets.at(cell); i < gridOffsets.at(cell + 1); i++)
+      {
+        int index = gridNodes.at(i);
+        const GraphNode& node = nodes.at(index);
+        if(node.lonx >= west && node.lonx <= east && node.laty >= south && node.laty <= north)
+          indexes.append(index);
+      }
+    }
+  }
+}
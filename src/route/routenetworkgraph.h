@@ -0,0 +1,189 @@
+/*****************************************************************************
+* Copyright 2015-2017 Alexander Barthel albar965@mailbox.org
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+#ifndef LITTLENAVMAP_ROUTENETWORKGRAPH_H
+#define LITTLENAVMAP_ROUTENETWORKGRAPH_H
+
+#include <QStringList>
+#include <QVector>
+
+#include <algorithm>
+
+namespace  atools {
+namespace sql {
+class SqlDatabase;
+}
+namespace geo {
+class Rect;
+}
+}
+
+namespace nw {
+
+/* Compact node as stored in the in-memory graph */
+struct GraphNode
+{
+  int id; /* Database id ("node_id") */
+  int navId; /* Database id of the navaid ("nav_id") */
+  int type; /* Raw type as stored in the database. Contains subtype in the lower four bits for airway networks. */
+  int range; /* Range for a radio navaid or 0 if not applicable */
+  float lonx, laty;
+};
+
+/* Compact edge as stored in the in-memory graph */
+struct GraphEdge
+{
+  int toIndex; /* Index of the target node in the graph node array */
+  int lengthMeter, minAltFt, airwayId;
+  int airwayNameIndex; /* Index into the interned airway names or -1 if none */
+  int type; /* nw::EdgeType */
+};
+
+}
+
+Q_DECLARE_TYPEINFO(nw::GraphNode, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(nw::GraphEdge, Q_PRIMITIVE_TYPE);
+
+/*
+ * Read only routing graph that is bulk loaded from the route_node_* and route_edge_* tables.
+ *
+ * Nodes and edges are kept in a compressed sparse row (CSR) layout: all nodes are stored in one array
+ * ordered by database id and all edges in another array where the edges of a node are
+ * stored contiguously. Airway names are interned and edges refer to them by index.
+ *
+ * Edges are added for both directions like RouteNetwork does when loading nodes lazily.
+ *
+ * Nodes are additionally indexed in a one degree lat/lon grid which allows to find all nodes in
+ * a rectangle by looking only at the covered grid cells.
+ */
+class RouteNetworkGraph
+{
+public:
+  RouteNetworkGraph();
+  ~RouteNetworkGraph();
+
+  /*
+   * Load the whole network from the given tables. Uses the same table layout as RouteNetwork.
+   * @return true if the network was loaded and is not empty
+   */
+  bool load(atools::sql::SqlDatabase *db, const QString& nodeTable, const QString& edgeTable,
+            const QStringList& nodeExtraColumns, const QStringList& edgeExtraColumns);
+
+  /* Remove all nodes and edges and free memory */
+  void clear();
+
+  bool isLoaded() const
+  {
+    return !nodes.isEmpty();
+  }
+
+  /* Number of nodes in the graph */
+  int size() const
+  {
+    return nodes.size();
+  }
+
+  /* Number of edges in the graph. Edges are counted for both directions. */
+  int sizeEdges() const
+  {
+    return edges.size();
+  }
+
+  /* Get index into node array for the given database node id or -1 if not found */
+  int indexOf(int nodeId) const
+  {
+    return nodeId >= 0 && nodeId < idToIndex.size() ? idToIndex.at(nodeId) : -1;
+  }
+
+  const nw::GraphNode& nodeAt(int index) const
+  {
+    return nodes.at(index);
+  }
+
+  /* Range of edge indexes for the node at the given index - end is exclusive */
+  int edgesBegin(int index) const
+  {
+    return edgeOffsets.at(index);
+  }
+
+  int edgesEnd(int index) const
+  {
+    return edgeOffsets.at(index + 1);
+  }
+
+  const nw::GraphEdge& edgeAt(int edgeIndex) const
+  {
+    return edges.at(edgeIndex);
+  }
+
+  /* Get indexes of all nodes inside the rectangle. Rectangles crossing the anti-meridian are split. */
+  void nodesInRect(const atools::geo::Rect& rect, QVector<int>& indexes) const;
+
+  /* Grid cell for the given coordinates. Also used by RouteNetwork to index the node cache. */
+  static int gridCell(float lonx, float laty)
+  {
+    return gridCellY(laty) * GRID_CELLS_X + gridCellX(lonx);
+  }
+
+  /* Get interned airway name or an empty string if index is -1 */
+  const QString& airwayName(int nameIndex) const
+  {
+    return nameIndex == -1 ? emptyName : airwayNames.at(nameIndex);
+  }
+
+  /* Get all grid cells covered by the rectangle. Rectangles crossing the anti-meridian are split. */
+  static void gridCells(const atools::geo::Rect& rect, QVector<int>& cells);
+
+private:
+  void buildGrid();
+
+  static int gridCellX(float lonx)
+  {
+    return std::max(0, std::min(GRID_CELLS_X - 1, static_cast<int>(lonx + 180.f)));
+  }
+
+  static int gridCellY(float laty)
+  {
+    return std::max(0, std::min(GRID_CELLS_Y - 1, static_cast<int>(laty + 90.f)));
+  }
+
+  /* One degree cells */
+  static Q_DECL_CONSTEXPR int GRID_CELLS_X = 360;
+  static Q_DECL_CONSTEXPR int GRID_CELLS_Y = 180;
+
+  /* Upper limit for database ids to avoid a oversized index vector */
+  static Q_DECL_CONSTEXPR int MAX_NODE_ID = 50000000;
+
+  /* Nodes ordered by database id */
+  QVector<nw::GraphNode> nodes;
+
+  /* Edges of node i are in range edgeOffsets[i] to edgeOffsets[i + 1] (exclusive) */
+  QVector<int> edgeOffsets;
+  QVector<nw::GraphEdge> edges;
+
+  /* Maps database node id to index into nodes */
+  QVector<int> idToIndex;
+
+  /* Nodes of grid cell i are gridNodes[gridOffsets[i]] to gridNodes[gridOffsets[i + 1]] (exclusive) */
+  QVector<int> gridOffsets, gridNodes;
+
+  /* Interned airway names */
+  QVector<QString> airwayNames;
+  const QString emptyName;
+};
+
+#endif // LITTLENAVMAP_ROUTENETWORKGRAPH_H
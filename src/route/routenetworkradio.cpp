@@ -19,8 +19,8 @@
 
 #include "sql/sqldatabase.h"
 
-RouteNetworkRadio::RouteNetworkRadio(atools::sql::SqlDatabase *sqlDb)
-  : RouteNetwork(sqlDb, "route_node_radio", "route_edge_radio", {"range"}, {"distance"})
+RouteNetworkRadio::RouteNetworkRadio(atools::sql::SqlDatabase *sqlDb, bool preloadGraph, bool useLandmarks)
+  : RouteNetwork(sqlDb, "route_node_radio", "route_edge_radio", {"range"}, {"distance"}, preloadGraph, useLandmarks)
 {
 }
 
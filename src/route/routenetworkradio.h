@@ -31,7 +31,7 @@ class RouteNetworkRadio :
   public RouteNetwork
 {
 public:
-  RouteNetworkRadio(atools::sql::SqlDatabase *sqlDb);
+  RouteNetworkRadio(atools::sql::SqlDatabase *sqlDb, bool preloadGraph = false, bool useLandmarks = false);
   virtual ~RouteNetworkRadio();
 
 };